@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/bytes.h"
+#include "base/stream.h"
+
+namespace wasmcc {
+
+/**
+ * A non-virtual cursor over a contiguous range of bytes.
+ *
+ * Unlike `ByteStream` this does not own the underlying memory, and reading a
+ * range of bytes returns a view into the source instead of a copy. The caller
+ * is responsible for keeping the underlying memory alive for as long as the
+ * cursor, or any views returned from it, are in use.
+ *
+ * All methods are defined inline so that code templated on a `ByteSource`
+ * (such as the parser and `leb128::Decode`) can be compiled down to plain
+ * pointer bumps.
+ */
+class ByteCursor final {
+ public:
+  explicit ByteCursor(bytes_view b) noexcept : _buffer(b) {}
+  ByteCursor(const ByteCursor&) = default;
+  ByteCursor& operator=(const ByteCursor&) = default;
+  ByteCursor(ByteCursor&&) noexcept = default;
+  ByteCursor& operator=(ByteCursor&&) noexcept = default;
+  ~ByteCursor() = default;
+
+  uint8_t ReadByte() {
+    if (!HasRemaining()) [[unlikely]] {
+      throw EndOfStreamException();
+    }
+    return _buffer[_position++];
+  }
+  uint8_t PeekByte() const {
+    if (!HasRemaining()) [[unlikely]] {
+      throw EndOfStreamException();
+    }
+    return _buffer[_position];
+  }
+  /**
+   * Read the next `n` bytes, the result is a view into the underlying buffer.
+   */
+  bytes_view ReadBytes(size_t n) {
+    if (remaining() < n) [[unlikely]] {
+      throw EndOfStreamException();
+    }
+    auto b = _buffer.subspan(_position, n);
+    _position += n;
+    return b;
+  }
+  void Skip(size_t n) {
+    if (remaining() < n) [[unlikely]] {
+      throw EndOfStreamException();
+    }
+    _position += n;
+  }
+  bool HasRemaining() const noexcept { return _position < _buffer.size(); }
+  size_t BytesConsumed() const noexcept { return _position; }
+
+  /** The number of bytes left to be read. */
+  size_t remaining() const noexcept { return _buffer.size() - _position; }
+  /** A view of the bytes that have not been read yet. */
+  bytes_view unread() const noexcept { return _buffer.subspan(_position); }
+
+ private:
+  bytes_view _buffer;
+  size_t _position = 0;
+};
+
+static_assert(ByteSource<ByteCursor>, "must be a byte source");
+
+}  // namespace wasmcc
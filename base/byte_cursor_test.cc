@@ -0,0 +1,53 @@
+#include "base/byte_cursor.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/bytes.h"
+
+namespace wasmcc {
+
+TEST(ByteCursor, ReadOne) {
+  bytes b = {0x04, 0x03, 0x02, 0x01, 0x00};
+  ByteCursor cursor(b);
+  EXPECT_TRUE(cursor.HasRemaining());
+  for (int i = 4; i >= 0; --i) {
+    EXPECT_EQ(cursor.PeekByte(), i);
+    EXPECT_EQ(cursor.ReadByte(), i);
+    EXPECT_EQ(cursor.HasRemaining(), i != 0);
+    EXPECT_EQ(cursor.BytesConsumed(), 5 - i);
+  }
+  EXPECT_THROW(cursor.ReadByte(), EndOfStreamException);
+  EXPECT_THROW(cursor.PeekByte(), EndOfStreamException);
+}
+
+TEST(ByteCursor, ReadManyIsAView) {
+  bytes b = {0x04, 0x03, 0x02, 0x01, 0x00};
+  ByteCursor cursor(b);
+  auto first = cursor.ReadBytes(2);
+  EXPECT_EQ(first.data(), b.data());
+  EXPECT_EQ(bytes(first.begin(), first.end()), bytes({0x04, 0x03}));
+  EXPECT_EQ(cursor.BytesConsumed(), 2);
+  auto second = cursor.ReadBytes(3);
+  EXPECT_EQ(second.data(), b.data() + 2);
+  EXPECT_EQ(bytes(second.begin(), second.end()), bytes({0x02, 0x01, 0x00}));
+  EXPECT_FALSE(cursor.HasRemaining());
+  EXPECT_THROW(cursor.ReadBytes(1), EndOfStreamException);
+  EXPECT_EQ(cursor.BytesConsumed(), 5);
+}
+
+TEST(ByteCursor, Skip) {
+  bytes b = {0x04, 0x03, 0x02, 0x01, 0x00};
+  ByteCursor cursor(b);
+  cursor.Skip(2);
+  EXPECT_EQ(cursor.BytesConsumed(), 2);
+  EXPECT_EQ(cursor.remaining(), 3);
+  EXPECT_THROW(cursor.Skip(4), EndOfStreamException);
+  EXPECT_EQ(cursor.BytesConsumed(), 2);
+  cursor.Skip(3);
+  EXPECT_FALSE(cursor.HasRemaining());
+  EXPECT_EQ(cursor.remaining(), 0);
+}
+
+}  // namespace wasmcc
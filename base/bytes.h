@@ -7,6 +7,6 @@
 namespace wasmcc {
 
 using bytes = std::vector<uint8_t>;
-using bytes_view = std::span<uint8_t>;
+using bytes_view = std::span<const uint8_t>;
 
 }  // namespace wasmcc
@@ -0,0 +1,112 @@
+#include "base/chunked_stream.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/assert.h"
+
+namespace wasmcc {
+
+namespace {
+// The maximum number of bytes in a LEB128 encoded 64 bit integer.
+constexpr size_t kMaxLeb128Bytes = 10;
+constexpr uint8_t kContinuationBit = 0x80;
+}  // namespace
+
+bool ChunkedStream::Awaiter::await_ready() const noexcept {
+  return _stream->IsReady(*this);
+}
+
+void ChunkedStream::Awaiter::await_suspend(
+    std::coroutine_handle<> handle) const noexcept {
+  Assert(!_stream->_waiter, "only a single waiter is supported");
+  _stream->_waiter = handle;
+  _stream->_waiting_for = *this;
+}
+
+void ChunkedStream::Push(bytes_view chunk) {
+  Assert(!_closed, "cannot push data into a closed stream");
+  // Drop what has already been read once that is the majority of the buffer,
+  // so the buffer doesn't grow without bound as we read.
+  if (_position > 0 && _position >= _buffer.size() / 2) {
+    _buffer.erase(_buffer.begin(), _buffer.begin() + int64_t(_position));
+    _discarded += _position;
+    _position = 0;
+  }
+  _buffer.insert(_buffer.end(), chunk.begin(), chunk.end());
+  MaybeResume();
+}
+
+void ChunkedStream::Close() {
+  _closed = true;
+  MaybeResume();
+}
+
+ChunkedStream::Awaiter ChunkedStream::WaitFor(size_t n) noexcept {
+  return {this, Awaiter::Kind::kBytes, n};
+}
+
+ChunkedStream::Awaiter ChunkedStream::WaitForLeb128() noexcept {
+  return {this, Awaiter::Kind::kLeb128, 0};
+}
+
+bool ChunkedStream::IsReady(const Awaiter& awaiter) const noexcept {
+  if (_closed) {
+    return true;
+  }
+  switch (awaiter._kind) {
+    case Awaiter::Kind::kBytes:
+      return buffered() >= awaiter._n;
+    case Awaiter::Kind::kLeb128: {
+      auto start = _buffer.begin() + int64_t(_position);
+      auto end = start + int64_t(std::min(buffered(), kMaxLeb128Bytes));
+      // Either the last byte of the integer has arrived, or enough bytes have
+      // arrived that decoding will fail regardless.
+      return std::any_of(start, end,
+                         [](uint8_t b) { return !(b & kContinuationBit); }) ||
+             buffered() >= kMaxLeb128Bytes;
+    }
+  }
+  __builtin_unreachable();
+}
+
+void ChunkedStream::MaybeResume() {
+  if (_waiter && IsReady(_waiting_for)) {
+    std::exchange(_waiter, nullptr).resume();
+  }
+}
+
+uint8_t ChunkedStream::ReadByte() {
+  if (!HasRemaining()) [[unlikely]] {
+    throw EndOfStreamException();
+  }
+  return _buffer[_position++];
+}
+uint8_t ChunkedStream::PeekByte() const {
+  if (!HasRemaining()) [[unlikely]] {
+    throw EndOfStreamException();
+  }
+  return _buffer[_position];
+}
+bytes_view ChunkedStream::ReadBytes(size_t n) {
+  if (buffered() < n) [[unlikely]] {
+    throw EndOfStreamException();
+  }
+  auto b = bytes_view(_buffer).subspan(_position, n);
+  _position += n;
+  return b;
+}
+void ChunkedStream::Skip(size_t n) {
+  if (buffered() < n) [[unlikely]] {
+    throw EndOfStreamException();
+  }
+  _position += n;
+}
+bool ChunkedStream::HasRemaining() const noexcept {
+  return _position < _buffer.size();
+}
+size_t ChunkedStream::BytesConsumed() const noexcept {
+  return _discarded + _position;
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+#include "base/bytes.h"
+#include "base/stream.h"
+
+namespace wasmcc {
+
+/**
+ * A stream of bytes that arrive incrementally, such as from a socket.
+ *
+ * The host feeds data in with `Push` (and `Close` once there is no more data),
+ * while the consumer is a coroutine that `co_await`s on `WaitFor` or
+ * `WaitForLeb128` before reading. If enough data has not arrived yet, the
+ * consumer is suspended and then resumed from within the `Push` call that
+ * supplies the missing bytes.
+ *
+ * Once a wait has completed the consumer reads synchronously using the usual
+ * `ByteSource` methods, which never block and throw `EndOfStreamException` if
+ * the consumer reads past what it waited for.
+ *
+ * Usage:
+ *
+ *   ChunkedStream stream;
+ *   auto parsed = ParseModule(&stream);
+ *   parsed.Start();
+ *   while (auto chunk = socket.Read()) {
+ *     stream.Push(chunk);
+ *   }
+ *   stream.Close();
+ *   // parsed.IsDone() is now true
+ *   auto module = parsed.get();
+ *
+ * Only a single consumer is supported at a time.
+ */
+class ChunkedStream final {
+ public:
+  class Awaiter {
+   public:
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<>) const noexcept;
+    constexpr void await_resume() const noexcept {}
+
+   private:
+    friend class ChunkedStream;
+    enum class Kind : uint8_t { kBytes, kLeb128 };
+    Awaiter(ChunkedStream* s, Kind k, size_t n) : _stream(s), _kind(k), _n(n) {}
+
+    ChunkedStream* _stream;
+    Kind _kind;
+    size_t _n;
+  };
+
+  ChunkedStream() = default;
+  ChunkedStream(const ChunkedStream&) = delete;
+  ChunkedStream& operator=(const ChunkedStream&) = delete;
+  ChunkedStream(ChunkedStream&&) = delete;
+  ChunkedStream& operator=(ChunkedStream&&) = delete;
+  ~ChunkedStream() = default;
+
+  /**
+   * Append more data to the stream, resuming the consumer if it was waiting
+   * on this data.
+   */
+  void Push(bytes_view);
+  /**
+   * Mark that there is no more data coming, resuming the consumer if it was
+   * waiting.
+   */
+  void Close();
+
+  /**
+   * Wait until at least `n` bytes are available to be read, or the stream is
+   * closed.
+   */
+  Awaiter WaitFor(size_t n) noexcept;
+  /**
+   * Wait until a complete LEB128 encoded integer is available to be read, or
+   * the stream is closed.
+   */
+  Awaiter WaitForLeb128() noexcept;
+
+  uint8_t ReadByte();
+  uint8_t PeekByte() const;
+  /**
+   * The returned view is only valid until the next call to `Push`.
+   */
+  bytes_view ReadBytes(size_t);
+  void Skip(size_t);
+  /** If there is data that has arrived but not yet been read. */
+  bool HasRemaining() const noexcept;
+  size_t BytesConsumed() const noexcept;
+
+  /** The number of bytes that have arrived but not yet been read. */
+  size_t buffered() const noexcept { return _buffer.size() - _position; }
+  bool closed() const noexcept { return _closed; }
+
+ private:
+  bool IsReady(const Awaiter&) const noexcept;
+  void MaybeResume();
+
+  bytes _buffer;
+  // The read position within `_buffer`.
+  size_t _position = 0;
+  // The number of bytes that have been read and dropped from `_buffer`.
+  size_t _discarded = 0;
+  bool _closed = false;
+
+  std::coroutine_handle<> _waiter;
+  // The condition that `_waiter` is waiting for.
+  Awaiter _waiting_for{nullptr, Awaiter::Kind::kBytes, 0};
+};
+
+static_assert(ByteSource<ChunkedStream>, "must be a byte source");
+
+/**
+ * A source of bytes that may need to wait for data to arrive before it is
+ * read.
+ */
+template <typename S>
+concept AsyncByteSource = ByteSource<S> && requires(S& s, size_t n) {
+  { s.WaitFor(n) } -> std::same_as<ChunkedStream::Awaiter>;
+  { s.WaitForLeb128() } -> std::same_as<ChunkedStream::Awaiter>;
+};
+
+}  // namespace wasmcc
@@ -0,0 +1,96 @@
+#include "base/chunked_stream.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/bytes.h"
+#include "base/coro.h"
+
+namespace wasmcc {
+
+namespace {
+co::Future<bytes> ReadN(ChunkedStream* stream, size_t n) {
+  co_await stream->WaitFor(n);
+  auto b = stream->ReadBytes(n);
+  co_return bytes(b.begin(), b.end());
+}
+
+co::Future<std::vector<uint8_t>> ReadLeb128Bytes(ChunkedStream* stream) {
+  co_await stream->WaitForLeb128();
+  std::vector<uint8_t> result;
+  uint8_t b = 0;
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-do-while)
+  do {
+    b = stream->ReadByte();
+    result.push_back(b);
+  } while (b & 0x80U);
+  co_return result;
+}
+}  // namespace
+
+TEST(ChunkedStream, ReadyWhenBuffered) {
+  ChunkedStream stream;
+  stream.Push(bytes{0x01, 0x02, 0x03});
+  auto f = ReadN(&stream, 2);
+  f.Start();
+  ASSERT_TRUE(f.IsDone());
+  EXPECT_EQ(f.get(), bytes({0x01, 0x02}));
+  EXPECT_EQ(stream.BytesConsumed(), 2);
+  EXPECT_EQ(stream.buffered(), 1);
+}
+
+TEST(ChunkedStream, SuspendsUntilDataArrives) {
+  ChunkedStream stream;
+  auto f = ReadN(&stream, 4);
+  f.Start();
+  EXPECT_FALSE(f.IsDone());
+  stream.Push(bytes{0x01});
+  EXPECT_FALSE(f.IsDone());
+  stream.Push(bytes{0x02, 0x03});
+  EXPECT_FALSE(f.IsDone());
+  stream.Push(bytes{0x04, 0x05});
+  ASSERT_TRUE(f.IsDone());
+  EXPECT_EQ(f.get(), bytes({0x01, 0x02, 0x03, 0x04}));
+  EXPECT_EQ(stream.BytesConsumed(), 4);
+  EXPECT_TRUE(stream.HasRemaining());
+}
+
+TEST(ChunkedStream, WaitsForCompleteLeb128) {
+  ChunkedStream stream;
+  auto f = ReadLeb128Bytes(&stream);
+  f.Start();
+  stream.Push(bytes{0x80});
+  EXPECT_FALSE(f.IsDone());
+  stream.Push(bytes{0xFF});
+  EXPECT_FALSE(f.IsDone());
+  stream.Push(bytes{0x01, 0x42});
+  ASSERT_TRUE(f.IsDone());
+  EXPECT_EQ(f.get(), std::vector<uint8_t>({0x80, 0xFF, 0x01}));
+}
+
+TEST(ChunkedStream, CloseResumesWaiter) {
+  ChunkedStream stream;
+  auto f = ReadN(&stream, 4);
+  f.Start();
+  stream.Push(bytes{0x01});
+  EXPECT_FALSE(f.IsDone());
+  stream.Close();
+  ASSERT_TRUE(f.IsDone());
+  EXPECT_THROW(f.get(), EndOfStreamException);
+}
+
+TEST(ChunkedStream, BytesConsumedAcrossCompaction) {
+  ChunkedStream stream;
+  size_t total = 0;
+  for (uint8_t i = 0; i < 100; ++i) {
+    stream.Push(bytes{i, i});
+    EXPECT_EQ(stream.ReadByte(), i);
+    EXPECT_EQ(stream.ReadByte(), i);
+    total += 2;
+    EXPECT_EQ(stream.BytesConsumed(), total);
+  }
+  EXPECT_FALSE(stream.HasRemaining());
+}
+
+}  // namespace wasmcc
@@ -72,6 +72,18 @@ class [[nodiscard("must not drop futures")]] Future {
     return await_resume();
   }
 
+  /**
+   * Run the coroutine until it either completes or suspends waiting on an
+   * external event (such as more data arriving on a `ChunkedStream`).
+   *
+   * Whatever triggers that event is responsible for resuming the coroutine,
+   * once `IsDone()` is true `get()` returns the result.
+   */
+  void Start() { await_suspend(std::noop_coroutine()).resume(); }
+
+  /** If the coroutine has run to completion. */
+  bool IsDone() const noexcept { return _handle.done(); }
+
   // awaitable interface
   constexpr bool await_ready() const noexcept { return false; }
   std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent)
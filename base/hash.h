@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+#include "base/bytes.h"
+
+namespace wasmcc {
+
+/**
+ * The 64 bit FNV-1a hash of `data`.
+ *
+ * This is fast and stable across builds and platforms, which makes it
+ * suitable for naming things on disk, but it is not collision resistant, so
+ * anything looked up by it must be verified.
+ */
+constexpr uint64_t Fnv1a64(bytes_view data) noexcept {
+  constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325;
+  constexpr uint64_t kPrime = 0x100000001b3;
+  uint64_t hash = kOffsetBasis;
+  for (uint8_t b : data) {
+    hash ^= b;
+    hash *= kPrime;
+  }
+  return hash;
+}
+
+}  // namespace wasmcc
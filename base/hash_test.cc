@@ -0,0 +1,23 @@
+#include "base/hash.h"
+
+#include <gtest/gtest.h>
+
+#include <string_view>
+
+namespace wasmcc {
+namespace {
+
+uint64_t Hash(std::string_view s) {
+  // NOLINTNEXTLINE(*-reinterpret-cast)
+  return Fnv1a64({reinterpret_cast<const uint8_t*>(s.data()), s.size()});
+}
+
+}  // namespace
+
+TEST(Hash, Fnv1a64) {
+  EXPECT_EQ(Hash(""), 0xcbf29ce484222325);
+  EXPECT_EQ(Hash("a"), 0xaf63dc4c8601ec8c);
+  EXPECT_EQ(Hash("foobar"), 0x85944171f73967e8);
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,92 @@
+#include "base/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+
+namespace wasmcc {
+
+namespace {
+class FileDescriptor {
+ public:
+  explicit FileDescriptor(int fd) : _fd(fd) {}
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+  FileDescriptor(FileDescriptor&&) = delete;
+  FileDescriptor& operator=(FileDescriptor&&) = delete;
+  ~FileDescriptor() {
+    if (_fd >= 0) {
+      ::close(_fd);
+    }
+  }
+
+  int get() const { return _fd; }
+
+ private:
+  int _fd;
+};
+}  // namespace
+
+MappedFile MappedFile::Open(const std::string& path) {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
+  FileDescriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd.get() < 0) {
+    throw std::runtime_error(absl::StrFormat("unable to open %s: %s", path,
+                                             std::strerror(errno)));
+  }
+  struct stat st {};
+  if (::fstat(fd.get(), &st) != 0) {
+    throw std::runtime_error(absl::StrFormat("unable to stat %s: %s", path,
+                                             std::strerror(errno)));
+  }
+  auto size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    // mmap does not support zero length mappings.
+    return {nullptr, 0};
+  }
+  void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+  if (addr == MAP_FAILED) {
+    throw std::runtime_error(absl::StrFormat("unable to mmap %s: %s", path,
+                                             std::strerror(errno)));
+  }
+  // We're going to read the module front to back.
+  ::madvise(addr, size, MADV_SEQUENTIAL);
+  return {addr, size};
+}
+
+MappedFile::MappedFile(void* addr, size_t size) : _addr(addr), _size(size) {}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _addr(std::exchange(other._addr, nullptr)),
+      _size(std::exchange(other._size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    if (_addr != nullptr) {
+      ::munmap(_addr, _size);
+    }
+    _addr = std::exchange(other._addr, nullptr);
+    _size = std::exchange(other._size, 0);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (_addr != nullptr) {
+    ::munmap(_addr, _size);
+  }
+}
+
+bytes_view MappedFile::data() const noexcept {
+  return {static_cast<const uint8_t*>(_addr), _size};
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "base/bytes.h"
+
+namespace wasmcc {
+
+/**
+ * A read-only memory mapping of a file on disk.
+ *
+ * This allows for parsing a module straight out of the page cache (using a
+ * `ByteCursor` over `data()`) without first copying the file into a buffer.
+ *
+ * The mapping is removed when this object is destroyed, so it must outlive any
+ * views into `data()`.
+ */
+class MappedFile {
+ public:
+  /**
+   * Map the file at `path` into memory.
+   *
+   * Throws `std::runtime_error` if the file cannot be opened or mapped.
+   */
+  static MappedFile Open(const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&&) noexcept;
+  MappedFile& operator=(MappedFile&&) noexcept;
+  ~MappedFile();
+
+  bytes_view data() const noexcept;
+  size_t size() const noexcept { return _size; }
+
+ private:
+  MappedFile(void*, size_t);
+
+  void* _addr;
+  size_t _size;
+};
+
+}  // namespace wasmcc
@@ -0,0 +1,51 @@
+#include "base/mapped_file.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "base/bytes.h"
+
+namespace wasmcc {
+
+namespace {
+std::string WriteTempFile(const std::string& name, const bytes& b) {
+  auto path = std::filesystem::path(testing::TempDir()) / name;
+  std::ofstream out(path, std::ios::binary);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  out.write(reinterpret_cast<const char*>(b.data()), int64_t(b.size()));
+  return path.string();
+}
+}  // namespace
+
+TEST(MappedFile, MapsContents) {
+  bytes b = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00};
+  auto file = MappedFile::Open(WriteTempFile("contents.wasm", b));
+  EXPECT_EQ(file.size(), b.size());
+  auto data = file.data();
+  EXPECT_EQ(bytes(data.begin(), data.end()), b);
+}
+
+TEST(MappedFile, EmptyFile) {
+  auto file = MappedFile::Open(WriteTempFile("empty.wasm", {}));
+  EXPECT_EQ(file.size(), 0);
+  EXPECT_TRUE(file.data().empty());
+}
+
+TEST(MappedFile, Move) {
+  bytes b = {0x01, 0x02};
+  auto file = MappedFile::Open(WriteTempFile("move.wasm", b));
+  MappedFile moved = std::move(file);
+  auto data = moved.data();
+  EXPECT_EQ(bytes(data.begin(), data.end()), b);
+}
+
+TEST(MappedFile, MissingFile) {
+  EXPECT_THROW(MappedFile::Open("/this/file/does/not/exist.wasm"),
+               std::runtime_error);
+}
+
+}  // namespace wasmcc
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <concepts>
 #include <cstdint>
 
 #include "base/bytes.h"
@@ -9,6 +10,23 @@ namespace wasmcc {
 /** There are no more bytes left in the stream. */
 class EndOfStreamException : public std::exception {};
 
+/**
+ * The interface the parser needs from a source of bytes.
+ *
+ * This is satisfied by the virtual `Stream` hierarchy as well as concrete
+ * non-virtual sources (like `ByteCursor`) so that hot loops can be
+ * instantiated directly over a source and have every read inlined.
+ */
+template <typename S>
+concept ByteSource = requires(S& s, size_t n) {
+  { s.ReadByte() } -> std::same_as<uint8_t>;
+  { s.PeekByte() } -> std::same_as<uint8_t>;
+  s.ReadBytes(n);
+  s.Skip(n);
+  { s.HasRemaining() } -> std::same_as<bool>;
+  { s.BytesConsumed() } -> std::same_as<size_t>;
+};
+
 /**
  * A abstract class for a stream of data.
  */
@@ -0,0 +1,85 @@
+#include "base/thread_pool.h"
+
+#include <limits>
+#include <utility>
+
+namespace wasmcc {
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  for (size_t i = 1; i < num_threads; ++i) {
+    _workers.emplace_back([this] { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock lock(_mutex);
+    _stopping = true;
+  }
+  _work_available.notify_all();
+  for (auto& worker : _workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t n, absl::FunctionRef<void(size_t)> fn) {
+  if (n == 0) {
+    return;
+  }
+  Job job{
+      .fn = fn,
+      .n = n,
+      .outstanding = n,
+      .error_index = std::numeric_limits<size_t>::max(),
+  };
+  std::unique_lock caller_lock(_caller_mutex);
+  std::unique_lock lock(_mutex);
+  _job = &job;
+  ++_generation;
+  _work_available.notify_all();
+  RunJob(&lock);
+  _job_done.wait(lock, [&job] { return job.outstanding == 0; });
+  _job = nullptr;
+  if (job.error) {
+    std::rethrow_exception(job.error);
+  }
+}
+
+void ThreadPool::RunJob(std::unique_lock<std::mutex>* lock) {
+  Job* job = _job;
+  while (job->next < job->n) {
+    size_t i = job->next++;
+    lock->unlock();
+    std::exception_ptr error;
+    try {
+      job->fn(i);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock->lock();
+    if (error && i < job->error_index) {
+      job->error_index = i;
+      job->error = std::move(error);
+    }
+    if (--job->outstanding == 0) {
+      _job_done.notify_all();
+    }
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  size_t seen_generation = 0;
+  std::unique_lock lock(_mutex);
+  while (true) {
+    _work_available.wait(lock, [this, seen_generation] {
+      return _stopping || (_job != nullptr && _generation != seen_generation);
+    });
+    if (_stopping) {
+      return;
+    }
+    seen_generation = _generation;
+    RunJob(&lock);
+  }
+}
+
+}  // namespace wasmcc
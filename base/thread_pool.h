@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+
+namespace wasmcc {
+
+/**
+ * A fixed size pool of worker threads for fork/join style parallelism.
+ *
+ * The thread that calls `ParallelFor` participates in the work, so a pool of
+ * size N creates N - 1 background threads, and a pool of size 1 runs
+ * everything inline.
+ *
+ * `ParallelFor` may be called from multiple threads, but the calls are run
+ * one at a time, and it must not be called from within a job.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+  ~ThreadPool();
+
+  /**
+   * Invoke `fn` for every index in [0, n), spread across the pool, returning
+   * once all invocations have completed.
+   *
+   * If any invocation throws, the remaining indexes are still run and the
+   * exception from the lowest index is rethrown, so the error reported does
+   * not depend on scheduling.
+   */
+  void ParallelFor(size_t n, absl::FunctionRef<void(size_t)> fn);
+
+  /** The number of threads (including the caller) that do work. */
+  size_t size() const noexcept { return _workers.size() + 1; }
+
+ private:
+  struct Job {
+    absl::FunctionRef<void(size_t)> fn;
+    size_t n;
+    size_t next = 0;
+    size_t outstanding;
+    size_t error_index;
+    std::exception_ptr error;
+  };
+
+  void WorkerLoop();
+  // Run indexes from the current job until there are none left.
+  //
+  // Must be called with `_mutex` held.
+  void RunJob(std::unique_lock<std::mutex>*);
+
+  // Held for the duration of a `ParallelFor`, so concurrent callers queue up.
+  std::mutex _caller_mutex;
+  std::mutex _mutex;
+  std::condition_variable _work_available;
+  std::condition_variable _job_done;
+  Job* _job = nullptr;
+  // Incremented for every new job so workers can tell jobs apart.
+  size_t _generation = 0;
+  bool _stopping = false;
+  std::vector<std::thread> _workers;
+};
+
+}  // namespace wasmcc
@@ -0,0 +1,73 @@
+#include "base/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wasmcc {
+
+TEST(ThreadPool, RunsEveryIndexOnce) {
+  for (size_t threads : {1, 2, 4}) {
+    ThreadPool pool(threads);
+    EXPECT_EQ(pool.size(), threads);
+    std::vector<std::atomic<int>> counts(1000);
+    pool.ParallelFor(counts.size(), [&counts](size_t i) { ++counts[i]; });
+    for (const auto& count : counts) {
+      EXPECT_EQ(count.load(), 1);
+    }
+  }
+}
+
+TEST(ThreadPool, CanBeReused) {
+  ThreadPool pool(4);
+  std::atomic<size_t> sum = 0;
+  for (int round = 0; round < 100; ++round) {
+    pool.ParallelFor(10, [&sum](size_t i) { sum += i; });
+  }
+  EXPECT_EQ(sum.load(), 100 * 45);
+}
+
+TEST(ThreadPool, Empty) {
+  ThreadPool pool(2);
+  pool.ParallelFor(0, [](size_t) { FAIL(); });
+}
+
+TEST(ThreadPool, RethrowsLowestIndexError) {
+  ThreadPool pool(4);
+  std::atomic<int> ran = 0;
+  try {
+    pool.ParallelFor(100, [&ran](size_t i) {
+      ++ran;
+      if (i % 10 == 7) {
+        throw std::runtime_error(std::to_string(i));
+      }
+    });
+    FAIL() << "expected an exception";
+  } catch (const std::runtime_error& e) {
+    EXPECT_EQ(std::string(e.what()), "7");
+  }
+  EXPECT_EQ(ran.load(), 100);
+}
+
+TEST(ThreadPool, ConcurrentCallers) {
+  ThreadPool pool(4);
+  std::atomic<size_t> sum = 0;
+  std::vector<std::thread> callers;
+  for (int caller = 0; caller < 4; ++caller) {
+    callers.emplace_back([&pool, &sum] {
+      for (int round = 0; round < 100; ++round) {
+        pool.ParallelFor(10, [&sum](size_t i) { sum += i; });
+      }
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(sum.load(), 4 * 100 * 45);
+}
+
+}  // namespace wasmcc
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <vector>
+
 #include "absl/strings/str_format.h"
 #include "compiler/arm64/call_convention.h"
 #include "compiler/arm64/register_tracker.h"
 #include "compiler/arm64/runtime_stack.h"
+#include "compiler/common/control_frame.h"
 #include "compiler/common/function_frame.h"
+#include "compiler/common/parallel_move.h"
 #include "core/ast.h"
 #include "core/instruction.h"
 
@@ -43,18 +47,64 @@ class Compiler {
   void Prologue();
   void Epilogue();
 
+  // The number of values that had to be spilled to the stack to free up a
+  // register while compiling the function.
+  size_t num_spills() const { return _num_spills; }
+
+  // The bytes the prologue reserves on the stack for the function's frame.
+  uint32_t frame_size_bytes() const { return _frame.StackSizeBytes(); }
+
   void operator()(const op::ConstI32&);
   void operator()(const op::AddI32&);
+  void operator()(const op::EqzI32&);
+  void operator()(const op::CompareI32&);
   void operator()(const op::GetLocalI32&);
   void operator()(const op::SetLocalI32&);
   void operator()(const op::Return&);
-  void operator()(const op::Label&);
+  void operator()(const op::Unreachable&);
+  void operator()(const op::Block&);
+  void operator()(const op::Loop&);
+  void operator()(const op::If&);
+  void operator()(const op::Else&);
+  void operator()(const op::End&);
   void operator()(const op::Br&);
   void operator()(const op::BrIf&);
+  void operator()(const op::BrTable&);
 
  private:
+  using ControlFrame = ::wasmcc::ControlFrame<CallingConvention>;
+  using ValueMove = ::wasmcc::ValueMove<CallingConvention>;
+
+  ControlFrame* ControlAt(uint32_t depth);
+  // Unconditionally branch to the frame at `depth`.
+  void Branch(uint32_t depth);
+  // Make sure the values for a branch to `frame` are in registers and return
+  // the moves needed before jumping to it.
+  std::vector<ValueMove> PrepareBranch(ControlFrame* frame);
+  // The moves needed before jumping to `frame`, whose values must already be
+  // in registers or constants. Never emits code.
+  std::vector<ValueMove> BranchMoves(ControlFrame* frame);
+  void EmitMoves(std::span<const ValueMove>);
+  // Make the current state of the stack `state`.
+  void SetState(std::span<const RuntimeValue>);
+  // The following code is never executed, so skip compiling it until the end
+  // of the current control frame.
+  void MarkUnreachable();
+  // Jump to `targets[i]` for the range `ranges[i]` that contains `index`, by
+  // binary searching over the ranges.
+  void EmitBrTableSearch(const GpReg& index, const GpReg& scratch,
+                         std::span<const BrTableRange> ranges,
+                         std::span<const asmjit::Label> targets);
+
   GpReg AllocateRegister();
   GpReg EnsureInRegister(RuntimeValue*);
+  // Move a comparison result on the top of the stack out of the flags, for
+  // instructions that would clobber them.
+  void MaterializeCondition();
+  // Jump to `target` if `v` (which has been popped) is non-zero, or zero.
+  //
+  // `v` must either be a pending condition or in a register.
+  void JumpIf(bool nonzero, const RuntimeValue& v, const asmjit::Label& target);
 
   // Annotate the next instruction emitted
   //
@@ -82,6 +132,11 @@ class Compiler {
   FunctionFrame<CallingConvention> _frame;
   asmjit::a64::Assembler _asm;
   asmjit::Label _exit_label;
+  std::vector<ControlFrame> _control;
+  bool _unreachable = false;
+  // The number of control frames that have been entered while unreachable.
+  size_t _unreachable_depth = 0;
+  size_t _num_spills = 0;
 };
 
 }  // namespace wasmcc::arm64
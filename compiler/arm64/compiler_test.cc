@@ -0,0 +1,230 @@
+#include "compiler/arm64/compiler.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "compiler/common/util.h"
+#include "core/ast.h"
+#include "core/instruction.h"
+#include "core/value.h"
+#include "gmock/gmock.h"
+#include "testing/asm.h"
+#include "testing/functions.h"
+
+namespace wasmcc::arm64 {
+namespace {
+
+using namespace wasmcc::op;
+
+// Compile `body` for arm64 (which doesn't have to be the host, as the code is
+// never run) and return the assembly that asmjit logs.
+std::string CompileToLog(Function::Metadata meta,
+                         const InstructionBuffer& body) {
+  asmjit::CodeHolder holder;
+  Check(holder.init(asmjit::Environment(asmjit::Arch::kAArch64)));
+  asmjit::StringLogger logger;
+  Compiler compiler(std::move(meta), &holder);
+  compiler.SetLogger(&logger);
+  compiler.Prologue();
+  Dispatch(body, &compiler);
+  compiler.Epilogue();
+  return logger.data();
+}
+
+// The mnemonics of the instructions emitted for `body`.
+std::vector<std::string> CompileToMnemonics(BlockType signature,
+                                            const InstructionBuffer& body) {
+  return Mnemonics(CompileToLog(
+      {
+          .signature = std::move(signature),
+          .max_stack_size_bytes = 64,
+          .max_stack_elements = 16,
+      },
+      body));
+}
+
+const BlockType kTwoInts = {
+    .parameter_types = {ValType::kI32, ValType::kI32},
+};
+const BlockType kIntToInt = {
+    .parameter_types = {ValType::kI32},
+    .result_types = {ValType::kI32},
+};
+
+// Sums the numbers below the parameter `n`, with two locals that are
+// accessed in a loop.
+const SumLocals kSumBelowN = {.counter = 1, .limit = 0};
+Function::Metadata SumKernelMetadata() {
+  return {
+      .signature = kIntToInt,
+      .locals = {ValType::kI32, ValType::kI32},
+      .max_stack_size_bytes = 8,
+      .max_stack_elements = 2,
+  };
+}
+
+}  // namespace
+
+TEST(Compiler, FusesCompareIntoBrIf) {
+  auto mnemonics = CompileToMnemonics(
+      kTwoInts, InstructionBuffer::Of(Block{}, GetLocalI32(0), GetLocalI32(1),
+                                      CompareI32{.cond = Condition::kLtS},
+                                      BrIf{.depth = 0}, End()));
+  EXPECT_TRUE(IsConditionalBranch(After(mnemonics, "cmp")));
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains("cset")));
+}
+
+TEST(Compiler, BrIfOnValueUsesCbnz) {
+  auto mnemonics = CompileToMnemonics(
+      kTwoInts,
+      InstructionBuffer::Of(Block{}, GetLocalI32(0), BrIf{.depth = 0}, End()));
+  EXPECT_THAT(mnemonics, testing::Contains("cbnz"));
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains("cmp")));
+}
+
+TEST(Compiler, FusesEqzIntoIf) {
+  auto mnemonics = CompileToMnemonics(
+      kTwoInts, InstructionBuffer::Of(GetLocalI32(0), EqzI32(), If{}, End()));
+  EXPECT_TRUE(IsConditionalBranch(After(mnemonics, "cmp")));
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains("cset")));
+}
+
+TEST(Compiler, FusesNegatedCompareIntoIf) {
+  auto mnemonics = CompileToMnemonics(
+      kTwoInts,
+      InstructionBuffer::Of(GetLocalI32(0), GetLocalI32(1),
+                            CompareI32{.cond = Condition::kGeU}, EqzI32(),
+                            If{}, End()));
+  EXPECT_TRUE(IsConditionalBranch(After(mnemonics, "cmp")));
+  EXPECT_EQ(std::ranges::count(mnemonics, "cmp"), 1);
+}
+
+TEST(Compiler, MaterializesCompareResult) {
+  auto mnemonics = CompileToMnemonics(
+      {
+          .parameter_types = {ValType::kI32, ValType::kI32},
+          .result_types = {ValType::kI32},
+      },
+      InstructionBuffer::Of(GetLocalI32(0), GetLocalI32(1),
+                            CompareI32{.cond = Condition::kEq}));
+  EXPECT_EQ(After(mnemonics, "cmp"), "cset");
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains(
+                             testing::Truly(IsConditionalBranch))));
+}
+
+TEST(Compiler, MaterializesCompareBeforeClobberingFlags) {
+  // The add would clobber the flags of the comparison.
+  auto mnemonics = CompileToMnemonics(
+      {
+          .parameter_types = {ValType::kI32, ValType::kI32},
+          .result_types = {ValType::kI32},
+      },
+      InstructionBuffer::Of(GetLocalI32(0), GetLocalI32(1),
+                            CompareI32{.cond = Condition::kEq}, GetLocalI32(0),
+                            AddI32()));
+  EXPECT_EQ(After(mnemonics, "cmp"), "cset");
+}
+
+TEST(Compiler, FoldsConstants) {
+  auto mnemonics = CompileToMnemonics(
+      {.result_types = {ValType::kI32}},
+      InstructionBuffer::Of(ConstI32(Value::I32(2)), ConstI32(Value::I32(3)),
+                            AddI32(), ConstI32(Value::I32(5)),
+                            CompareI32{.cond = Condition::kEq}, EqzI32()));
+  // Only the result is materialized, straight into the return register.
+  EXPECT_THAT(mnemonics, testing::ElementsAre("sub", "mov", "add", "ret"));
+}
+
+TEST(Compiler, SubtractsNegativeImmediate) {
+  auto mnemonics = CompileToMnemonics(
+      kIntToInt, InstructionBuffer::Of(GetLocalI32(0), ConstI32(Value::I32(-5)),
+                                       AddI32()));
+  EXPECT_THAT(Prefix(mnemonics, 4),
+              testing::ElementsAre("sub", "str", "ldr", "sub"));
+}
+
+TEST(Compiler, MaterializesLargeImmediate) {
+  auto mnemonics = CompileToMnemonics(
+      kIntToInt, InstructionBuffer::Of(GetLocalI32(0),
+                                       ConstI32(Value::I32(100000)), AddI32()));
+  EXPECT_THAT(Prefix(mnemonics, 5),
+              testing::ElementsAre("sub", "str", "ldr", "mov", "add"));
+}
+
+TEST(Compiler, ComparesWithImmediate) {
+  auto mnemonics = CompileToMnemonics(
+      kTwoInts, InstructionBuffer::Of(Block{}, GetLocalI32(0),
+                                      ConstI32(Value::I32(10)),
+                                      CompareI32{.cond = Condition::kLtS},
+                                      BrIf{.depth = 0}, End()));
+  EXPECT_EQ(After(mnemonics, "cmp"), "b.lt");
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains("mov")));
+}
+
+TEST(Compiler, CommutesCompareWithImmediateOnTheLeft) {
+  auto mnemonics = CompileToMnemonics(
+      kTwoInts, InstructionBuffer::Of(Block{}, ConstI32(Value::I32(10)),
+                                      GetLocalI32(0),
+                                      CompareI32{.cond = Condition::kLtS},
+                                      BrIf{.depth = 0}, End()));
+  EXPECT_EQ(After(mnemonics, "cmp"), "b.gt");
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains("mov")));
+}
+
+TEST(Compiler, StoresZeroRegister) {
+  auto mnemonics = CompileToMnemonics(
+      {.parameter_types = {ValType::kI32}},
+      InstructionBuffer::Of(ConstI32(Value::I32(0)), SetLocalI32(0)));
+  EXPECT_THAT(mnemonics,
+              testing::ElementsAre("sub", "str", "str", "add", "ret"));
+}
+
+TEST(Compiler, FoldsConstantBranches) {
+  auto mnemonics = CompileToMnemonics(
+      {}, InstructionBuffer::Of(Block{}, ConstI32(Value::I32(0)),
+                                BrIf{.depth = 0}, ConstI32(Value::I32(3)),
+                                BrTable{.default_depth = 0}, End()));
+  EXPECT_THAT(mnemonics, testing::ElementsAre("sub", "b", "add", "ret"));
+}
+
+TEST(Compiler, KeepsHotLocalsInRegisters) {
+  auto meta = SumKernelMetadata();
+  meta.local_uses = {8, 24, 17};
+  // Only saving and restoring the callee saved registers touches memory.
+  EXPECT_EQ(CountMemoryAccesses(CompileToLog(meta, SumKernel(kSumBelowN))),
+            (MemoryAccesses{.loads = 2, .stores = 2}));
+}
+
+TEST(Compiler, KeepsLocalsInMemoryWithoutUses) {
+  EXPECT_EQ(CountMemoryAccesses(
+                CompileToLog(SumKernelMetadata(), SumKernel(kSumBelowN))),
+            (MemoryAccesses{.loads = 6, .stores = 5}));
+}
+
+TEST(Compiler, SpillsOneValueAtATime) {
+  constexpr int kDepth = 32;
+  asmjit::CodeHolder holder;
+  Check(holder.init(asmjit::Environment(asmjit::Arch::kAArch64)));
+  asmjit::StringLogger logger;
+  Compiler compiler(
+      {
+          .signature = kIntToInt,
+          .max_stack_size_bytes = kDepth * 4,
+          .max_stack_elements = kDepth,
+      },
+      &holder);
+  compiler.SetLogger(&logger);
+  compiler.Prologue();
+  Dispatch(DeepStack(kDepth), &compiler);
+  compiler.Epilogue();
+  // Once the registers run out, every value pushed spills exactly one other.
+  size_t expected = kDepth - CallingConvention::kGpCallerSavedRegisters.size();
+  EXPECT_EQ(compiler.num_spills(), expected);
+  // The only other store is the parameter being saved to its local.
+  EXPECT_EQ(CountMemoryAccesses(logger.data()).stores, int(expected) + 1);
+}
+
+}  // namespace wasmcc::arm64
@@ -0,0 +1,285 @@
+#include "compiler/code_cache.h"
+
+#include <asmjit/asmjit.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+#include "base/byte_cursor.h"
+#include "base/hash.h"
+#include "base/mapped_file.h"
+#include "base/stream.h"
+#include "compiler/code_target.h"
+#include "leb128/leb128.h"
+#include "parser/parser.h"
+
+namespace wasmcc {
+
+namespace {
+
+// Every serialized module starts with this magic number, followed by the
+// format version. The format version must be bumped whenever the layout
+// below changes.
+constexpr std::array<uint8_t, 4> kMagic = {0x00, 'w', 'c', 'c'};
+constexpr uint32_t kFormatVersion = 4;
+
+class Writer {
+ public:
+  void U32(uint32_t v) { Raw(leb128::Encode(v)); }
+  void U64(uint64_t v) { Raw(leb128::Encode(v)); }
+  void Bytes(bytes_view b) {
+    U32(uint32_t(b.size()));
+    Raw(b);
+  }
+  void ValTypes(const std::vector<ValType>& types) {
+    U32(uint32_t(types.size()));
+    for (ValType type : types) {
+      _out.push_back(uint8_t(type));
+    }
+  }
+  void Raw(bytes_view b) { _out.insert(_out.end(), b.begin(), b.end()); }
+
+  bytes take() && { return std::move(_out); }
+
+ private:
+  bytes _out;
+};
+
+class Reader {
+ public:
+  explicit Reader(bytes_view b) : _in(b) {}
+
+  uint32_t U32() { return leb128::Decode<uint32_t>(&_in); }
+  uint64_t U64() { return leb128::Decode<uint64_t>(&_in); }
+  bytes_view Bytes() { return _in.ReadBytes(U32()); }
+  std::vector<ValType> ValTypes() {
+    std::vector<ValType> types(U32());
+    for (auto& type : types) {
+      type = ValType(_in.ReadByte());
+    }
+    return types;
+  }
+  bytes_view Raw(size_t n) { return _in.ReadBytes(n); }
+
+  bool HasRemaining() const { return _in.HasRemaining(); }
+
+ private:
+  ByteCursor _in;
+};
+
+void Expect(bool ok, const char* msg) {
+  if (!ok) {
+    throw CodeCacheException(msg);
+  }
+}
+
+bool Equal(bytes_view a, bytes_view b) {
+  return std::ranges::equal(a, b);
+}
+
+void WriteMetadata(const Function::Metadata& meta, Writer* out) {
+  out->ValTypes(meta.signature.parameter_types);
+  out->ValTypes(meta.signature.result_types);
+  out->ValTypes(meta.locals);
+  out->U32(meta.max_stack_size_bytes);
+  out->U32(meta.max_stack_elements);
+  out->U32(uint32_t(meta.local_uses.size()));
+  for (uint32_t uses : meta.local_uses) {
+    out->U32(uses);
+  }
+}
+
+Function::Metadata ReadMetadata(Reader* in) {
+  Function::Metadata meta;
+  meta.signature.parameter_types = in->ValTypes();
+  meta.signature.result_types = in->ValTypes();
+  meta.locals = in->ValTypes();
+  meta.max_stack_size_bytes = in->U32();
+  meta.max_stack_elements = in->U32();
+  meta.local_uses.resize(in->U32());
+  for (auto& uses : meta.local_uses) {
+    uses = in->U32();
+  }
+  return meta;
+}
+
+// Read everything but the artifact's code, which is left in `serialized` and
+// returned through `code` so that it can be copied straight to where it runs.
+CompiledArtifact ReadArtifact(bytes_view serialized, bytes_view wasm,
+                              bytes_view* code) {
+  Reader in(serialized);
+  Expect(Equal(in.Raw(kMagic.size()), kMagic), "not a compiled module");
+  Expect(in.U32() == kFormatVersion, "unsupported format version");
+  Expect(in.U32() == Compiler::kVersion, "compiled by a different version");
+  CompiledArtifact artifact;
+  artifact.tier = Tier(in.U32());
+  artifact.eliminate_dead_functions = in.U32() != 0;
+  artifact.target.arch = asmjit::Arch(in.U32());
+  artifact.target.cpu_features.resize(in.U32());
+  for (auto& feature : artifact.target.cpu_features) {
+    feature = in.U32();
+  }
+  Expect(Equal(in.Bytes(), wasm), "compiled from a different module");
+
+  uint32_t num_exports = in.U32();
+  for (uint32_t i = 0; i < num_exports; ++i) {
+    auto name = in.Bytes();
+    artifact.exported_functions.emplace(
+        Name(std::string(name.begin(), name.end())), FuncIdx(in.U32()));
+  }
+  uint32_t num_functions = in.U32();
+  for (uint32_t i = 0; i < num_functions; ++i) {
+    artifact.offsets.push_back(in.U32());
+    artifact.frame_sizes.push_back(in.U32());
+    artifact.metadata.push_back(ReadMetadata(&in));
+  }
+  artifact.dead_code_bytes = in.U64();
+  *code = in.Bytes();
+  Expect(!in.HasRemaining(), "trailing data");
+  for (const auto& [_, idx] : artifact.exported_functions) {
+    Expect(idx.value() < num_functions, "export out of range");
+  }
+  for (uint32_t offset : artifact.offsets) {
+    Expect(offset == CompiledArtifact::kNoCode || offset < code->size(),
+           "function out of range");
+  }
+  return artifact;
+}
+
+}  // namespace
+
+bytes SerializeArtifact(bytes_view wasm, const CompiledArtifact& artifact) {
+  Writer out;
+  out.Raw(kMagic);
+  out.U32(kFormatVersion);
+  out.U32(Compiler::kVersion);
+  out.U32(uint32_t(artifact.tier));
+  out.U32(uint32_t(artifact.eliminate_dead_functions));
+  out.U32(uint32_t(artifact.target.arch));
+  out.U32(uint32_t(artifact.target.cpu_features.size()));
+  for (uint32_t feature : artifact.target.cpu_features) {
+    out.U32(feature);
+  }
+  // Keep the whole module, as the hash in the entry's name can collide.
+  out.Bytes(wasm);
+  out.U32(uint32_t(artifact.exported_functions.size()));
+  for (const auto& [name, idx] : artifact.exported_functions) {
+    std::string s = name.value();
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    out.Bytes({reinterpret_cast<const uint8_t*>(s.data()), s.size()});
+    out.U32(idx.value());
+  }
+  out.U32(uint32_t(artifact.offsets.size()));
+  for (size_t i = 0; i < artifact.offsets.size(); ++i) {
+    out.U32(artifact.offsets[i]);
+    out.U32(artifact.frame_sizes[i]);
+    WriteMetadata(artifact.metadata[i], &out);
+  }
+  out.U64(artifact.dead_code_bytes);
+  out.Bytes(artifact.code);
+  return std::move(out).take();
+}
+
+CompiledArtifact DeserializeArtifact(bytes_view serialized, bytes_view wasm) {
+  bytes_view code;
+  auto artifact = ReadArtifact(serialized, wasm, &code);
+  artifact.code.assign(code.begin(), code.end());
+  return artifact;
+}
+
+CodeCache::CodeCache(std::filesystem::path directory)
+    : _directory(std::move(directory)) {
+  std::filesystem::create_directories(_directory);
+}
+
+std::filesystem::path CodeCache::EntryPath(
+    bytes_view wasm, Tier tier, bool eliminate_dead_functions) const {
+  return _directory / absl::StrFormat("%016x.%d%d.wcc", Fnv1a64(wasm),
+                                      int(tier), int(eliminate_dead_functions));
+}
+
+std::optional<CompiledModule> CodeCache::Lookup(
+    bytes_view wasm, const CompilerOptions& options) const {
+  auto path = EntryPath(wasm, options.tier, options.eliminate_dead_functions);
+  if (!std::filesystem::exists(path)) {
+    return std::nullopt;
+  }
+  try {
+    auto file = MappedFile::Open(path);
+    // The code stays in the mapping until it is copied into executable
+    // memory, which is the only copy made of it.
+    bytes_view code;
+    auto artifact = ReadArtifact(file.data(), wasm, &code);
+    if (!artifact.target.CanRunOn(CodeTarget::Host()) ||
+        artifact.tier != options.tier ||
+        artifact.eliminate_dead_functions !=
+            options.eliminate_dead_functions) {
+      return std::nullopt;
+    }
+    return LoadArtifact(std::move(artifact), code);
+  } catch (const CodeCacheException&) {
+    // Stale.
+  } catch (const EndOfStreamException&) {
+    // Truncated.
+  } catch (const leb128::DecodeException&) {
+    // Corrupt.
+  } catch (const std::runtime_error&) {
+    // Removed since checking that it exists.
+  }
+  return std::nullopt;
+}
+
+void CodeCache::Insert(bytes_view wasm,
+                       const CompiledArtifact& artifact) const {
+  auto serialized = SerializeArtifact(wasm, artifact);
+  auto path = EntryPath(wasm, artifact.tier, artifact.eliminate_dead_functions);
+  auto tmp = path;
+  tmp += absl::StrFormat(".%d.%d.tmp", ::getpid(),
+                         std::hash<std::thread::id>{}(
+                             std::this_thread::get_id()));
+  try {
+    {
+      std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      file.write(reinterpret_cast<const char*>(serialized.data()),
+                 std::streamsize(serialized.size()));
+      if (!file.flush()) {
+        throw std::runtime_error(
+            absl::StrFormat("unable to write %s", tmp.string()));
+      }
+    }
+    std::filesystem::rename(tmp, path);
+  } catch (...) {
+    std::error_code ignored;
+    std::filesystem::remove(tmp, ignored);
+    throw;
+  }
+}
+
+co::Future<CompiledModule> CodeCache::LoadOrCompile(bytes_view wasm,
+                                                    Compiler* compiler) const {
+  if (auto cached = Lookup(wasm, compiler->options())) {
+    co_return std::move(*cached);
+  }
+  ByteCursor cursor(wasm);
+  auto parsed = co_await ParseModule(&cursor);
+  auto artifact = co_await compiler->CompileArtifact(std::move(parsed));
+  try {
+    Insert(wasm, artifact);
+  } catch (const std::runtime_error&) {
+    // Caching is only an optimization, so a read-only or full disk shouldn't
+    // lose the module that was just compiled. This also catches
+    // `std::filesystem::filesystem_error`.
+  }
+  co_return LoadArtifact(std::move(artifact));
+}
+
+}  // namespace wasmcc
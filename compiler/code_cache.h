@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "base/bytes.h"
+#include "base/coro.h"
+#include "compiler/code_target.h"
+#include "compiler/compiler.h"
+#include "compiler/module.h"
+
+namespace wasmcc {
+
+class CodeCacheException : public std::exception {
+ public:
+  explicit CodeCacheException(std::string msg) : _msg(std::move(msg)) {}
+
+  const char* what() const noexcept final { return _msg.c_str(); }
+
+ private:
+  std::string _msg;
+};
+
+/**
+ * Serialize an artifact that was compiled from `wasm`.
+ *
+ * The artifact's code is position independent, so it is stored as is and only
+ * needs to be copied into executable memory to be loaded again.
+ */
+bytes SerializeArtifact(bytes_view wasm, const CompiledArtifact&);
+
+/**
+ * Read an artifact serialized by `SerializeArtifact`, which may have been
+ * compiled for a different machine.
+ *
+ * Throws `CodeCacheException` if the artifact was not compiled from `wasm` by
+ * this version of the compiler.
+ */
+CompiledArtifact DeserializeArtifact(bytes_view serialized, bytes_view wasm);
+
+/**
+ * A directory of compiled modules, so that a module only has to be compiled
+ * once across process restarts.
+ *
+ * Entries are named after a hash of the module's bytes and the options that
+ * change the code (the tier and dead function elimination), but are only used
+ * if they were compiled from exactly the same bytes, with the same options, by
+ * the same version of the compiler, for a CPU that is compatible with this
+ * one. Anything else is a miss, and is replaced by the next insert.
+ *
+ * Entries are written to a temporary file and then renamed into place, so a
+ * cache directory can be shared by many threads and processes at once.
+ */
+class CodeCache {
+ public:
+  explicit CodeCache(std::filesystem::path directory);
+
+  /**
+   * Load the code for `wasm` if it is in the cache, compiled as a compiler
+   * with `options` would.
+   */
+  std::optional<CompiledModule> Lookup(bytes_view wasm,
+                                       const CompilerOptions& = {}) const;
+
+  /**
+   * Add an artifact compiled from `wasm` to the cache. Throws
+   * `std::runtime_error` if it can't be written.
+   */
+  void Insert(bytes_view wasm, const CompiledArtifact&) const;
+
+  /**
+   * Load the code for `wasm` from the cache, otherwise parse and compile it
+   * with `compiler` and add it to the cache. Only code compiled with the same
+   * options as `compiler` is loaded. The module is still returned if it can't
+   * be added to the cache.
+   */
+  co::Future<CompiledModule> LoadOrCompile(bytes_view wasm, Compiler*) const;
+
+ private:
+  std::filesystem::path EntryPath(bytes_view wasm, Tier tier,
+                                  bool eliminate_dead_functions) const;
+
+  std::filesystem::path _directory;
+};
+
+}  // namespace wasmcc
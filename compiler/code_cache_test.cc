@@ -0,0 +1,196 @@
+#include "compiler/code_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "compiler/compiler.h"
+#include "compiler/module.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+constexpr std::string_view kModule = R"WAT(
+(module
+  (func $add (param $lhs i32) (param $rhs i32) (result i32)
+    local.get $lhs
+    local.get $rhs
+    i32.add)
+  (func $add_minus_one (param $lhs i32) (param $rhs i32) (result i32)
+    local.get $rhs
+    i32.const -1
+    local.get $lhs
+    i32.add
+    i32.add)
+  (export "add" (func $add)))
+)WAT";
+
+class CodeCacheTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    const auto* test = ::testing::UnitTest::GetInstance()->current_test_info();
+    _directory = std::filesystem::path(::testing::TempDir()) / test->name();
+    std::filesystem::remove_all(_directory);
+  }
+
+  void TearDown() override {
+    for (auto& module : _modules) {
+      _compiler->Release(std::move(module)).get();
+    }
+    std::filesystem::remove_all(_directory);
+  }
+
+  CodeCache cache() { return CodeCache(_directory); }
+
+  CompiledModule LoadOrCompile(bytes_view wasm) {
+    return Keep(cache().LoadOrCompile(wasm, _compiler.get()).get());
+  }
+
+  std::optional<CompiledModule> Lookup(bytes_view wasm,
+                                       const CompilerOptions& options = {}) {
+    auto module = cache().Lookup(wasm, options);
+    if (module) {
+      return Keep(std::move(*module));
+    }
+    return std::nullopt;
+  }
+
+  // Overwrite every entry in the cache with `contents`.
+  void OverwriteEntries(const std::string& contents) {
+    for (const auto& entry :
+         std::filesystem::directory_iterator(_directory)) {
+      std::ofstream(entry.path(), std::ios::binary | std::ios::trunc)
+          << contents;
+    }
+  }
+
+  // Replace every entry in the cache with a directory, so it can't be
+  // written again.
+  void BlockEntries() {
+    for (const auto& entry : Entries()) {
+      std::filesystem::remove(entry);
+      std::filesystem::create_directories(entry / "blocked");
+    }
+  }
+
+  std::vector<std::filesystem::path> Entries() const {
+    std::vector<std::filesystem::path> entries;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(_directory)) {
+      entries.push_back(entry.path());
+    }
+    return entries;
+  }
+
+ private:
+  CompiledModule Keep(CompiledModule module) {
+    _modules.push_back(module);
+    return module;
+  }
+
+  std::filesystem::path _directory;
+  std::unique_ptr<Compiler> _compiler = Compiler::CreateNative();
+  std::vector<CompiledModule> _modules;
+};
+
+CompiledFunction AddFn(CompiledModule* module) {
+  auto idx = module->exported_functions[Name("add")];
+  return module->functions[idx.value()];
+}
+
+}  // namespace
+
+TEST_F(CodeCacheTest, MissesThenHits) {
+  bytes wasm = Wat2Wasm(kModule);
+  EXPECT_FALSE(Lookup(wasm).has_value());
+  auto compiled = LoadOrCompile(wasm);
+  EXPECT_EQ((AddFn(&compiled).invoke<int32_t, int32_t, int32_t>(1, 2)), 3);
+
+  auto cached = Lookup(wasm);
+  ASSERT_TRUE(cached.has_value());
+  EXPECT_NE(cached->code.data, compiled.code.data);
+  EXPECT_EQ((AddFn(&*cached).invoke<int32_t, int32_t, int32_t>(1, 2)), 3);
+  ASSERT_EQ(cached->functions.size(), compiled.functions.size());
+  for (size_t i = 0; i < compiled.functions.size(); ++i) {
+    EXPECT_EQ(cached->functions[i].metadata().signature,
+              compiled.functions[i].metadata().signature);
+    EXPECT_EQ(cached->functions[i].metadata().local_uses,
+              compiled.functions[i].metadata().local_uses);
+    EXPECT_EQ(cached->functions[i].frame_size_bytes(),
+              compiled.functions[i].frame_size_bytes());
+  }
+}
+
+TEST_F(CodeCacheTest, RequiresTheSameModule) {
+  bytes wasm = Wat2Wasm(kModule);
+  LoadOrCompile(wasm);
+  wasm.push_back(0);
+  EXPECT_FALSE(Lookup(wasm).has_value());
+}
+
+TEST_F(CodeCacheTest, IgnoresCorruptEntries) {
+  bytes wasm = Wat2Wasm(kModule);
+  LoadOrCompile(wasm);
+  OverwriteEntries("not a module");
+  EXPECT_FALSE(Lookup(wasm).has_value());
+  OverwriteEntries("");
+  EXPECT_FALSE(Lookup(wasm).has_value());
+  // The entry is replaced the next time it is compiled.
+  auto compiled = LoadOrCompile(wasm);
+  EXPECT_EQ((AddFn(&compiled).invoke<int32_t, int32_t, int32_t>(2, 2)), 4);
+  EXPECT_TRUE(Lookup(wasm).has_value());
+}
+
+TEST_F(CodeCacheTest, RequiresTheSameOptions) {
+  bytes wasm = Wat2Wasm(kModule);
+  LoadOrCompile(wasm);
+  EXPECT_FALSE(Lookup(wasm, {.tier = Tier::kOptimized}).has_value());
+  EXPECT_FALSE(Lookup(wasm, {.eliminate_dead_functions = true}).has_value());
+
+  auto compiler = Compiler::CreateNative({.tier = Tier::kOptimized});
+  auto optimized = cache().LoadOrCompile(wasm, compiler.get()).get();
+  EXPECT_EQ((AddFn(&optimized).invoke<int32_t, int32_t, int32_t>(1, 2)), 3);
+  compiler->Release(std::move(optimized)).get();
+  // Both are cached side by side.
+  EXPECT_TRUE(Lookup(wasm, {.tier = Tier::kOptimized}).has_value());
+  EXPECT_TRUE(Lookup(wasm).has_value());
+}
+
+TEST_F(CodeCacheTest, KeepsDeadCodeBytes) {
+  bytes wasm = Wat2Wasm(kModule);
+  auto compiler = Compiler::CreateNative({.eliminate_dead_functions = true});
+  auto compiled = cache().LoadOrCompile(wasm, compiler.get()).get();
+  // `$add_minus_one` isn't exported.
+  EXPECT_GT(compiled.dead_code_bytes, 0);
+  auto cached = Lookup(wasm, {.eliminate_dead_functions = true});
+  ASSERT_TRUE(cached.has_value());
+  EXPECT_EQ(cached->dead_code_bytes, compiled.dead_code_bytes);
+  compiler->Release(std::move(compiled)).get();
+}
+
+TEST_F(CodeCacheTest, CompilesWhenTheEntryCantBeWritten) {
+  bytes wasm = Wat2Wasm(kModule);
+  LoadOrCompile(wasm);
+  auto entries = Entries();
+  BlockEntries();
+  auto compiled = LoadOrCompile(wasm);
+  EXPECT_EQ((AddFn(&compiled).invoke<int32_t, int32_t, int32_t>(1, 2)), 3);
+  EXPECT_FALSE(Lookup(wasm).has_value());
+  // The partially written entry is cleaned up.
+  EXPECT_EQ(Entries(), entries);
+}
+
+TEST_F(CodeCacheTest, MissesCodeForAnotherMachine) {
+  bytes wasm = Wat2Wasm(kModule);
+  CompiledArtifact artifact{.target = CodeTarget::Host()};
+  artifact.target.cpu_features.push_back(UINT32_MAX);
+  cache().Insert(wasm, artifact);
+  EXPECT_FALSE(Lookup(wasm).has_value());
+  // The entry is still readable, e.g. to copy to a machine that can run it.
+  EXPECT_NO_THROW(DeserializeArtifact(SerializeArtifact(wasm, artifact), wasm));
+}
+
+}  // namespace wasmcc
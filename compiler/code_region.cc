@@ -0,0 +1,36 @@
+#include "compiler/code_region.h"
+
+#include <asmjit/asmjit.h>
+
+#include "base/align.h"
+#include "compiler/common/util.h"
+
+namespace wasmcc {
+
+CodeRegion AllocateCodeRegion(size_t size) {
+  CodeRegion region;
+  if (size == 0) {
+    return region;
+  }
+  region.size = AlignUp<size_t>(size, asmjit::VirtMem::info().pageSize);
+  Check(asmjit::VirtMem::alloc(&region.data, region.size,
+                               asmjit::MemoryFlags::kAccessRW));
+  return region;
+}
+
+void MakeExecutable(const CodeRegion& region) {
+  if (region.data == nullptr) {
+    return;
+  }
+  Check(asmjit::VirtMem::protect(region.data, region.size,
+                                 asmjit::MemoryFlags::kAccessRX));
+  asmjit::VirtMem::flushInstructionCache(region.data, region.size);
+}
+
+void ReleaseCodeRegion(const CodeRegion& region) {
+  if (region.data != nullptr) {
+    Check(asmjit::VirtMem::release(region.data, region.size));
+  }
+}
+
+}  // namespace wasmcc
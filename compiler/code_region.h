@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wasmcc {
+
+/**
+ * A page aligned block of executable memory.
+ */
+struct CodeRegion {
+  void* data = nullptr;
+  size_t size = 0;
+};
+
+/**
+ * Allocate a writable region that can hold at least `size` bytes of code.
+ *
+ * Nothing is allocated if `size` is zero.
+ */
+CodeRegion AllocateCodeRegion(size_t size);
+
+/**
+ * Make a region executable once all the code has been written into it, after
+ * which it can no longer be written to.
+ */
+void MakeExecutable(const CodeRegion&);
+
+/**
+ * Free a region, after which none of the code in it can be used.
+ */
+void ReleaseCodeRegion(const CodeRegion&);
+
+}  // namespace wasmcc
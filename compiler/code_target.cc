@@ -0,0 +1,26 @@
+#include "compiler/code_target.h"
+
+#include <asmjit/asmjit.h>
+
+#include <algorithm>
+
+namespace wasmcc {
+
+CodeTarget CodeTarget::Host() {
+  CodeTarget target{.arch = asmjit::Environment::host().arch()};
+  auto it = asmjit::CpuInfo::host().features().iterator();
+  while (it.hasNext()) {
+    target.cpu_features.push_back(uint32_t(it.next()));
+  }
+  return target;
+}
+
+bool CodeTarget::CanRunOn(const CodeTarget& host) const {
+  return arch == host.arch &&
+         std::ranges::all_of(cpu_features, [&host](uint32_t feature) {
+           return std::ranges::find(host.cpu_features, feature) !=
+                  host.cpu_features.end();
+         });
+}
+
+}  // namespace wasmcc
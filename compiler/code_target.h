@@ -0,0 +1,25 @@
+#pragma once
+
+#include <asmjit/core.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace wasmcc {
+
+/**
+ * The machine that code is compiled for.
+ */
+struct CodeTarget {
+  asmjit::Arch arch;
+  // The (asmjit) ids of the CPU features that the code is allowed to use.
+  std::vector<uint32_t> cpu_features;
+
+  /** The machine that this process is running on. */
+  static CodeTarget Host();
+
+  /** If code compiled for this target can run on `host`. */
+  bool CanRunOn(const CodeTarget& host) const;
+};
+
+}  // namespace wasmcc
@@ -0,0 +1,21 @@
+#include "compiler/code_target.h"
+
+#include <gtest/gtest.h>
+
+namespace wasmcc {
+
+TEST(CodeTarget, CanRunOn) {
+  CodeTarget host = {.arch = asmjit::Arch::kX64, .cpu_features = {1, 2, 3}};
+  EXPECT_TRUE(host.CanRunOn(host));
+  EXPECT_TRUE((CodeTarget{.arch = asmjit::Arch::kX64, .cpu_features = {2}})
+                  .CanRunOn(host));
+  EXPECT_FALSE((CodeTarget{.arch = asmjit::Arch::kX64, .cpu_features = {4}})
+                   .CanRunOn(host));
+  EXPECT_FALSE((CodeTarget{.arch = asmjit::Arch::kAArch64}).CanRunOn(host));
+}
+
+TEST(CodeTarget, HostCanRunOnItself) {
+  EXPECT_TRUE(CodeTarget::Host().CanRunOn(CodeTarget::Host()));
+}
+
+}  // namespace wasmcc
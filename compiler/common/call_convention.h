@@ -43,6 +43,8 @@ class RegisterMask {
   void Reset(const T& reg) noexcept { _mask.reset(reg.id()); }
   void Reset() noexcept { _mask.reset(); }
   bool Test(const T& reg) const noexcept { return _mask.test(reg.id()); }
+  // The number of registers in the set.
+  size_t size() const noexcept { return _mask.count(); }
 
   class ConstIterator {
    public:
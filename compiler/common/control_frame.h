@@ -0,0 +1,113 @@
+#pragma once
+
+#include <asmjit/core.h>
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "compiler/common/call_convention.h"
+#include "compiler/common/parallel_move.h"
+#include "compiler/common/runtime_stack.h"
+#include "core/instruction.h"
+
+namespace wasmcc {
+
+/**
+ * A structured control instruction that is currently open during compilation.
+ *
+ * Branches to a frame jump directly to `label`, after moving the values on the
+ * stack to where `merge` expects them. The expected register state is defined
+ * by whichever edge reaches the label first (or on entry for loops), so that
+ * in the common case nothing has to be moved or spilled at all.
+ */
+template <CallingConvention CC>
+struct ControlFrame {
+  enum class Kind : uint8_t { kFunction, kBlock, kLoop, kIf, kElse };
+
+  Kind kind;
+  // Where branches to this frame jump to.
+  asmjit::Label label;
+  // For `If` frames, the start of the else branch.
+  asmjit::Label else_label;
+  // The number of values on the stack when the frame was entered.
+  size_t height = 0;
+  // The number of values carried by a branch to this frame.
+  size_t arity = 0;
+  // The state of the stack at `label`, if anything has branched to it yet.
+  std::optional<std::vector<RuntimeValue<CC>>> merge;
+  // For `If` frames, the state of the stack on entry to the else branch.
+  std::vector<RuntimeValue<CC>> else_state;
+};
+
+/**
+ * The state of the stack after branching to a frame of `height` and `arity`,
+ * which is the values below the frame followed by the branch's values.
+ *
+ * The branch values must be in registers or constants, as their stack slots
+ * move.
+ */
+template <CallingConvention CC>
+std::vector<RuntimeValue<CC>> BranchState(
+    std::span<const RuntimeValue<CC>> current, size_t height, size_t arity) {
+  std::vector<RuntimeValue<CC>> state(current.begin(),
+                                      current.begin() + int64_t(height));
+  int32_t stack_pointer = state.empty() ? 0 : state.back().stack_pointer;
+  for (auto v : current.last(arity)) {
+    stack_pointer += int32_t(v.size_bytes());
+    v.stack_pointer = stack_pointer;
+    state.push_back(v);
+  }
+  return state;
+}
+
+/**
+ * The moves required to get from one stack state to another of the same
+ * shape.
+ */
+template <CallingConvention CC>
+std::vector<ValueMove<CC>> MergeMoves(std::span<const RuntimeValue<CC>> from,
+                                      std::span<const RuntimeValue<CC>> to) {
+  std::vector<ValueMove<CC>> moves;
+  for (size_t i = 0; i < to.size(); ++i) {
+    const auto& src = from[i];
+    const auto& dst = to[i];
+    if (src.reg.has_value() == dst.reg.has_value() &&
+        (!src.reg || src.reg->id() == dst.reg->id())) {
+      continue;
+    }
+    moves.push_back({.from = src, .to = dst});
+  }
+  return moves;
+}
+
+/**
+ * A range of `br_table` indexes, starting at `lo` up until the next range,
+ * that all branch to the same depth.
+ */
+struct BrTableRange {
+  uint32_t lo;
+  uint32_t depth;
+};
+
+/**
+ * Split a `br_table` into ranges, sorted by index and covering all possible
+ * indexes (out of range indexes use the default).
+ */
+inline std::vector<BrTableRange> BrTableRanges(const op::BrTable& op) {
+  std::vector<BrTableRange> ranges;
+  for (size_t i = 0; i < op.size(); ++i) {
+    uint32_t depth = op.target(i);
+    if (ranges.empty() || ranges.back().depth != depth) {
+      ranges.push_back({.lo = uint32_t(i), .depth = depth});
+    }
+  }
+  if (ranges.empty() || ranges.back().depth != op.default_depth) {
+    ranges.push_back({.lo = uint32_t(op.size()), .depth = op.default_depth});
+  }
+  return ranges;
+}
+
+}  // namespace wasmcc
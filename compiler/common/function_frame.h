@@ -1,6 +1,13 @@
 #pragma once
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
 #include "base/align.h"
 #include "compiler/common/call_convention.h"
+#include "compiler/common/runtime_stack.h"
 #include "core/ast.h"
 
 namespace wasmcc {
@@ -17,15 +24,21 @@ namespace wasmcc {
  * that, and stack values grow *towards* the locals (as that was simpler to
  * implement).
  *
+ * The most used locals don't live in memory at all. Parameters stay in the
+ * register they were passed in, and other locals are given callee saved
+ * registers, which are saved in the frame (only if used) and restored on exit.
+ *
  * Here is a graphical representation of the stack usage.
  *
- *  ┌──────────┬───────────────┐
- *  │  LOCALS  │  STACK        │
- *  └──────────┴───────────────┘
- *  0xFFFF                0xFF00
+ *  ┌─────────────┬──────────┬───────────────┐
+ *  │  SAVED REGS │  LOCALS  │  STACK        │
+ *  └─────────────┴──────────┴───────────────┘
+ *  0xFFFF                             0xFF00
  */
 template <CallingConvention CC>
 class FunctionFrame {
+  using GpReg = typename CC::GpReg;
+
  public:
   explicit FunctionFrame(Function::Metadata meta);
 
@@ -33,43 +46,111 @@ class FunctionFrame {
   int32_t StackSizeBytes() const noexcept {
     // TODO: This can be optimized, as there are registers around to hold the
     // stack size.
-    return AlignUp<uint32_t>(_locals_size_bytes + _meta.max_stack_size_bytes,
+    return AlignUp<uint32_t>(_saved_registers_offset +
+                                 (_saved_registers.size() * sizeof(uint64_t)),
                              CC::kStackAlignment);
   }
 
+  /* The number of locals, including parameters. */
+  size_t num_locals() const { return _local_registers.size(); }
+
+  /* The offset of a local that is not in a register. */
   int32_t LocalStackOffset(size_t idx) const {
     return _locals_stack_offset[idx];
   }
 
+  /* The register that holds a local for the whole function, if any. */
+  const std::optional<GpReg>& LocalRegister(size_t idx) const {
+    return _local_registers[idx];
+  }
+
+  /* The callee saved registers used for locals, that must be preserved. */
+  std::span<const GpReg> SavedRegisters() const { return _saved_registers; }
+
+  /* The offset of the slot where `SavedRegisters()[i]` is saved. */
+  int32_t SavedRegisterOffset(size_t i) const {
+    return _saved_registers_offset + int32_t(i * sizeof(uint64_t));
+  }
+
+  /* The offset of a stack value's slot, relative to the stack pointer. */
+  int32_t ValueStackOffset(const RuntimeValue<CC>& v) const {
+    return v.stack_pointer - int32_t(v.size_bytes());
+  }
+
  private:
+  // Assign registers to the most used locals.
+  void AssignLocalRegisters();
+
   Function::Metadata _meta;
-  // The size of the locals in bytes.
-  int32_t _locals_size_bytes{0};
   // A mapping between a local and it's memory offset onto the stack.
   //
-  // The offset is relative to rsp.
+  // The offset is relative to the stack pointer.
   absl::FixedArray<int32_t> _locals_stack_offset;
+  // The registers that locals live in instead of memory.
+  absl::FixedArray<std::optional<GpReg>> _local_registers;
+  std::vector<GpReg> _saved_registers;
+  int32_t _saved_registers_offset{0};
 };
 
 template <CallingConvention CC>
 FunctionFrame<CC>::FunctionFrame(Function::Metadata meta)
     : _meta(std::move(meta)),
       _locals_stack_offset(_meta.locals.size() +
-                           _meta.signature.parameter_types.size()) {
-  // Initially record the stack offset relative to the bottom of the stack
+                           _meta.signature.parameter_types.size()),
+      _local_registers(_locals_stack_offset.size()) {
+  AssignLocalRegisters();
+  // The stack values are at the bottom of the frame (closest to the stack
+  // pointer), then the locals that are not in registers.
+  auto offset = int32_t(_meta.max_stack_size_bytes);
   size_t i = 0;
-  for (const auto& type : _meta.signature.parameter_types) {
-    _locals_stack_offset[i++] = _locals_size_bytes;
-    _locals_size_bytes += int32_t(ValTypeSizeBytes(type));
-  }
-  for (const auto& type : _meta.locals) {
-    _locals_stack_offset[i++] = _locals_size_bytes;
-    _locals_size_bytes += int32_t(ValTypeSizeBytes(type));
+  auto assign_slot = [&](ValType type) {
+    if (!_local_registers[i]) {
+      _locals_stack_offset[i] = offset;
+      offset += int32_t(ValTypeSizeBytes(type));
+    }
+    ++i;
+  };
+  std::ranges::for_each(_meta.signature.parameter_types, assign_slot);
+  std::ranges::for_each(_meta.locals, assign_slot);
+  _saved_registers_offset =
+      int32_t(AlignUp<uint32_t>(offset, sizeof(uint64_t)));
+}
+
+template <CallingConvention CC>
+void FunctionFrame<CC>::AssignLocalRegisters() {
+  // Leave enough registers free for the values on the stack.
+  constexpr size_t kMinScratchRegisters = 4;
+  const auto& params = _meta.signature.parameter_types;
+  auto type_of = [&](size_t idx) {
+    return idx < params.size() ? params[idx]
+                               : _meta.locals[idx - params.size()];
+  };
+  std::vector<size_t> candidates;
+  for (size_t idx = 0; idx < _meta.local_uses.size(); ++idx) {
+    ValType type = type_of(idx);
+    if (_meta.local_uses[idx] > 0 &&
+        (type == ValType::kI32 || type == ValType::kI64)) {
+      candidates.push_back(idx);
+    }
   }
-  // Now that we've calculated the full stack size, adjust the offset to be
-  // relative to the top of the stack.
-  for (i = 0; i < _locals_stack_offset.size(); ++i) {
-    _locals_stack_offset[i] -= StackSizeBytes();
+  std::ranges::stable_sort(candidates, std::greater<>(), [this](size_t idx) {
+    return _meta.local_uses[idx];
+  });
+  size_t max_pinned_args = CC::kGpCallerSavedRegisters.size();
+  max_pinned_args -= std::min(max_pinned_args, kMinScratchRegisters);
+  size_t pinned_args = 0;
+  auto callee_saved = CC::kGpCalleeSavedRegisters.begin();
+  for (size_t idx : candidates) {
+    if (idx < params.size() && idx < CC::kGpArgs.size() &&
+        pinned_args < max_pinned_args) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+      _local_registers[idx] = CC::kGpArgs[idx];
+      ++pinned_args;
+    } else if (callee_saved != CC::kGpCalleeSavedRegisters.end()) {
+      _local_registers[idx] = *callee_saved;
+      _saved_registers.push_back(*callee_saved);
+      ++callee_saved;
+    }
   }
 }
 
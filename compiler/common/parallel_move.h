@@ -0,0 +1,90 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "compiler/common/call_convention.h"
+#include "compiler/common/runtime_stack.h"
+
+namespace wasmcc {
+
+/**
+ * Move a stack value from one location to another.
+ *
+ * A location is either a register or (if `reg` is not set) the value's slot in
+ * stack memory, as given by `stack_pointer`.
+ */
+template <CallingConvention CC>
+struct ValueMove {
+  RuntimeValue<CC> from;
+  RuntimeValue<CC> to;
+};
+
+/**
+ * Emit a set of moves that logically all happen at the same time, such as
+ * when reconciling the register state of two control flow edges.
+ *
+ * The destinations must all be distinct, and the destination memory slots
+ * must not hold any other value that is the source of a move. Moves from
+ * memory to memory are not supported, those values are assumed to already be
+ * in the same slot. Constants can only be moved into registers, and are
+ * materialized by the emitter's `Load`.
+ *
+ * The emitter must support:
+ *
+ *  Store(const GpReg& src, const RuntimeValue& slot)
+ *  Load(const RuntimeValue& slot, const GpReg& dst)
+ *  Move(const GpReg& src, const GpReg& dst, ValType)
+ */
+template <CallingConvention CC, typename Emitter>
+void EmitParallelMove(std::span<const ValueMove<CC>> moves, Emitter* emitter) {
+  std::vector<ValueMove<CC>> pending;
+  std::vector<ValueMove<CC>> loads;
+  // Stores first, so that their source registers are free to be overwritten.
+  for (const auto& move : moves) {
+    if (move.from.reg && !move.to.reg) {
+      emitter->Store(*move.from.reg, move.to);
+    } else if (!move.from.reg && move.to.reg) {
+      loads.push_back(move);
+    } else if (move.from.reg && move.from.reg->id() != move.to.reg->id()) {
+      pending.push_back(move);
+    }
+  }
+  auto is_pending_source = [&pending](const typename CC::GpReg& reg) {
+    for (const auto& move : pending) {
+      if (move.from.reg->id() == reg.id()) {
+        return true;
+      }
+    }
+    return false;
+  };
+  while (!pending.empty()) {
+    bool progress = false;
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+      if (is_pending_source(*it->to.reg)) {
+        continue;
+      }
+      emitter->Move(*it->from.reg, *it->to.reg, it->to.type);
+      pending.erase(it);
+      progress = true;
+      break;
+    }
+    if (progress) {
+      continue;
+    }
+    // Every remaining move is part of a cycle, break one by going through the
+    // destination's memory slot.
+    auto move = pending.back();
+    pending.pop_back();
+    emitter->Store(*move.from.reg, move.to);
+    move.from = move.to;
+    move.from.reg = std::nullopt;
+    loads.push_back(move);
+  }
+  // All registers that are sources have been read at this point.
+  for (const auto& move : loads) {
+    emitter->Load(move.from, *move.to.reg);
+  }
+}
+
+}  // namespace wasmcc
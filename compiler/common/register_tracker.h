@@ -30,15 +30,24 @@ class RegisterTracker {
   std::optional<typename CC::GpReg> TakeUnusedRegister();
 
   void MarkRegisterUnused(const typename CC::GpReg&);
+  void MarkRegisterUsed(const typename CC::GpReg&);
+
+  // Never hand out this register (even after a `Reset`), because it is
+  // dedicated to something else for the whole function, such as a local.
+  void ReserveRegister(const typename CC::GpReg&);
+
+  // Mark all registers as unused.
+  void Reset();
 
  private:
   RegisterMask<typename CC::GpReg> _gp_reg_mask;
+  RegisterMask<typename CC::GpReg> _gp_reserved_mask;
 };
 
 template <CallingConvention CC>
 std::optional<typename CC::GpReg> RegisterTracker<CC>::TakeUnusedRegister() {
   for (const typename CC::GpReg& reg : CC::kGpCallerSavedRegisters) {
-    if (!_gp_reg_mask.Test(reg)) {
+    if (!_gp_reg_mask.Test(reg) && !_gp_reserved_mask.Test(reg)) {
       _gp_reg_mask.Set(reg);
       return reg;
     }
@@ -52,4 +61,19 @@ void RegisterTracker<CC>::MarkRegisterUnused(const typename CC::GpReg& reg) {
   _gp_reg_mask.Reset(reg);
 }
 
+template <CallingConvention CC>
+void RegisterTracker<CC>::MarkRegisterUsed(const typename CC::GpReg& reg) {
+  _gp_reg_mask.Set(reg);
+}
+
+template <CallingConvention CC>
+void RegisterTracker<CC>::ReserveRegister(const typename CC::GpReg& reg) {
+  _gp_reserved_mask.Set(reg);
+}
+
+template <CallingConvention CC>
+void RegisterTracker<CC>::Reset() {
+  _gp_reg_mask.Reset();
+}
+
 }  // namespace wasmcc
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <optional>
 #include <span>
 
 #include "absl/container/fixed_array.h"
 #include "compiler/common/call_convention.h"
 #include "compiler/common/register_tracker.h"
+#include "core/instruction.h"
 #include "core/value.h"
 
 namespace wasmcc {
@@ -18,6 +20,14 @@ struct RuntimeValue {
   std::optional<typename CC::GpReg> reg;
   // The type of this register
   ValType type = ValType::kI32;
+  // If set, this value is the (not yet materialized) result of a comparison
+  // that is in the CPU's flags. Only the top of the stack can be in this
+  // state, as almost any other instruction can clobber the flags.
+  std::optional<Condition> condition;
+  // If set, this value is a constant that has not been materialized anywhere.
+  // It is only moved into a register once an instruction needs it there, so
+  // that it can otherwise be folded or used as an immediate operand.
+  std::optional<Value> constant;
 
   bool operator==(const RuntimeValue&) const = default;
 
@@ -59,11 +69,23 @@ class RuntimeStack {
     return &_stack[_stack_size - 1];
   }
 
+  // Replace the contents of the stack with `values`, from bottom to top.
+  void Restore(std::span<const RuntimeValue<CC>> values) noexcept {
+    _stack_size = 0;
+    _stack_memory_offset = 0;
+    for (const auto& v : values) {
+      Push(v);
+    }
+  }
+
   // Iterator from the bottom of the stack to the top.
   std::span<RuntimeValue<CC>> ReverseIterator() noexcept {
     return {_stack.data(), _stack_size};
   }
 
+  // The number of values on the stack.
+  size_t size() const noexcept { return _stack_size; }
+
   // The current offset in bytes from the bottom of current function's stack.
   int32_t pointer() const noexcept { return _stack_memory_offset; }
 
@@ -2,76 +2,439 @@
 
 #include <asmjit/asmjit.h>
 
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <source_location>
-#include <variant>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+
+#include "base/align.h"
 #include "base/assert.h"
 #include "base/coro.h"
+#include "base/thread_pool.h"
 #include "compiler/arm64/compiler.h"
+#include "compiler/code_region.h"
+#include "compiler/code_target.h"
 #include "compiler/common/util.h"
 #include "compiler/module.h"
+#include "compiler/optimizer.h"
+#include "compiler/reachability.h"
+#include "compiler/ssa/builder.h"
+#include "compiler/ssa/passes.h"
 #include "compiler/x64/compiler.h"
+#include "compiler/x64/optimizing_compiler.h"
 
 namespace wasmcc {
 namespace {
-template <typename T>
-class CompilerImpl : public Compiler {
+// Functions start on their own cache line, so that a small function doesn't
+// pull in the end of another one.
+constexpr size_t kFunctionAlignment = 64;
+
+// Marks a function that runs no code of its own.
+constexpr size_t kNone = SIZE_MAX;
+
+// The order to lay out the functions that are compiled in, which is exported
+// functions first, as they are the entry points and so the most likely to be
+// hot. `sources` is as in `Plan`.
+std::vector<size_t> LayoutOrder(const ParsedModule& parsed,
+                                std::span<const size_t> sources) {
+  std::vector<bool> exported(parsed.functions.size());
+  std::vector<size_t> order;
+  order.reserve(parsed.functions.size());
+  for (const auto& [_, idx] : parsed.exported_functions) {
+    exported[idx.value()] = true;
+  }
+  for (size_t i = 0; i < exported.size(); ++i) {
+    if (exported[i] && sources[i] == i) {
+      order.push_back(i);
+    }
+  }
+  for (size_t i = 0; i < exported.size(); ++i) {
+    if (!exported[i] && sources[i] == i) {
+      order.push_back(i);
+    }
+  }
+  return order;
+}
+
+// Identifies the code a function compiles to, which only depends on its
+// signature, locals and body, as the rest of its metadata is derived from
+// them.
+std::string FunctionKey(const Function& func) {
+  std::string key;
+  key.reserve(func.body.size_bytes() + 16);
+  for (const auto* types :
+       {&func.meta.signature.parameter_types,
+        &func.meta.signature.result_types, &func.meta.locals}) {
+    absl::StrAppend(&key, types->size(), ":");
+    for (ValType type : *types) {
+      key.push_back(char(type));
+    }
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  key.append(reinterpret_cast<const char*>(func.body.begin()),
+             func.body.size_bytes());
+  return key;
+}
+
+// How to get the code for each function of a module.
+struct Plan {
+  // Which function's code each function runs: its own (so it's compiled),
+  // that of an identical function earlier in the module, or none (`kNone`).
+  std::vector<size_t> sources;
+  // The key of each function that is compiled, if functions are folded.
+  std::vector<std::string> keys;
+  size_t dead_code_bytes = 0;
+};
+
+// The code that identical functions share across all the modules a compiler
+// has loaded. Each region of code is reference counted by the functions that
+// run code from it, and freed once all of them have been released.
+class SharedCode {
  public:
-  CompilerImpl() {
-    Check(_code_holder.init(_runtime.environment(), _runtime.cpuFeatures()));
+  struct Entry {
+    void* code = nullptr;
+    uint32_t frame_size_bytes = 0;
   };
 
-  co::Future<CompiledFunction> Compile(Function func) {
-    T func_compiler(func.meta, &_code_holder);
-    asmjit::StringLogger logger;
-    func_compiler.SetLogger(&logger);
-    func_compiler.Prologue();
-    for (const auto& expr : func.body) {
-      std::visit(func_compiler, expr);
-      co_await co::MaybeYield();
+  // The function with `key` that is already loaded, if any, holding a
+  // reference to its code for each of `refs` functions.
+  Entry Acquire(const std::string& key, size_t refs) {
+    std::unique_lock lock(_mutex);
+    auto it = _code.find(key);
+    if (it == _code.end()) {
+      return {};
+    }
+    Find(it->second.code)->second.refs += refs;
+    return it->second;
+  }
+
+  // Share the code of a newly loaded module, where `keys` are as in `Plan`.
+  void Add(const CompiledModule& module, std::vector<std::string> keys) {
+    if (module.code.data == nullptr) {
+      return;
+    }
+    std::unique_lock lock(_mutex);
+    auto& region = _regions[uintptr_t(module.code.data)];
+    region.code = module.code;
+    for (size_t i = 0; i < module.functions.size(); ++i) {
+      void* code = module.functions[i].get();
+      auto it = code == nullptr ? _regions.end() : Find(code);
+      if (it == _regions.end() || it->second.code.data != region.code.data) {
+        continue;
+      }
+      ++region.refs;
+      // Another module may have loaded the same function at the same time.
+      if (!keys[i].empty() && !_code.contains(keys[i])) {
+        _code.emplace(keys[i],
+                      Entry{code, module.functions[i].frame_size_bytes()});
+        region.keys.push_back(std::move(keys[i]));
+      }
+    }
+  }
+
+  // Drop the references of a module's functions. Returns whether the module's
+  // own code region was shared, and so is freed by this once it's unused.
+  bool Release(const CompiledModule& module) {
+    std::unique_lock lock(_mutex);
+    bool shared = _regions.contains(uintptr_t(module.code.data));
+    for (const auto& function : module.functions) {
+      void* code = function.get();
+      auto it = code == nullptr ? _regions.end() : Find(code);
+      if (it != _regions.end()) {
+        Unref(it, 1);
+      }
+    }
+    return shared;
+  }
+
+  // Give back references taken by `Acquire` for a module that then failed
+  // to load.
+  void Drop(const Entry& entry, size_t refs) {
+    std::unique_lock lock(_mutex);
+    Unref(Find(entry.code), refs);
+  }
+
+ private:
+  struct Region {
+    CodeRegion code;
+    size_t refs = 0;
+    // The keys of the functions in `_code` that this region holds.
+    std::vector<std::string> keys;
+  };
+
+  // The region that holds `code`, if any.
+  std::map<uintptr_t, Region>::iterator Find(void* code) {
+    auto address = uintptr_t(code);
+    auto it = _regions.upper_bound(address);
+    if (it == _regions.begin()) {
+      return _regions.end();
+    }
+    --it;
+    if (address >= it->first + it->second.code.size) {
+      return _regions.end();
+    }
+    return it;
+  }
+
+  // Drop `refs` references to a region, freeing it once it's unused.
+  void Unref(std::map<uintptr_t, Region>::iterator it, size_t refs) {
+    it->second.refs -= refs;
+    if (it->second.refs > 0) {
+      return;
+    }
+    for (const auto& key : it->second.keys) {
+      _code.erase(key);
+    }
+    ReleaseCodeRegion(it->second.code);
+    _regions.erase(it);
+  }
+
+  std::mutex _mutex;
+  absl::flat_hash_map<std::string, Entry> _code;
+  // By start address.
+  std::map<uintptr_t, Region> _regions;
+};
+
+// Compiles with the baseline compiler `T`, or for the optimizing tier with `O`
+// if the target has one, which compiles from SSA form.
+template <typename T, typename O = void>
+class CompilerImpl : public Compiler {
+ public:
+  CompilerImpl(CodeTarget target, CompilerOptions options)
+      : _target(std::move(target)), _env(_target.arch), _options(options) {
+    for (uint32_t feature : _target.cpu_features) {
+      _features.add(feature);
     }
-    func_compiler.Epilogue();
-    void* compiled = nullptr;
-    Check(_runtime.add(&compiled, &_code_holder));
-    std::cout << logger.data() << std::endl;
-    co_return CompiledFunction(compiled, std::move(func.meta));
   }
 
   co::Future<CompiledModule> Compile(ParsedModule parsed) override {
-    CompiledModule compiled{.exported_functions = parsed.exported_functions};
-    compiled.functions.reserve(parsed.functions.size());
-    for (auto& func : parsed.functions) {
-      compiled.functions.push_back(co_await Compile(std::move(func)));
+    Plan plan = MakePlan(parsed);
+    if (!_options.fold_identical_functions) {
+      co_return LoadArtifact(co_await Build(std::move(parsed), plan));
     }
+    // Reuse the code of functions that another module already loaded, rather
+    // than compiling them again.
+    size_t num_functions = parsed.functions.size();
+    std::vector<size_t> refs(num_functions);
+    for (size_t source : plan.sources) {
+      if (source != kNone) {
+        ++refs[source];
+      }
+    }
+    std::vector<SharedCode::Entry> shared(num_functions);
+    for (size_t i = 0; i < num_functions; ++i) {
+      size_t source = plan.sources[i];
+      if (source == i) {
+        shared[i] = _shared.Acquire(plan.keys[i], refs[i]);
+      } else if (source != kNone) {
+        shared[i] = shared[source];
+      }
+      if (shared[i].code != nullptr) {
+        plan.sources[i] = kNone;
+        plan.keys[i].clear();
+      }
+    }
+    CompiledModule compiled;
+    try {
+      compiled = LoadArtifact(co_await Build(std::move(parsed), plan));
+    } catch (...) {
+      // The references were taken by each function that others fold into.
+      for (size_t i = 0; i < num_functions; ++i) {
+        if (shared[i].code != nullptr && refs[i] > 0) {
+          _shared.Drop(shared[i], refs[i]);
+        }
+      }
+      throw;
+    }
+    for (size_t i = 0; i < num_functions; ++i) {
+      if (shared[i].code != nullptr) {
+        compiled.functions[i] =
+            CompiledFunction(shared[i].code, compiled.functions[i].metadata(),
+                             shared[i].frame_size_bytes);
+      }
+    }
+    _shared.Add(compiled, std::move(plan.keys));
     co_return std::move(compiled);
   }
 
-  void Release(const CompiledFunction& compiled) {
-    _runtime.release(compiled.get());
+  co::Future<CompiledArtifact> CompileArtifact(ParsedModule parsed) override {
+    Plan plan = MakePlan(parsed);
+    co_return co_await Build(std::move(parsed), plan);
   }
 
   co::Future<> Release(CompiledModule compiled) override {
-    for (const auto& func : compiled.functions) {
-      Release(func);
-      co_await co::MaybeYield();
+    if (!_options.fold_identical_functions || !_shared.Release(compiled)) {
+      ReleaseCodeRegion(compiled.code);
     }
+    co_return;
   }
 
+  const CompilerOptions& options() const override { return _options; }
+
  private:
-  asmjit::JitRuntime _runtime;
-  asmjit::CodeHolder _code_holder;
+  Plan MakePlan(const ParsedModule& parsed) const {
+    size_t num_functions = parsed.functions.size();
+    std::vector<bool> live(num_functions, true);
+    if (_options.eliminate_dead_functions) {
+      live = ReachableFunctions(parsed);
+    }
+    Plan plan;
+    plan.sources.resize(num_functions, kNone);
+    plan.keys.resize(num_functions);
+    absl::flat_hash_map<std::string_view, size_t> first;
+    for (size_t i = 0; i < num_functions; ++i) {
+      const auto& func = parsed.functions[i];
+      if (!live[i]) {
+        plan.dead_code_bytes += func.body.size_bytes();
+        continue;
+      }
+      if (!_options.fold_identical_functions) {
+        plan.sources[i] = i;
+        continue;
+      }
+      plan.keys[i] = FunctionKey(func);
+      auto [it, inserted] = first.emplace(plan.keys[i], i);
+      plan.sources[i] = it->second;
+      if (!inserted) {
+        plan.keys[i].clear();
+      }
+    }
+    return plan;
+  }
+
+  // Compile the functions that `plan` says to into an artifact.
+  co::Future<CompiledArtifact> Build(ParsedModule parsed, const Plan& plan) {
+    const auto& sources = plan.sources;
+    // Each function is compiled into its own code buffer, so that they can be
+    // compiled independently, and then linked together.
+    std::vector<asmjit::CodeHolder> code(parsed.functions.size());
+    std::vector<uint32_t> frame_sizes(code.size());
+    ThreadPool* pool = _options.pool;
+    if (pool != nullptr && pool->size() > 1) {
+      pool->ParallelFor(
+          code.size(),
+          [this, &parsed, &sources, &code, &frame_sizes](size_t i) {
+            if (sources[i] == i) {
+              frame_sizes[i] = Compile(parsed.functions[i], &code[i]);
+            }
+          });
+    } else {
+      for (size_t i = 0; i < code.size(); ++i) {
+        if (sources[i] == i) {
+          frame_sizes[i] = Compile(parsed.functions[i], &code[i]);
+          co_await co::MaybeYield();
+        }
+      }
+    }
+    CompiledArtifact artifact{
+        .target = _target,
+        .tier = _options.tier,
+        .eliminate_dead_functions = _options.eliminate_dead_functions,
+        .exported_functions = std::move(parsed.exported_functions),
+        .dead_code_bytes = plan.dead_code_bytes,
+    };
+    Link(LayoutOrder(parsed, sources), &code, &artifact);
+    for (size_t i = 0; i < sources.size(); ++i) {
+      if (sources[i] != kNone && sources[i] != i) {
+        artifact.offsets[i] = artifact.offsets[sources[i]];
+        frame_sizes[i] = frame_sizes[sources[i]];
+      }
+    }
+    artifact.frame_sizes = std::move(frame_sizes);
+    artifact.metadata.reserve(parsed.functions.size());
+    for (auto& func : parsed.functions) {
+      artifact.metadata.push_back(std::move(func.meta));
+    }
+    co_return std::move(artifact);
+  }
+
+  // Only touches `code`, so is safe to run on many threads at once. Returns
+  // the size of the function's frame.
+  uint32_t Compile(const Function& func, asmjit::CodeHolder* code) const {
+    Check(code->init(_env, _features));
+    if (_options.tier == Tier::kOptimized) {
+      if constexpr (!std::is_void_v<O>) {
+        if (ssa::CanBuild(func.meta)) {
+          auto ssa_func = ssa::Build(func);
+          ssa::Optimize(&ssa_func);
+          O func_compiler(ssa_func, code);
+          func_compiler.Compile();
+          return func_compiler.frame_size_bytes();
+        }
+      }
+    }
+    T func_compiler(func.meta, code);
+    func_compiler.Prologue();
+    if (_options.tier == Tier::kOptimized) {
+      Dispatch(Optimize(func), &func_compiler);
+    } else {
+      Dispatch(func.body, &func_compiler);
+    }
+    func_compiler.Epilogue();
+    return func_compiler.frame_size_bytes();
+  }
+
+  // Copy the functions in `order` into the artifact's code, recording where
+  // each function ended up, and that the rest have no code. Code is relocated
+  // as if the artifact starts at address zero, which doesn't matter as there
+  // are no absolute addresses.
+  static void Link(std::span<const size_t> order,
+                   std::vector<asmjit::CodeHolder>* code,
+                   CompiledArtifact* artifact) {
+    artifact->offsets.assign(code->size(), CompiledArtifact::kNoCode);
+    size_t size = 0;
+    for (size_t i : order) {
+      auto& holder = (*code)[i];
+      Check(holder.flatten());
+      Check(holder.resolveUnresolvedLinks());
+      size = AlignUp(size, kFunctionAlignment);
+      artifact->offsets[i] = uint32_t(size);
+      size += holder.codeSize();
+    }
+    artifact->code.resize(size);
+    for (size_t i : order) {
+      auto& holder = (*code)[i];
+      uint32_t offset = artifact->offsets[i];
+      Check(holder.relocateToBase(offset));
+      // NOLINTNEXTLINE(*-pointer-arithmetic)
+      Check(holder.copyFlattenedData(artifact->code.data() + offset,
+                                     holder.codeSize()));
+    }
+  }
+
+  CodeTarget _target;
+  asmjit::Environment _env;
+  asmjit::CpuFeatures _features;
+  CompilerOptions _options;
+  SharedCode _shared;
 };
 }  // namespace
 
-std::unique_ptr<Compiler> Compiler::CreateNative() {
-  auto env = asmjit::Environment::host();
+std::unique_ptr<Compiler> Compiler::CreateNative(CompilerOptions options) {
+  return CreateForTarget(CodeTarget::Host(), options);
+}
+
+std::unique_ptr<Compiler> Compiler::CreateForTarget(CodeTarget target,
+                                                    CompilerOptions options) {
   std::string_view unsupported_arch;
-  switch (env.arch()) {
+  switch (target.arch) {
     case asmjit::Arch::kX64:
-      return std::make_unique<CompilerImpl<x64::Compiler>>();
+      return std::make_unique<
+          CompilerImpl<x64::Compiler, x64::OptimizingCompiler>>(
+          std::move(target), options);
     case asmjit::Arch::kAArch64:
-      return std::make_unique<CompilerImpl<arm64::Compiler>>();
+      return std::make_unique<CompilerImpl<arm64::Compiler>>(
+          std::move(target), options);
     case asmjit::Arch::kX86:
       unsupported_arch = "x86";
       break;
@@ -1,23 +1,67 @@
+#include <cstdint>
 #include <memory>
 #include <random>
 
 #include "base/coro.h"
+#include "base/thread_pool.h"
+#include "compiler/code_target.h"
 #include "compiler/module.h"
+#include "compiler/tier.h"
 #include "core/ast.h"
 
 #pragma once
 
 namespace wasmcc {
 
+struct CompilerOptions {
+  Tier tier = Tier::kBaseline;
+  /**
+   * If set, function bodies are compiled in parallel on this pool, each into
+   * its own code buffer, and then linked together. The resulting code is
+   * identical to compiling serially.
+   */
+  ThreadPool* pool = nullptr;
+  /**
+   * If set, functions that can never run (see `ReachableFunctions`) are
+   * validated by the parser as usual, but aren't compiled, and have no code.
+   * The size of their bodies is reported in `dead_code_bytes`.
+   */
+  bool eliminate_dead_functions = false;
+  /**
+   * If set, functions with the same signature, locals and body are only
+   * compiled once, and share the same code. Within a module this applies to
+   * `CompileArtifact` too, while `Compile` also shares code with every module
+   * the compiler has loaded and not yet released, so a module's functions may
+   * run code outside of its own `CompiledModule::code`. Shared code is freed
+   * once every module using it has been released.
+   */
+  bool fold_identical_functions = false;
+};
+
 /**
  * An abstract class that converts our IR into machine code.
+ *
+ * Compilers are safe to use from multiple threads at once.
  */
 class Compiler {
  public:
   /**
    * Create a compiler using a FunctionCompiler for the current platform.
    */
-  static std::unique_ptr<Compiler> CreateNative();
+  static std::unique_ptr<Compiler> CreateNative(CompilerOptions = {});
+
+  /**
+   * Create a compiler that generates code for `target`, which doesn't have to
+   * be this machine, for ahead of time compilation with `CompileArtifact`.
+   */
+  static std::unique_ptr<Compiler> CreateForTarget(CodeTarget,
+                                                   CompilerOptions = {});
+
+  /**
+   * Identifies the code that the compilers generate, which must be bumped
+   * whenever it changes so that previously cached code is not reused.
+   */
+  static constexpr uint32_t kVersion = 2;
 
   Compiler() = default;
   Compiler(const Compiler&) = delete;
@@ -27,17 +71,28 @@ class Compiler {
   virtual ~Compiler() = default;
 
   /**
-   * Compile all parsed functions into machine code for a target architecture.
+   * Compile all parsed functions into machine code, and load it so that it can
+   * be run, which requires the compiler's target to be this machine.
    *
-   * NOTE: A compiled function's lifetime is currently managed by the compiler
-   * that created it, but the memory management may change in the future.
+   * The code for every function is placed in a single region of memory,
+   * `CompiledModule::code`, which lives until the module is released (unless
+   * `fold_identical_functions` is set).
    */
   virtual co::Future<CompiledModule> Compile(ParsedModule) = 0;
 
+  /**
+   * Compile all parsed functions into machine code for the compiler's target,
+   * without loading it.
+   */
+  virtual co::Future<CompiledArtifact> CompileArtifact(ParsedModule) = 0;
+
   /**
    * Free the memory associated with all compiled functions in a module.
    */
   virtual co::Future<> Release(CompiledModule) = 0;
+
+  /** The options that the compiler compiles with. */
+  virtual const CompilerOptions& options() const = 0;
 };
 
 }  // namespace wasmcc
@@ -0,0 +1,325 @@
+#include <benchmark/benchmark.h>
+
+#include <asmjit/asmjit.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/byte_cursor.h"
+#include "base/thread_pool.h"
+#include "compiler/arm64/compiler.h"
+#include "compiler/common/util.h"
+#include "compiler/compiler.h"
+#include "compiler/lazy_module.h"
+#include "compiler/ssa/builder.h"
+#include "compiler/ssa/passes.h"
+#include "compiler/x64/compiler.h"
+#include "compiler/x64/optimizing_compiler.h"
+#include "core/ast.h"
+#include "core/instruction.h"
+#include "parser/parser.h"
+#include "testing/asm.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+// A loop that keeps a counter and an accumulator in locals.
+constexpr std::string_view kKernel = R"WAT(
+(module
+  (func $kernel (param $n i32) (result i32) (local $i i32) (local $acc i32)
+    block
+      loop
+        local.get $i
+        local.get $n
+        i32.ge_s
+        br_if 1
+        local.get $acc
+        local.get $i
+        i32.add
+        local.set $acc
+        local.get $i
+        i32.const 1
+        i32.add
+        local.set $i
+        br 0
+      end
+    end
+    local.get $acc)
+  (export "kernel" (func $kernel)))
+)WAT";
+
+ParsedModule ParseKernelModule() {
+  bytes wasm = Wat2Wasm(kKernel);
+  ByteCursor cursor(wasm);
+  return ParseModule(&cursor).get();
+}
+
+Function ParseKernel() {
+  return std::move(ParseKernelModule().functions.front());
+}
+
+// Pushes `depth` copies of a parameter, then adds them all together, so that
+// the stack gets deeper than there are registers.
+Function DeepStack(int depth) {
+  Function func;
+  func.meta = {
+      .signature = {.parameter_types = {ValType::kI32},
+                    .result_types = {ValType::kI32}},
+      .max_stack_size_bytes = uint32_t(depth) * 4,
+      .max_stack_elements = uint32_t(depth),
+  };
+  for (int i = 0; i < depth; ++i) {
+    func.body.Append(op::GetLocalI32(0));
+  }
+  for (int i = 1; i < depth; ++i) {
+    func.body.Append(op::AddI32());
+  }
+  return func;
+}
+
+// Returns the number of values spilled.
+template <typename C>
+size_t Compile(asmjit::Arch arch, const Function& func,
+               asmjit::Logger* logger = nullptr) {
+  asmjit::CodeHolder holder;
+  Check(holder.init(asmjit::Environment(arch)));
+  C compiler(func.meta, &holder);
+  if (logger != nullptr) {
+    compiler.SetLogger(logger);
+  }
+  compiler.Prologue();
+  Dispatch(func.body, &compiler);
+  compiler.Epilogue();
+  return compiler.num_spills();
+}
+
+// Compiles the kernel, and reports the number of memory accesses in the
+// generated code. With `registers` set to 0 all locals are kept in memory.
+template <typename C, asmjit::Arch kArch>
+void BM_CompileKernel(benchmark::State& state) {
+  static const Function kFunction = ParseKernel();
+  Function func = kFunction;
+  if (state.range(0) == 0) {
+    func.meta.local_uses.clear();
+  }
+  for (auto _ : state) {
+    Compile<C>(kArch, func);
+  }
+  asmjit::StringLogger logger;
+  Compile<C>(kArch, func, &logger);
+  auto accesses = CountMemoryAccesses(logger.data());
+  state.counters["loads"] = accesses.loads;
+  state.counters["stores"] = accesses.stores;
+}
+BENCHMARK(BM_CompileKernel<x64::Compiler, asmjit::Arch::kX64>)
+    ->ArgName("registers")
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK(BM_CompileKernel<arm64::Compiler, asmjit::Arch::kAArch64>)
+    ->ArgName("registers")
+    ->Arg(0)
+    ->Arg(1);
+
+// Compiles the kernel for x64 with the optimizing tier's SSA backend, and
+// reports the number of memory accesses in the generated code, to compare
+// with the baseline compiler above.
+void BM_CompileKernelOptimized(benchmark::State& state) {
+  static const Function kFunction = ParseKernel();
+  auto compile = [](asmjit::Logger* logger) {
+    auto func = ssa::Build(kFunction);
+    ssa::Optimize(&func);
+    asmjit::CodeHolder holder;
+    Check(holder.init(asmjit::Environment(asmjit::Arch::kX64)));
+    x64::OptimizingCompiler compiler(func, &holder);
+    if (logger != nullptr) {
+      compiler.SetLogger(logger);
+    }
+    compiler.Compile();
+  };
+  for (auto _ : state) {
+    compile(nullptr);
+  }
+  asmjit::StringLogger logger;
+  compile(&logger);
+  auto accesses = CountMemoryAccesses(logger.data());
+  state.counters["loads"] = accesses.loads;
+  state.counters["stores"] = accesses.stores;
+}
+BENCHMARK(BM_CompileKernelOptimized);
+
+// Runs the kernel for `n` iterations after compiling it for the host with
+// each tier.
+template <Tier kTier>
+void BM_RunKernel(benchmark::State& state) {
+  static const ParsedModule kModule = ParseKernelModule();
+  auto compiler = Compiler::CreateNative({.tier = kTier});
+  auto compiled = compiler->Compile(kModule).get();
+  auto& kernel = compiled.functions.front();
+  auto n = int32_t(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(kernel.invoke<int32_t>(n));
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+  compiler->Release(std::move(compiled)).get();
+}
+BENCHMARK(BM_RunKernel<Tier::kBaseline>)
+    ->ArgName("n")
+    ->Arg(1000)
+    ->Arg(100000);
+BENCHMARK(BM_RunKernel<Tier::kOptimized>)
+    ->ArgName("n")
+    ->Arg(1000)
+    ->Arg(100000);
+
+// Compiles a function whose stack is `depth` values deep, and reports how many
+// values are spilled and the number of memory accesses in the generated code.
+template <typename C, asmjit::Arch kArch>
+void BM_CompileDeepStack(benchmark::State& state) {
+  Function func = DeepStack(int(state.range(0)));
+  for (auto _ : state) {
+    Compile<C>(kArch, func);
+  }
+  asmjit::StringLogger logger;
+  state.counters["spills"] = double(Compile<C>(kArch, func, &logger));
+  auto accesses = CountMemoryAccesses(logger.data());
+  state.counters["loads"] = accesses.loads;
+  state.counters["stores"] = accesses.stores;
+}
+BENCHMARK(BM_CompileDeepStack<x64::Compiler, asmjit::Arch::kX64>)
+    ->ArgName("depth")
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128);
+BENCHMARK(BM_CompileDeepStack<arm64::Compiler, asmjit::Arch::kAArch64>)
+    ->ArgName("depth")
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128);
+
+constexpr int kNumFunctions = 10000;
+
+// A module of many copies of the kernel, where only the first is exported.
+ParsedModule ParseLargeModule() {
+  std::string wat = "(module\n";
+  // Just the body of the function, as the function names must be unique.
+  std::string_view kernel = kKernel;
+  kernel = kernel.substr(kernel.find("(param"));
+  kernel = kernel.substr(0, kernel.find("(export"));
+  for (int i = 0; i < kNumFunctions; ++i) {
+    wat += "(func ";
+    wat += kernel;
+  }
+  wat += R"WAT((export "kernel" (func 0))))WAT";
+  bytes wasm = Wat2Wasm(wat);
+  ByteCursor cursor(wasm);
+  return ParseModule(&cursor).get();
+}
+
+// Compiles a large module for the host on a pool of `threads`, and reports
+// the size of the module's code region.
+void BM_CompileModule(benchmark::State& state) {
+  static const ParsedModule kModule = ParseLargeModule();
+  ThreadPool pool(state.range(0));
+  auto compiler = Compiler::CreateNative({.pool = &pool});
+  size_t code_bytes = 0;
+  for (auto _ : state) {
+    auto compiled = compiler->Compile(kModule).get();
+    code_bytes = compiled.code.size;
+    compiler->Release(std::move(compiled)).get();
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * kNumFunctions);
+  state.counters["code_bytes"] = double(code_bytes);
+}
+BENCHMARK(BM_CompileModule)
+    ->ArgName("threads")
+    ->DenseRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Modules built from the same code, which each have the same functions apart
+// from one that is unique to the module.
+std::vector<ParsedModule> SimilarModules(int n) {
+  ParsedModule common;
+  common.functions.push_back(ParseKernel());
+  for (int depth = 1; depth <= 100; ++depth) {
+    common.functions.push_back(DeepStack(depth));
+  }
+  std::vector<ParsedModule> modules(n, common);
+  for (int i = 0; i < n; ++i) {
+    modules[i].functions.push_back(Function{
+        .meta = {.signature = {.result_types = {ValType::kI32}},
+                 .max_stack_size_bytes = 4,
+                 .max_stack_elements = 1},
+        .body = InstructionBuffer::Of(op::ConstI32(i)),
+    });
+  }
+  return modules;
+}
+
+// Compiles a fleet of similar modules, keeping them all loaded at once, with
+// (`fold` = 1) or without identical functions being shared, and reports the
+// total size of their code regions.
+void BM_CompileSimilarModules(benchmark::State& state) {
+  static const std::vector<ParsedModule> kModules = SimilarModules(16);
+  auto compiler = Compiler::CreateNative({
+      .fold_identical_functions = state.range(0) != 0,
+  });
+  size_t code_bytes = 0;
+  for (auto _ : state) {
+    std::vector<CompiledModule> compiled;
+    for (const auto& module : kModules) {
+      compiled.push_back(compiler->Compile(module).get());
+    }
+    state.PauseTiming();
+    code_bytes = 0;
+    for (auto& module : compiled) {
+      code_bytes += module.code.size;
+      compiler->Release(std::move(module)).get();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) *
+                          int64_t(kModules.size()));
+  state.counters["code_bytes"] = double(code_bytes);
+}
+BENCHMARK(BM_CompileSimilarModules)
+    ->ArgName("fold")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+// The time from having a parsed large module to the result of calling one of
+// its functions, when the functions are compiled upfront (`lazy` = 0) or on
+// their first call.
+void BM_TimeToFirstCall(benchmark::State& state) {
+  static const ParsedModule kModule = ParseLargeModule();
+  auto compiler = Compiler::CreateNative();
+  bool lazy = state.range(0) != 0;
+  for (auto _ : state) {
+    if (lazy) {
+      auto module = LazyModule::Create(kModule, compiler.get());
+      auto kernel = module->module().functions.front();
+      benchmark::DoNotOptimize(kernel.invoke<int32_t>(100));
+      state.PauseTiming();
+      module.reset();
+      state.ResumeTiming();
+    } else {
+      auto compiled = compiler->Compile(kModule).get();
+      auto kernel = compiled.functions.front();
+      benchmark::DoNotOptimize(kernel.invoke<int32_t>(100));
+      state.PauseTiming();
+      compiler->Release(std::move(compiled)).get();
+      state.ResumeTiming();
+    }
+  }
+}
+BENCHMARK(BM_TimeToFirstCall)
+    ->ArgName("lazy")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace wasmcc
@@ -2,15 +2,25 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_format.h"
 #include "base/stream.h"
+#include "base/thread_pool.h"
+#include "compiler/code_target.h"
+#include "compiler/common/exception.h"
 #include "compiler/module.h"
+#include "core/instruction.h"
 #include "parser/parser.h"
 #include "testing/wat.h"
 
 namespace wasmcc {
 namespace {
 
-class CompilerTest : public ::testing::Test {
+// Every test runs against each tier, which must agree.
+class CompilerTest : public ::testing::TestWithParam<Tier> {
  public:
   CompiledModule Compile(std::string_view wat) {
     auto source = ByteStream(Wat2Wasm(wat));
@@ -18,12 +28,41 @@ class CompilerTest : public ::testing::Test {
     return _compiler->Compile(parsed).get();
   }
 
+  // Compile a module that exports a single function named "fn".
+  CompiledFunction CompileFn(std::string_view wat) {
+    auto compiled = Compile(wat);
+    auto func_idx = compiled.exported_functions[Name("fn")];
+    return compiled.functions[func_idx.value()];
+  }
+
  private:
-  std::unique_ptr<Compiler> _compiler = Compiler::CreateNative();
+  std::unique_ptr<Compiler> _compiler =
+      Compiler::CreateNative({.tier = GetParam()});
 };
+
+// A module with a single exported function that returns 42.
+ParsedModule ConstantModule() {
+  ParsedModule parsed;
+  parsed.functions.push_back(Function{
+      .meta = {.signature = {.result_types = {ValType::kI32}},
+               .max_stack_size_bytes = 4,
+               .max_stack_elements = 1},
+      .body = InstructionBuffer::Of(op::ConstI32(42)),
+  });
+  parsed.exported_functions.emplace(Name("fn"), FuncIdx(0));
+  return parsed;
+}
+
+CompiledArtifact CompileFor(asmjit::Arch arch) {
+  auto compiler = Compiler::CreateForTarget({.arch = arch});
+  return compiler->CompileArtifact(ConstantModule()).get();
+}
 }  // namespace
 
-TEST_F(CompilerTest, CanGenerateAddFn) {
+INSTANTIATE_TEST_SUITE_P(Tiers, CompilerTest,
+                         ::testing::Values(Tier::kBaseline, Tier::kOptimized));
+
+TEST_P(CompilerTest, CanGenerateAddFn) {
   auto compiled = Compile(R"WAT(
   (module
     (func $add (param $lhs i32) (param $rhs i32) (result i32)
@@ -37,4 +76,515 @@ TEST_F(CompilerTest, CanGenerateAddFn) {
   EXPECT_EQ(result, 3);
 }
 
+TEST_P(CompilerTest, IfElse) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $cond i32) (result i32)
+      local.get $cond
+      if (result i32)
+        i32.const 1
+      else
+        i32.const 2
+      end) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(1)), 1);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 2);
+}
+
+TEST_P(CompilerTest, IfWithoutElse) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $cond i32) (param $x i32) (result i32)
+      local.get $cond
+      if
+        local.get $x
+        i32.const 10
+        i32.add
+        local.set $x
+      end
+      local.get $x) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t, int32_t>(1, 5)), 15);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t, int32_t>(0, 5)), 5);
+}
+
+TEST_P(CompilerTest, BranchWithValue) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $cond i32) (result i32)
+      i32.const 100
+      block (result i32)
+        i32.const 7
+        local.get $cond
+        br_if 0
+        local.set $cond
+        i32.const 9
+      end
+      i32.add) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(1)), 107);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 109);
+}
+
+TEST_P(CompilerTest, Loop) {
+  // Sum the numbers from 1 to n
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $n i32) (result i32) (local $acc i32)
+      loop
+        local.get $acc
+        local.get $n
+        i32.add
+        local.set $acc
+        local.get $n
+        i32.const -1
+        i32.add
+        local.set $n
+        local.get $n
+        br_if 0
+      end
+      local.get $acc) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(1)), 1);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(10)), 55);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(1000)), 500500);
+}
+
+TEST_P(CompilerTest, CompareAndBranch) {
+  // Sum the numbers in [0, n)
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $n i32) (result i32) (local $i i32) (local $acc i32)
+      block
+        loop
+          local.get $i
+          local.get $n
+          i32.ge_s
+          br_if 1
+          local.get $acc
+          local.get $i
+          i32.add
+          local.set $acc
+          local.get $i
+          i32.const 1
+          i32.add
+          local.set $i
+          br 0
+        end
+      end
+      local.get $acc) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 0);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(-5)), 0);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(5)), 10);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(100)), 4950);
+}
+
+TEST_P(CompilerTest, CompareInIf) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $a i32) (param $b i32) (result i32)
+      local.get $a
+      local.get $b
+      i32.gt_u
+      i32.eqz
+      if (result i32)
+        local.get $b
+      else
+        local.get $a
+      end) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t, int32_t>(1, 2)), 2);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t, int32_t>(2, 1)), 2);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t, int32_t>(-1, 1)), -1);
+}
+
+TEST_P(CompilerTest, CompareResults) {
+  auto compiled = Compile(R"WAT(
+  (module
+    (func $lt_s (param $a i32) (param $b i32) (result i32)
+      local.get $a
+      local.get $b
+      i32.lt_s)
+    (func $lt_u (param $a i32) (param $b i32) (result i32)
+      local.get $a
+      local.get $b
+      i32.lt_u)
+    (func $eq_plus (param $a i32) (param $b i32) (result i32)
+      local.get $a
+      local.get $b
+      i32.eq
+      i32.const 10
+      i32.add)
+    (export "lt_s" (func $lt_s))
+    (export "lt_u" (func $lt_u))
+    (export "eq_plus" (func $eq_plus)))
+  )WAT");
+  auto fn = [&compiled](std::string_view name) {
+    auto func_idx = compiled.exported_functions[Name(std::string(name))];
+    return compiled.functions[func_idx.value()];
+  };
+  auto lt_s = fn("lt_s");
+  auto lt_u = fn("lt_u");
+  auto eq_plus = fn("eq_plus");
+  EXPECT_EQ((lt_s.invoke<int32_t, int32_t, int32_t>(-1, 1)), 1);
+  EXPECT_EQ((lt_u.invoke<int32_t, int32_t, int32_t>(-1, 1)), 0);
+  EXPECT_EQ((eq_plus.invoke<int32_t, int32_t, int32_t>(3, 3)), 11);
+  EXPECT_EQ((eq_plus.invoke<int32_t, int32_t, int32_t>(3, 4)), 10);
+}
+
+TEST_P(CompilerTest, BrTable) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $idx i32) (result i32)
+      block
+        block
+          block
+            local.get $idx
+            br_table 0 1 1 2
+          end
+          i32.const 10
+          return
+        end
+        i32.const 20
+        return
+      end
+      i32.const 30) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 10);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(1)), 20);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(2)), 20);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(3)), 30);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(4)), 30);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(-1)), 30);
+}
+
+TEST_P(CompilerTest, ReturnFromNestedBlock) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $x i32) (result i32)
+      i32.const 1
+      block
+        block
+          local.get $x
+          if
+            i32.const 5
+            return
+          end
+        end
+      end) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(1)), 5);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 1);
+}
+
+TEST_P(CompilerTest, ConstantOperands) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $x i32) (result i32)
+      i32.const 7
+      local.get $x
+      i32.add
+      i32.const -3
+      i32.add
+      local.set $x
+      i32.const 100
+      local.get $x
+      i32.lt_s
+      if (result i32)
+        local.get $x
+      else
+        i32.const 2
+        i32.const 3
+        i32.add
+      end) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 5);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(200)), 204);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(-10)), 5);
+}
+
+TEST_P(CompilerTest, LocalsInRegisters) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $n i32) (result i32) (local $i i32) (local $acc i32)
+      block
+        loop
+          local.get $i
+          local.get $n
+          i32.ge_s
+          br_if 1
+          local.get $acc
+          local.get $i
+          i32.add
+          local.set $acc
+          local.get $i
+          i32.const 1
+          i32.add
+          local.set $i
+          br 0
+        end
+      end
+      local.get $acc) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(0)), 0);
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(10)), 45);
+}
+
+TEST_P(CompilerTest, ManyParameters) {
+  // There are not enough registers to keep every parameter where it was
+  // passed in.
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param i32 i32 i32 i32 i32 i32) (result i32)
+      local.get 0
+      local.get 1
+      i32.add
+      local.get 2
+      i32.add
+      local.get 3
+      i32.add
+      local.get 4
+      i32.add
+      local.get 5
+      i32.add) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t, int32_t, int32_t, int32_t, int32_t,
+                       int32_t>(1, 2, 3, 4, 5, 6)),
+            21);
+}
+
+TEST_P(CompilerTest, ConstantControlFlow) {
+  auto fn = CompileFn(R"WAT(
+  (module
+    (func $fn (param $x i32) (result i32) (local $k i32)
+      i32.const 3
+      local.set $k
+      local.get $k
+      i32.const 3
+      i32.eq
+      if (result i32)
+        local.get $x
+        local.get $k
+        i32.add
+      else
+        unreachable
+      end
+      block
+        i32.const 1
+        br_if 0
+        unreachable
+      end) (export "fn" (func $fn)))
+  )WAT");
+  EXPECT_EQ((fn.invoke<int32_t, int32_t>(4)), 7);
+}
+
+TEST_P(CompilerTest, PacksModuleIntoOneRegion) {
+  auto compiled = Compile(R"WAT(
+  (module
+    (func $a (result i32) i32.const 1)
+    (func $b (result i32) i32.const 2)
+    (func $c (result i32) i32.const 3) (export "c" (func $c)))
+  )WAT");
+  auto* begin = static_cast<uint8_t*>(compiled.code.data);
+  auto* end = begin + compiled.code.size;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(begin) % 4096, 0);
+  for (const auto& fn : compiled.functions) {
+    auto* code = static_cast<uint8_t*>(fn.get());
+    EXPECT_GE(code, begin);
+    EXPECT_LT(code, end);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(code) % 64, 0);
+  }
+  // Exported functions come first.
+  EXPECT_EQ(compiled.functions[2].get(), compiled.code.data);
+  EXPECT_EQ(compiled.functions[2].invoke<int32_t>(), 3);
+}
+
+TEST(Compiler, CompilesInParallel) {
+  constexpr int kNumFunctions = 100;
+  std::string wat = "(module\n";
+  for (int i = 0; i < kNumFunctions; ++i) {
+    absl::StrAppendFormat(&wat,
+                          "(func $f%d (param i32) (result i32)\n"
+                          "  local.get 0 i32.const %d i32.add)\n"
+                          "(export \"f%d\" (func $f%d))\n",
+                          i, i, i, i);
+  }
+  wat += ")";
+  auto source = ByteStream(Wat2Wasm(wat));
+  auto parsed = ParseModule(&source).get();
+
+  ThreadPool pool(4);
+  auto compiler = Compiler::CreateNative({.pool = &pool});
+  // Compile the module from a few threads at once, which share the pool.
+  std::vector<CompiledModule> modules(3);
+  std::vector<std::thread> threads;
+  for (auto& module : modules) {
+    threads.emplace_back([&compiler, &parsed, &module] {
+      module = compiler->Compile(parsed).get();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& module : modules) {
+    for (int i = 0; i < kNumFunctions; ++i) {
+      auto idx = module.exported_functions[Name(absl::StrFormat("f%d", i))];
+      auto fn = module.functions[idx.value()];
+      EXPECT_EQ((fn.invoke<int32_t, int32_t>(1)), i + 1);
+    }
+    compiler->Release(std::move(module)).get();
+  }
+}
+
+TEST(Compiler, EliminatesDeadFunctions) {
+  auto source = ByteStream(Wat2Wasm(R"WAT(
+  (module
+    (func $a (result i32) i32.const 1)
+    (func $b (result i32) i32.const 2)
+    (func $c (result i32) i32.const 3) (export "b" (func $b)))
+  )WAT"));
+  auto parsed = ParseModule(&source).get();
+  auto compiler = Compiler::CreateNative({.eliminate_dead_functions = true});
+
+  auto artifact = compiler->CompileArtifact(parsed).get();
+  EXPECT_EQ(artifact.offsets,
+            (std::vector<uint32_t>{CompiledArtifact::kNoCode, 0,
+                                   CompiledArtifact::kNoCode}));
+  // Two `i32.const`s.
+  EXPECT_EQ(artifact.dead_code_bytes, 10);
+
+  auto compiled = LoadArtifact(std::move(artifact));
+  EXPECT_EQ(compiled.functions[0].get(), nullptr);
+  EXPECT_EQ(compiled.functions[1].invoke<int32_t>(), 2);
+  EXPECT_EQ(compiled.functions[2].get(), nullptr);
+  EXPECT_EQ(compiled.dead_code_bytes, 10);
+  compiler->Release(std::move(compiled)).get();
+}
+
+TEST(Compiler, FoldsIdenticalFunctions) {
+  auto source = ByteStream(Wat2Wasm(R"WAT(
+  (module
+    (func $a (param i32) (result i32) local.get 0 i32.const 1 i32.add)
+    (func $b (param i32) (result i32) local.get 0 i32.const 2 i32.add)
+    (func $c (param i32) (result i32) local.get 0 i32.const 1 i32.add))
+  )WAT"));
+  auto parsed = ParseModule(&source).get();
+  auto compiler = Compiler::CreateNative({.fold_identical_functions = true});
+
+  auto artifact = compiler->CompileArtifact(parsed).get();
+  EXPECT_EQ(artifact.offsets[0], artifact.offsets[2]);
+  EXPECT_NE(artifact.offsets[0], artifact.offsets[1]);
+
+  auto compiled = compiler->Compile(parsed).get();
+  EXPECT_EQ(compiled.functions[0].get(), compiled.functions[2].get());
+  EXPECT_EQ((compiled.functions[2].invoke<int32_t, int32_t>(1)), 2);
+  EXPECT_EQ((compiled.functions[1].invoke<int32_t, int32_t>(1)), 3);
+  compiler->Release(std::move(compiled)).get();
+}
+
+TEST(Compiler, SharesIdenticalFunctionsAcrossModules) {
+  auto parse = [](std::string_view wat) {
+    auto source = ByteStream(Wat2Wasm(wat));
+    return ParseModule(&source).get();
+  };
+  auto first = parse(R"WAT(
+  (module
+    (func (result i32) i32.const 1)
+    (func (result i32) i32.const 2))
+  )WAT");
+  auto second = parse(R"WAT(
+  (module
+    (func (result i32) i32.const 3)
+    (func (result i32) i32.const 1))
+  )WAT");
+  auto compiler = Compiler::CreateNative({.fold_identical_functions = true});
+
+  auto a = compiler->Compile(first).get();
+  auto b = compiler->Compile(second).get();
+  EXPECT_EQ(b.functions[1].get(), a.functions[0].get());
+  EXPECT_NE(b.functions[0].get(), a.functions[0].get());
+
+  // The shared code outlives the module that compiled it.
+  compiler->Release(std::move(a)).get();
+  EXPECT_EQ(b.functions[1].invoke<int32_t>(), 1);
+  EXPECT_EQ(b.functions[0].invoke<int32_t>(), 3);
+
+  // It is still shared with new modules while it's in use.
+  auto c = compiler->Compile(first).get();
+  EXPECT_EQ(c.functions[0].get(), b.functions[1].get());
+  EXPECT_EQ(c.functions[1].invoke<int32_t>(), 2);
+  compiler->Release(std::move(b)).get();
+  EXPECT_EQ(c.functions[0].invoke<int32_t>(), 1);
+  compiler->Release(std::move(c)).get();
+}
+
+TEST(Compiler, ReleasesSharedCodeWhenCompilingFails) {
+  auto parse = [](std::string_view wat) {
+    auto source = ByteStream(Wat2Wasm(wat));
+    return ParseModule(&source).get();
+  };
+  auto first = parse(R"WAT(
+  (module
+    (func (result i32) i32.const 1))
+  )WAT");
+  // Sharing the first function, but with too many results to return in
+  // registers on either x64 or arm64.
+  auto failing = parse(R"WAT(
+  (module
+    (func (result i32) i32.const 1)
+    (func (result i32 i32 i32 i32 i32 i32 i32 i32 i32)
+      i32.const 1 i32.const 2 i32.const 3 i32.const 4 i32.const 5
+      i32.const 6 i32.const 7 i32.const 8 i32.const 9))
+  )WAT");
+  auto compiler = Compiler::CreateNative({.fold_identical_functions = true});
+
+  auto a = compiler->Compile(first).get();
+  EXPECT_THROW(compiler->Compile(failing).get(), CompilationException);
+  compiler->Release(std::move(a)).get();
+
+  // Nothing holds on to the shared code anymore, so it's compiled again.
+  auto b = compiler->Compile(first).get();
+  auto* code = static_cast<uint8_t*>(b.code.data);
+  auto* function = static_cast<uint8_t*>(b.functions[0].get());
+  EXPECT_GE(function, code);
+  // NOLINTNEXTLINE(*-pointer-arithmetic)
+  EXPECT_LT(function, code + b.code.size);
+  EXPECT_EQ(b.functions[0].invoke<int32_t>(), 1);
+  compiler->Release(std::move(b)).get();
+}
+
+TEST(Compiler, CrossCompilesForX64) {
+  auto artifact = CompileFor(asmjit::Arch::kX64);
+  EXPECT_EQ(artifact.target.arch, asmjit::Arch::kX64);
+  EXPECT_EQ(artifact.offsets, std::vector<uint32_t>{0});
+  EXPECT_EQ(artifact.exported_functions[Name("fn")], FuncIdx(0));
+  EXPECT_EQ(artifact.code, (bytes{
+                               0x48, 0x83, 0xEC, 0x10,        // sub rsp, 16
+                               0xB8, 0x2A, 0x00, 0x00, 0x00,  // mov eax, 42
+                               0x48, 0x83, 0xC4, 0x10,        // add rsp, 16
+                               0xC3,                          // ret
+                           }));
+}
+
+TEST(Compiler, CrossCompilesForAArch64) {
+  auto artifact = CompileFor(asmjit::Arch::kAArch64);
+  EXPECT_EQ(artifact.target.arch, asmjit::Arch::kAArch64);
+  EXPECT_EQ(artifact.offsets, std::vector<uint32_t>{0});
+  EXPECT_EQ(artifact.exported_functions[Name("fn")], FuncIdx(0));
+  EXPECT_EQ(artifact.code, (bytes{
+                               0xFF, 0x43, 0x00, 0xD1,  // sub sp, sp, #16
+                               0x40, 0x05, 0x80, 0x52,  // mov w0, #42
+                               0xFF, 0x43, 0x00, 0x91,  // add sp, sp, #16
+                               0xC0, 0x03, 0x5F, 0xD6,  // ret
+                           }));
+}
+
+TEST(Compiler, RefusesToLoadCodeForAnotherMachine) {
+  auto host = CodeTarget::Host();
+  auto other = host.arch == asmjit::Arch::kX64 ? asmjit::Arch::kAArch64
+                                               : asmjit::Arch::kX64;
+  EXPECT_THROW(LoadArtifact(CompileFor(other)), CompilationException);
+}
+
 }  // namespace wasmcc
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "absl/functional/any_invocable.h"
+
+namespace wasmcc {
+
+/**
+ * Where calls to a function go, which can be pointed at new code at any time,
+ * even while the function is running, so that calls that start afterwards
+ * use the new code.
+ *
+ * Entries through the slot are counted, and `on_hot` is invoked (once, on the
+ * entering thread) when the count reaches `hot_threshold`. Counting stops
+ * there, and a threshold of zero never counts at all, so the count can't wrap
+ * around and make the function hot again.
+ *
+ * A slot can also start out without any code, like a call stub that resolves
+ * its target on first use, in which case entries call `resolve` until it has
+ * been patched.
+ */
+class DispatchSlot {
+ public:
+  DispatchSlot(void* code, uint32_t hot_threshold,
+               absl::AnyInvocable<void()> on_hot)
+      : _code(code),
+        _hot_threshold(hot_threshold),
+        _on_hot(std::move(on_hot)) {}
+  /**
+   * A slot for a function that has no code yet. `resolve` must have patched
+   * the slot by the time it returns (or throw), and may be called by several
+   * entering threads at once.
+   */
+  explicit DispatchSlot(absl::AnyInvocable<void() const> resolve)
+      : _code(nullptr),
+        _hot_threshold(0),
+        _on_hot([] {}),
+        _resolve(std::move(resolve)) {}
+  DispatchSlot(const DispatchSlot&) = delete;
+  DispatchSlot& operator=(const DispatchSlot&) = delete;
+  DispatchSlot(DispatchSlot&&) = delete;
+  DispatchSlot& operator=(DispatchSlot&&) = delete;
+  ~DispatchSlot() = default;
+
+  /** Count an entry into the function and return the code to call. */
+  void* Enter() {
+    // Threads racing past the threshold can overshoot it by one entry each,
+    // which is harmless as only the one that reaches it is hot.
+    if (_entries.load(std::memory_order_relaxed) < _hot_threshold &&
+        _entries.fetch_add(1, std::memory_order_relaxed) + 1 ==
+            _hot_threshold) {
+      _on_hot();
+    }
+    return Resolve();
+  }
+
+  /**
+   * The code to call, resolving it first if the slot has none yet, but
+   * without counting an entry.
+   */
+  void* Resolve() const {
+    void* code = this->code();
+    if (code == nullptr) [[unlikely]] {
+      _resolve();
+      code = this->code();
+    }
+    return code;
+  }
+
+  /** The code that calls currently go to, or null if it's not resolved yet. */
+  void* code() const { return _code.load(std::memory_order_acquire); }
+
+  /** Send all future calls to `code`, which must stay valid. */
+  void Patch(void* code) { _code.store(code, std::memory_order_release); }
+
+  /** The number of entries counted, which stops at the threshold. */
+  uint32_t entries() const { return _entries.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<void*> _code;
+  std::atomic<uint32_t> _entries = 0;
+  uint32_t _hot_threshold;
+  absl::AnyInvocable<void()> _on_hot;
+  absl::AnyInvocable<void() const> _resolve;
+};
+
+}  // namespace wasmcc
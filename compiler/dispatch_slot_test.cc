@@ -0,0 +1,53 @@
+#include "compiler/dispatch_slot.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+namespace wasmcc {
+namespace {
+
+int code = 0;
+
+}  // namespace
+
+TEST(DispatchSlot, BecomesHotOnce) {
+  int hot = 0;
+  DispatchSlot slot(&code, 3, [&hot] { ++hot; });
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(slot.Enter(), &code);
+  }
+  EXPECT_EQ(hot, 0);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(slot.Enter(), &code);
+  }
+  EXPECT_EQ(hot, 1);
+  // Counting stops once hot, so it can never wrap around to the threshold.
+  EXPECT_EQ(slot.entries(), 3);
+}
+
+TEST(DispatchSlot, NeverHotWithoutAThreshold) {
+  int hot = 0;
+  DispatchSlot slot(&code, 0, [&hot] { ++hot; });
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(slot.Enter(), &code);
+  }
+  EXPECT_EQ(hot, 0);
+  EXPECT_EQ(slot.entries(), 0);
+}
+
+TEST(DispatchSlot, ResolvesOnFirstEntry) {
+  int resolved = 0;
+  DispatchSlot* self = nullptr;
+  DispatchSlot slot([&resolved, &self] {
+    ++resolved;
+    self->Patch(&code);
+  });
+  self = &slot;
+  EXPECT_EQ(slot.code(), nullptr);
+  EXPECT_EQ(slot.Enter(), &code);
+  EXPECT_EQ(slot.Enter(), &code);
+  EXPECT_EQ(resolved, 1);
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,39 @@
+#include "compiler/lazy_module.h"
+
+#include <utility>
+
+namespace wasmcc {
+
+LazyModule::LazyModule(ParsedModule parsed, Compiler* compiler)
+    : _parsed(std::move(parsed)), _compiler(compiler) {}
+
+std::unique_ptr<LazyModule> LazyModule::Create(ParsedModule parsed,
+                                               Compiler* compiler) {
+  std::unique_ptr<LazyModule> lazy(
+      new LazyModule(std::move(parsed), compiler));
+  const auto& functions = lazy->_parsed.functions;
+  lazy->_module.functions.reserve(functions.size());
+  for (size_t i = 0; i < functions.size(); ++i) {
+    lazy->_compiling.emplace_back();
+    auto& slot = lazy->_slots.emplace_back(
+        [module = lazy.get(), i] { module->Compile(i); });
+    lazy->_module.functions.emplace_back(&slot, functions[i].meta);
+  }
+  lazy->_module.exported_functions = lazy->_parsed.exported_functions;
+  return lazy;
+}
+
+size_t LazyModule::num_compiled() const { return _compiler.size(); }
+
+void LazyModule::Compile(size_t idx) {
+  // Not `std::call_once`, which can't be retried after throwing with
+  // libstdc++.
+  std::unique_lock compiling(_compiling[idx]);
+  if (_slots[idx].code() != nullptr) {
+    // Another thread compiled it while this one waited.
+    return;
+  }
+  _slots[idx].Patch(_compiler.Compile(_parsed.functions[idx])->get());
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "compiler/compiler.h"
+#include "compiler/dispatch_slot.h"
+#include "compiler/module.h"
+#include "compiler/single_function_compiler.h"
+#include "core/ast.h"
+
+namespace wasmcc {
+
+/**
+ * A module whose functions are each compiled the first time they're called,
+ * so the cost of instantiating it scales with the code that actually runs
+ * rather than the size of the module.
+ *
+ * Every function is called through a `DispatchSlot` that starts out without
+ * any code. The first call compiles the function on the calling thread (once,
+ * with any other threads calling it at the same time waiting for it) and
+ * patches the slot, so later calls go straight to the code. If a function
+ * fails to compile, the call that compiled it throws `CompilationException`,
+ * and the next call tries again. A VM running the module compiles exported
+ * functions before switching to its own stack, so the exception reaches the
+ * caller there too.
+ *
+ * Each function is compiled into its own code region, which lives as long as
+ * the module does.
+ */
+class LazyModule {
+ public:
+  /**
+   * Get ready to compile `parsed` with `compiler`, which must outlive the
+   * module. Nothing is compiled yet.
+   */
+  static std::unique_ptr<LazyModule> Create(ParsedModule parsed,
+                                            Compiler* compiler);
+
+  LazyModule(const LazyModule&) = delete;
+  LazyModule& operator=(const LazyModule&) = delete;
+  LazyModule(LazyModule&&) = delete;
+  LazyModule& operator=(LazyModule&&) = delete;
+  ~LazyModule() = default;
+
+  /**
+   * The module to run, whose functions call through the dispatch slots. It is
+   * only valid while this module is alive.
+   */
+  const CompiledModule& module() const { return _module; }
+
+  /** The number of functions that have been compiled. */
+  size_t num_compiled() const;
+
+ private:
+  LazyModule(ParsedModule, Compiler*);
+
+  // Called by threads calling function `idx` before it has been compiled.
+  void Compile(size_t idx);
+
+  ParsedModule _parsed;
+  SingleFunctionCompiler _compiler;
+  // Stable, as the compiled functions point into them.
+  std::deque<DispatchSlot> _slots;
+  // Held while compiling each function.
+  std::deque<std::mutex> _compiling;
+  CompiledModule _module;
+};
+
+}  // namespace wasmcc
@@ -0,0 +1,133 @@
+#include "compiler/lazy_module.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "base/stream.h"
+#include "compiler/common/exception.h"
+#include "compiler/compiler.h"
+#include "parser/parser.h"
+#include "runtime/vm.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+constexpr std::string_view kModule = R"WAT(
+(module
+  (func $add (param $lhs i32) (param $rhs i32) (result i32)
+    local.get $lhs
+    local.get $rhs
+    i32.add)
+  (func $one (result i32) i32.const 1)
+  (func $unused (result i32) i32.const 2)
+  (export "add" (func $add))
+  (export "one" (func $one)))
+)WAT";
+
+ParsedModule Parse() {
+  auto source = ByteStream(Wat2Wasm(kModule));
+  return ParseModule(&source).get();
+}
+
+CompiledFunction Export(const LazyModule& lazy, std::string_view name) {
+  const auto& module = lazy.module();
+  auto idx = module.exported_functions.at(Name(std::string(name)));
+  return module.functions[idx.value()];
+}
+
+// A compiler that fails every time.
+class FailingCompiler final : public Compiler {
+ public:
+  co::Future<CompiledModule> Compile(ParsedModule) override {
+    ++attempts;
+    throw CompilationException("unsupported");
+  }
+  co::Future<CompiledArtifact> CompileArtifact(ParsedModule) override {
+    throw CompilationException("unsupported");
+  }
+  co::Future<> Release(CompiledModule) override { co_return; }
+  const CompilerOptions& options() const override { return _options; }
+
+  int attempts = 0;
+
+ private:
+  CompilerOptions _options;
+};
+
+}  // namespace
+
+TEST(LazyModule, CompilesOnFirstCall) {
+  auto compiler = Compiler::CreateNative();
+  auto lazy = LazyModule::Create(Parse(), compiler.get());
+  auto add = Export(*lazy, "add");
+  auto one = Export(*lazy, "one");
+  EXPECT_EQ(lazy->num_compiled(), 0);
+  EXPECT_EQ(add.get(), nullptr);
+
+  EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(2, 3)), 5);
+  EXPECT_EQ(lazy->num_compiled(), 1);
+  void* code = add.get();
+  EXPECT_NE(code, nullptr);
+  EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(4, 5)), 9);
+  EXPECT_EQ(add.get(), code);
+  EXPECT_EQ(lazy->num_compiled(), 1);
+
+  EXPECT_EQ(one.invoke<int32_t>(), 1);
+  EXPECT_EQ(lazy->num_compiled(), 2);
+}
+
+TEST(LazyModule, CompilesOnceWhenCalledConcurrently) {
+  auto compiler = Compiler::CreateNative();
+  auto lazy = LazyModule::Create(Parse(), compiler.get());
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&lazy, t] {
+      auto add = Export(*lazy, "add");
+      for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(
+            (add.invoke<int32_t, int32_t, int32_t>(int32_t(i), int32_t(t))),
+            i + t);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(lazy->num_compiled(), 1);
+}
+
+TEST(LazyModule, RetriesAfterFailing) {
+  FailingCompiler compiler;
+  auto lazy = LazyModule::Create(Parse(), &compiler);
+  auto one = Export(*lazy, "one");
+  EXPECT_THROW(one.invoke<int32_t>(), CompilationException);
+  EXPECT_THROW(one.invoke<int32_t>(), CompilationException);
+  EXPECT_EQ(compiler.attempts, 2);
+  EXPECT_EQ(lazy->num_compiled(), 0);
+}
+
+TEST(LazyModule, CompilesBeforeSwitchingToTheVMStack) {
+  auto compiler = Compiler::CreateNative();
+  auto lazy = LazyModule::Create(Parse(), compiler.get());
+  auto vm = VM::Create(lazy->module());
+  auto add = vm->LookupFunctionHandle<int (*)(int, int)>(Name("add"));
+  ASSERT_TRUE(add.has_value());
+  EXPECT_EQ(add->Call(2, 3), 5);
+  EXPECT_EQ(lazy->num_compiled(), 1);
+}
+
+TEST(LazyModule, ThrowsToTheVMCallerAfterFailing) {
+  FailingCompiler compiler;
+  auto lazy = LazyModule::Create(Parse(), &compiler);
+  auto vm = VM::Create(lazy->module());
+  auto one = vm->LookupFunctionHandle<int (*)()>(Name("one"));
+  ASSERT_TRUE(one.has_value());
+  EXPECT_THROW(one->Call(), CompilationException);
+  EXPECT_THROW(one->Call(), CompilationException);
+  EXPECT_EQ(compiler.attempts, 2);
+}
+
+}  // namespace wasmcc
@@ -1,11 +1,50 @@
 #include "compiler/module.h"
 
+#include <algorithm>
+
+#include "compiler/common/exception.h"
 #include "core/ast.h"
 
 namespace wasmcc {
-CompiledFunction::CompiledFunction(void* p, Function::Metadata m)
-    : _ptr(p), _meta(std::move(m)) {}
+CompiledFunction::CompiledFunction(void* p, Function::Metadata m,
+                                   uint32_t frame_size_bytes)
+    : _ptr(p), _meta(std::move(m)), _frame_size_bytes(frame_size_bytes) {}
+CompiledFunction::CompiledFunction(DispatchSlot* slot, Function::Metadata m)
+    : _slot(slot), _meta(std::move(m)) {}
 
-void* CompiledFunction::get() const { return _ptr; }
+void* CompiledFunction::get() const {
+  return _slot == nullptr ? _ptr : _slot->code();
+}
+void* CompiledFunction::Resolve() const {
+  return _slot == nullptr ? _ptr : _slot->Resolve();
+}
 const Function::Metadata& CompiledFunction::metadata() const { return _meta; }
+
+CompiledModule LoadArtifact(CompiledArtifact artifact) {
+  auto code = std::move(artifact.code);
+  return LoadArtifact(std::move(artifact), code);
+}
+
+CompiledModule LoadArtifact(CompiledArtifact artifact, bytes_view code) {
+  if (!artifact.target.CanRunOn(CodeTarget::Host())) {
+    throw CompilationException("compiled for a different machine");
+  }
+  CompiledModule compiled{
+      .exported_functions = std::move(artifact.exported_functions),
+      .code = AllocateCodeRegion(code.size()),
+      .dead_code_bytes = artifact.dead_code_bytes,
+  };
+  auto* base = static_cast<uint8_t*>(compiled.code.data);
+  std::ranges::copy(code, base);
+  MakeExecutable(compiled.code);
+  compiled.functions.reserve(artifact.offsets.size());
+  for (size_t i = 0; i < artifact.offsets.size(); ++i) {
+    uint32_t offset = artifact.offsets[i];
+    // NOLINTNEXTLINE(*-pointer-arithmetic)
+    void* code = offset == CompiledArtifact::kNoCode ? nullptr : base + offset;
+    compiled.functions.emplace_back(code, std::move(artifact.metadata[i]),
+                                    artifact.frame_sizes[i]);
+  }
+  return compiled;
+}
 }  // namespace wasmcc
@@ -1,10 +1,17 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "base/bytes.h"
+#include "compiler/code_region.h"
+#include "compiler/code_target.h"
+#include "compiler/dispatch_slot.h"
+#include "compiler/tier.h"
 #include "core/ast.h"
 
 namespace wasmcc {
@@ -13,34 +20,98 @@ namespace wasmcc {
  */
 class CompiledFunction {
  public:
-  CompiledFunction(void*, Function::Metadata);
+  // For code whose frame size isn't known.
+  static constexpr uint32_t kUnknownFrameSize = UINT32_MAX;
+
+  CompiledFunction(void*, Function::Metadata,
+                   uint32_t frame_size_bytes = kUnknownFrameSize);
+  // A function that is called through `slot`, which must outlive it.
+  CompiledFunction(DispatchSlot* slot, Function::Metadata);
 
   template <typename Fn, typename Args>
   decltype(auto) apply(Args&& args) {
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    auto typed_ptr = reinterpret_cast<Fn>(_ptr);
+    auto typed_ptr = reinterpret_cast<Fn>(Enter());
     return std::apply(typed_ptr, std::forward<Args>(args));
   }
 
   template <typename R, typename... A>
   R invoke(A&&... args) {
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    auto typed_ptr = reinterpret_cast<R (*)(A...)>(_ptr);
+    auto typed_ptr = reinterpret_cast<R (*)(A...)>(Enter());
     return std::invoke(typed_ptr, std::forward<A>(args)...);
   }
 
+  // The code that calls currently go to.
   void* get() const;
+  // Like `get`, but resolving the code of a dispatch slot that has none yet,
+  // which can throw.
+  void* Resolve() const;
 
   const Function::Metadata& metadata() const;
 
+  // The bytes the code reserves on the native stack below its return address,
+  // or `kUnknownFrameSize`.
+  uint32_t frame_size_bytes() const { return _frame_size_bytes; }
+
  private:
-  void* _ptr;
+  void* Enter() const { return _slot == nullptr ? _ptr : _slot->Enter(); }
+
+  void* _ptr = nullptr;
+  DispatchSlot* _slot = nullptr;
   Function::Metadata _meta;
+  uint32_t _frame_size_bytes = kUnknownFrameSize;
 };
 
 struct CompiledModule {
   std::vector<CompiledFunction> functions;
   absl::flat_hash_map<Name, FuncIdx> exported_functions;
+  // Holds the code for every function in the module, other than any it shares
+  // with other modules.
+  CodeRegion code;
+  // The size of the IR of functions that weren't compiled because they can
+  // never run, whose code is null.
+  size_t dead_code_bytes = 0;
 };
 
+/**
+ * A compiled module that has not been loaded into executable memory, so it can
+ * be for a different machine, or written to disk.
+ *
+ * The code is position independent, so it can be loaded at any address.
+ */
+struct CompiledArtifact {
+  CodeTarget target;
+  // How the code was compiled, as in `CompilerOptions`.
+  Tier tier = Tier::kBaseline;
+  bool eliminate_dead_functions = false;
+  // The code for every function, laid out as it is in memory once loaded.
+  bytes code;
+  // Where each function starts in `code`, or `kNoCode` for functions that
+  // weren't compiled.
+  std::vector<uint32_t> offsets;
+  // The frame size of each function, as in `CompiledFunction`, or zero for
+  // functions that weren't compiled.
+  std::vector<uint32_t> frame_sizes;
+  std::vector<Function::Metadata> metadata;
+  absl::flat_hash_map<Name, FuncIdx> exported_functions;
+  size_t dead_code_bytes = 0;
+
+  static constexpr uint32_t kNoCode = UINT32_MAX;
+};
+
+/**
+ * Copy an artifact's code into executable memory so that it can be run.
+ *
+ * Throws `CompilationException` if the artifact can't run on this machine.
+ */
+CompiledModule LoadArtifact(CompiledArtifact);
+
+/**
+ * Like `LoadArtifact`, but with the code kept outside of the artifact, such as
+ * in a mapped file, so that it is only copied once. The artifact's `code` is
+ * ignored.
+ */
+CompiledModule LoadArtifact(CompiledArtifact, bytes_view code);
+
 }  // namespace wasmcc
@@ -0,0 +1,285 @@
+#include "compiler/optimizer.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "core/value.h"
+
+namespace wasmcc {
+namespace {
+
+class Optimizer {
+ public:
+  explicit Optimizer(const Function& func)
+      : _locals(func.meta.signature.parameter_types.size() +
+                func.meta.locals.size()) {
+    // Locals that aren't parameters start out as zero.
+    for (size_t i = func.meta.signature.parameter_types.size();
+         i < _locals.size(); ++i) {
+      _locals[i] = 0;
+    }
+    _out.Reserve(func.body.size_bytes());
+  }
+
+  InstructionBuffer Finish() && {
+    Flush();
+    return std::move(_out);
+  }
+
+  void operator()(const op::ConstI32& op) {
+    if (_skip) {
+      return;
+    }
+    _pending.push_back(op.value.AsU32());
+  }
+  void operator()(const op::AddI32& op) {
+    if (_skip) {
+      return;
+    }
+    if (_pending.size() >= 2) {
+      uint32_t rhs = PopPending();
+      _pending.back() += rhs;
+      return;
+    }
+    Flush();
+    _out.Append(op);
+  }
+  void operator()(const op::EqzI32& op) {
+    if (_skip) {
+      return;
+    }
+    if (!_pending.empty()) {
+      _pending.back() = _pending.back() == 0 ? 1 : 0;
+      return;
+    }
+    _out.Append(op);
+  }
+  void operator()(const op::CompareI32& op) {
+    if (_skip) {
+      return;
+    }
+    if (_pending.size() >= 2) {
+      uint32_t rhs = PopPending();
+      _pending.back() = Evaluate(op.cond, _pending.back(), rhs) ? 1 : 0;
+      return;
+    }
+    Flush();
+    _out.Append(op);
+  }
+  void operator()(const op::GetLocalI32& op) {
+    if (_skip) {
+      return;
+    }
+    if (auto known = _locals[op.idx]) {
+      _pending.push_back(*known);
+      return;
+    }
+    Flush();
+    _out.Append(op);
+  }
+  void operator()(const op::SetLocalI32& op) {
+    if (_skip) {
+      return;
+    }
+    if (_pending.empty()) {
+      _locals[op.idx] = std::nullopt;
+      _out.Append(op);
+      return;
+    }
+    // The store still has to happen, but the value is known from here on.
+    uint32_t value = PopPending();
+    _locals[op.idx] = value;
+    _out.Append(op::ConstI32(value));
+    _out.Append(op);
+  }
+  void operator()(const op::Return& op) {
+    if (_skip) {
+      return;
+    }
+    Flush();
+    _out.Append(op);
+    SkipToEndOfFrame();
+  }
+  void operator()(const op::Unreachable& op) {
+    if (_skip) {
+      return;
+    }
+    Flush();
+    _out.Append(op);
+    SkipToEndOfFrame();
+  }
+  void operator()(const op::Block& op) {
+    if (EnterSkipped()) {
+      return;
+    }
+    Flush();
+    _control.push_back(Frame::kNormal);
+    _out.Append(op);
+  }
+  void operator()(const op::Loop& op) {
+    if (EnterSkipped()) {
+      return;
+    }
+    Flush();
+    // The loop can be branched back to with locals that have since changed.
+    Forget();
+    _control.push_back(Frame::kNormal);
+    _out.Append(op);
+  }
+  void operator()(const op::If& op) {
+    if (EnterSkipped()) {
+      return;
+    }
+    if (_pending.empty()) {
+      _control.push_back(Frame::kNormal);
+      _out.Append(op);
+      return;
+    }
+    bool taken = PopPending() != 0;
+    Flush();
+    // Only one arm can run, which is just a block (as branches to an `if` go
+    // to its end, the same as a block).
+    _control.push_back(taken ? Frame::kThenTaken : Frame::kElseTaken);
+    _out.Append(op::Block{.result = op.result});
+    if (!taken) {
+      SkipToEndOfFrame();
+    }
+  }
+  void operator()(const op::Else& op) {
+    if (_skip && _skip_depth > 0) {
+      return;
+    }
+    _skip = false;
+    Flush();
+    // The else arm starts from the locals as they were before the `if`, which
+    // are no longer known.
+    Forget();
+    switch (_control.back()) {
+      case Frame::kNormal:
+        _out.Append(op);
+        break;
+      case Frame::kThenTaken:
+        SkipToEndOfFrame();
+        break;
+      case Frame::kElseTaken:
+        break;
+    }
+  }
+  void operator()(const op::End& op) {
+    if (_skip && _skip_depth > 0) {
+      --_skip_depth;
+      return;
+    }
+    _skip = false;
+    Flush();
+    // Every branch to here merges, each with its own locals.
+    Forget();
+    _control.pop_back();
+    _out.Append(op);
+  }
+  void operator()(const op::Br& op) {
+    if (_skip) {
+      return;
+    }
+    Flush();
+    _out.Append(op);
+    SkipToEndOfFrame();
+  }
+  void operator()(const op::BrIf& op) {
+    if (_skip) {
+      return;
+    }
+    if (_pending.empty()) {
+      _out.Append(op);
+      return;
+    }
+    if (PopPending() == 0) {
+      return;
+    }
+    (*this)(op::Br{.depth = op.depth});
+  }
+  void operator()(const op::BrTable& op) {
+    if (_skip) {
+      return;
+    }
+    if (_pending.empty()) {
+      _out.Append(op);
+      SkipToEndOfFrame();
+      return;
+    }
+    uint32_t index = PopPending();
+    (*this)(op::Br{.depth = index < op.size() ? op.target(index)
+                                              : op.default_depth});
+  }
+
+ private:
+  // How a control frame was compiled.
+  enum class Frame : uint8_t {
+    kNormal,
+    // An `if` on a constant that was turned into a block of the arm taken.
+    kThenTaken,
+    kElseTaken,
+  };
+
+  uint32_t PopPending() {
+    uint32_t v = _pending.back();
+    _pending.pop_back();
+    return v;
+  }
+
+  // Emit the constants that are on the top of the stack.
+  void Flush() {
+    for (uint32_t v : _pending) {
+      _out.Append(op::ConstI32(v));
+    }
+    _pending.clear();
+  }
+
+  // Forget the values of all locals, where control flow merges.
+  void Forget() {
+    for (auto& local : _locals) {
+      local = std::nullopt;
+    }
+  }
+
+  // Nothing can run until the end of the current frame (or the start of its
+  // else arm).
+  void SkipToEndOfFrame() {
+    _pending.clear();
+    _skip = true;
+    _skip_depth = 0;
+  }
+
+  // Track entering a frame while skipping, so that its end doesn't end
+  // skipping, returning if the frame is skipped.
+  bool EnterSkipped() {
+    if (_skip) {
+      ++_skip_depth;
+    }
+    return _skip;
+  }
+
+  InstructionBuffer _out;
+  // The constants on the top of the stack, which haven't been emitted yet
+  // (bottom first), as they might be folded into the instructions that use
+  // them.
+  std::vector<uint32_t> _pending;
+  // The value of each local, if it's a known constant.
+  std::vector<std::optional<uint32_t>> _locals;
+  std::vector<Frame> _control;
+  // If the code being read can never run.
+  bool _skip = false;
+  // The number of frames entered since skipping started.
+  size_t _skip_depth = 0;
+};
+
+}  // namespace
+
+InstructionBuffer Optimize(const Function& func) {
+  Optimizer optimizer(func);
+  Dispatch(func.body, &optimizer);
+  return std::move(optimizer).Finish();
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "core/ast.h"
+#include "core/instruction.h"
+
+namespace wasmcc {
+
+/**
+ * Rewrite a function's body into one that computes the same thing with less
+ * work, for the optimizing tier, which can afford an extra pass over the IR.
+ *
+ * - Constants are propagated through locals and folded, so only the results
+ *   of arithmetic on constants remain.
+ * - Branches on a constant are resolved, so an `if` on a constant becomes a
+ *   `block` of the arm that is taken.
+ * - Code that can never run, such as the rest of a block after a branch, or
+ *   the arm of an `if` that isn't taken, is removed.
+ *
+ * The result needs no more stack than the original, so the function's
+ * metadata is still valid for it.
+ */
+InstructionBuffer Optimize(const Function&);
+
+}  // namespace wasmcc
@@ -0,0 +1,106 @@
+#include "compiler/optimizer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "core/instruction.h"
+#include "testing/functions.h"
+
+namespace wasmcc {
+namespace {
+
+std::vector<uint8_t> Encoded(const InstructionBuffer& buffer) {
+  return {buffer.begin(), buffer.end()};
+}
+
+void ExpectOptimizesTo(InstructionBuffer body, const InstructionBuffer& want) {
+  EXPECT_EQ(Encoded(Optimize(Fn(std::move(body), 1, 1))), Encoded(want));
+}
+
+}  // namespace
+
+TEST(Optimizer, FoldsConstants) {
+  ExpectOptimizesTo(InstructionBuffer::Of(op::ConstI32(1), op::ConstI32(2),
+                                          op::AddI32(), op::ConstI32(3),
+                                          op::CompareI32{Condition::kEq},
+                                          op::EqzI32()),
+                    InstructionBuffer::Of(op::ConstI32(0)));
+  // Only the constant part is folded.
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::GetLocalI32(0), op::ConstI32(1),
+                            op::ConstI32(2), op::AddI32(), op::AddI32()),
+      InstructionBuffer::Of(op::GetLocalI32(0), op::ConstI32(3),
+                            op::AddI32()));
+}
+
+TEST(Optimizer, PropagatesConstantsThroughLocals) {
+  // Locals start out as zero, parameters are unknown.
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::GetLocalI32(1), op::ConstI32(5), op::AddI32(),
+                            op::SetLocalI32(1), op::GetLocalI32(1),
+                            op::GetLocalI32(0), op::AddI32()),
+      InstructionBuffer::Of(op::ConstI32(5), op::SetLocalI32(1),
+                            op::ConstI32(5), op::GetLocalI32(0),
+                            op::AddI32()));
+}
+
+TEST(Optimizer, ForgetsLocalsInLoops) {
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::Loop{}, op::GetLocalI32(1), op::ConstI32(1),
+                            op::AddI32(), op::SetLocalI32(1), op::End(),
+                            op::GetLocalI32(1)),
+      InstructionBuffer::Of(op::Loop{}, op::GetLocalI32(1), op::ConstI32(1),
+                            op::AddI32(), op::SetLocalI32(1), op::End(),
+                            op::GetLocalI32(1)));
+}
+
+TEST(Optimizer, ResolvesIfOnAConstant) {
+  auto if_else = [](int32_t cond) {
+    return InstructionBuffer::Of(
+        op::ConstI32(cond), op::If{.result = ValType::kI32}, op::ConstI32(1),
+        op::Else(), op::ConstI32(2), op::End());
+  };
+  ExpectOptimizesTo(if_else(1),
+                    InstructionBuffer::Of(op::Block{.result = ValType::kI32},
+                                          op::ConstI32(1), op::End()));
+  ExpectOptimizesTo(if_else(0),
+                    InstructionBuffer::Of(op::Block{.result = ValType::kI32},
+                                          op::ConstI32(2), op::End()));
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::ConstI32(0), op::If{}, op::Unreachable(),
+                            op::End(), op::GetLocalI32(0)),
+      InstructionBuffer::Of(op::Block{}, op::End(), op::GetLocalI32(0)));
+}
+
+TEST(Optimizer, ResolvesBranchesOnAConstant) {
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::Block{}, op::ConstI32(0), op::BrIf{0},
+                            op::ConstI32(1), op::BrIf{0}, op::End(),
+                            op::GetLocalI32(0)),
+      InstructionBuffer::Of(op::Block{}, op::Br{0}, op::End(),
+                            op::GetLocalI32(0)));
+  auto packed = PackTargets({1, 0});
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(
+          op::Block{}, op::Block{}, op::ConstI32(1),
+          op::BrTable{.packed_targets = packed, .default_depth = 1}, op::End(),
+          op::End(), op::GetLocalI32(0)),
+      InstructionBuffer::Of(op::Block{}, op::Block{}, op::Br{0}, op::End(),
+                            op::End(), op::GetLocalI32(0)));
+}
+
+TEST(Optimizer, RemovesUnreachableCode) {
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::Block{}, op::Br{0}, op::GetLocalI32(0),
+                            op::Block{}, op::End(), op::SetLocalI32(1),
+                            op::End(), op::GetLocalI32(1)),
+      InstructionBuffer::Of(op::Block{}, op::Br{0}, op::End(),
+                            op::GetLocalI32(1)));
+  ExpectOptimizesTo(
+      InstructionBuffer::Of(op::GetLocalI32(0), op::Return(), op::ConstI32(1)),
+      InstructionBuffer::Of(op::GetLocalI32(0), op::Return()));
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,16 @@
+#include "compiler/reachability.h"
+
+namespace wasmcc {
+
+std::vector<bool> ReachableFunctions(const ParsedModule& parsed) {
+  std::vector<bool> reachable(parsed.functions.size());
+  for (const auto& [_, idx] : parsed.exported_functions) {
+    reachable[idx.value()] = true;
+  }
+  if (parsed.start_function) {
+    reachable[parsed.start_function->value()] = true;
+  }
+  return reachable;
+}
+
+}  // namespace wasmcc
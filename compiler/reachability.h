@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "core/ast.h"
+
+namespace wasmcc {
+
+/**
+ * Find which of a module's functions can ever run, indexed by function.
+ *
+ * A function is reachable if it is exported or is the start function. The IR
+ * has no calls, tables or `ref.func`, so there are no edges between functions
+ * to follow yet, and everything else is dead.
+ */
+std::vector<bool> ReachableFunctions(const ParsedModule&);
+
+}  // namespace wasmcc
@@ -0,0 +1,52 @@
+#include "compiler/reachability.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "base/stream.h"
+#include "parser/parser.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+ParsedModule Parse(std::string_view wat) {
+  auto source = ByteStream(Wat2Wasm(wat));
+  return ParseModule(&source).get();
+}
+
+using ::testing::ElementsAre;
+
+TEST(Reachability, ExportsAreReachable) {
+  auto parsed = Parse(R"WAT(
+  (module
+    (func $a (result i32) i32.const 1)
+    (func $b (result i32) i32.const 2)
+    (func $c (result i32) i32.const 3)
+    (export "c" (func $c))
+    (export "also_c" (func $c))
+    (export "a" (func $a)))
+  )WAT");
+  EXPECT_THAT(ReachableFunctions(parsed), ElementsAre(true, false, true));
+}
+
+TEST(Reachability, StartIsReachable) {
+  auto parsed = Parse(R"WAT(
+  (module
+    (func $a)
+    (func $b)
+    (start $b))
+  )WAT");
+  EXPECT_THAT(ReachableFunctions(parsed), ElementsAre(false, true));
+}
+
+TEST(Reachability, NothingIsReachableWithoutRoots) {
+  auto parsed = Parse(R"WAT(
+  (module
+    (func $a (result i32) i32.const 1))
+  )WAT");
+  EXPECT_THAT(ReachableFunctions(parsed), ElementsAre(false));
+}
+
+}  // namespace
+}  // namespace wasmcc
@@ -0,0 +1,38 @@
+#include "compiler/single_function_compiler.h"
+
+#include <utility>
+
+#include "compiler/common/exception.h"
+
+namespace wasmcc {
+
+SingleFunctionCompiler::~SingleFunctionCompiler() {
+  for (auto& compiled : _compiled) {
+    _compiler->Release(std::move(compiled)).get();
+  }
+}
+
+CompiledFunction* SingleFunctionCompiler::Compile(const Function& func) {
+  // Exported, so it isn't eliminated as dead code, which would leave nothing
+  // to call.
+  auto compiled = _compiler
+                      ->Compile(ParsedModule{
+                          .functions = {func},
+                          .exported_functions = {{Name("f"), FuncIdx(0)}},
+                      })
+                      .get();
+  if (compiled.functions.front().get() == nullptr) [[unlikely]] {
+    _compiler->Release(std::move(compiled)).get();
+    throw CompilationException("function compiled without any code");
+  }
+  std::unique_lock lock(_mutex);
+  _compiled.push_back(std::move(compiled));
+  return &_compiled.back().functions.front();
+}
+
+size_t SingleFunctionCompiler::size() const {
+  std::unique_lock lock(_mutex);
+  return _compiled.size();
+}
+
+}  // namespace wasmcc
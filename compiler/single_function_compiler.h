@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+#include "compiler/compiler.h"
+#include "compiler/module.h"
+#include "core/ast.h"
+
+namespace wasmcc {
+
+/**
+ * Compiles functions one at a time, each into a module of its own, for
+ * modules whose functions are compiled on demand rather than all upfront.
+ *
+ * The code lives as long as this does, so it can be patched into dispatch
+ * slots that calls might still be running through.
+ *
+ * This class is thread safe.
+ */
+class SingleFunctionCompiler {
+ public:
+  /** `compiler` must outlive this. */
+  explicit SingleFunctionCompiler(Compiler* compiler) : _compiler(compiler) {}
+  SingleFunctionCompiler(const SingleFunctionCompiler&) = delete;
+  SingleFunctionCompiler& operator=(const SingleFunctionCompiler&) = delete;
+  SingleFunctionCompiler(SingleFunctionCompiler&&) = delete;
+  SingleFunctionCompiler& operator=(SingleFunctionCompiler&&) = delete;
+  ~SingleFunctionCompiler();
+
+  /**
+   * Compile `func` on the calling thread, even if the compiler eliminates dead
+   * functions. Throws `CompilationException` if it can't be compiled.
+   */
+  CompiledFunction* Compile(const Function& func);
+
+  /** The number of functions that have been compiled. */
+  size_t size() const;
+
+ private:
+  Compiler* _compiler;
+  mutable std::mutex _mutex;
+  // Stable, as callers point into them.
+  std::deque<CompiledModule> _compiled;
+};
+
+}  // namespace wasmcc
@@ -0,0 +1,57 @@
+#include "compiler/single_function_compiler.h"
+
+#include <gtest/gtest.h>
+
+#include "base/stream.h"
+#include "compiler/common/exception.h"
+#include "compiler/compiler.h"
+#include "parser/parser.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+ParsedModule Parse() {
+  auto source = ByteStream(Wat2Wasm(R"WAT(
+  (module
+    (func (result i32) i32.const 1)
+    (func (result i32) i32.const 2)
+    (func (result i32 i32 i32 i32 i32 i32 i32 i32 i32)
+      i32.const 1 i32.const 2 i32.const 3 i32.const 4 i32.const 5
+      i32.const 6 i32.const 7 i32.const 8 i32.const 9))
+  )WAT"));
+  return ParseModule(&source).get();
+}
+
+}  // namespace
+
+TEST(SingleFunctionCompiler, CompilesEachFunctionOnItsOwn) {
+  auto parsed = Parse();
+  auto native = Compiler::CreateNative();
+  SingleFunctionCompiler compiler(native.get());
+  auto* one = compiler.Compile(parsed.functions[0]);
+  auto* two = compiler.Compile(parsed.functions[1]);
+  EXPECT_EQ(one->invoke<int32_t>(), 1);
+  EXPECT_EQ(two->invoke<int32_t>(), 2);
+  EXPECT_EQ(compiler.size(), 2);
+}
+
+TEST(SingleFunctionCompiler, CompilesWhenEliminatingDeadFunctions) {
+  auto parsed = Parse();
+  auto native = Compiler::CreateNative({.eliminate_dead_functions = true});
+  SingleFunctionCompiler compiler(native.get());
+  auto* one = compiler.Compile(parsed.functions[0]);
+  ASSERT_NE(one->get(), nullptr);
+  EXPECT_EQ(one->invoke<int32_t>(), 1);
+}
+
+TEST(SingleFunctionCompiler, KeepsNothingAfterFailing) {
+  auto parsed = Parse();
+  auto native = Compiler::CreateNative();
+  SingleFunctionCompiler compiler(native.get());
+  // Too many results to return in registers, on any target.
+  EXPECT_THROW(compiler.Compile(parsed.functions[2]), CompilationException);
+  EXPECT_EQ(compiler.size(), 0);
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,454 @@
+#include "compiler/ssa/builder.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "compiler/common/control_frame.h"
+#include "compiler/common/exception.h"
+#include "core/instruction.h"
+
+namespace wasmcc::ssa {
+
+bool CanBuild(const wasmcc::Function::Metadata& meta) {
+  auto is_i32 = [](ValType vt) { return vt == ValType::kI32; };
+  return std::ranges::all_of(meta.signature.parameter_types, is_i32) &&
+         std::ranges::all_of(meta.signature.result_types, is_i32) &&
+         std::ranges::all_of(meta.locals, is_i32);
+}
+
+namespace {
+
+class Builder {
+ public:
+  explicit Builder(const wasmcc::Function& func)
+      : _num_locals(func.meta.signature.parameter_types.size() +
+                    func.meta.locals.size()) {
+    _func.num_params = func.meta.signature.parameter_types.size();
+    _func.num_results = func.meta.signature.result_types.size();
+    _current = NewBlock();
+    Seal(_current);
+    for (size_t i = 0; i < _func.num_params; ++i) {
+      WriteLocal(i, _current, Emit({.op = Opcode::kParam, .imm = uint32_t(i)}));
+    }
+    if (_num_locals > _func.num_params) {
+      ValueId zero = Emit({.op = Opcode::kConst, .imm = 0});
+      for (size_t i = _func.num_params; i < _num_locals; ++i) {
+        WriteLocal(i, _current, zero);
+      }
+    }
+    _control.push_back({.kind = Frame::Kind::kFunction});
+  }
+
+  Function Finish() && {
+    if (_current != kNoBlock) {
+      SetExit({.kind = Exit::kReturn, .results = TopResults()});
+    }
+    for (auto& value : _func.values) {
+      for (auto& arg : value.args) {
+        arg = Resolve(arg);
+      }
+    }
+    for (auto& block : _func.blocks) {
+      std::erase_if(block.phis,
+                    [this](ValueId phi) { return _forward[phi] != kNoValue; });
+      if (block.exit.value != kNoValue) {
+        block.exit.value = Resolve(block.exit.value);
+      }
+      for (auto& result : block.exit.results) {
+        result = Resolve(result);
+      }
+    }
+    return std::move(_func);
+  }
+
+  void operator()(const op::ConstI32& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    Push(Emit({.op = Opcode::kConst, .imm = op.value.AsU32()}));
+  }
+  void operator()(const op::AddI32&) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    ValueId rhs = Pop();
+    ValueId lhs = Pop();
+    Push(Emit({.op = Opcode::kAdd, .args = {lhs, rhs}}));
+  }
+  void operator()(const op::EqzI32&) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    Push(Emit({.op = Opcode::kEqz, .args = {Pop()}}));
+  }
+  void operator()(const op::CompareI32& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    ValueId rhs = Pop();
+    ValueId lhs = Pop();
+    Push(Emit({.op = Opcode::kCompare, .cond = op.cond, .args = {lhs, rhs}}));
+  }
+  void operator()(const op::GetLocalI32& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    Push(ReadLocal(op.idx, _current));
+  }
+  void operator()(const op::SetLocalI32& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    WriteLocal(op.idx, _current, Pop());
+  }
+  void operator()(const op::Return&) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    SetExit({.kind = Exit::kReturn, .results = TopResults()});
+    _current = kNoBlock;
+  }
+  void operator()(const op::Unreachable&) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    SetExit({.kind = Exit::kTrap});
+    _current = kNoBlock;
+  }
+  void operator()(const op::Block& op) {
+    if (EnterSkipped()) {
+      return;
+    }
+    _control.push_back({
+        .kind = Frame::Kind::kBlock,
+        .target = NewBlock(),
+        .has_result = op.result.has_value(),
+        .height = _stack.size(),
+    });
+  }
+  void operator()(const op::Loop& op) {
+    if (EnterSkipped()) {
+      return;
+    }
+    BlockId header = NewBlock();
+    Jump(header);
+    _current = header;
+    _control.push_back({
+        .kind = Frame::Kind::kLoop,
+        .target = header,
+        .has_result = op.result.has_value(),
+        .height = _stack.size(),
+    });
+  }
+  void operator()(const op::If& op) {
+    if (EnterSkipped()) {
+      return;
+    }
+    ValueId cond = Pop();
+    BlockId then_block = NewBlock();
+    BlockId else_block = NewBlock();
+    SetExit({.kind = Exit::kBranch,
+             .value = cond,
+             .targets = {then_block, else_block}});
+    AddEdge(_current, then_block);
+    AddEdge(_current, else_block);
+    Seal(then_block);
+    Seal(else_block);
+    _current = then_block;
+    _control.push_back({
+        .kind = Frame::Kind::kIf,
+        .target = NewBlock(),
+        .else_block = else_block,
+        .has_result = op.result.has_value(),
+        .height = _stack.size(),
+    });
+  }
+  void operator()(const op::Else&) {
+    if (_skip_depth > 0) {
+      return;
+    }
+    auto& frame = _control.back();
+    if (_current != kNoBlock) {
+      Jump(EdgeTo(&frame));
+    }
+    _stack.resize(frame.height);
+    _current = std::exchange(frame.else_block, kNoBlock);
+  }
+  void operator()(const op::End&) {
+    if (_skip_depth > 0) {
+      --_skip_depth;
+      return;
+    }
+    Frame frame = std::move(_control.back());
+    _control.pop_back();
+    if (frame.kind == Frame::Kind::kLoop) {
+      // Branches to a loop go to its start, so the end is only reached by
+      // falling through, and every branch back has been seen.
+      Seal(frame.target);
+      return;
+    }
+    if (_current != kNoBlock) {
+      Jump(EdgeTo(&frame));
+    }
+    if (frame.else_block != kNoBlock) {
+      // An if without an else, where the else arm just falls through.
+      _current = frame.else_block;
+      Jump(EdgeTo(&frame));
+    }
+    Seal(frame.target);
+    _stack.resize(frame.height);
+    if (_func.blocks[frame.target].preds.empty()) {
+      _current = kNoBlock;
+      return;
+    }
+    _current = frame.target;
+    if (frame.has_result) {
+      Push(MergeResults(frame));
+    }
+  }
+  void operator()(const op::Br& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    auto* frame = FrameAt(op.depth);
+    if (frame->kind == Frame::Kind::kFunction) {
+      SetExit({.kind = Exit::kReturn, .results = TopResults()});
+    } else {
+      Jump(EdgeTo(frame));
+    }
+    _current = kNoBlock;
+  }
+  void operator()(const op::BrIf& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    ValueId cond = Pop();
+    BlockId taken = EdgeTo(FrameAt(op.depth));
+    BlockId next = NewBlock();
+    SetExit(
+        {.kind = Exit::kBranch, .value = cond, .targets = {taken, next}});
+    AddEdge(_current, next);
+    Seal(next);
+    _current = next;
+  }
+  void operator()(const op::BrTable& op) {
+    if (_current == kNoBlock) {
+      return;
+    }
+    ValueId index = Pop();
+    Terminator exit = {.kind = Exit::kSwitch, .value = index};
+    absl::flat_hash_map<uint32_t, BlockId> targets;
+    for (const auto& range : BrTableRanges(op)) {
+      auto [it, inserted] = targets.try_emplace(range.depth, kNoBlock);
+      if (inserted) {
+        it->second = EdgeTo(FrameAt(range.depth));
+      }
+      exit.lows.push_back(range.lo);
+      exit.targets.push_back(it->second);
+    }
+    SetExit(std::move(exit));
+    _current = kNoBlock;
+  }
+
+ private:
+  struct Frame {
+    enum class Kind : uint8_t { kFunction, kBlock, kLoop, kIf };
+    Kind kind;
+    // Where branches to the frame go: the start of a loop, otherwise the
+    // block after the frame's end.
+    BlockId target = kNoBlock;
+    // The else arm of an if, until it's reached.
+    BlockId else_block = kNoBlock;
+    bool has_result = false;
+    size_t height = 0;
+    // The result from each of the target's predecessors.
+    std::vector<ValueId> results;
+  };
+
+  BlockId NewBlock() {
+    _defs.emplace_back(_num_locals, kNoValue);
+    _sealed.push_back(false);
+    _incomplete_phis.emplace_back();
+    return _func.AddBlock();
+  }
+
+  ValueId Emit(Value v) {
+    ValueId id = NewValue(_current, std::move(v));
+    _func.blocks[_current].insts.push_back(id);
+    return id;
+  }
+
+  ValueId NewValue(BlockId block, Value v) {
+    _forward.push_back(kNoValue);
+    return _func.AddValue(block, std::move(v));
+  }
+
+  ValueId NewPhi(BlockId block) {
+    ValueId phi = NewValue(block, {.op = Opcode::kPhi});
+    _func.blocks[block].phis.push_back(phi);
+    return phi;
+  }
+
+  void Push(ValueId v) { _stack.push_back(v); }
+  ValueId Pop() {
+    ValueId v = _stack.back();
+    _stack.pop_back();
+    return v;
+  }
+  std::vector<ValueId> TopResults() const {
+    return {_stack.end() - ptrdiff_t(_func.num_results), _stack.end()};
+  }
+
+  Frame* FrameAt(uint32_t depth) {
+    return &_control[_control.size() - 1 - depth];
+  }
+
+  bool EnterSkipped() {
+    if (_current == kNoBlock) {
+      ++_skip_depth;
+      return true;
+    }
+    return false;
+  }
+
+  void SetExit(Terminator exit) {
+    _func.blocks[_current].exit = std::move(exit);
+  }
+
+  void AddEdge(BlockId from, BlockId to) {
+    auto& preds = _func.blocks[to].preds;
+    if (std::ranges::find(preds, from) == preds.end()) {
+      preds.push_back(from);
+    }
+  }
+
+  void Jump(BlockId target) {
+    SetExit({.kind = Exit::kJump, .targets = {target}});
+    AddEdge(_current, target);
+  }
+
+  // Add an edge from the current block for a branch to `frame`, returning the
+  // block to go to.
+  BlockId EdgeTo(Frame* frame) {
+    if (frame->kind == Frame::Kind::kFunction) {
+      BlockId ret = NewBlock();
+      _func.blocks[ret].preds.push_back(_current);
+      _func.blocks[ret].exit = {.kind = Exit::kReturn,
+                                .results = TopResults()};
+      Seal(ret);
+      return ret;
+    }
+    auto& preds = _func.blocks[frame->target].preds;
+    bool seen = std::ranges::find(preds, _current) != preds.end();
+    AddEdge(_current, frame->target);
+    if (!seen && frame->has_result && frame->kind != Frame::Kind::kLoop) {
+      frame->results.push_back(_stack.back());
+    }
+    return frame->target;
+  }
+
+  ValueId MergeResults(const Frame& frame) {
+    ValueId phi = NewPhi(frame.target);
+    _func.values[phi].args = frame.results;
+    return TryRemoveTrivialPhi(phi);
+  }
+
+  void WriteLocal(size_t local, BlockId block, ValueId v) {
+    _defs[block][local] = v;
+  }
+
+  ValueId ReadLocal(size_t local, BlockId block) {
+    ValueId v = _defs[block][local];
+    if (v != kNoValue) {
+      return Resolve(v);
+    }
+    const auto& preds = _func.blocks[block].preds;
+    if (!_sealed[block]) {
+      // Not every predecessor is known yet, so fill the phi in when it is.
+      v = NewPhi(block);
+      _incomplete_phis[block].emplace_back(local, v);
+    } else if (preds.size() == 1) {
+      v = ReadLocal(local, preds.front());
+    } else if (preds.empty()) {
+      throw CompilationException("read of a local in an unreachable block");
+    } else {
+      // Break cycles by writing the phi before reading the predecessors.
+      v = NewPhi(block);
+      WriteLocal(local, block, v);
+      v = AddPhiOperands(local, v);
+    }
+    WriteLocal(local, block, v);
+    return v;
+  }
+
+  ValueId AddPhiOperands(size_t local, ValueId phi) {
+    BlockId block = _func.values[phi].block;
+    for (BlockId pred : _func.blocks[block].preds) {
+      ValueId arg = ReadLocal(local, pred);
+      _func.values[phi].args.push_back(arg);
+    }
+    return TryRemoveTrivialPhi(phi);
+  }
+
+  // A phi that only merges one value (apart from itself) is that value.
+  ValueId TryRemoveTrivialPhi(ValueId phi) {
+    ValueId same = kNoValue;
+    for (ValueId arg : _func.values[phi].args) {
+      arg = Resolve(arg);
+      if (arg == same || arg == phi) {
+        continue;
+      }
+      if (same != kNoValue) {
+        return phi;
+      }
+      same = arg;
+    }
+    if (same == kNoValue) {
+      return phi;
+    }
+    _forward[phi] = same;
+    return same;
+  }
+
+  void Seal(BlockId block) {
+    for (auto [local, phi] : std::exchange(_incomplete_phis[block], {})) {
+      AddPhiOperands(local, phi);
+    }
+    _sealed[block] = true;
+  }
+
+  ValueId Resolve(ValueId v) const {
+    while (_forward[v] != kNoValue) {
+      v = _forward[v];
+    }
+    return v;
+  }
+
+  Function _func;
+  size_t _num_locals;
+  // The block instructions are added to, or `kNoBlock` if it can't be
+  // reached.
+  BlockId _current = kNoBlock;
+  // The number of frames entered since the code became unreachable.
+  size_t _skip_depth = 0;
+  std::vector<ValueId> _stack;
+  std::vector<Frame> _control;
+  // The current value of each local at the end of each block (so far).
+  std::vector<std::vector<ValueId>> _defs;
+  std::vector<bool> _sealed;
+  std::vector<std::vector<std::pair<size_t, ValueId>>> _incomplete_phis;
+  // The value that replaces each removed (trivial) phi.
+  std::vector<ValueId> _forward;
+};
+
+}  // namespace
+
+Function Build(const wasmcc::Function& func) {
+  Builder builder(func);
+  Dispatch(func.body, &builder);
+  return std::move(builder).Finish();
+}
+
+}  // namespace wasmcc::ssa
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "compiler/ssa/ir.h"
+#include "core/ast.h"
+
+namespace wasmcc::ssa {
+
+/**
+ * If `Build` supports a function, which requires every parameter, local and
+ * result to be an i32.
+ */
+bool CanBuild(const wasmcc::Function::Metadata&);
+
+/**
+ * Convert a function's IR into SSA form, using "Simple and Efficient
+ * Construction of Static Single Assignment Form" by Braun et al.
+ *
+ * Wasm's control flow is structured, so every block can be sealed as soon as
+ * the instruction that ends it is reached. Code that can never run is not
+ * converted at all.
+ */
+Function Build(const wasmcc::Function&);
+
+}  // namespace wasmcc::ssa
@@ -0,0 +1,153 @@
+#include "compiler/ssa/builder.h"
+
+#include <gtest/gtest.h>
+
+#include <utility>
+
+#include "compiler/ssa/ir.h"
+#include "core/instruction.h"
+#include "testing/functions.h"
+
+namespace wasmcc::ssa {
+namespace {
+
+std::string BuildToString(InstructionBuffer body) {
+  return ToString(Build(Fn(std::move(body), 2, 1)));
+}
+
+}  // namespace
+
+TEST(Builder, StraightLine) {
+  EXPECT_EQ(BuildToString(InstructionBuffer::Of(
+                op::GetLocalI32(0), op::GetLocalI32(1), op::AddI32(),
+                op::SetLocalI32(2), op::GetLocalI32(2), op::GetLocalI32(2),
+                op::AddI32())),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  v1 = param 1\n"
+            "  v2 = const 0\n"
+            "  v3 = add v0 v1\n"
+            "  v4 = add v3 v3\n"
+            "  return v4\n");
+}
+
+TEST(Builder, MergesLocalsWithPhis) {
+  EXPECT_EQ(BuildToString(InstructionBuffer::Of(
+                op::GetLocalI32(0), op::If{}, op::ConstI32(1),
+                op::SetLocalI32(2), op::Else(), op::ConstI32(2),
+                op::SetLocalI32(2), op::End(), op::GetLocalI32(2))),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  v1 = param 1\n"
+            "  v2 = const 0\n"
+            "  branch v0 b1 b2\n"
+            "b2: <- b0\n"
+            "  v4 = const 2\n"
+            "  jump b3\n"
+            "b1: <- b0\n"
+            "  v3 = const 1\n"
+            "  jump b3\n"
+            "b3: <- b1 b2\n"
+            "  v5 = phi v3 v4\n"
+            "  return v5\n");
+}
+
+TEST(Builder, MergesBlockResults) {
+  EXPECT_EQ(
+      BuildToString(InstructionBuffer::Of(
+          op::Block{.result = ValType::kI32}, op::GetLocalI32(1),
+          op::GetLocalI32(0), op::BrIf{.depth = 0}, op::SetLocalI32(2),
+          op::ConstI32(7), op::End())),
+      "b0:\n"
+      "  v0 = param 0\n"
+      "  v1 = param 1\n"
+      "  v2 = const 0\n"
+      "  branch v0 b1 b2\n"
+      "b2: <- b0\n"
+      "  v3 = const 7\n"
+      "  jump b1\n"
+      "b1: <- b0 b2\n"
+      "  v4 = phi v1 v3\n"
+      "  return v4\n");
+}
+
+TEST(Builder, LoopsOnlyGetPhisForLocalsTheyWrite) {
+  // Counts the parameter down to zero, while the other parameter is only
+  // read.
+  EXPECT_EQ(BuildToString(InstructionBuffer::Of(
+                op::Loop{}, op::GetLocalI32(0), op::ConstI32(-1), op::AddI32(),
+                op::SetLocalI32(0), op::GetLocalI32(0), op::BrIf{.depth = 0},
+                op::End(), op::GetLocalI32(1))),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  v1 = param 1\n"
+            "  v2 = const 0\n"
+            "  jump b1\n"
+            "b1: <- b0 b1\n"
+            "  v3 = phi v0 v5\n"
+            "  v4 = const -1\n"
+            "  v5 = add v3 v4\n"
+            "  branch v5 b1 b2\n"
+            "b2: <- b1\n"
+            "  return v1\n");
+}
+
+TEST(Builder, SkipsUnreachableCode) {
+  EXPECT_EQ(BuildToString(InstructionBuffer::Of(
+                op::Block{}, op::Br{.depth = 0}, op::GetLocalI32(0),
+                op::SetLocalI32(2), op::Loop{}, op::Br{.depth = 0}, op::End(),
+                op::End(), op::GetLocalI32(2))),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  v1 = param 1\n"
+            "  v2 = const 0\n"
+            "  jump b1\n"
+            "b1: <- b0\n"
+            "  return v2\n");
+}
+
+TEST(Builder, BranchTables) {
+  // Indexes 0 and 1 go to the inner block, everything else to the outer one.
+  auto targets = PackTargets({0, 0});
+  EXPECT_EQ(BuildToString(InstructionBuffer::Of(
+                op::Block{}, op::Block{}, op::GetLocalI32(0),
+                op::BrTable{.packed_targets = targets, .default_depth = 1},
+                op::End(), op::ConstI32(5), op::SetLocalI32(1), op::End(),
+                op::GetLocalI32(1))),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  v1 = param 1\n"
+            "  v2 = const 0\n"
+            "  switch v0 [0 2] b2 b1\n"
+            "b2: <- b0\n"
+            "  v3 = const 5\n"
+            "  jump b1\n"
+            "b1: <- b0 b2\n"
+            "  v4 = phi v1 v3\n"
+            "  return v4\n");
+}
+
+TEST(Builder, ReturnsFromBranchesToTheFunction) {
+  EXPECT_EQ(BuildToString(InstructionBuffer::Of(
+                op::GetLocalI32(1), op::GetLocalI32(0), op::BrIf{.depth = 0},
+                op::ConstI32(3))),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  v1 = param 1\n"
+            "  v2 = const 0\n"
+            "  branch v0 b1 b2\n"
+            "b2: <- b0\n"
+            "  v3 = const 3\n"
+            "  return v3\n"
+            "b1: <- b0\n"
+            "  return v1\n");
+}
+
+TEST(Builder, OnlySupportsI32) {
+  EXPECT_TRUE(CanBuild(Fn({}).meta));
+  auto meta = Fn({}).meta;
+  meta.locals.push_back(ValType::kI64);
+  EXPECT_FALSE(CanBuild(meta));
+}
+
+}  // namespace wasmcc::ssa
@@ -0,0 +1,219 @@
+#include "compiler/ssa/ir.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+
+namespace wasmcc::ssa {
+
+std::vector<BlockId> Successors(const Function& func, BlockId block) {
+  std::vector<BlockId> succs;
+  for (BlockId target : func.blocks[block].exit.targets) {
+    if (std::ranges::find(succs, target) == succs.end()) {
+      succs.push_back(target);
+    }
+  }
+  return succs;
+}
+
+std::vector<ValueId> Uses(const Terminator& term) {
+  switch (term.kind) {
+    case Exit::kBranch:
+    case Exit::kSwitch:
+      return {term.value};
+    case Exit::kReturn:
+      return term.results;
+    case Exit::kJump:
+    case Exit::kTrap:
+      return {};
+  }
+  __builtin_unreachable();
+}
+
+std::vector<BlockId> ReversePostorder(const Function& func) {
+  std::vector<BlockId> postorder;
+  std::vector<bool> visited(func.blocks.size());
+  // Each entry is a block and the index of the next successor to visit.
+  std::vector<std::pair<BlockId, size_t>> stack = {{0, 0}};
+  std::vector<std::vector<BlockId>> succs(func.blocks.size());
+  visited[0] = true;
+  succs[0] = Successors(func, 0);
+  while (!stack.empty()) {
+    auto& [block, next] = stack.back();
+    if (next == succs[block].size()) {
+      postorder.push_back(block);
+      stack.pop_back();
+      continue;
+    }
+    BlockId succ = succs[block][next++];
+    if (!visited[succ]) {
+      visited[succ] = true;
+      succs[succ] = Successors(func, succ);
+      stack.emplace_back(succ, 0);
+    }
+  }
+  std::ranges::reverse(postorder);
+  return postorder;
+}
+
+std::vector<BlockId> Dominators(const Function& func,
+                                std::span<const BlockId> rpo) {
+  // "A Simple, Fast Dominance Algorithm" by Cooper, Harvey and Kennedy.
+  std::vector<size_t> order(func.blocks.size());
+  for (size_t i = 0; i < rpo.size(); ++i) {
+    order[rpo[i]] = i;
+  }
+  std::vector<BlockId> idom(func.blocks.size(), kNoBlock);
+  idom[0] = 0;
+  auto intersect = [&](BlockId a, BlockId b) {
+    while (a != b) {
+      while (order[a] > order[b]) {
+        a = idom[a];
+      }
+      while (order[b] > order[a]) {
+        b = idom[b];
+      }
+    }
+    return a;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (BlockId block : rpo.subspan(1)) {
+      BlockId new_idom = kNoBlock;
+      for (BlockId pred : func.blocks[block].preds) {
+        if (idom[pred] == kNoBlock) {
+          continue;
+        }
+        new_idom = new_idom == kNoBlock ? pred : intersect(pred, new_idom);
+      }
+      if (idom[block] != new_idom) {
+        idom[block] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  return idom;
+}
+
+bool Dominates(std::span<const BlockId> idom, BlockId a, BlockId b) {
+  while (b != a) {
+    if (b == 0 || idom[b] == kNoBlock) {
+      return false;
+    }
+    b = idom[b];
+  }
+  return true;
+}
+
+namespace {
+
+std::string ValueName(ValueId v) { return absl::StrFormat("v%d", v); }
+
+std::string BlockName(BlockId b) { return absl::StrFormat("b%d", b); }
+
+const char* ConditionName(Condition cond) {
+  switch (cond) {
+    case Condition::kEq:
+      return "eq";
+    case Condition::kNe:
+      return "ne";
+    case Condition::kLtS:
+      return "lt_s";
+    case Condition::kLtU:
+      return "lt_u";
+    case Condition::kGtS:
+      return "gt_s";
+    case Condition::kGtU:
+      return "gt_u";
+    case Condition::kLeS:
+      return "le_s";
+    case Condition::kLeU:
+      return "le_u";
+    case Condition::kGeS:
+      return "ge_s";
+    case Condition::kGeU:
+      return "ge_u";
+  }
+  __builtin_unreachable();
+}
+
+std::string ValueString(ValueId id, const Value& v) {
+  auto args = absl::StrJoin(v.args, " ", [](std::string* out, ValueId arg) {
+    out->append(ValueName(arg));
+  });
+  switch (v.op) {
+    case Opcode::kParam:
+      return absl::StrFormat("%s = param %d", ValueName(id), v.imm);
+    case Opcode::kConst:
+      return absl::StrFormat("%s = const %d", ValueName(id), int32_t(v.imm));
+    case Opcode::kAdd:
+      return absl::StrFormat("%s = add %s", ValueName(id), args);
+    case Opcode::kEqz:
+      return absl::StrFormat("%s = eqz %s", ValueName(id), args);
+    case Opcode::kCompare:
+      return absl::StrFormat("%s = %s %s", ValueName(id),
+                             ConditionName(v.cond), args);
+    case Opcode::kPhi:
+      return absl::StrFormat("%s = phi %s", ValueName(id), args);
+  }
+  __builtin_unreachable();
+}
+
+std::string ExitString(const Terminator& term) {
+  auto blocks = [](std::span<const BlockId> blocks) {
+    return absl::StrJoin(blocks, " ", [](std::string* out, BlockId b) {
+      out->append(BlockName(b));
+    });
+  };
+  switch (term.kind) {
+    case Exit::kJump:
+      return absl::StrFormat("jump %s", blocks(term.targets));
+    case Exit::kBranch:
+      return absl::StrFormat("branch %s %s", ValueName(term.value),
+                             blocks(term.targets));
+    case Exit::kSwitch:
+      return absl::StrFormat("switch %s [%s] %s", ValueName(term.value),
+                             absl::StrJoin(term.lows, " "),
+                             blocks(term.targets));
+    case Exit::kReturn:
+      return absl::StrFormat(
+          "return%s",
+          absl::StrJoin(term.results, "", [](std::string* out, ValueId v) {
+            out->append(" " + ValueName(v));
+          }));
+    case Exit::kTrap:
+      return "trap";
+  }
+  __builtin_unreachable();
+}
+
+}  // namespace
+
+std::string ToString(const Function& func) {
+  std::string out;
+  for (BlockId b : ReversePostorder(func)) {
+    const auto& block = func.blocks[b];
+    absl::StrAppendFormat(&out, "%s:", BlockName(b));
+    if (!block.preds.empty()) {
+      absl::StrAppend(
+          &out, " <-",
+          absl::StrJoin(block.preds, "", [](std::string* s, BlockId p) {
+            s->append(" " + BlockName(p));
+          }));
+    }
+    out += "\n";
+    for (ValueId v : block.phis) {
+      absl::StrAppend(&out, "  ", ValueString(v, func.values[v]), "\n");
+    }
+    for (ValueId v : block.insts) {
+      absl::StrAppend(&out, "  ", ValueString(v, func.values[v]), "\n");
+    }
+    absl::StrAppend(&out, "  ", ExitString(block.exit), "\n");
+  }
+  return out;
+}
+
+}  // namespace wasmcc::ssa
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "core/instruction.h"
+
+namespace wasmcc::ssa {
+
+/**
+ * A function in SSA form, for the optimizing tier.
+ *
+ * Every value is defined exactly once, by an instruction in a basic block,
+ * and is identified by its index in `Function::values`. Locals and the wasm
+ * operand stack don't exist anymore: each read of a local is replaced by the
+ * value that was last written to it, with phis where control flow merges.
+ *
+ * Only i32 values exist, as that is all the IR supports.
+ */
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+
+constexpr ValueId kNoValue = std::numeric_limits<ValueId>::max();
+constexpr BlockId kNoBlock = std::numeric_limits<BlockId>::max();
+
+enum class Opcode : uint8_t {
+  // The parameter with index `imm`.
+  kParam,
+  // The constant `imm`.
+  kConst,
+  // args[0] + args[1]
+  kAdd,
+  // 1 if args[0] is zero, otherwise 0.
+  kEqz,
+  // 1 if `args[0] <cond> args[1]`, otherwise 0.
+  kCompare,
+  // args[i] if control came from the block's preds[i].
+  kPhi,
+};
+
+struct Value {
+  Opcode op;
+  // The block that defines the value.
+  BlockId block = kNoBlock;
+  uint32_t imm = 0;
+  Condition cond = Condition::kEq;
+  std::vector<ValueId> args;
+
+  // If the value can be computed anywhere its operands are available, and
+  // evaluating it has no effects (so it can be moved or removed).
+  bool IsPure() const {
+    return op == Opcode::kConst || op == Opcode::kAdd || op == Opcode::kEqz ||
+           op == Opcode::kCompare;
+  }
+};
+
+// How a block ends.
+enum class Exit : uint8_t {
+  // Go to targets[0].
+  kJump,
+  // Go to targets[0] if `value` is non zero, otherwise targets[1].
+  kBranch,
+  // Go to targets[i] for the indexes from lows[i] up until lows[i + 1], where
+  // the last target is used for everything after that. `value` is the index.
+  kSwitch,
+  // Return `results` to the caller.
+  kReturn,
+  // Trap.
+  kTrap,
+};
+
+struct Terminator {
+  Exit kind = Exit::kTrap;
+  ValueId value = kNoValue;
+  std::vector<BlockId> targets;
+  std::vector<uint32_t> lows;
+  std::vector<ValueId> results;
+};
+
+struct Block {
+  // Each predecessor appears once, even if it can branch here in several ways.
+  std::vector<BlockId> preds;
+  std::vector<ValueId> phis;
+  // The instructions that aren't phis, in order.
+  std::vector<ValueId> insts;
+  Terminator exit;
+};
+
+struct Function {
+  std::vector<Value> values;
+  // The entry block is first.
+  std::vector<Block> blocks;
+  size_t num_params = 0;
+  size_t num_results = 0;
+
+  ValueId AddValue(BlockId block, Value v) {
+    v.block = block;
+    values.push_back(std::move(v));
+    return ValueId(values.size() - 1);
+  }
+  BlockId AddBlock() {
+    blocks.emplace_back();
+    return BlockId(blocks.size() - 1);
+  }
+};
+
+// The distinct blocks that `block` can go to, in order of first appearance.
+std::vector<BlockId> Successors(const Function&, BlockId block);
+
+// Every value that `term` uses.
+std::vector<ValueId> Uses(const Terminator& term);
+
+// The blocks reachable from the entry, in reverse postorder, so that every
+// block comes before the blocks it dominates.
+std::vector<BlockId> ReversePostorder(const Function&);
+
+// The immediate dominator of each block (the entry is its own), or `kNoBlock`
+// for blocks that can't be reached.
+std::vector<BlockId> Dominators(const Function&,
+                                std::span<const BlockId> rpo);
+
+// If `a` dominates `b`.
+bool Dominates(std::span<const BlockId> idom, BlockId a, BlockId b);
+
+// A readable dump of the function, for tests and debugging.
+std::string ToString(const Function&);
+
+}  // namespace wasmcc::ssa
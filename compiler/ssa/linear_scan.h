@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <vector>
+
+#include "compiler/common/call_convention.h"
+#include "compiler/ssa/ir.h"
+
+namespace wasmcc::ssa {
+
+/**
+ * The part of the function where a value must be kept, as positions in the
+ * block order: each block starts at an even position, followed by one
+ * position per instruction and one for its exit.
+ *
+ * A value is kept from its definition up until its last use, including
+ * everything in between even if it isn't needed there, so a single interval
+ * is all that's needed.
+ */
+struct LiveInterval {
+  uint32_t start = std::numeric_limits<uint32_t>::max();
+  uint32_t end = 0;
+
+  bool empty() const { return start > end; }
+  void Cover(uint32_t pos) {
+    start = std::min(start, pos);
+    end = std::max(end, pos);
+  }
+};
+
+enum class LocationKind : uint8_t {
+  // The value is never kept anywhere: it's a constant, which is used as an
+  // immediate, or a condition that is only used by its block's branch.
+  kNone,
+  kRegister,
+  kStack,
+};
+
+template <CallingConvention CC>
+struct Location {
+  LocationKind kind = LocationKind::kNone;
+  typename CC::GpReg reg;
+  // For values on the stack, their slot index.
+  uint32_t slot = 0;
+};
+
+template <CallingConvention CC>
+struct Allocation {
+  // The order to emit blocks in.
+  std::vector<BlockId> order;
+  std::vector<LiveInterval> intervals;
+  std::vector<Location<CC>> locations;
+  // The number of stack slots used by spilled values.
+  uint32_t num_slots = 0;
+  // The callee saved registers that are used, which must be preserved.
+  RegisterMask<typename CC::GpReg> callee_saved;
+};
+
+/**
+ * If `v` is a comparison that is only used by the branch right after it, so
+ * it can be folded into the branch instead of materialized.
+ */
+inline bool IsFusedCondition(const Function& func, ValueId v,
+                             std::span<const uint32_t> use_counts) {
+  const auto& value = func.values[v];
+  if (value.op != Opcode::kCompare && value.op != Opcode::kEqz) {
+    return false;
+  }
+  const auto& block = func.blocks[value.block];
+  return use_counts[v] == 1 && block.exit.kind == Exit::kBranch &&
+         block.exit.value == v && block.insts.back() == v;
+}
+
+/**
+ * Assign a register or stack slot to every value in a function, using "Linear
+ * Scan Register Allocation" by Poletto and Sarkar.
+ *
+ * The function must not have critical edges into blocks with phis (see
+ * `SplitCriticalEdges`), as the moves for phis are made at the end of each
+ * predecessor. A phi's interval covers the ends of all its predecessors, so
+ * those moves can't overwrite anything else that is live.
+ *
+ * Caller saved registers are used before callee saved ones, which need to be
+ * saved and restored. `reserved` registers are never used, so they are free
+ * as scratch registers while lowering.
+ */
+template <CallingConvention CC>
+Allocation<CC> AllocateRegisters(
+    const Function& func, const RegisterMask<typename CC::GpReg>& reserved) {
+  using GpReg = typename CC::GpReg;
+  Allocation<CC> result;
+  result.order = ReversePostorder(func);
+  const auto& order = result.order;
+  size_t num_values = func.values.size();
+
+  std::vector<uint32_t> use_counts(num_values);
+  for (BlockId b : order) {
+    const auto& block = func.blocks[b];
+    auto count_args = [&](ValueId v) {
+      for (ValueId arg : func.values[v].args) {
+        ++use_counts[arg];
+      }
+    };
+    std::ranges::for_each(block.phis, count_args);
+    std::ranges::for_each(block.insts, count_args);
+    for (ValueId v : Uses(block.exit)) {
+      ++use_counts[v];
+    }
+  }
+
+  // Number every instruction.
+  std::vector<uint32_t> block_from(func.blocks.size());
+  std::vector<uint32_t> block_to(func.blocks.size());
+  std::vector<uint32_t> def_pos(num_values);
+  uint32_t pos = 0;
+  for (BlockId b : order) {
+    const auto& block = func.blocks[b];
+    block_from[b] = pos;
+    for (ValueId phi : block.phis) {
+      def_pos[phi] = pos;
+    }
+    for (ValueId v : block.insts) {
+      pos += 2;
+      // Parameters all arrive together on entry.
+      def_pos[v] =
+          func.values[v].op == Opcode::kParam ? block_from[b] : pos;
+    }
+    pos += 2;
+    block_to[b] = pos;
+    pos += 2;
+  }
+
+  // Which values are live at the end of each block, including the arguments
+  // of phis in its successors, solved iteratively in reverse.
+  std::vector<std::vector<bool>> live_out(
+      func.blocks.size(), std::vector<bool>(num_values));
+  std::vector<std::vector<bool>> live_in = live_out;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (BlockId b : std::ranges::reverse_view(order)) {
+      const auto& block = func.blocks[b];
+      std::vector<bool> live(num_values);
+      for (BlockId succ : Successors(func, b)) {
+        const auto& succ_block = func.blocks[succ];
+        auto idx = std::ranges::find(succ_block.preds, b) -
+                   succ_block.preds.begin();
+        for (size_t v = 0; v < num_values; ++v) {
+          if (live_in[succ][v]) {
+            live[v] = true;
+          }
+        }
+        for (ValueId phi : succ_block.phis) {
+          live[func.values[phi].args[idx]] = true;
+        }
+      }
+      if (live != live_out[b]) {
+        live_out[b] = live;
+        changed = true;
+      }
+      for (ValueId v : Uses(block.exit)) {
+        live[v] = true;
+      }
+      for (ValueId v : std::ranges::reverse_view(block.insts)) {
+        live[v] = false;
+        for (ValueId arg : func.values[v].args) {
+          live[arg] = true;
+        }
+      }
+      for (ValueId phi : block.phis) {
+        live[phi] = false;
+      }
+      if (live != live_in[b]) {
+        live_in[b] = std::move(live);
+        changed = true;
+      }
+    }
+  }
+
+  auto& intervals = result.intervals;
+  intervals.resize(num_values);
+  for (BlockId b : order) {
+    const auto& block = func.blocks[b];
+    for (ValueId phi : block.phis) {
+      intervals[phi].Cover(def_pos[phi]);
+      for (BlockId pred : block.preds) {
+        intervals[phi].Cover(block_to[pred]);
+      }
+    }
+    for (ValueId v : block.insts) {
+      intervals[v].Cover(def_pos[v]);
+      for (ValueId arg : func.values[v].args) {
+        intervals[arg].Cover(def_pos[v]);
+      }
+    }
+    for (ValueId v : Uses(block.exit)) {
+      intervals[v].Cover(block_to[b]);
+    }
+    for (size_t v = 0; v < num_values; ++v) {
+      if (live_out[b][v]) {
+        intervals[v].Cover(block_from[b]);
+        intervals[v].Cover(block_to[b]);
+      }
+    }
+  }
+
+  std::vector<ValueId> unhandled;
+  auto& locations = result.locations;
+  locations.resize(num_values);
+  for (BlockId b : order) {
+    const auto& block = func.blocks[b];
+    unhandled.insert(unhandled.end(), block.phis.begin(), block.phis.end());
+    for (ValueId v : block.insts) {
+      if (func.values[v].op != Opcode::kConst &&
+          !IsFusedCondition(func, v, use_counts)) {
+        unhandled.push_back(v);
+      }
+    }
+  }
+  std::ranges::stable_sort(unhandled, {},
+                           [&](ValueId v) { return intervals[v].start; });
+
+  std::vector<GpReg> free;
+  for (const auto& mask :
+       {CC::kGpCalleeSavedRegisters, CC::kGpCallerSavedRegisters}) {
+    for (auto reg : mask) {
+      if (!reserved.Test(reg) && reg.id() != CC::kSp.id()) {
+        free.push_back(reg);
+      }
+    }
+  }
+  // The registers that `v` would ideally be in, where it is defined or used.
+  std::vector<std::vector<GpReg>> return_hints(num_values);
+  for (BlockId b : order) {
+    const auto& exit = func.blocks[b].exit;
+    if (exit.kind != Exit::kReturn) {
+      continue;
+    }
+    for (size_t i = 0; i < exit.results.size() && i < CC::kGpRets.size();
+         ++i) {
+      return_hints[exit.results[i]].push_back(CC::kGpRets[i]);
+    }
+  }
+  auto hints_for = [&](ValueId v) {
+    const auto& value = func.values[v];
+    std::vector<GpReg> hints;
+    if (value.op == Opcode::kParam && value.imm < CC::kGpArgs.size()) {
+      hints.push_back(CC::kGpArgs[value.imm]);
+    }
+    for (ValueId arg : value.args) {
+      if (locations[arg].kind == LocationKind::kRegister) {
+        hints.push_back(locations[arg].reg);
+      }
+    }
+    hints.insert(hints.end(), return_hints[v].begin(), return_hints[v].end());
+    return hints;
+  };
+  // Sorted by end, so the ones that expire first are at the front.
+  std::vector<ValueId> active;
+  auto spill = [&](ValueId v) {
+    locations[v] = {.kind = LocationKind::kStack, .slot = result.num_slots++};
+  };
+  for (ValueId v : unhandled) {
+    const auto& interval = intervals[v];
+    while (!active.empty() && intervals[active.front()].end <= interval.start) {
+      free.push_back(locations[active.front()].reg);
+      active.erase(active.begin());
+    }
+    auto insert_active = [&](ValueId v) {
+      auto it = std::ranges::upper_bound(
+          active, intervals[v].end, {},
+          [&](ValueId a) { return intervals[a].end; });
+      active.insert(it, v);
+    };
+    if (!free.empty()) {
+      // Free is a stack, with caller saved registers on top, but a register
+      // that avoids a move is better.
+      // Hints are in order of preference.
+      auto it = free.end();
+      for (const GpReg& hint : hints_for(v)) {
+        it = std::ranges::find(free, hint.id(), &GpReg::id);
+        if (it != free.end()) {
+          break;
+        }
+      }
+      if (it == free.end()) {
+        it = std::prev(free.end());
+      }
+      GpReg reg = *it;
+      free.erase(it);
+      locations[v] = {.kind = LocationKind::kRegister, .reg = reg};
+      if (CC::kGpCalleeSavedRegisters.Test(reg)) {
+        result.callee_saved.Set(reg);
+      }
+      insert_active(v);
+      continue;
+    }
+    // Spill whichever value is needed for longest.
+    ValueId last = active.back();
+    if (intervals[last].end > interval.end) {
+      locations[v] = locations[last];
+      spill(last);
+      active.pop_back();
+      insert_active(v);
+    } else {
+      spill(v);
+    }
+  }
+  return result;
+}
+
+}  // namespace wasmcc::ssa
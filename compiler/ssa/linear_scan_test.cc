@@ -0,0 +1,110 @@
+#include "compiler/ssa/linear_scan.h"
+
+#include <gtest/gtest.h>
+
+#include <utility>
+
+#include "compiler/ssa/builder.h"
+#include "compiler/ssa/ir.h"
+#include "compiler/ssa/passes.h"
+#include "compiler/x64/call_convention.h"
+#include "core/instruction.h"
+#include "testing/functions.h"
+
+namespace wasmcc::ssa {
+namespace {
+
+using CC = x64::CallingConvention;
+
+// The registers the allocator may not use.
+const RegisterMask<x64::GpReg> kReserved = {asmjit::x86::r10,
+                                            asmjit::x86::r11};
+
+// A function with two i32 parameters, `num_locals` i32 locals and an i32
+// result, built and optimized.
+Function Optimized(InstructionBuffer body, size_t num_locals = 2) {
+  auto func = Build(Fn(std::move(body), 2, num_locals));
+  Optimize(&func);
+  return func;
+}
+
+// Every value that has a location, and where its interval overlaps another
+// value's, they are in different places.
+void ExpectNoInterference(const Function& func,
+                          const Allocation<CC>& alloc) {
+  for (ValueId a = 0; a < func.values.size(); ++a) {
+    for (ValueId b = a + 1; b < func.values.size(); ++b) {
+      const auto& la = alloc.locations[a];
+      const auto& lb = alloc.locations[b];
+      if (la.kind != lb.kind || la.kind == LocationKind::kNone) {
+        continue;
+      }
+      const auto& ia = alloc.intervals[a];
+      const auto& ib = alloc.intervals[b];
+      if (ia.empty() || ib.empty() || ia.end <= ib.start ||
+          ib.end <= ia.start) {
+        continue;
+      }
+      if (la.kind == LocationKind::kRegister) {
+        EXPECT_NE(la.reg.id(), lb.reg.id()) << "v" << a << " and v" << b;
+      } else {
+        EXPECT_NE(la.slot, lb.slot) << "v" << a << " and v" << b;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(LinearScan, KeepsLoopValuesInRegisters) {
+  auto func = Optimized(SumKernel());
+  auto alloc = AllocateRegisters<CC>(func, kReserved);
+  ExpectNoInterference(func, alloc);
+  EXPECT_EQ(alloc.num_slots, 0);
+  // Caller saved registers are used first, so nothing has to be saved.
+  EXPECT_EQ(alloc.callee_saved.size(), 0);
+  for (const auto& block : func.blocks) {
+    for (ValueId v : block.phis) {
+      EXPECT_EQ(alloc.locations[v].kind, LocationKind::kRegister);
+    }
+  }
+}
+
+TEST(LinearScan, FusesConditionsIntoBranches) {
+  auto func = Optimized(SumKernel());
+  auto alloc = AllocateRegisters<CC>(func, kReserved);
+  for (BlockId b : ReversePostorder(func)) {
+    const auto& exit = func.blocks[b].exit;
+    if (exit.kind == Exit::kBranch) {
+      EXPECT_EQ(alloc.locations[exit.value].kind, LocationKind::kNone);
+    }
+  }
+}
+
+TEST(LinearScan, PrefersArgumentAndResultRegisters) {
+  // Returns the second parameter.
+  auto func = Optimized(InstructionBuffer::Of(op::GetLocalI32(1)));
+  auto alloc = AllocateRegisters<CC>(func, kReserved);
+  ValueId param = func.blocks[0].exit.results[0];
+  ASSERT_EQ(alloc.locations[param].kind, LocationKind::kRegister);
+  EXPECT_EQ(alloc.locations[param].reg.id(), CC::kGpArgs[1].id());
+}
+
+TEST(LinearScan, SpillsWhenOutOfRegisters) {
+  constexpr int kNumValues = 20;
+  auto func = Optimized(ManyLiveValues(kNumValues), kNumValues);
+  auto alloc = AllocateRegisters<CC>(func, kReserved);
+  ExpectNoInterference(func, alloc);
+  // The values and the second parameter are live at once, in 16 registers
+  // minus the stack pointer and the reserved ones.
+  EXPECT_GE(alloc.num_slots, kNumValues + 1 - 13);
+  EXPECT_EQ(alloc.callee_saved.size(), CC::kGpCalleeSavedRegisters.size());
+  for (const auto& location : alloc.locations) {
+    if (location.kind == LocationKind::kRegister) {
+      EXPECT_FALSE(kReserved.Test(location.reg));
+      EXPECT_NE(location.reg.id(), CC::kSp.id());
+    }
+  }
+}
+
+}  // namespace wasmcc::ssa
@@ -0,0 +1,380 @@
+#include "compiler/ssa/passes.h"
+
+#include <algorithm>
+#include <optional>
+#include <ranges>
+#include <tuple>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace wasmcc::ssa {
+namespace {
+
+// The value that replaces each value, or `kNoValue` if it's kept.
+class Forwarding {
+ public:
+  explicit Forwarding(const Function& func)
+      : _forward(func.values.size(), kNoValue) {}
+
+  void Replace(ValueId v, ValueId with) { _forward[v] = with; }
+  bool IsReplaced(ValueId v) const { return _forward[v] != kNoValue; }
+
+  ValueId Resolve(ValueId v) const {
+    while (_forward[v] != kNoValue) {
+      v = _forward[v];
+    }
+    return v;
+  }
+
+  // Rewrite every use of a replaced value, and drop the replaced values from
+  // their blocks.
+  void Apply(Function* func) const {
+    auto replaced = [this](ValueId v) { return IsReplaced(v); };
+    for (auto& value : func->values) {
+      for (auto& arg : value.args) {
+        arg = Resolve(arg);
+      }
+    }
+    for (auto& block : func->blocks) {
+      std::erase_if(block.phis, replaced);
+      std::erase_if(block.insts, replaced);
+      if (block.exit.value != kNoValue) {
+        block.exit.value = Resolve(block.exit.value);
+      }
+      for (auto& result : block.exit.results) {
+        result = Resolve(result);
+      }
+    }
+  }
+
+ private:
+  std::vector<ValueId> _forward;
+};
+
+void RemovePred(Function* func, BlockId block, BlockId pred) {
+  auto& preds = func->blocks[block].preds;
+  auto idx = std::ranges::find(preds, pred) - preds.begin();
+  preds.erase(preds.begin() + idx);
+  for (ValueId phi : func->blocks[block].phis) {
+    auto& args = func->values[phi].args;
+    args.erase(args.begin() + idx);
+  }
+}
+
+// Empty every block that can't be reached, so the rest never refer to them.
+void PruneUnreachable(Function* func) {
+  std::vector<bool> reachable(func->blocks.size());
+  for (BlockId b : ReversePostorder(*func)) {
+    reachable[b] = true;
+  }
+  for (BlockId b = 0; b < func->blocks.size(); ++b) {
+    if (reachable[b]) {
+      continue;
+    }
+    for (BlockId succ : Successors(*func, b)) {
+      if (reachable[succ]) {
+        RemovePred(func, succ, b);
+      }
+    }
+    func->blocks[b] = {};
+  }
+}
+
+void MakeConst(Value* value, uint32_t imm) {
+  value->op = Opcode::kConst;
+  value->imm = imm;
+  value->args.clear();
+}
+
+// Replace the block's exit with a jump to `keep`, removing its other edges.
+void JumpTo(Function* func, BlockId block, BlockId keep) {
+  for (BlockId succ : Successors(*func, block)) {
+    if (succ != keep) {
+      RemovePred(func, succ, block);
+    }
+  }
+  func->blocks[block].exit = {.kind = Exit::kJump, .targets = {keep}};
+}
+
+}  // namespace
+
+void SimplifyPhis(Function* func) {
+  Forwarding forwarding(*func);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& block : func->blocks) {
+      for (ValueId phi : block.phis) {
+        if (forwarding.IsReplaced(phi)) {
+          continue;
+        }
+        ValueId same = kNoValue;
+        bool trivial = true;
+        for (ValueId arg : func->values[phi].args) {
+          arg = forwarding.Resolve(arg);
+          if (arg == phi || arg == same) {
+            continue;
+          }
+          if (same != kNoValue) {
+            trivial = false;
+            break;
+          }
+          same = arg;
+        }
+        if (trivial && same != kNoValue) {
+          forwarding.Replace(phi, same);
+          changed = true;
+        }
+      }
+    }
+  }
+  forwarding.Apply(func);
+}
+
+void FoldConstants(Function* func) {
+  Forwarding forwarding(*func);
+  auto constant = [&](ValueId v) -> std::optional<uint32_t> {
+    const auto& value = func->values[v];
+    if (value.op != Opcode::kConst) {
+      return std::nullopt;
+    }
+    return value.imm;
+  };
+  for (BlockId b : ReversePostorder(*func)) {
+    for (ValueId v : func->blocks[b].insts) {
+      auto& value = func->values[v];
+      for (auto& arg : value.args) {
+        arg = forwarding.Resolve(arg);
+      }
+      switch (value.op) {
+        case Opcode::kAdd: {
+          auto lhs = constant(value.args[0]);
+          auto rhs = constant(value.args[1]);
+          if (lhs && rhs) {
+            MakeConst(&value, *lhs + *rhs);
+          } else if (rhs == 0) {
+            forwarding.Replace(v, value.args[0]);
+          } else if (lhs == 0) {
+            forwarding.Replace(v, value.args[1]);
+          }
+          break;
+        }
+        case Opcode::kEqz: {
+          const auto& arg = func->values[value.args[0]];
+          if (arg.op == Opcode::kConst) {
+            MakeConst(&value, arg.imm == 0 ? 1 : 0);
+          } else if (arg.op == Opcode::kCompare) {
+            // So the comparison can still be fused into a branch.
+            value.op = Opcode::kCompare;
+            value.cond = Negate(arg.cond);
+            value.args = arg.args;
+          }
+          break;
+        }
+        case Opcode::kCompare: {
+          auto lhs = constant(value.args[0]);
+          auto rhs = constant(value.args[1]);
+          if (lhs && rhs) {
+            MakeConst(&value, Evaluate(value.cond, *lhs, *rhs) ? 1 : 0);
+          }
+          break;
+        }
+        case Opcode::kParam:
+        case Opcode::kConst:
+        case Opcode::kPhi:
+          break;
+      }
+    }
+
+    auto& exit = func->blocks[b].exit;
+    if (exit.value != kNoValue) {
+      exit.value = forwarding.Resolve(exit.value);
+    }
+    auto succs = Successors(*func, b);
+    if (exit.kind == Exit::kBranch || exit.kind == Exit::kSwitch) {
+      if (succs.size() == 1) {
+        JumpTo(func, b, succs.front());
+      } else if (auto index = constant(exit.value)) {
+        if (exit.kind == Exit::kBranch) {
+          JumpTo(func, b, exit.targets[*index != 0 ? 0 : 1]);
+        } else {
+          // The last range that starts at or before the index.
+          auto it = std::ranges::upper_bound(exit.lows, *index);
+          JumpTo(func, b, exit.targets[it - exit.lows.begin() - 1]);
+        }
+      }
+    }
+  }
+  PruneUnreachable(func);
+  forwarding.Apply(func);
+}
+
+void NumberValues(Function* func) {
+  auto rpo = ReversePostorder(*func);
+  auto idom = Dominators(*func, rpo);
+  Forwarding forwarding(*func);
+  using Key = std::tuple<Opcode, uint32_t, Condition, std::vector<ValueId>>;
+  // Every instruction seen for each key. An instruction can only be replaced
+  // by one whose block dominates it.
+  absl::flat_hash_map<Key, std::vector<ValueId>> seen;
+  for (BlockId b : rpo) {
+    for (ValueId v : func->blocks[b].insts) {
+      auto& value = func->values[v];
+      for (auto& arg : value.args) {
+        arg = forwarding.Resolve(arg);
+      }
+      if (!value.IsPure()) {
+        continue;
+      }
+      auto args = value.args;
+      if (value.op == Opcode::kAdd) {
+        std::ranges::sort(args);
+      }
+      auto& candidates = seen[Key(
+          value.op, value.imm,
+          value.op == Opcode::kCompare ? value.cond : Condition::kEq,
+          std::move(args))];
+      auto it = std::ranges::find_if(candidates, [&](ValueId c) {
+        return Dominates(idom, func->values[c].block, b);
+      });
+      if (it != candidates.end()) {
+        forwarding.Replace(v, *it);
+      } else {
+        candidates.push_back(v);
+      }
+    }
+  }
+  forwarding.Apply(func);
+}
+
+void HoistLoopInvariants(Function* func) {
+  auto rpo = ReversePostorder(*func);
+  auto idom = Dominators(*func, rpo);
+  // The blocks that branch back to each loop header.
+  std::vector<std::vector<BlockId>> latches(func->blocks.size());
+  for (BlockId b : rpo) {
+    for (BlockId succ : Successors(*func, b)) {
+      if (Dominates(idom, succ, b)) {
+        latches[succ].push_back(b);
+      }
+    }
+  }
+  // Inner loops come later in reverse postorder than the loops around them,
+  // so visiting them first lets an instruction move out several levels.
+  for (BlockId header : std::ranges::reverse_view(rpo)) {
+    if (latches[header].empty()) {
+      continue;
+    }
+    std::vector<bool> in_loop(func->blocks.size());
+    in_loop[header] = true;
+    std::vector<BlockId> worklist = latches[header];
+    while (!worklist.empty()) {
+      BlockId b = worklist.back();
+      worklist.pop_back();
+      if (!in_loop[b]) {
+        in_loop[b] = true;
+        worklist.insert(worklist.end(), func->blocks[b].preds.begin(),
+                        func->blocks[b].preds.end());
+      }
+    }
+
+    // Only hoist into a block that always goes straight to the loop.
+    BlockId preheader = kNoBlock;
+    for (BlockId pred : func->blocks[header].preds) {
+      if (in_loop[pred]) {
+        continue;
+      }
+      if (preheader != kNoBlock) {
+        preheader = kNoBlock;
+        break;
+      }
+      preheader = pred;
+    }
+    if (preheader == kNoBlock || Successors(*func, preheader).size() != 1) {
+      continue;
+    }
+
+    for (BlockId b : rpo) {
+      if (!in_loop[b]) {
+        continue;
+      }
+      std::erase_if(func->blocks[b].insts, [&](ValueId v) {
+        auto& value = func->values[v];
+        // Constants are cheaper to rematerialize than to keep in a register.
+        if (!value.IsPure() || value.op == Opcode::kConst ||
+            std::ranges::any_of(value.args, [&](ValueId arg) {
+              return in_loop[func->values[arg].block];
+            })) {
+          return false;
+        }
+        value.block = preheader;
+        func->blocks[preheader].insts.push_back(v);
+        return true;
+      });
+    }
+  }
+}
+
+void EliminateDeadCode(Function* func) {
+  std::vector<bool> live(func->values.size());
+  std::vector<ValueId> worklist;
+  auto mark = [&](ValueId v) {
+    if (!live[v]) {
+      live[v] = true;
+      worklist.push_back(v);
+    }
+  };
+  for (BlockId b : ReversePostorder(*func)) {
+    for (ValueId v : Uses(func->blocks[b].exit)) {
+      mark(v);
+    }
+  }
+  while (!worklist.empty()) {
+    ValueId v = worklist.back();
+    worklist.pop_back();
+    for (ValueId arg : func->values[v].args) {
+      mark(arg);
+    }
+  }
+  auto dead = [&](ValueId v) { return !live[v]; };
+  for (auto& block : func->blocks) {
+    std::erase_if(block.phis, dead);
+    std::erase_if(block.insts, dead);
+  }
+}
+
+void SplitCriticalEdges(Function* func) {
+  for (BlockId b : ReversePostorder(*func)) {
+    auto succs = Successors(*func, b);
+    if (succs.size() < 2) {
+      continue;
+    }
+    for (BlockId succ : succs) {
+      if (func->blocks[succ].phis.empty()) {
+        continue;
+      }
+      BlockId split = func->AddBlock();
+      func->blocks[split].preds = {b};
+      func->blocks[split].exit = {.kind = Exit::kJump, .targets = {succ}};
+      std::ranges::replace(func->blocks[succ].preds, b, split);
+      std::ranges::replace(func->blocks[b].exit.targets, succ, split);
+    }
+  }
+}
+
+void Optimize(Function* func) {
+  SimplifyPhis(func);
+  // Resolving a branch can make phis trivial, which can make more branches
+  // constant, so go round twice.
+  for (int i = 0; i < 2; ++i) {
+    FoldConstants(func);
+    NumberValues(func);
+    SimplifyPhis(func);
+  }
+  HoistLoopInvariants(func);
+  EliminateDeadCode(func);
+  SplitCriticalEdges(func);
+}
+
+}  // namespace wasmcc::ssa
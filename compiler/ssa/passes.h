@@ -0,0 +1,42 @@
+#pragma once
+
+#include "compiler/ssa/ir.h"
+
+namespace wasmcc::ssa {
+
+/**
+ * Optimization passes over a function in SSA form.
+ *
+ * Each pass leaves the function valid: blocks that can no longer be reached
+ * are emptied and dropped from their successors' predecessors, and values
+ * that are removed are no longer used anywhere.
+ */
+
+// Replace phis that only merge a single value with that value.
+void SimplifyPhis(Function*);
+
+// Evaluate instructions whose operands are all constant, and resolve branches
+// on constants, dropping the blocks that can no longer be reached. Negated
+// comparisons become a single comparison.
+void FoldConstants(Function*);
+
+// Global value numbering: replace pure instructions with an equivalent one
+// that dominates them.
+void NumberValues(Function*);
+
+// Move pure instructions that compute the same value on every iteration of a
+// loop to just before the loop.
+void HoistLoopInvariants(Function*);
+
+// Remove instructions whose values are never used.
+void EliminateDeadCode(Function*);
+
+// Split edges from blocks with several successors to blocks with phis, so
+// every phi's moves can be made at the end of its predecessor.
+void SplitCriticalEdges(Function*);
+
+// Run every pass above, in an order that lets each one benefit from the
+// others.
+void Optimize(Function*);
+
+}  // namespace wasmcc::ssa
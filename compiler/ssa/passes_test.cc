@@ -0,0 +1,235 @@
+#include "compiler/ssa/passes.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "compiler/ssa/builder.h"
+#include "compiler/ssa/ir.h"
+#include "core/instruction.h"
+#include "testing/functions.h"
+
+namespace wasmcc::ssa {
+namespace {
+
+Function Optimized(InstructionBuffer body) {
+  auto func = Build(Fn(std::move(body)));
+  Optimize(&func);
+  return func;
+}
+
+// Run a function in SSA form, returning its result, or nothing if it traps.
+std::optional<uint32_t> Interpret(const Function& func, uint32_t arg0,
+                            uint32_t arg1) {
+  std::vector<uint32_t> values(func.values.size());
+  BlockId prev = kNoBlock;
+  BlockId b = 0;
+  while (true) {
+    const auto& block = func.blocks[b];
+    if (!block.phis.empty()) {
+      // Phis all read their arguments before any of them are written.
+      auto idx = std::ranges::find(block.preds, prev) - block.preds.begin();
+      auto before = values;
+      for (ValueId phi : block.phis) {
+        values[phi] = before[func.values[phi].args[idx]];
+      }
+    }
+    for (ValueId v : block.insts) {
+      const auto& value = func.values[v];
+      auto arg = [&](size_t i) { return values[value.args[i]]; };
+      switch (value.op) {
+        case Opcode::kParam:
+          values[v] = value.imm == 0 ? arg0 : arg1;
+          break;
+        case Opcode::kConst:
+          values[v] = value.imm;
+          break;
+        case Opcode::kAdd:
+          values[v] = arg(0) + arg(1);
+          break;
+        case Opcode::kEqz:
+          values[v] = arg(0) == 0 ? 1 : 0;
+          break;
+        case Opcode::kCompare:
+          values[v] = Evaluate(value.cond, arg(0), arg(1)) ? 1 : 0;
+          break;
+        case Opcode::kPhi:
+          ADD_FAILURE() << "phi in instructions";
+          return std::nullopt;
+      }
+    }
+    prev = b;
+    const auto& exit = block.exit;
+    switch (exit.kind) {
+      case Exit::kJump:
+        b = exit.targets[0];
+        break;
+      case Exit::kBranch:
+        b = exit.targets[values[exit.value] != 0 ? 0 : 1];
+        break;
+      case Exit::kSwitch: {
+        auto it = std::ranges::upper_bound(exit.lows, values[exit.value]);
+        b = exit.targets[it - exit.lows.begin() - 1];
+        break;
+      }
+      case Exit::kReturn:
+        return values[exit.results[0]];
+      case Exit::kTrap:
+        return std::nullopt;
+    }
+  }
+}
+
+// The values of every instruction with `op` that is still reachable.
+std::vector<ValueId> Find(const Function& func, Opcode op) {
+  std::vector<ValueId> found;
+  for (BlockId b : ReversePostorder(func)) {
+    for (ValueId v : func.blocks[b].insts) {
+      if (func.values[v].op == op) {
+        found.push_back(v);
+      }
+    }
+  }
+  return found;
+}
+
+// Classifies the first parameter with a branch table, trapping on 3.
+InstructionBuffer SwitchKernel() {
+  static const auto kTargets = PackTargets({0, 1, 1, 3});
+  return InstructionBuffer::Of(
+      op::Block{}, op::Block{}, op::Block{}, op::Block{}, op::GetLocalI32(0),
+      op::BrTable{.packed_targets = kTargets, .default_depth = 2}, op::End(),
+      op::ConstI32(10), op::Return(), op::End(), op::ConstI32(20),
+      op::Return(), op::End(), op::GetLocalI32(1), op::Return(), op::End(),
+      op::Unreachable());
+}
+
+// Picks the larger parameter, with a value carried out of a block and dead
+// code behind a constant branch.
+InstructionBuffer MaxKernel() {
+  return InstructionBuffer::Of(
+      op::ConstI32(0), op::If{}, op::GetLocalI32(0), op::SetLocalI32(3),
+      op::End(), op::Block{.result = ValType::kI32}, op::GetLocalI32(0),
+      op::GetLocalI32(0), op::GetLocalI32(1),
+      op::CompareI32{.cond = Condition::kGtS}, op::BrIf{.depth = 0},
+      op::SetLocalI32(2), op::GetLocalI32(1), op::End(), op::GetLocalI32(3),
+      op::AddI32());
+}
+
+// Swaps the parameters on every iteration of a loop, so the phis at the start
+// of the loop depend on each other.
+InstructionBuffer SwapKernel() {
+  return InstructionBuffer::Of(
+      op::Loop{}, op::GetLocalI32(0), op::SetLocalI32(2), op::GetLocalI32(1),
+      op::SetLocalI32(0), op::GetLocalI32(2), op::SetLocalI32(1),
+      op::GetLocalI32(3), op::ConstI32(1), op::AddI32(), op::SetLocalI32(3),
+      op::GetLocalI32(3), op::ConstI32(3),
+      op::CompareI32{.cond = Condition::kLtU}, op::BrIf{.depth = 0},
+      op::End(), op::GetLocalI32(0));
+}
+
+}  // namespace
+
+TEST(Passes, PreserveSemantics) {
+  const std::vector<uint32_t> args = {0, 1, 2, 3, 4, 7, uint32_t(-1), 100};
+  for (const auto& body :
+       {SumKernel(), SwitchKernel(), MaxKernel(), SwapKernel()}) {
+    auto built = Build(Fn(body));
+    auto optimized = Optimized(body);
+    for (uint32_t a : args) {
+      for (uint32_t b : args) {
+        EXPECT_EQ(Interpret(optimized, a, b), Interpret(built, a, b))
+            << "args " << a << " " << b << "\n"
+            << ToString(built) << "\noptimized to\n"
+            << ToString(optimized);
+      }
+    }
+  }
+  auto sum = Optimized(SumKernel());
+  EXPECT_EQ(Interpret(sum, 3, 7), 3 + 4 + 5 + 6);
+  auto swap = Optimized(SwapKernel());
+  EXPECT_EQ(Interpret(swap, 1, 2), 2);
+  auto max = Optimized(MaxKernel());
+  EXPECT_EQ(Interpret(max, 1, 2), 2);
+  EXPECT_EQ(Interpret(max, 5, 2), 5);
+  auto table = Optimized(SwitchKernel());
+  EXPECT_EQ(Interpret(table, 0, 9), 10);
+  EXPECT_EQ(Interpret(table, 2, 9), 20);
+  EXPECT_EQ(Interpret(table, 3, 9), std::nullopt);
+  EXPECT_EQ(Interpret(table, 4, 9), 9);
+}
+
+TEST(Passes, FoldConstants) {
+  auto func = Optimized(InstructionBuffer::Of(
+      op::ConstI32(2), op::ConstI32(3), op::AddI32(), op::SetLocalI32(2),
+      op::GetLocalI32(2), op::ConstI32(5),
+      op::CompareI32{.cond = Condition::kEq}, op::If{}, op::GetLocalI32(0),
+      op::SetLocalI32(2), op::Else(), op::Unreachable(), op::End(),
+      op::GetLocalI32(2), op::ConstI32(0), op::AddI32()));
+  EXPECT_EQ(ToString(func),
+            "b0:\n"
+            "  v0 = param 0\n"
+            "  jump b1\n"
+            "b1: <- b0\n"
+            "  jump b3\n"
+            "b3: <- b1\n"
+            "  return v0\n");
+}
+
+TEST(Passes, NumberValues) {
+  auto func = Optimized(InstructionBuffer::Of(
+      op::GetLocalI32(0), op::GetLocalI32(1), op::AddI32(),
+      op::GetLocalI32(1), op::GetLocalI32(0), op::AddI32(),
+      op::CompareI32{.cond = Condition::kEq}));
+  // Both adds are the same, so the comparison is of a value with itself.
+  EXPECT_EQ(Find(func, Opcode::kAdd).size(), 1);
+  auto compares = Find(func, Opcode::kCompare);
+  ASSERT_EQ(compares.size(), 1);
+  const auto& args = func.values[compares[0]].args;
+  EXPECT_EQ(args[0], args[1]);
+}
+
+TEST(Passes, HoistLoopInvariants) {
+  // Adds both parameters together on every iteration.
+  auto func = Optimized(InstructionBuffer::Of(
+      op::Loop{}, op::GetLocalI32(0), op::GetLocalI32(1), op::AddI32(),
+      op::GetLocalI32(2), op::AddI32(), op::SetLocalI32(2),
+      op::GetLocalI32(2), op::ConstI32(100),
+      op::CompareI32{.cond = Condition::kLtU}, op::BrIf{.depth = 0},
+      op::End(), op::GetLocalI32(2)));
+  auto adds = Find(func, Opcode::kAdd);
+  ASSERT_EQ(adds.size(), 2);
+  EXPECT_EQ(func.values[adds[0]].block, 0) << ToString(func);
+  EXPECT_NE(func.values[adds[1]].block, 0) << ToString(func);
+}
+
+TEST(Passes, EliminateDeadCode) {
+  auto func = Optimized(InstructionBuffer::Of(
+      op::GetLocalI32(0), op::GetLocalI32(1), op::AddI32(),
+      op::SetLocalI32(2), op::GetLocalI32(1)));
+  EXPECT_EQ(ToString(func),
+            "b0:\n"
+            "  v1 = param 1\n"
+            "  return v1\n");
+}
+
+TEST(Passes, SplitCriticalEdges) {
+  for (const auto& body :
+       {SumKernel(), SwitchKernel(), MaxKernel(), SwapKernel()}) {
+    auto func = Optimized(body);
+    for (BlockId b : ReversePostorder(func)) {
+      if (func.blocks[b].phis.empty()) {
+        continue;
+      }
+      for (BlockId pred : func.blocks[b].preds) {
+        EXPECT_EQ(Successors(func, pred).size(), 1) << ToString(func);
+      }
+    }
+  }
+}
+
+}  // namespace wasmcc::ssa
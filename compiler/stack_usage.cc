@@ -0,0 +1,17 @@
+#include "compiler/stack_usage.h"
+
+namespace wasmcc {
+
+std::optional<size_t> MaxStackBytes(const CompiledModule& module,
+                                    FuncIdx idx) {
+  const auto& function = module.functions[idx.value()];
+  if (function.get() == nullptr ||
+      function.frame_size_bytes() == CompiledFunction::kUnknownFrameSize) {
+    return std::nullopt;
+  }
+  // The call itself pushes the return address (or the callee could spill the
+  // link register, on machines that have one).
+  return sizeof(void*) + function.frame_size_bytes();
+}
+
+}  // namespace wasmcc
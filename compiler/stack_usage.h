@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+#include "compiler/module.h"
+#include "core/ast.h"
+
+namespace wasmcc {
+
+/**
+ * The most native stack a call to `module.functions[idx]` can use, from its
+ * return address down, or nothing if it can't be bounded statically, in which
+ * case the caller has to fall back to a stack big enough for anything and
+ * rely on its guard pages.
+ *
+ * This is the largest sum of frame sizes along any path through the call
+ * graph from the function. The IR has no calls or tables yet, so every
+ * function is a leaf and its bound is its own frame. Functions whose frame
+ * size isn't known, such as those compiled lazily, can't be bounded.
+ */
+std::optional<size_t> MaxStackBytes(const CompiledModule& module, FuncIdx idx);
+
+}  // namespace wasmcc
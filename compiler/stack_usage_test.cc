@@ -0,0 +1,67 @@
+#include "compiler/stack_usage.h"
+
+#include <gtest/gtest.h>
+
+#include "base/stream.h"
+#include "compiler/compiler.h"
+#include "compiler/lazy_module.h"
+#include "parser/parser.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+ParsedModule Parse(std::string_view wat) {
+  auto source = ByteStream(Wat2Wasm(wat));
+  return ParseModule(&source).get();
+}
+
+constexpr std::string_view kModule = R"WAT(
+(module
+  (func $small (result i32) i32.const 1)
+  (func $big (param $a i32) (result i32)
+    (local $b i32) (local $c i32) (local $d i32) (local $e i32)
+    (local $f i32) (local $g i32) (local $h i32) (local $i i32)
+    local.get $a
+    local.get $b
+    local.get $c
+    local.get $d
+    local.get $e
+    local.get $f
+    local.get $g
+    local.get $h
+    local.get $i
+    i32.add
+    i32.add
+    i32.add
+    i32.add
+    i32.add
+    i32.add
+    i32.add
+    i32.add)
+  (export "small" (func $small))
+  (export "big" (func $big)))
+)WAT";
+
+TEST(StackUsage, BoundsCompiledFunctionsByTheirFrame) {
+  auto compiler = Compiler::CreateNative();
+  auto compiled = compiler->Compile(Parse(kModule)).get();
+  for (uint32_t i = 0; i < compiled.functions.size(); ++i) {
+    auto bytes = MaxStackBytes(compiled, FuncIdx(i));
+    ASSERT_TRUE(bytes.has_value());
+    EXPECT_EQ(*bytes, sizeof(void*) + compiled.functions[i].frame_size_bytes());
+  }
+  // The deep operand stack needs more room.
+  EXPECT_LT(MaxStackBytes(compiled, FuncIdx(0)),
+            MaxStackBytes(compiled, FuncIdx(1)));
+  compiler->Release(std::move(compiled)).get();
+}
+
+TEST(StackUsage, CannotBoundLazilyCompiledFunctions) {
+  auto compiler = Compiler::CreateNative();
+  auto lazy = LazyModule::Create(Parse(kModule), compiler.get());
+  EXPECT_EQ(MaxStackBytes(lazy->module(), FuncIdx(0)), std::nullopt);
+}
+
+}  // namespace
+}  // namespace wasmcc
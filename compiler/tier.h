@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+namespace wasmcc {
+
+/**
+ * How much effort to put into the generated code.
+ */
+enum class Tier : uint8_t {
+  // Compile each function in a single pass, straight from the IR, so code is
+  // ready as soon as possible.
+  kBaseline,
+  // Optimize each function in SSA form and allocate registers across the
+  // whole function (see `ssa::Optimize`), for code that runs long enough to
+  // pay back the extra compile time. Targets or functions the SSA backend
+  // doesn't support get the baseline compiler on optimized IR (see
+  // `Optimize`).
+  kOptimized,
+};
+
+}  // namespace wasmcc
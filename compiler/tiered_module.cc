@@ -0,0 +1,95 @@
+#include "compiler/tiered_module.h"
+
+#include <exception>
+#include <utility>
+
+namespace wasmcc {
+
+TieredModule::TieredModule(ParsedModule parsed, Compiler* baseline,
+                           Compiler* optimizing)
+    : _parsed(std::move(parsed)),
+      _baseline(baseline),
+      _optimizing(optimizing) {}
+
+co::Future<std::unique_ptr<TieredModule>> TieredModule::Create(
+    ParsedModule parsed, Compiler* baseline, Compiler* optimizing,
+    TieringOptions options) {
+  std::unique_ptr<TieredModule> tiered(
+      new TieredModule(std::move(parsed), baseline, optimizing));
+  // The IR is kept to recompile from, so the baseline compiler gets a copy.
+  tiered->_baseline_code = co_await baseline->Compile(tiered->_parsed);
+  const auto& functions = tiered->_baseline_code.functions;
+  tiered->_module.functions.reserve(functions.size());
+  for (size_t i = 0; i < functions.size(); ++i) {
+    auto& slot = tiered->_slots.emplace_back(
+        functions[i].get(), options.hot_threshold,
+        [module = tiered.get(), i] { module->Enqueue(i); });
+    tiered->_module.functions.emplace_back(&slot, functions[i].metadata());
+  }
+  tiered->_module.exported_functions =
+      tiered->_baseline_code.exported_functions;
+  tiered->_module.code = tiered->_baseline_code.code;
+  co_return std::move(tiered);
+}
+
+TieredModule::~TieredModule() {
+  {
+    std::unique_lock lock(_mutex);
+    _stopping = true;
+  }
+  _work_available.notify_all();
+  if (_worker.joinable()) {
+    _worker.join();
+  }
+  _baseline->Release(std::move(_baseline_code)).get();
+}
+
+void TieredModule::WaitForRecompilation() {
+  std::unique_lock lock(_mutex);
+  _idle.wait(lock, [this] { return _queue.empty() && !_busy; });
+}
+
+size_t TieredModule::num_optimized() const { return _optimizing.size(); }
+
+void TieredModule::Enqueue(size_t idx) {
+  {
+    std::unique_lock lock(_mutex);
+    _queue.push_back(idx);
+    if (!_worker.joinable()) {
+      _worker = std::thread([this] { RecompileLoop(); });
+    }
+  }
+  _work_available.notify_one();
+}
+
+void TieredModule::RecompileLoop() {
+  std::unique_lock lock(_mutex);
+  while (true) {
+    _work_available.wait(lock,
+                         [this] { return _stopping || !_queue.empty(); });
+    if (_stopping) {
+      return;
+    }
+    size_t idx = _queue.front();
+    _queue.pop_front();
+    _busy = true;
+    lock.unlock();
+    CompiledFunction* compiled = nullptr;
+    try {
+      compiled = _optimizing.Compile(_parsed.functions[idx]);
+    } catch (const std::exception&) {
+      // Keep running the baseline code. Nothing can be thrown from this
+      // thread, and `_busy` must be reset for `WaitForRecompilation`.
+    }
+    lock.lock();
+    if (compiled != nullptr) {
+      _slots[idx].Patch(compiled->get());
+    }
+    _busy = false;
+    if (_queue.empty()) {
+      _idle.notify_all();
+    }
+  }
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "base/coro.h"
+#include "compiler/compiler.h"
+#include "compiler/dispatch_slot.h"
+#include "compiler/module.h"
+#include "compiler/single_function_compiler.h"
+#include "core/ast.h"
+
+namespace wasmcc {
+
+struct TieringOptions {
+  /**
+   * How many calls it takes for a function to be recompiled by the optimizing
+   * compiler, or zero to never recompile.
+   */
+  uint32_t hot_threshold = 1000;
+};
+
+/**
+ * A module that starts out with code from a compiler that is fast to compile
+ * with, where functions are recompiled by an optimizing compiler once they are
+ * hot, so that short lived modules start quickly and long lived ones still
+ * reach peak throughput.
+ *
+ * Every function is called through a `DispatchSlot`, which counts calls to
+ * it. The call that makes a function hot queues it to be recompiled on a
+ * background thread (which is only started once something is hot), and the
+ * slot is patched to the optimized code once it's ready. Calls that are
+ * already running keep running the old code, so all code lives as long as the
+ * module does.
+ */
+class TieredModule {
+ public:
+  /**
+   * Compile `parsed` with `baseline`, ready to recompile functions with
+   * `optimizing`. Both compilers must outlive the module.
+   */
+  static co::Future<std::unique_ptr<TieredModule>> Create(ParsedModule parsed,
+                                                          Compiler* baseline,
+                                                          Compiler* optimizing,
+                                                          TieringOptions = {});
+
+  TieredModule(const TieredModule&) = delete;
+  TieredModule& operator=(const TieredModule&) = delete;
+  TieredModule(TieredModule&&) = delete;
+  TieredModule& operator=(TieredModule&&) = delete;
+  // Waits for any recompilation that is in progress.
+  ~TieredModule();
+
+  /**
+   * The module to run, whose functions call through the dispatch slots. It is
+   * only valid while this module is alive.
+   */
+  const CompiledModule& module() const { return _module; }
+
+  /** Block until every function that has become hot has been recompiled. */
+  void WaitForRecompilation();
+
+  /** The number of functions that have been recompiled. */
+  size_t num_optimized() const;
+
+ private:
+  TieredModule(ParsedModule, Compiler* baseline, Compiler* optimizing);
+
+  // Called on the first thread to make function `idx` hot.
+  void Enqueue(size_t idx);
+  void RecompileLoop();
+
+  ParsedModule _parsed;
+  Compiler* _baseline;
+  CompiledModule _baseline_code;
+  SingleFunctionCompiler _optimizing;
+  // Stable, as the compiled functions point into them.
+  std::deque<DispatchSlot> _slots;
+  CompiledModule _module;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _work_available;
+  std::condition_variable _idle;
+  // Functions waiting to be recompiled, in the order they became hot.
+  std::deque<size_t> _queue;
+  // If a function is being recompiled right now.
+  bool _busy = false;
+  bool _stopping = false;
+  std::thread _worker;
+};
+
+}  // namespace wasmcc
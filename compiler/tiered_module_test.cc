@@ -0,0 +1,143 @@
+#include "compiler/tiered_module.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "base/stream.h"
+#include "compiler/compiler.h"
+#include "parser/parser.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+constexpr std::string_view kModule = R"WAT(
+(module
+  (func $add (param $lhs i32) (param $rhs i32) (result i32)
+    (local $bias i32)
+    i32.const 0
+    local.set $bias
+    local.get $lhs
+    local.get $rhs
+    i32.add
+    local.get $bias
+    i32.add)
+  (func $cold (result i32) i32.const 1)
+  (export "add" (func $add))
+  (export "cold" (func $cold)))
+)WAT";
+
+class TieredModuleTest : public ::testing::Test {
+ public:
+  std::unique_ptr<TieredModule> Create(TieringOptions options,
+                                       Compiler* optimizing = nullptr) {
+    auto source = ByteStream(Wat2Wasm(kModule));
+    auto parsed = ParseModule(&source).get();
+    return TieredModule::Create(
+               std::move(parsed), _baseline.get(),
+               optimizing != nullptr ? optimizing : _optimizing.get(), options)
+        .get();
+  }
+
+ private:
+  std::unique_ptr<Compiler> _baseline = Compiler::CreateNative();
+  std::unique_ptr<Compiler> _optimizing =
+      Compiler::CreateNative({.tier = Tier::kOptimized});
+};
+
+// A compiler that runs out of memory every time.
+class ThrowingCompiler final : public Compiler {
+ public:
+  co::Future<CompiledModule> Compile(ParsedModule) override {
+    ++attempts;
+    throw std::bad_alloc();
+  }
+  co::Future<CompiledArtifact> CompileArtifact(ParsedModule) override {
+    throw std::bad_alloc();
+  }
+  co::Future<> Release(CompiledModule) override { co_return; }
+  const CompilerOptions& options() const override { return _options; }
+
+  std::atomic<int> attempts = 0;
+
+ private:
+  CompilerOptions _options;
+};
+
+CompiledFunction Export(const TieredModule& tiered, std::string_view name) {
+  const auto& module = tiered.module();
+  auto idx = module.exported_functions.at(Name(std::string(name)));
+  return module.functions[idx.value()];
+}
+
+}  // namespace
+
+TEST_F(TieredModuleTest, RecompilesHotFunctions) {
+  auto tiered = Create({.hot_threshold = 10});
+  auto add = Export(*tiered, "add");
+  auto cold = Export(*tiered, "cold");
+  void* baseline = add.get();
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(int32_t(i), 1)), i + 1);
+  }
+  EXPECT_EQ(cold.invoke<int32_t>(), 1);
+  tiered->WaitForRecompilation();
+  EXPECT_EQ(tiered->num_optimized(), 0);
+  EXPECT_EQ(add.get(), baseline);
+
+  EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(9, 1)), 10);
+  tiered->WaitForRecompilation();
+  EXPECT_EQ(tiered->num_optimized(), 1);
+  EXPECT_NE(add.get(), baseline);
+  EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(2, 3)), 5);
+  EXPECT_EQ(cold.invoke<int32_t>(), 1);
+}
+
+TEST_F(TieredModuleTest, KeepsBaselineCodeWhenRecompilingThrows) {
+  ThrowingCompiler optimizing;
+  auto tiered = Create({.hot_threshold = 1}, &optimizing);
+  auto add = Export(*tiered, "add");
+  void* baseline = add.get();
+  EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(2, 3)), 5);
+  tiered->WaitForRecompilation();
+  EXPECT_EQ(optimizing.attempts, 1);
+  EXPECT_EQ(tiered->num_optimized(), 0);
+  EXPECT_EQ(add.get(), baseline);
+  EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(4, 5)), 9);
+}
+
+TEST_F(TieredModuleTest, NeverRecompilesWithoutAThreshold) {
+  auto tiered = Create({.hot_threshold = 0});
+  auto add = Export(*tiered, "add");
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ((add.invoke<int32_t, int32_t, int32_t>(int32_t(i), 1)), i + 1);
+  }
+  tiered->WaitForRecompilation();
+  EXPECT_EQ(tiered->num_optimized(), 0);
+}
+
+TEST_F(TieredModuleTest, PatchesWhileRunning) {
+  auto tiered = Create({.hot_threshold = 100});
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&tiered, t] {
+      auto add = Export(*tiered, "add");
+      for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(
+            (add.invoke<int32_t, int32_t, int32_t>(int32_t(i), int32_t(t))),
+            i + t);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  tiered->WaitForRecompilation();
+  EXPECT_EQ(tiered->num_optimized(), 1);
+}
+
+}  // namespace wasmcc
@@ -7,6 +7,33 @@ GpReg Cast(const GpReg& reg, ValType vt) {
   GpReg reg64 = reg.r64();
   return IsValType32Bit(vt) ? reg32 : reg64;
 }
+
+asmjit::x86::CondCode ToCondCode(Condition cond) {
+  switch (cond) {
+    case Condition::kEq:
+      return asmjit::x86::CondCode::kEqual;
+    case Condition::kNe:
+      return asmjit::x86::CondCode::kNotEqual;
+    case Condition::kLtS:
+      return asmjit::x86::CondCode::kSignedLT;
+    case Condition::kLtU:
+      return asmjit::x86::CondCode::kUnsignedLT;
+    case Condition::kGtS:
+      return asmjit::x86::CondCode::kSignedGT;
+    case Condition::kGtU:
+      return asmjit::x86::CondCode::kUnsignedGT;
+    case Condition::kLeS:
+      return asmjit::x86::CondCode::kSignedLE;
+    case Condition::kLeU:
+      return asmjit::x86::CondCode::kUnsignedLE;
+    case Condition::kGeS:
+      return asmjit::x86::CondCode::kSignedGE;
+    case Condition::kGeU:
+      return asmjit::x86::CondCode::kUnsignedGE;
+  }
+  __builtin_unreachable();
+}
+
 const RegisterMask<GpReg> CallingConvention::kGpCalleeSavedRegisters({
     asmjit::x86::rbx,
     asmjit::x86::rbp,
@@ -5,6 +5,7 @@
 #include <array>
 
 #include "compiler/common/call_convention.h"
+#include "core/instruction.h"
 #include "core/value.h"
 
 namespace wasmcc::x64 {
@@ -14,6 +15,9 @@ static constexpr GpReg kSpReg = asmjit::x86::rsp;
 
 GpReg Cast(const GpReg& reg, ValType vt);
 
+// The condition code for the flags set by `cmp lhs, rhs` when `lhs <cond> rhs`.
+asmjit::x86::CondCode ToCondCode(Condition cond);
+
 // The SystemV calling convention, which is used on Mac + Linux.
 struct CallingConvention {
   using GpReg = GpReg;
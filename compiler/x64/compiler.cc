@@ -2,9 +2,14 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstddef>
+#include <iterator>
 #include <memory>
+#include <utility>
+#include <vector>
 
+#include "compiler/common/exception.h"
 #include "compiler/common/util.h"
 #include "compiler/x64/call_convention.h"
 #include "compiler/x64/register_tracker.h"
@@ -18,6 +23,33 @@ namespace x86 = asmjit::x86;
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
 static ThrowingErrorHandler kErrorHandler;
 
+class MoveEmitter {
+ public:
+  MoveEmitter(x86::Assembler* assembler,
+              const FunctionFrame<CallingConvention>* frame)
+      : _asm(assembler), _frame(frame) {}
+
+  void Store(const GpReg& src, const RuntimeValue& slot) {
+    _asm->mov(x86::Mem(x86::rsp, _frame->ValueStackOffset(slot)),
+              Cast(src, slot.type));
+  }
+  void Load(const RuntimeValue& slot, const GpReg& dst) {
+    if (slot.constant) {
+      _asm->mov(dst.r32(), slot.constant->AsI32());
+      return;
+    }
+    _asm->mov(Cast(dst, slot.type),
+              x86::Mem(x86::rsp, _frame->ValueStackOffset(slot)));
+  }
+  void Move(const GpReg& src, const GpReg& dst, ValType vt) {
+    _asm->mov(Cast(dst, vt), Cast(src, vt));
+  }
+
+ private:
+  x86::Assembler* _asm;
+  const FunctionFrame<CallingConvention>* _frame;
+};
+
 }  // namespace
 
 Compiler::Compiler(Function::Metadata meta, asmjit::CodeHolder* holder)
@@ -31,6 +63,11 @@ Compiler::Compiler(Function::Metadata meta, asmjit::CodeHolder* holder)
   _asm.addDiagnosticOptions(asmjit::DiagnosticOptions::kValidateAssembler);
 #endif
   _asm.setErrorHandler(&kErrorHandler);
+  for (size_t i = 0; i < _frame.num_locals(); ++i) {
+    if (const auto& reg = _frame.LocalRegister(i)) {
+      _reg_tracker->ReserveRegister(*reg);
+    }
+  }
 }
 
 void Compiler::SetLogger(asmjit::Logger* logger) { _asm.setLogger(logger); }
@@ -40,28 +77,75 @@ void Compiler::Prologue() {
   AnnotateNext("set locals stack space");
   // rsp -= <stack_size>
   _asm.sub(x86::regs::rsp, _frame.StackSizeBytes());
-  // TODO: We should lazily spill these onto the stack, and handle passing
-  // values by stack
-  for (size_t i = 0; i < _meta.signature.parameter_types.size(); ++i) {
-    ValType vt = _meta.signature.parameter_types[i];
+  auto saved = _frame.SavedRegisters();
+  for (size_t i = 0; i < saved.size(); ++i) {
+    AnnotateNext("save callee saved register");
+    _asm.mov(x86::Mem(x86::regs::rsp, _frame.SavedRegisterOffset(i)),
+             saved[i]);
+  }
+  // TODO: Handle passing values by stack
+  const auto& params = _meta.signature.parameter_types;
+  for (size_t i = 0; i < params.size(); ++i) {
+    ValType vt = params[i];
     // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
     const auto& reg = Cast(CallingConvention::kGpArgs[i], vt);
-    auto comment = AnnotateNext("SaveLocalToStack(%d)", i);
-    _asm.mov(x86::Mem(x86::regs::rsp, _frame.LocalStackOffset(i)), reg);
+    const auto& home = _frame.LocalRegister(i);
+    if (!home) {
+      auto comment = AnnotateNext("SaveLocalToStack(%d)", i);
+      _asm.mov(x86::Mem(x86::regs::rsp, _frame.LocalStackOffset(i)), reg);
+    } else if (home->id() != reg.id()) {
+      auto comment = AnnotateNext("MoveLocalToRegister(%d)", i);
+      _asm.mov(Cast(*home, vt), reg);
+    }
+  }
+  // Locals start out as zero.
+  for (size_t i = params.size(); i < _frame.num_locals(); ++i) {
+    auto comment = AnnotateNext("ZeroLocal(%d)", i);
+    if (const auto& home = _frame.LocalRegister(i)) {
+      _asm.xor_(home->r32(), home->r32());
+      continue;
+    }
+    ValType vt = _meta.locals[i - params.size()];
+    auto offset = _frame.LocalStackOffset(i);
+    _asm.mov(IsValType64Bit(vt) ? x86::qword_ptr(x86::regs::rsp, offset)
+                                : x86::dword_ptr(x86::regs::rsp, offset),
+             0);
+  }
+  // Branching to the function's frame is returning, which expects the
+  // results in the return registers.
+  const auto& result_types = _meta.signature.result_types;
+  if (result_types.size() > CallingConvention::kGpRets.size()) [[unlikely]] {
+    throw CompilationException("too many function results");
   }
+  std::vector<RuntimeValue> results;
+  int32_t stack_pointer = 0;
+  for (size_t i = 0; i < result_types.size(); ++i) {
+    stack_pointer += int32_t(ValTypeSizeBytes(result_types[i]));
+    results.push_back({
+        .stack_pointer = stack_pointer,
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+        .reg = CallingConvention::kGpRets[i],
+        .type = result_types[i],
+    });
+  }
+  _control.push_back({
+      .kind = ControlFrame::Kind::kFunction,
+      .label = _exit_label,
+      .arity = results.size(),
+      .merge = std::move(results),
+  });
 }
 void Compiler::Epilogue() {
   AnnotateNext("epilog start");
+  if (!_unreachable) {
+    EmitMoves(PrepareBranch(&_control.front()));
+  }
   _asm.bind(_exit_label);
-  if (!_meta.signature.result_types.empty()) {
-    auto vt = _meta.signature.result_types.front();
-    auto result_reg = Cast(x86::regs::rax, vt);
-    auto v = _stack->Pop();
-    auto stack_top_reg = EnsureInRegister(&v);
-    stack_top_reg = Cast(stack_top_reg, v.type);
-    if (stack_top_reg != result_reg) {
-      _asm.mov(result_reg, stack_top_reg);
-    }
+  auto saved = _frame.SavedRegisters();
+  for (size_t i = 0; i < saved.size(); ++i) {
+    AnnotateNext("restore callee saved register");
+    _asm.mov(saved[i],
+             x86::Mem(x86::regs::rsp, _frame.SavedRegisterOffset(i)));
   }
   // rsp += <stack size>
   _asm.add(x86::regs::rsp, _frame.StackSizeBytes());
@@ -69,48 +153,446 @@ void Compiler::Epilogue() {
 }
 
 void Compiler::operator()(const op::ConstI32& op) {
-  auto* top = _stack->Push({.type = ValType::kI32});
-  auto reg = EnsureInRegister(top);
-  int32_t v = op.value.AsI32();
-  auto comment = AnnotateNext("ConstI32(%d)", v);
-  // reg = i32
-  _asm.mov(reg.r32(), v);
+  if (_unreachable) {
+    return;
+  }
+  MaterializeCondition();
+  // Nothing is emitted until the constant is used, as it can often be folded
+  // or become an immediate operand.
+  _stack->Push({.type = ValType::kI32, .constant = op.value});
 }
 void Compiler::operator()(const op::AddI32&) {
+  if (_unreachable) {
+    return;
+  }
   auto x2 = _stack->Pop();
-  auto x2_reg = EnsureInRegister(&x2);
   auto* x1 = _stack->Peek();
+  if (x1->constant && x2.constant) {
+    x1->constant = Value::U32(x1->constant->AsU32() + x2.constant->AsU32());
+    return;
+  }
+  if (x2.constant) {
+    auto x1_reg = EnsureInRegister(x1);
+    int32_t imm = x2.constant->AsI32();
+    if (imm != 0) {
+      AnnotateNext("AddI32");
+      // x1r += imm
+      _asm.add(x1_reg.r32(), imm);
+    }
+    return;
+  }
+  auto x2_reg = EnsureInRegister(&x2);
+  if (x1->constant) {
+    // Addition commutes, so add into x2's register and make it the result.
+    AnnotateNext("AddI32");
+    // x2r += imm
+    _asm.add(x2_reg.r32(), x1->constant->AsI32());
+    x1->constant = std::nullopt;
+    x1->reg = x2_reg;
+    return;
+  }
   auto x1_reg = EnsureInRegister(x1);
   AnnotateNext("AddI32");
   // x1r += x2r
-  _asm.adc(x1_reg.r32(), x2_reg.r32());
+  _asm.add(x1_reg.r32(), x2_reg.r32());
   _reg_tracker->MarkRegisterUnused(x2_reg);
 }
+void Compiler::operator()(const op::EqzI32&) {
+  if (_unreachable) {
+    return;
+  }
+  auto* top = _stack->Peek();
+  if (top->condition) {
+    top->condition = Negate(*top->condition);
+    return;
+  }
+  if (top->constant) {
+    top->constant = Value::I32(top->constant->AsU32() == 0 ? 1 : 0);
+    return;
+  }
+  auto reg = EnsureInRegister(top);
+  AnnotateNext("EqzI32");
+  _asm.test(reg.r32(), reg.r32());
+  _reg_tracker->MarkRegisterUnused(reg);
+  top->reg = std::nullopt;
+  top->condition = Condition::kEq;
+}
+void Compiler::operator()(const op::CompareI32& op) {
+  if (_unreachable) {
+    return;
+  }
+  auto rhs = _stack->Pop();
+  auto* lhs = _stack->Peek();
+  if (lhs->constant && rhs.constant) {
+    bool result =
+        Evaluate(op.cond, lhs->constant->AsU32(), rhs.constant->AsU32());
+    lhs->constant = Value::I32(result ? 1 : 0);
+    return;
+  }
+  // The result is left in the flags, so that a branch can use them directly.
+  if (rhs.constant) {
+    auto lhs_reg = EnsureInRegister(lhs);
+    AnnotateNext("CompareI32");
+    _asm.cmp(lhs_reg.r32(), rhs.constant->AsI32());
+    _reg_tracker->MarkRegisterUnused(lhs_reg);
+    lhs->reg = std::nullopt;
+    lhs->condition = op.cond;
+    return;
+  }
+  auto rhs_reg = EnsureInRegister(&rhs);
+  if (lhs->constant) {
+    // Only the right hand side can be an immediate, so swap the operands.
+    AnnotateNext("CompareI32");
+    _asm.cmp(rhs_reg.r32(), lhs->constant->AsI32());
+    _reg_tracker->MarkRegisterUnused(rhs_reg);
+    lhs->constant = std::nullopt;
+    lhs->condition = Commute(op.cond);
+    return;
+  }
+  auto lhs_reg = EnsureInRegister(lhs);
+  AnnotateNext("CompareI32");
+  _asm.cmp(lhs_reg.r32(), rhs_reg.r32());
+  _reg_tracker->MarkRegisterUnused(rhs_reg);
+  _reg_tracker->MarkRegisterUnused(lhs_reg);
+  lhs->reg = std::nullopt;
+  lhs->condition = op.cond;
+}
 void Compiler::operator()(const op::GetLocalI32& op) {
+  if (_unreachable) {
+    return;
+  }
+  MaterializeCondition();
   _stack->Push({.type = ValType::kI32});
   auto* top = _stack->Peek();
   top->reg = AllocateRegister();
-  auto offset = _frame.LocalStackOffset(op.idx);
   auto comment = AnnotateNext("GetLocalI32(%d)", op.idx);
+  // The local can change while the value is on the stack, so always copy it.
+  if (const auto& home = _frame.LocalRegister(op.idx)) {
+    _asm.mov(top->reg->r32(), home->r32());
+    return;
+  }
+  auto offset = _frame.LocalStackOffset(op.idx);
   _asm.mov(top->reg->r32(), x86::Mem(x86::rsp, offset));
 }
 void Compiler::operator()(const op::SetLocalI32& op) {
+  if (_unreachable) {
+    return;
+  }
   auto v = _stack->Pop();
-  auto v_reg = EnsureInRegister(&v);
+  if (const auto& home = _frame.LocalRegister(op.idx)) {
+    if (v.constant) {
+      auto comment = AnnotateNext("SetLocalI32(%d)", op.idx);
+      _asm.mov(home->r32(), v.constant->AsI32());
+      return;
+    }
+    auto v_reg = EnsureInRegister(&v);
+    auto comment = AnnotateNext("SetLocalI32(%d)", op.idx);
+    _asm.mov(home->r32(), v_reg.r32());
+    _reg_tracker->MarkRegisterUnused(v_reg);
+    return;
+  }
   auto offset = _frame.LocalStackOffset(op.idx);
+  if (v.constant) {
+    auto comment = AnnotateNext("SetLocalI32(%d)", op.idx);
+    _asm.mov(x86::dword_ptr(x86::rsp, offset), v.constant->AsI32());
+    return;
+  }
+  auto v_reg = EnsureInRegister(&v);
   auto comment = AnnotateNext("SetLocalI32(%d)", op.idx);
-  _asm.mov(x86::Mem(x86::rsp, offset), v_reg);
+  _asm.mov(x86::Mem(x86::rsp, offset), Cast(v_reg, v.type));
   _reg_tracker->MarkRegisterUnused(v_reg);
 }
-void Compiler::operator()(const op::Return&) { _asm.jmp(_exit_label); }
-void Compiler::operator()(const op::Label&) {
-  // TODO
+void Compiler::operator()(const op::Return&) {
+  if (_unreachable) {
+    return;
+  }
+  AnnotateNext("Return");
+  EmitMoves(PrepareBranch(&_control.front()));
+  _asm.jmp(_exit_label);
+  MarkUnreachable();
+}
+void Compiler::operator()(const op::Unreachable&) {
+  if (_unreachable) {
+    return;
+  }
+  AnnotateNext("Unreachable");
+  _asm.ud2();
+  MarkUnreachable();
+}
+void Compiler::operator()(const op::Block& op) {
+  if (_unreachable) {
+    ++_unreachable_depth;
+    return;
+  }
+  MaterializeCondition();
+  _control.push_back({
+      .kind = ControlFrame::Kind::kBlock,
+      .label = _asm.newLabel(),
+      .height = _stack->size(),
+      .arity = op.result ? 1U : 0U,
+  });
 }
-void Compiler::operator()(const op::Br&) {
-  // TODO
+void Compiler::operator()(const op::Loop&) {
+  if (_unreachable) {
+    ++_unreachable_depth;
+    return;
+  }
+  MaterializeCondition();
+  // Branches to a loop carry no values and go back to the start, so the
+  // state at the start is the state every branch needs to match.
+  auto values = _stack->ReverseIterator();
+  _control.push_back({
+      .kind = ControlFrame::Kind::kLoop,
+      .label = _asm.newLabel(),
+      .height = _stack->size(),
+      .merge = std::vector<RuntimeValue>(values.begin(), values.end()),
+  });
+  _asm.bind(_control.back().label);
 }
-void Compiler::operator()(const op::BrIf&) {
-  // TODO
+void Compiler::operator()(const op::If& op) {
+  if (_unreachable) {
+    ++_unreachable_depth;
+    return;
+  }
+  auto cond = _stack->Pop();
+  std::optional<Condition> taken;
+  if (!cond.constant) {
+    taken = TestCondition(&cond);
+  }
+  auto values = _stack->ReverseIterator();
+  _control.push_back({
+      .kind = ControlFrame::Kind::kIf,
+      .label = _asm.newLabel(),
+      .else_label = _asm.newLabel(),
+      .height = _stack->size(),
+      .arity = op.result ? 1U : 0U,
+      .else_state = std::vector<RuntimeValue>(values.begin(), values.end()),
+  });
+  if (taken) {
+    AnnotateNext("If");
+    _asm.j(ToCondCode(Negate(*taken)), _control.back().else_label);
+  } else if (cond.constant->AsU32() == 0) {
+    // Only the else branch (if any) is ever executed.
+    MarkUnreachable();
+  }
+}
+void Compiler::operator()(const op::Else&) {
+  if (_unreachable && _unreachable_depth > 0) {
+    return;
+  }
+  auto* frame = &_control.back();
+  if (!_unreachable) {
+    EmitMoves(PrepareBranch(frame));
+    _asm.jmp(frame->label);
+  }
+  _asm.bind(frame->else_label);
+  frame->kind = ControlFrame::Kind::kElse;
+  SetState(frame->else_state);
+  _unreachable = false;
+}
+void Compiler::operator()(const op::End&) {
+  if (_unreachable && _unreachable_depth > 0) {
+    --_unreachable_depth;
+    return;
+  }
+  ControlFrame frame = std::move(_control.back());
+  _control.pop_back();
+  if (frame.kind == ControlFrame::Kind::kLoop) {
+    // The label is at the start of the loop, so just fall through.
+    return;
+  }
+  bool fallthrough = !_unreachable;
+  if (fallthrough) {
+    EmitMoves(PrepareBranch(&frame));
+  }
+  if (frame.kind == ControlFrame::Kind::kIf) {
+    // Without an else, the else branch goes straight to the end.
+    if (!frame.merge) {
+      frame.merge = std::move(frame.else_state);
+      _asm.bind(frame.else_label);
+    } else {
+      auto moves = MergeMoves<CallingConvention>(frame.else_state, *frame.merge);
+      if (fallthrough && !moves.empty()) {
+        _asm.jmp(frame.label);
+      }
+      _asm.bind(frame.else_label);
+      EmitMoves(moves);
+    }
+  }
+  _asm.bind(frame.label);
+  // If nothing branches here, then the code after the frame is unreachable as
+  // well.
+  if (frame.merge) {
+    SetState(*frame.merge);
+    _unreachable = false;
+  }
+}
+void Compiler::operator()(const op::Br& op) {
+  if (_unreachable) {
+    return;
+  }
+  auto comment = AnnotateNext("Br(%d)", op.depth);
+  Branch(op.depth);
+}
+void Compiler::operator()(const op::BrIf& op) {
+  if (_unreachable) {
+    return;
+  }
+  auto cond = _stack->Pop();
+  if (cond.constant) {
+    if (cond.constant->AsU32() != 0) {
+      auto comment = AnnotateNext("BrIf(%d)", op.depth);
+      Branch(op.depth);
+    }
+    return;
+  }
+  auto* frame = ControlAt(op.depth);
+  auto taken = TestCondition(&cond);
+  // This must happen before branching, as it can change the state of the
+  // stack for the fallthrough too. None of this touches the flags.
+  auto moves = PrepareBranch(frame);
+  auto comment = AnnotateNext("BrIf(%d)", op.depth);
+  if (moves.empty()) {
+    _asm.j(ToCondCode(taken), frame->label);
+    return;
+  }
+  auto skip = _asm.newLabel();
+  _asm.j(ToCondCode(Negate(taken)), skip);
+  EmitMoves(moves);
+  _asm.jmp(frame->label);
+  _asm.bind(skip);
+}
+void Compiler::operator()(const op::BrTable& op) {
+  if (_unreachable) {
+    return;
+  }
+  auto index = _stack->Pop();
+  if (index.constant) {
+    uint32_t i = index.constant->AsU32();
+    AnnotateNext("BrTable");
+    Branch(i < op.size() ? op.target(i) : op.default_depth);
+    return;
+  }
+  auto index_reg = EnsureInRegister(&index);
+  auto ranges = BrTableRanges(op);
+  // Load the carried values into registers once, up front. Making room for
+  // them can spill other values, which would invalidate the moves of ranges
+  // that were already handled.
+  size_t arity = 0;
+  for (const auto& range : ranges) {
+    arity = std::max(arity, ControlAt(range.depth)->arity);
+  }
+  for (auto& v : _stack->ReverseIterator().last(arity)) {
+    EnsureInRegister(&v);
+  }
+  // Branches that need moves first go through a trampoline that does them.
+  struct Trampoline {
+    asmjit::Label label;
+    uint32_t depth;
+    std::vector<ValueMove> moves;
+  };
+  std::vector<asmjit::Label> targets;
+  std::vector<Trampoline> trampolines;
+  targets.reserve(ranges.size());
+  for (const auto& range : ranges) {
+    auto* frame = ControlAt(range.depth);
+    auto moves = BranchMoves(frame);
+    if (moves.empty()) {
+      targets.push_back(frame->label);
+      continue;
+    }
+    auto it = std::ranges::find(trampolines, range.depth, &Trampoline::depth);
+    if (it == trampolines.end()) {
+      trampolines.push_back({_asm.newLabel(), range.depth, std::move(moves)});
+      it = std::prev(trampolines.end());
+    }
+    targets.push_back(it->label);
+  }
+  _reg_tracker->MarkRegisterUnused(index_reg);
+  AnnotateNext("BrTable");
+  EmitBrTableSearch(index_reg, ranges, targets);
+  for (const auto& trampoline : trampolines) {
+    _asm.bind(trampoline.label);
+    EmitMoves(trampoline.moves);
+    _asm.jmp(ControlAt(trampoline.depth)->label);
+  }
+  MarkUnreachable();
+}
+
+Compiler::ControlFrame* Compiler::ControlAt(uint32_t depth) {
+  return &_control[_control.size() - 1 - depth];
+}
+
+void Compiler::Branch(uint32_t depth) {
+  auto* frame = ControlAt(depth);
+  EmitMoves(PrepareBranch(frame));
+  _asm.jmp(frame->label);
+  MarkUnreachable();
+}
+
+std::vector<Compiler::ValueMove> Compiler::PrepareBranch(ControlFrame* frame) {
+  auto values = _stack->ReverseIterator();
+  for (auto& v : values.last(frame->arity)) {
+    // Constants can be moved straight into the registers of an existing merge
+    // state, but the first branch defines the state so it needs a register.
+    if (!v.constant || !frame->merge) {
+      EnsureInRegister(&v);
+    }
+  }
+  return BranchMoves(frame);
+}
+
+std::vector<Compiler::ValueMove> Compiler::BranchMoves(ControlFrame* frame) {
+  auto state = BranchState<CallingConvention>(_stack->ReverseIterator(),
+                                              frame->height, frame->arity);
+  if (!frame->merge) {
+    frame->merge = std::move(state);
+    return {};
+  }
+  return MergeMoves<CallingConvention>(state, *frame->merge);
+}
+
+void Compiler::EmitMoves(std::span<const ValueMove> moves) {
+  MoveEmitter emitter(&_asm, &_frame);
+  EmitParallelMove(moves, &emitter);
+}
+
+void Compiler::SetState(std::span<const RuntimeValue> state) {
+  _stack->Restore(state);
+  _reg_tracker->Reset();
+  for (const auto& v : state) {
+    if (v.reg) {
+      _reg_tracker->MarkRegisterUsed(*v.reg);
+    }
+  }
+}
+
+void Compiler::MarkUnreachable() {
+  _unreachable = true;
+  _unreachable_depth = 0;
+}
+
+void Compiler::EmitBrTableSearch(const GpReg& index,
+                                 std::span<const BrTableRange> ranges,
+                                 std::span<const asmjit::Label> targets) {
+  while (ranges.size() > 1) {
+    size_t mid = ranges.size() / 2;
+    if (mid == 1) {
+      _asm.cmp(index.r32(), ranges[1].lo);
+      _asm.jb(targets[0]);
+      ranges = ranges.subspan(1);
+      targets = targets.subspan(1);
+      continue;
+    }
+    auto upper = _asm.newLabel();
+    _asm.cmp(index.r32(), ranges[mid].lo);
+    _asm.jae(upper);
+    EmitBrTableSearch(index, ranges.first(mid), targets.first(mid));
+    _asm.bind(upper);
+    ranges = ranges.subspan(mid);
+    targets = targets.subspan(mid);
+  }
+  _asm.jmp(targets[0]);
 }
 
 GpReg Compiler::AllocateRegister() {
@@ -118,28 +600,61 @@ GpReg Compiler::AllocateRegister() {
   if (reg) {
     return *reg;
   }
+  // Spill a single value: the deepest one in a register. Values are used in
+  // stack order, so it is the value that is needed furthest in the future.
+  // Every stack depth has its own slot in the frame, so spilling never needs
+  // more stack space than the deepest the stack gets.
   for (auto& v : _stack->ReverseIterator()) {
     if (!v.reg.has_value()) {
       continue;
     }
     std::swap(reg, v.reg);
-    // Spill the register to the stack.
     AnnotateNext("spill onto stack");
-    // rsp[sp] = r
-    _asm.mov(x86::Mem(x86::rsp, v.stack_pointer), Cast(*reg, v.type));
+    _asm.mov(x86::Mem(x86::rsp, _frame.ValueStackOffset(v)),
+             Cast(*reg, v.type));
+    ++_num_spills;
+    return *reg;
   }
-  ABSL_ASSERT(reg.has_value());
-  return *reg;
+  throw CompilationException("no register to spill");
 }
 
 GpReg Compiler::EnsureInRegister(RuntimeValue* v) {
-  if (!v->reg) {
+  if (v->condition) {
+    v->reg = AllocateRegister();
+    AnnotateNext("materialize condition");
+    _asm.set(ToCondCode(*v->condition), v->reg->r8());
+    _asm.movzx(v->reg->r32(), v->reg->r8());
+    v->condition = std::nullopt;
+  } else if (v->constant) {
+    v->reg = AllocateRegister();
+    AnnotateNext("materialize constant");
+    // reg = i32
+    _asm.mov(v->reg->r32(), v->constant->AsI32());
+    v->constant = std::nullopt;
+  } else if (!v->reg) {
     v->reg = AllocateRegister();
     AnnotateNext("load from stack");
     // reg = rsp[sp]
-    _asm.mov(Cast(*v->reg, v->type), x86::Mem(x86::rsp, v->stack_pointer));
+    _asm.mov(Cast(*v->reg, v->type),
+             x86::Mem(x86::rsp, _frame.ValueStackOffset(*v)));
   }
   return *v->reg;
 }
 
+void Compiler::MaterializeCondition() {
+  if (_stack->size() > 0 && _stack->Peek()->condition) {
+    EnsureInRegister(_stack->Peek());
+  }
+}
+
+Condition Compiler::TestCondition(RuntimeValue* v) {
+  if (v->condition) {
+    return *v->condition;
+  }
+  auto reg = EnsureInRegister(v);
+  _asm.test(reg.r32(), reg.r32());
+  _reg_tracker->MarkRegisterUnused(reg);
+  return Condition::kNe;
+}
+
 }  // namespace wasmcc::x64
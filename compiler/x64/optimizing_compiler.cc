@@ -0,0 +1,406 @@
+#include "compiler/x64/optimizing_compiler.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base/align.h"
+#include "compiler/common/exception.h"
+#include "compiler/common/util.h"
+
+namespace wasmcc::x64 {
+namespace {
+namespace x86 = asmjit::x86;
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+static ThrowingErrorHandler kErrorHandler;
+
+// Registers that are never allocated, for loading operands that can't be used
+// from memory or as an immediate.
+constexpr GpReg kScratch = x86::r11;
+// For moves from memory to memory, which can happen while `kScratch` holds a
+// value that's part of a cycle of moves.
+constexpr GpReg kMoveScratch = x86::r10;
+
+constexpr int32_t kSlotSize = 8;
+
+}  // namespace
+
+bool OptimizingCompiler::Operand::operator==(const Operand& other) const {
+  if (kind != other.kind) {
+    return false;
+  }
+  switch (kind) {
+    case Kind::kRegister:
+      return reg.id() == other.reg.id();
+    case Kind::kStack:
+      return slot == other.slot;
+    case Kind::kImmediate:
+      return imm == other.imm;
+  }
+  __builtin_unreachable();
+}
+
+OptimizingCompiler::OptimizingCompiler(const ssa::Function& func,
+                                       asmjit::CodeHolder* holder)
+    : _func(func),
+      _alloc(ssa::AllocateRegisters<CallingConvention>(
+          func, {kScratch, kMoveScratch})),
+      _asm(holder) {
+#ifndef NDEBUG
+  _asm.addDiagnosticOptions(asmjit::DiagnosticOptions::kValidateAssembler);
+#endif
+  _asm.setErrorHandler(&kErrorHandler);
+  if (func.num_params > CallingConvention::kGpArgs.size()) [[unlikely]] {
+    throw CompilationException("too many function parameters");
+  }
+  if (func.num_results > CallingConvention::kGpRets.size()) [[unlikely]] {
+    throw CompilationException("too many function results");
+  }
+  for (auto reg : _alloc.callee_saved) {
+    _saved.push_back(reg);
+  }
+  _stack_size = AlignUp<uint32_t>(
+      kSlotSize * (_saved.size() + _alloc.num_slots),
+      CallingConvention::kStackAlignment);
+  for (size_t i = 0; i < func.blocks.size(); ++i) {
+    _labels.push_back(_asm.newLabel());
+  }
+}
+
+void OptimizingCompiler::SetLogger(asmjit::Logger* logger) {
+  _asm.setLogger(logger);
+}
+
+void OptimizingCompiler::Compile() {
+  Prologue();
+  for (size_t i = 0; i < _alloc.order.size(); ++i) {
+    EmitBlock(i);
+  }
+}
+
+void OptimizingCompiler::Prologue() {
+  if (_stack_size > 0) {
+    _asm.sub(x86::rsp, _stack_size);
+  }
+  for (size_t i = 0; i < _saved.size(); ++i) {
+    _asm.mov(x86::qword_ptr(x86::rsp, int32_t(i) * kSlotSize), _saved[i]);
+  }
+  // Parameters are all in the entry block, and arrive in the argument
+  // registers at the same time.
+  std::vector<Move> moves;
+  for (ssa::ValueId v : _func.blocks.front().insts) {
+    const auto& value = _func.values[v];
+    if (value.op != ssa::Opcode::kParam) {
+      continue;
+    }
+    moves.push_back({
+        .from = {.kind = Operand::Kind::kRegister,
+                 // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+                 .reg = CallingConvention::kGpArgs[value.imm]},
+        .to = OperandOf(v),
+    });
+  }
+  EmitParallelMove(std::move(moves));
+}
+
+void OptimizingCompiler::EmitEpilogue() {
+  for (size_t i = 0; i < _saved.size(); ++i) {
+    _asm.mov(_saved[i], x86::qword_ptr(x86::rsp, int32_t(i) * kSlotSize));
+  }
+  if (_stack_size > 0) {
+    _asm.add(x86::rsp, _stack_size);
+  }
+  _asm.ret();
+}
+
+void OptimizingCompiler::EmitBlock(size_t i) {
+  ssa::BlockId b = _alloc.order[i];
+  _asm.bind(BlockLabel(b));
+  for (ssa::ValueId v : _func.blocks[b].insts) {
+    EmitInstruction(v);
+  }
+  EmitExit(b, i + 1 < _alloc.order.size() ? _alloc.order[i + 1]
+                                          : ssa::kNoBlock);
+}
+
+void OptimizingCompiler::EmitInstruction(ssa::ValueId v) {
+  const auto& value = _func.values[v];
+  if (_alloc.locations[v].kind == ssa::LocationKind::kNone) {
+    // Constants are used as immediates, and fused conditions are emitted
+    // with their branch.
+    return;
+  }
+  switch (value.op) {
+    case ssa::Opcode::kParam:
+    case ssa::Opcode::kConst:
+    case ssa::Opcode::kPhi:
+      return;
+    case ssa::Opcode::kAdd: {
+      Operand dst = OperandOf(v);
+      Operand lhs = OperandOf(value.args[0]);
+      Operand rhs = OperandOf(value.args[1]);
+      // Addition commutes, so avoid overwriting `rhs` before it's read.
+      if (rhs == dst) {
+        std::swap(lhs, rhs);
+      }
+      GpReg reg = dst.kind == Operand::Kind::kRegister ? dst.reg : kScratch;
+      EmitMove(lhs, {.kind = Operand::Kind::kRegister, .reg = reg});
+      switch (rhs.kind) {
+        case Operand::Kind::kRegister:
+          _asm.add(reg.r32(), rhs.reg.r32());
+          break;
+        case Operand::Kind::kStack:
+          _asm.add(reg.r32(), SlotMemory(rhs.slot));
+          break;
+        case Operand::Kind::kImmediate:
+          _asm.add(reg.r32(), int32_t(rhs.imm));
+          break;
+      }
+      EmitMove({.kind = Operand::Kind::kRegister, .reg = reg}, dst);
+      return;
+    }
+    case ssa::Opcode::kEqz:
+    case ssa::Opcode::kCompare:
+      EmitSetCondition(EmitCondition(v), OperandOf(v));
+      return;
+  }
+}
+
+void OptimizingCompiler::EmitExit(ssa::BlockId b, ssa::BlockId next) {
+  const auto& exit = _func.blocks[b].exit;
+  auto check_no_phis = [this](ssa::BlockId target) {
+    if (!_func.blocks[target].phis.empty()) [[unlikely]] {
+      throw CompilationException("critical edge to a block with phis");
+    }
+  };
+  switch (exit.kind) {
+    case ssa::Exit::kJump:
+      EmitJump(b, exit.targets[0], next);
+      return;
+    case ssa::Exit::kBranch: {
+      ssa::BlockId taken = exit.targets[0];
+      ssa::BlockId not_taken = exit.targets[1];
+      check_no_phis(taken);
+      check_no_phis(not_taken);
+      Condition cond =
+          _alloc.locations[exit.value].kind == ssa::LocationKind::kNone &&
+                  _func.values[exit.value].op != ssa::Opcode::kConst
+              ? EmitCondition(exit.value)
+              : EmitCompare(Condition::kNe, OperandOf(exit.value),
+                            {.kind = Operand::Kind::kImmediate, .imm = 0});
+      if (taken == next) {
+        _asm.j(ToCondCode(Negate(cond)), BlockLabel(not_taken));
+        return;
+      }
+      _asm.j(ToCondCode(cond), BlockLabel(taken));
+      if (not_taken != next) {
+        _asm.jmp(BlockLabel(not_taken));
+      }
+      return;
+    }
+    case ssa::Exit::kSwitch: {
+      std::ranges::for_each(exit.targets, check_no_phis);
+      GpReg index = InRegister(OperandOf(exit.value), kScratch);
+      EmitSwitchSearch(index, exit.lows, exit.targets);
+      return;
+    }
+    case ssa::Exit::kReturn: {
+      std::vector<Move> moves;
+      for (size_t i = 0; i < exit.results.size(); ++i) {
+        moves.push_back({
+            .from = OperandOf(exit.results[i]),
+            .to = {.kind = Operand::Kind::kRegister,
+                   // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+                   .reg = CallingConvention::kGpRets[i]},
+        });
+      }
+      EmitParallelMove(std::move(moves));
+      EmitEpilogue();
+      return;
+    }
+    case ssa::Exit::kTrap:
+      _asm.ud2();
+      return;
+  }
+}
+
+Condition OptimizingCompiler::EmitCondition(ssa::ValueId v) {
+  const auto& value = _func.values[v];
+  if (value.op == ssa::Opcode::kEqz) {
+    return EmitCompare(Condition::kEq, OperandOf(value.args[0]),
+                       {.kind = Operand::Kind::kImmediate, .imm = 0});
+  }
+  return EmitCompare(value.cond, OperandOf(value.args[0]),
+                     OperandOf(value.args[1]));
+}
+
+Condition OptimizingCompiler::EmitCompare(Condition cond, Operand lhs,
+                                          Operand rhs) {
+  if (lhs.kind == Operand::Kind::kImmediate) {
+    std::swap(lhs, rhs);
+    cond = Commute(cond);
+  }
+  GpReg reg = InRegister(lhs, kScratch).r32();
+  switch (rhs.kind) {
+    case Operand::Kind::kRegister:
+      _asm.cmp(reg, rhs.reg.r32());
+      break;
+    case Operand::Kind::kStack:
+      _asm.cmp(reg, SlotMemory(rhs.slot));
+      break;
+    case Operand::Kind::kImmediate:
+      if (rhs.imm == 0) {
+        // Sets the flags the same way as comparing to zero.
+        _asm.test(reg, reg);
+      } else {
+        _asm.cmp(reg, int32_t(rhs.imm));
+      }
+      break;
+  }
+  return cond;
+}
+
+void OptimizingCompiler::EmitSetCondition(Condition cond, const Operand& dst) {
+  GpReg reg = dst.kind == Operand::Kind::kRegister ? dst.reg : kScratch;
+  _asm.set(ToCondCode(cond), reg.r8());
+  _asm.movzx(reg.r32(), reg.r8());
+  EmitMove({.kind = Operand::Kind::kRegister, .reg = reg}, dst);
+}
+
+void OptimizingCompiler::EmitSwitchSearch(
+    const GpReg& index, std::span<const uint32_t> lows,
+    std::span<const ssa::BlockId> targets) {
+  while (lows.size() > 1) {
+    size_t mid = lows.size() / 2;
+    if (mid == 1) {
+      _asm.cmp(index.r32(), lows[1]);
+      _asm.jb(BlockLabel(targets[0]));
+      lows = lows.subspan(1);
+      targets = targets.subspan(1);
+      continue;
+    }
+    auto upper = _asm.newLabel();
+    _asm.cmp(index.r32(), lows[mid]);
+    _asm.jae(upper);
+    EmitSwitchSearch(index, lows.first(mid), targets.first(mid));
+    _asm.bind(upper);
+    lows = lows.subspan(mid);
+    targets = targets.subspan(mid);
+  }
+  _asm.jmp(BlockLabel(targets[0]));
+}
+
+void OptimizingCompiler::EmitJump(ssa::BlockId from, ssa::BlockId to,
+                                  ssa::BlockId next) {
+  const auto& block = _func.blocks[to];
+  auto idx = std::ranges::find(block.preds, from) - block.preds.begin();
+  std::vector<Move> moves;
+  for (ssa::ValueId phi : block.phis) {
+    moves.push_back({
+        .from = OperandOf(_func.values[phi].args[idx]),
+        .to = OperandOf(phi),
+    });
+  }
+  EmitParallelMove(std::move(moves));
+  if (to != next) {
+    _asm.jmp(BlockLabel(to));
+  }
+}
+
+void OptimizingCompiler::EmitParallelMove(std::vector<Move> moves) {
+  std::erase_if(moves, [](const Move& m) { return m.from == m.to; });
+  while (!moves.empty()) {
+    // A move can be made once nothing else still needs to read its
+    // destination.
+    auto ready = std::ranges::find_if(moves, [&moves](const Move& m) {
+      return std::ranges::none_of(
+          moves, [&m](const Move& other) { return other.from == m.to; });
+    });
+    if (ready != moves.end()) {
+      EmitMove(ready->from, ready->to);
+      moves.erase(ready);
+      continue;
+    }
+    // Every remaining move is part of a cycle, so break one by moving a
+    // source out of the way.
+    Operand source = moves.back().from;
+    Operand scratch = {.kind = Operand::Kind::kRegister, .reg = kScratch};
+    EmitMove(source, scratch);
+    for (auto& move : moves) {
+      if (move.from == source) {
+        move.from = scratch;
+      }
+    }
+  }
+}
+
+void OptimizingCompiler::EmitMove(const Operand& from, const Operand& to) {
+  if (from == to) {
+    return;
+  }
+  if (to.kind == Operand::Kind::kRegister) {
+    GpReg dst = to.reg.r32();
+    switch (from.kind) {
+      case Operand::Kind::kRegister:
+        _asm.mov(dst, from.reg.r32());
+        return;
+      case Operand::Kind::kStack:
+        _asm.mov(dst, SlotMemory(from.slot));
+        return;
+      case Operand::Kind::kImmediate:
+        _asm.mov(dst, int32_t(from.imm));
+        return;
+    }
+  }
+  x86::Mem dst = SlotMemory(to.slot);
+  switch (from.kind) {
+    case Operand::Kind::kRegister:
+      _asm.mov(dst, from.reg.r32());
+      return;
+    case Operand::Kind::kStack:
+      _asm.mov(kMoveScratch.r32(), SlotMemory(from.slot));
+      _asm.mov(dst, kMoveScratch.r32());
+      return;
+    case Operand::Kind::kImmediate:
+      _asm.mov(dst, int32_t(from.imm));
+      return;
+  }
+}
+
+OptimizingCompiler::Operand OptimizingCompiler::OperandOf(
+    ssa::ValueId v) const {
+  const auto& value = _func.values[v];
+  if (value.op == ssa::Opcode::kConst) {
+    return {.kind = Operand::Kind::kImmediate, .imm = value.imm};
+  }
+  const auto& location = _alloc.locations[v];
+  switch (location.kind) {
+    case ssa::LocationKind::kRegister:
+      return {.kind = Operand::Kind::kRegister, .reg = location.reg};
+    case ssa::LocationKind::kStack:
+      return {.kind = Operand::Kind::kStack, .slot = location.slot};
+    case ssa::LocationKind::kNone:
+      break;
+  }
+  throw CompilationException("value has no location");
+}
+
+GpReg OptimizingCompiler::InRegister(const Operand& op, const GpReg& scratch) {
+  if (op.kind == Operand::Kind::kRegister) {
+    return op.reg;
+  }
+  EmitMove(op, {.kind = Operand::Kind::kRegister, .reg = scratch});
+  return scratch;
+}
+
+x86::Mem OptimizingCompiler::SlotMemory(uint32_t slot) const {
+  return x86::dword_ptr(x86::rsp,
+                        int32_t(_saved.size() + slot) * kSlotSize);
+}
+
+asmjit::Label OptimizingCompiler::BlockLabel(ssa::BlockId b) const {
+  return _labels[b];
+}
+
+}  // namespace wasmcc::x64
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <asmjit/x86.h>
+
+#include <span>
+#include <vector>
+
+#include "compiler/ssa/ir.h"
+#include "compiler/ssa/linear_scan.h"
+#include "compiler/x64/call_convention.h"
+
+namespace wasmcc::x64 {
+
+/**
+ * The optimizing tier's backend, which lowers a function in SSA form to
+ * machine code, after `ssa::Optimize` has run on it.
+ *
+ * Every value gets a register or stack slot of its own for its whole lifetime
+ * from the linear scan allocator, so there is no stack of values to keep in
+ * sync like in the baseline compiler: each instruction reads its operands
+ * from wherever they were allocated. Constants are used as immediates and
+ * comparisons that only feed a branch are fused into it.
+ *
+ * The frame holds the callee saved registers that are used, followed by a
+ * slot for each spilled value.
+ *
+ *  ┌─────────────┬──────────────┐
+ *  │  SAVED REGS │  SPILLS      │
+ *  └─────────────┴──────────────┘
+ *  rsp
+ */
+class OptimizingCompiler {
+ public:
+  OptimizingCompiler(const ssa::Function&, asmjit::CodeHolder*);
+  OptimizingCompiler(const OptimizingCompiler&) = delete;
+  OptimizingCompiler& operator=(const OptimizingCompiler&) = delete;
+  OptimizingCompiler(OptimizingCompiler&&) = delete;
+  OptimizingCompiler& operator=(OptimizingCompiler&&) = delete;
+  ~OptimizingCompiler() = default;
+
+  void SetLogger(asmjit::Logger*);
+
+  void Compile();
+
+  // The number of values that had to live on the stack.
+  size_t num_spills() const { return _alloc.num_slots; }
+
+  // The bytes the prologue reserves on the stack for the function's frame.
+  uint32_t frame_size_bytes() const { return _stack_size; }
+
+ private:
+  using Location = ssa::Location<CallingConvention>;
+
+  // Where a value can be read from, which unlike a `Location` can also be an
+  // immediate.
+  struct Operand {
+    enum class Kind : uint8_t { kRegister, kStack, kImmediate };
+    Kind kind;
+    GpReg reg;
+    uint32_t slot = 0;
+    uint32_t imm = 0;
+
+    bool operator==(const Operand&) const;
+  };
+  struct Move {
+    Operand from;
+    Operand to;
+  };
+
+  void Prologue();
+  void EmitEpilogue();
+  void EmitBlock(size_t i);
+  void EmitInstruction(ssa::ValueId);
+  void EmitExit(ssa::BlockId, ssa::BlockId next);
+
+  // Set the flags from a comparison value, returning the condition for when
+  // it's true.
+  Condition EmitCondition(ssa::ValueId);
+  // Compare `lhs` to `rhs`, returning the condition to use, which is `cond`
+  // unless the operands had to be swapped.
+  Condition EmitCompare(Condition cond, Operand lhs, Operand rhs);
+  // Store the flags for `cond` as 0 or 1 into `dst`.
+  void EmitSetCondition(Condition cond, const Operand& dst);
+  // Jump to the target block for each range of indexes, by binary search.
+  void EmitSwitchSearch(const GpReg& index, std::span<const uint32_t> lows,
+                        std::span<const ssa::BlockId> targets);
+  // Go to a block, moving values into its phis first.
+  void EmitJump(ssa::BlockId from, ssa::BlockId to, ssa::BlockId next);
+  // Make a set of moves that logically happen at the same time.
+  void EmitParallelMove(std::vector<Move> moves);
+  void EmitMove(const Operand& from, const Operand& to);
+
+  Operand OperandOf(ssa::ValueId) const;
+  // The register holding `op`, loading it into `scratch` if it's not in one.
+  GpReg InRegister(const Operand& op, const GpReg& scratch);
+  asmjit::x86::Mem SlotMemory(uint32_t slot) const;
+  asmjit::Label BlockLabel(ssa::BlockId) const;
+
+  const ssa::Function& _func;
+  ssa::Allocation<CallingConvention> _alloc;
+  asmjit::x86::Assembler _asm;
+  std::vector<GpReg> _saved;
+  uint32_t _stack_size = 0;
+  std::vector<asmjit::Label> _labels;
+};
+
+}  // namespace wasmcc::x64
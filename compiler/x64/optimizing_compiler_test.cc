@@ -0,0 +1,86 @@
+#include "compiler/x64/optimizing_compiler.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "compiler/common/util.h"
+#include "compiler/ssa/builder.h"
+#include "compiler/ssa/passes.h"
+#include "core/ast.h"
+#include "core/instruction.h"
+#include "gmock/gmock.h"
+#include "testing/asm.h"
+#include "testing/functions.h"
+
+namespace wasmcc::x64 {
+namespace {
+
+using namespace wasmcc::op;
+
+// Build and optimize a function with two i32 parameters, `num_locals` i32
+// locals and an i32 result, compile it for x64 and return the assembly that
+// asmjit logs.
+std::string CompileToLog(const InstructionBuffer& body, size_t num_locals = 2,
+                         size_t* num_spills = nullptr) {
+  auto func = ssa::Build(Fn(body, 2, num_locals));
+  ssa::Optimize(&func);
+  asmjit::CodeHolder holder;
+  Check(holder.init(asmjit::Environment(asmjit::Arch::kX64)));
+  asmjit::StringLogger logger;
+  OptimizingCompiler compiler(func, &holder);
+  compiler.SetLogger(&logger);
+  compiler.Compile();
+  if (num_spills != nullptr) {
+    *num_spills = compiler.num_spills();
+  }
+  return logger.data();
+}
+
+}  // namespace
+
+TEST(OptimizingCompiler, FusesCompareIntoBranch) {
+  auto mnemonics = Mnemonics(CompileToLog(SumKernel()));
+  EXPECT_TRUE(IsConditionalJump(After(mnemonics, "cmp")));
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains(
+                             testing::Truly(IsSetcc))));
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains("test")));
+}
+
+TEST(OptimizingCompiler, KeepsLoopsInRegisters) {
+  // No callee saved registers are needed, so nothing touches memory.
+  EXPECT_EQ(CountMemoryAccesses(CompileToLog(SumKernel())),
+            (MemoryAccesses{}));
+}
+
+TEST(OptimizingCompiler, MaterializesCompareResult) {
+  auto mnemonics = Mnemonics(CompileToLog(InstructionBuffer::Of(
+      GetLocalI32(0), GetLocalI32(1), CompareI32{.cond = Condition::kEq})));
+  EXPECT_TRUE(IsSetcc(After(mnemonics, "cmp")));
+  EXPECT_THAT(mnemonics, testing::Contains("movzx"));
+  EXPECT_THAT(mnemonics, testing::Not(testing::Contains(
+                             testing::Truly(IsConditionalJump))));
+}
+
+TEST(OptimizingCompiler, FoldsConstants) {
+  auto mnemonics = Mnemonics(CompileToLog(InstructionBuffer::Of(
+      ConstI32(Value::I32(2)), ConstI32(Value::I32(3)), AddI32(),
+      ConstI32(Value::I32(5)), CompareI32{.cond = Condition::kEq},
+      EqzI32())));
+  EXPECT_THAT(mnemonics, testing::ElementsAre("mov", "ret"));
+}
+
+TEST(OptimizingCompiler, SpillsUnderPressure) {
+  constexpr int kNumValues = 20;
+  size_t num_spills = 0;
+  auto log = CompileToLog(ManyLiveValues(kNumValues), kNumValues, &num_spills);
+  EXPECT_GT(num_spills, 0);
+  // Every callee saved register is saved and restored, and every spilled
+  // value is stored once and loaded once.
+  size_t saved = CallingConvention::kGpCalleeSavedRegisters.size();
+  auto accesses = CountMemoryAccesses(log);
+  EXPECT_EQ(accesses.stores, int(saved + num_spills));
+  EXPECT_GE(accesses.loads, int(saved + num_spills));
+}
+
+}  // namespace wasmcc::x64
@@ -0,0 +1,132 @@
+#include "compiler/common/parallel_move.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "compiler/x64/call_convention.h"
+#include "compiler/x64/runtime_stack.h"
+#include "core/value.h"
+
+namespace wasmcc::x64 {
+namespace {
+
+namespace x86 = asmjit::x86;
+using ValueMove = ValueMove<CallingConvention>;
+
+// Executes the moves against a model of the registers and stack memory.
+class Simulator {
+ public:
+  void Store(const GpReg& src, const RuntimeValue& slot) {
+    memory[slot.stack_pointer] = registers[src.id()];
+    ++num_instructions;
+  }
+  void Load(const RuntimeValue& slot, const GpReg& dst) {
+    registers[dst.id()] = slot.constant ? slot.constant->AsI32()
+                                        : memory[slot.stack_pointer];
+    ++num_instructions;
+  }
+  void Move(const GpReg& src, const GpReg& dst, ValType) {
+    registers[dst.id()] = registers[src.id()];
+    ++num_instructions;
+  }
+
+  int Read(const RuntimeValue& v) {
+    return v.reg ? registers[v.reg->id()] : memory[v.stack_pointer];
+  }
+  void Write(const RuntimeValue& v, int value) {
+    if (v.reg) {
+      registers[v.reg->id()] = value;
+    } else {
+      memory[v.stack_pointer] = value;
+    }
+  }
+
+  absl::flat_hash_map<uint32_t, int> registers;
+  absl::flat_hash_map<int32_t, int> memory;
+  int num_instructions = 0;
+};
+
+RuntimeValue InReg(const GpReg& reg, int32_t stack_pointer) {
+  return {.stack_pointer = stack_pointer, .reg = reg};
+}
+RuntimeValue InMemory(int32_t stack_pointer) {
+  return {.stack_pointer = stack_pointer};
+}
+
+// Run the moves and check that every value ends up at it's destination.
+int RunMoves(const std::vector<ValueMove>& moves) {
+  Simulator sim;
+  int value = 0;
+  for (const auto& move : moves) {
+    sim.Write(move.from, ++value);
+  }
+  EmitParallelMove<CallingConvention>(moves, &sim);
+  value = 0;
+  for (const auto& move : moves) {
+    EXPECT_EQ(sim.Read(move.to), ++value);
+  }
+  return sim.num_instructions;
+}
+
+}  // namespace
+
+TEST(ParallelMove, Empty) { EXPECT_EQ(RunMoves({}), 0); }
+
+TEST(ParallelMove, SameRegisterIsNoop) {
+  EXPECT_EQ(RunMoves({{InReg(x86::rax, 4), InReg(x86::rax, 4)}}), 0);
+}
+
+TEST(ParallelMove, Chain) {
+  EXPECT_EQ(RunMoves({
+                {InReg(x86::rax, 4), InReg(x86::rcx, 4)},
+                {InReg(x86::rcx, 8), InReg(x86::rdx, 8)},
+                {InReg(x86::rdx, 12), InReg(x86::rsi, 12)},
+            }),
+            3);
+}
+
+TEST(ParallelMove, Swap) {
+  EXPECT_EQ(RunMoves({
+                {InReg(x86::rax, 4), InReg(x86::rcx, 4)},
+                {InReg(x86::rcx, 8), InReg(x86::rax, 8)},
+            }),
+            3);
+}
+
+TEST(ParallelMove, Cycle) {
+  RunMoves({
+      {InReg(x86::rax, 4), InReg(x86::rcx, 4)},
+      {InReg(x86::rcx, 8), InReg(x86::rdx, 8)},
+      {InReg(x86::rdx, 12), InReg(x86::rax, 12)},
+      {InReg(x86::rsi, 16), InReg(x86::rdi, 16)},
+  });
+}
+
+TEST(ParallelMove, SpillAndReload) {
+  // A register that is spilled is then reused for a value that was in memory.
+  EXPECT_EQ(RunMoves({
+                {InReg(x86::rax, 4), InMemory(4)},
+                {InMemory(8), InReg(x86::rax, 8)},
+                {InReg(x86::rcx, 12), InReg(x86::rdx, 12)},
+            }),
+            3);
+}
+
+TEST(ParallelMove, MaterializesConstant) {
+  // The constant must not be loaded until the register's old value is moved.
+  Simulator sim;
+  sim.registers[x86::rax.id()] = 1;
+  std::vector<ValueMove> moves = {
+      {RuntimeValue{.stack_pointer = 4, .constant = Value::I32(42)},
+       InReg(x86::rax, 4)},
+      {InReg(x86::rax, 8), InReg(x86::rcx, 8)},
+  };
+  EmitParallelMove<CallingConvention>(moves, &sim);
+  EXPECT_EQ(sim.registers[x86::rax.id()], 42);
+  EXPECT_EQ(sim.registers[x86::rcx.id()], 1);
+  EXPECT_EQ(sim.num_instructions, 2);
+}
+
+}  // namespace wasmcc::x64
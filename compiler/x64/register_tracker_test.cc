@@ -46,4 +46,13 @@ TEST(RegisterTracker, CanAllocateAllRegisters) {
                                               registers.end());
   EXPECT_THAT(registers, testing::UnorderedElementsAreArray(unique));
 }
+
+TEST(RegisterTracker, NeverAllocatesReservedRegisters) {
+  RegisterTracker rt;
+  rt.ReserveRegister(asmjit::x86::rdi);
+  rt.Reset();
+  while (auto reg = rt.TakeUnusedRegister()) {
+    EXPECT_NE(reg->id(), asmjit::x86::rdi.id());
+  }
+}
 }  // namespace wasmcc::x64
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <optional>
 #include <variant>
 #include <vector>
 
@@ -78,14 +79,19 @@ struct Function {
     std::vector<ValType> locals;
     uint32_t max_stack_size_bytes;
     uint32_t max_stack_elements;
+    // An estimate of how often each local (parameters first) is accessed,
+    // where accesses inside loops count for more. Empty if unknown.
+    std::vector<uint32_t> local_uses;
   };
   Metadata meta;
-  std::vector<Instruction> body;
+  InstructionBuffer body;
 };
 
 struct ParsedModule {
   std::vector<Function> functions;
   absl::flat_hash_map<Name, FuncIdx> exported_functions;
+  // The function that runs when the module is instantiated, if any.
+  std::optional<FuncIdx> start_function;
 };
 
 }  // namespace wasmcc
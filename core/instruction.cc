@@ -1,11 +1,70 @@
 #include "core/instruction.h"
 
-#include "absl/strings/str_format.h"
-
 namespace wasmcc {
 
-LabelId MakeLabelId(std::string_view name, int32_t id) {
-  return LabelId(absl::StrFormat("%s_%d", name, id));
+void InstructionBuffer::PutOpcode(Opcode opcode) {
+  _encoded.push_back(uint8_t(opcode));
+  ++_size;
+}
+void InstructionBuffer::PutImmediate(uint32_t v) {
+  size_t offset = _encoded.size();
+  _encoded.resize(offset + sizeof(v));
+  std::memcpy(_encoded.data() + offset, &v, sizeof(v));
+}
+void InstructionBuffer::PutBlockType(std::optional<ValType> vt) {
+  _encoded.push_back(vt ? uint8_t(*vt) : 0);
+}
+
+void InstructionBuffer::Append(const op::ConstI32& op) {
+  PutOpcode(op.kOpcode);
+  PutImmediate(op.value.AsU32());
+}
+void InstructionBuffer::Append(const op::AddI32& op) { PutOpcode(op.kOpcode); }
+void InstructionBuffer::Append(const op::EqzI32& op) { PutOpcode(op.kOpcode); }
+void InstructionBuffer::Append(const op::CompareI32& op) {
+  PutOpcode(op.kOpcode);
+  _encoded.push_back(uint8_t(op.cond));
+}
+void InstructionBuffer::Append(const op::GetLocalI32& op) {
+  PutOpcode(op.kOpcode);
+  PutImmediate(op.idx);
+}
+void InstructionBuffer::Append(const op::SetLocalI32& op) {
+  PutOpcode(op.kOpcode);
+  PutImmediate(op.idx);
+}
+void InstructionBuffer::Append(const op::Return& op) { PutOpcode(op.kOpcode); }
+void InstructionBuffer::Append(const op::Unreachable& op) {
+  PutOpcode(op.kOpcode);
+}
+void InstructionBuffer::Append(const op::Block& op) {
+  PutOpcode(op.kOpcode);
+  PutBlockType(op.result);
+}
+void InstructionBuffer::Append(const op::Loop& op) {
+  PutOpcode(op.kOpcode);
+  PutBlockType(op.result);
+}
+void InstructionBuffer::Append(const op::If& op) {
+  PutOpcode(op.kOpcode);
+  PutBlockType(op.result);
+}
+void InstructionBuffer::Append(const op::Else& op) { PutOpcode(op.kOpcode); }
+void InstructionBuffer::Append(const op::End& op) { PutOpcode(op.kOpcode); }
+void InstructionBuffer::Append(const op::Br& op) {
+  PutOpcode(op.kOpcode);
+  PutImmediate(op.depth);
+}
+void InstructionBuffer::Append(const op::BrIf& op) {
+  PutOpcode(op.kOpcode);
+  PutImmediate(op.depth);
+}
+void InstructionBuffer::Append(const op::BrTable& op) {
+  PutOpcode(op.kOpcode);
+  PutImmediate(uint32_t(op.size()));
+  _encoded.insert(_encoded.end(), op.packed_targets.begin(),
+                  op.packed_targets.end());
+  PutImmediate(op.default_depth);
 }
 
 }  // namespace wasmcc
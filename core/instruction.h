@@ -1,63 +1,419 @@
-#include <array>
-#include <string>
-#include <variant>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
 #include <vector>
 
-#include "base/named_type.h"
 #include "value.h"
 
 #pragma once
 
 namespace wasmcc {
 
-using LabelId = NamedType<std::string, struct LabelIdTag>;
-
-// Make a label in the form of <str>_<id>
+// The opcode byte that starts every instruction in an `InstructionBuffer`.
 //
-// Most labels have a "class" so to speak and then an numeric id to prevent
-// clashes, so this simplifies creating those.
-LabelId MakeLabelId(std::string_view, int32_t);
+// These are dense so that dispatching on them compiles to a jump table.
+enum class Opcode : uint8_t {
+  kConstI32,
+  kAddI32,
+  kEqzI32,
+  kCompareI32,
+  kGetLocalI32,
+  kSetLocalI32,
+  kReturn,
+  kUnreachable,
+  kBlock,
+  kLoop,
+  kIf,
+  kElse,
+  kEnd,
+  kBr,
+  kBrIf,
+  kBrTable,
+};
+
+// The condition of a comparison between two integers, `lhs <cond> rhs`.
+enum class Condition : uint8_t {
+  kEq,
+  kNe,
+  kLtS,
+  kLtU,
+  kGtS,
+  kGtU,
+  kLeS,
+  kLeU,
+  kGeS,
+  kGeU,
+};
+
+// The condition that is true exactly when `cond` is false.
+constexpr Condition Negate(Condition cond) {
+  switch (cond) {
+    case Condition::kEq:
+      return Condition::kNe;
+    case Condition::kNe:
+      return Condition::kEq;
+    case Condition::kLtS:
+      return Condition::kGeS;
+    case Condition::kLtU:
+      return Condition::kGeU;
+    case Condition::kGtS:
+      return Condition::kLeS;
+    case Condition::kGtU:
+      return Condition::kLeU;
+    case Condition::kLeS:
+      return Condition::kGtS;
+    case Condition::kLeU:
+      return Condition::kGtU;
+    case Condition::kGeS:
+      return Condition::kLtS;
+    case Condition::kGeU:
+      return Condition::kLtU;
+  }
+  __builtin_unreachable();
+}
+
+// The condition that holds for `rhs <cond> lhs` exactly when `cond` holds for
+// `lhs <cond> rhs`.
+constexpr Condition Commute(Condition cond) {
+  switch (cond) {
+    case Condition::kEq:
+    case Condition::kNe:
+      return cond;
+    case Condition::kLtS:
+      return Condition::kGtS;
+    case Condition::kLtU:
+      return Condition::kGtU;
+    case Condition::kGtS:
+      return Condition::kLtS;
+    case Condition::kGtU:
+      return Condition::kLtU;
+    case Condition::kLeS:
+      return Condition::kGeS;
+    case Condition::kLeU:
+      return Condition::kGeU;
+    case Condition::kGeS:
+      return Condition::kLeS;
+    case Condition::kGeU:
+      return Condition::kLeU;
+  }
+  __builtin_unreachable();
+}
+
+// Evaluate `lhs <cond> rhs`.
+constexpr bool Evaluate(Condition cond, uint32_t lhs, uint32_t rhs) {
+  auto slhs = int32_t(lhs);
+  auto srhs = int32_t(rhs);
+  switch (cond) {
+    case Condition::kEq:
+      return lhs == rhs;
+    case Condition::kNe:
+      return lhs != rhs;
+    case Condition::kLtS:
+      return slhs < srhs;
+    case Condition::kLtU:
+      return lhs < rhs;
+    case Condition::kGtS:
+      return slhs > srhs;
+    case Condition::kGtU:
+      return lhs > rhs;
+    case Condition::kLeS:
+      return slhs <= srhs;
+    case Condition::kLeU:
+      return lhs <= rhs;
+    case Condition::kGeS:
+      return slhs >= srhs;
+    case Condition::kGeU:
+      return lhs >= rhs;
+  }
+  __builtin_unreachable();
+}
 
 namespace op {
 // Push the constant onto the top of the stack.
 struct ConstI32 {
+  static constexpr Opcode kOpcode = Opcode::kConstI32;
   explicit ConstI32(uint32_t v) : value(Value::U32(v)) {}
   explicit ConstI32(int32_t v) : value(Value::I32(v)) {}
   explicit ConstI32(Value v) : value(v) {}
   Value value;
 };
-struct AddI32 {};
+struct AddI32 {
+  static constexpr Opcode kOpcode = Opcode::kAddI32;
+};
+// Push 1 if the top of the stack is zero, otherwise 0.
+struct EqzI32 {
+  static constexpr Opcode kOpcode = Opcode::kEqzI32;
+};
+// Pop `rhs` then `lhs` and push 1 if `lhs <cond> rhs`, otherwise 0.
+struct CompareI32 {
+  static constexpr Opcode kOpcode = Opcode::kCompareI32;
+  Condition cond;
+};
 // Push the local indexed by `idx` onto the top of the stack.
 struct GetLocalI32 {
-  explicit GetLocalI32(size_t i) : idx(i) {}
-  size_t idx;
+  static constexpr Opcode kOpcode = Opcode::kGetLocalI32;
+  explicit GetLocalI32(uint32_t i) : idx(i) {}
+  uint32_t idx;
 };
 // Pop the top of the stack into local indexed by `idx`.
 struct SetLocalI32 {
-  explicit SetLocalI32(size_t i) : idx(i) {}
-  size_t idx;
+  static constexpr Opcode kOpcode = Opcode::kSetLocalI32;
+  explicit SetLocalI32(uint32_t i) : idx(i) {}
+  uint32_t idx;
 };
 // Return the rest of the stack to the caller.
-struct Return {};
+struct Return {
+  static constexpr Opcode kOpcode = Opcode::kReturn;
+};
+
+// Trap unconditionally.
+struct Unreachable {
+  static constexpr Opcode kOpcode = Opcode::kUnreachable;
+};
 
-// The start of a block
-struct Label {
-  LabelId id;
+// Structured control instructions.
+//
+// Only the MVP block types are supported: blocks take no parameters and
+// produce at most a single result.
+//
+// Branches reference their target by relative depth in the stack of enclosing
+// structured control instructions, where the function body itself is the
+// outermost one. A branch to a `Block` or `If` jumps to its `End` and a branch
+// to a `Loop` jumps to the start of the loop.
+struct Block {
+  static constexpr Opcode kOpcode = Opcode::kBlock;
+  std::optional<ValType> result;
+};
+struct Loop {
+  static constexpr Opcode kOpcode = Opcode::kLoop;
+  std::optional<ValType> result;
+};
+// Pop the top of the stack and execute the following instructions if it's non
+// zero, otherwise continue at the matching `Else` (or `End` if there is none).
+struct If {
+  static constexpr Opcode kOpcode = Opcode::kIf;
+  std::optional<ValType> result;
+};
+struct Else {
+  static constexpr Opcode kOpcode = Opcode::kElse;
+};
+// The end of a `Block`, `Loop` or `If`.
+struct End {
+  static constexpr Opcode kOpcode = Opcode::kEnd;
 };
-// Branch to a given label ID
+// Branch unconditionally to the label `depth` levels out.
 struct Br {
-  LabelId label_id;
+  static constexpr Opcode kOpcode = Opcode::kBr;
+  uint32_t depth;
 };
-// Branch to `then_label_id` if the top of the stack is non zero, otherwise
-// branch to `else_label_id`.
+// Pop the top of the stack and branch to the label `depth` levels out if it's
+// non zero.
 struct BrIf {
-  LabelId then_label_id;
-  LabelId else_label_id;
+  static constexpr Opcode kOpcode = Opcode::kBrIf;
+  uint32_t depth;
+};
+// Pop the top of the stack and use it to index into `targets`, branching to
+// that label, or `default_depth` if the index is out of range.
+struct BrTable {
+  static constexpr Opcode kOpcode = Opcode::kBrTable;
+  // The target depths, packed as unaligned uint32_t values.
+  std::span<const uint8_t> packed_targets;
+  uint32_t default_depth;
+
+  size_t size() const { return packed_targets.size() / sizeof(uint32_t); }
+  uint32_t target(size_t i) const {
+    uint32_t v = 0;
+    std::memcpy(&v, packed_targets.data() + (i * sizeof(v)), sizeof(v));
+    return v;
+  }
 };
 }  // namespace op
 
-using Instruction =
-    std::variant<op::ConstI32, op::AddI32, op::GetLocalI32, op::SetLocalI32,
-                 op::Return, op::Label, op::Br, op::BrIf>;
+/**
+ * The body of a function in our IR.
+ *
+ * Instructions are packed into a single contiguous byte buffer: an opcode byte
+ * followed by the instruction's immediates, which are fixed width (unaligned)
+ * 32 bit values, apart from block types and conditions which are a single
+ * byte. So most instructions take 1, 2 or 5 bytes, and appending never
+ * allocates except to grow the buffer.
+ *
+ * Instructions are read back out with `Dispatch` or an `InstructionReader`,
+ * which switch on the opcode and call the visitor with the matching `op::*`
+ * struct.
+ */
+class InstructionBuffer {
+ public:
+  InstructionBuffer() = default;
+  InstructionBuffer(const InstructionBuffer&) = default;
+  InstructionBuffer& operator=(const InstructionBuffer&) = default;
+  InstructionBuffer(InstructionBuffer&&) noexcept = default;
+  InstructionBuffer& operator=(InstructionBuffer&&) noexcept = default;
+  ~InstructionBuffer() = default;
+
+  // Make a buffer from a list of ops, mostly useful for tests.
+  template <typename... Op>
+  static InstructionBuffer Of(const Op&... ops) {
+    InstructionBuffer buffer;
+    (buffer.Append(ops), ...);
+    return buffer;
+  }
+
+  void Append(const op::ConstI32&);
+  void Append(const op::AddI32&);
+  void Append(const op::EqzI32&);
+  void Append(const op::CompareI32&);
+  void Append(const op::GetLocalI32&);
+  void Append(const op::SetLocalI32&);
+  void Append(const op::Return&);
+  void Append(const op::Unreachable&);
+  void Append(const op::Block&);
+  void Append(const op::Loop&);
+  void Append(const op::If&);
+  void Append(const op::Else&);
+  void Append(const op::End&);
+  void Append(const op::Br&);
+  void Append(const op::BrIf&);
+  void Append(const op::BrTable&);
+
+  // Reserve space for `n` bytes of encoded instructions.
+  void Reserve(size_t n) { _encoded.reserve(n); }
+
+  // The number of instructions.
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  // The number of bytes used by the encoded instructions.
+  size_t size_bytes() const { return _encoded.size(); }
+
+  const uint8_t* begin() const { return _encoded.data(); }
+  const uint8_t* end() const { return _encoded.data() + _encoded.size(); }
+
+ private:
+  void PutOpcode(Opcode);
+  void PutImmediate(uint32_t);
+  void PutBlockType(std::optional<ValType>);
+
+  std::vector<uint8_t> _encoded;
+  uint32_t _size = 0;
+};
+
+namespace internal {
+inline uint32_t ReadImmediate(const uint8_t* pc) {
+  uint32_t v = 0;
+  std::memcpy(&v, pc, sizeof(v));
+  return v;
+}
+// Block types are encoded as a single byte, zero for no result, otherwise the
+// `ValType` of the result.
+inline std::optional<ValType> ReadBlockType(const uint8_t* pc) {
+  if (*pc == 0) {
+    return std::nullopt;
+  }
+  return ValType(*pc);
+}
+}  // namespace internal
+
+/**
+ * Decode the instruction at `pc`, invoke `visitor` with it and return the
+ * start of the next instruction.
+ */
+template <typename Visitor>
+const uint8_t* DispatchOne(const uint8_t* pc, Visitor* visitor) {
+  using internal::ReadBlockType;
+  using internal::ReadImmediate;
+  constexpr size_t kImm = sizeof(uint32_t);
+  switch (Opcode(*pc++)) {
+    case Opcode::kConstI32:
+      (*visitor)(op::ConstI32(Value::U32(ReadImmediate(pc))));
+      return pc + kImm;
+    case Opcode::kAddI32:
+      (*visitor)(op::AddI32());
+      return pc;
+    case Opcode::kEqzI32:
+      (*visitor)(op::EqzI32());
+      return pc;
+    case Opcode::kCompareI32:
+      (*visitor)(op::CompareI32{.cond = Condition(*pc)});
+      return pc + 1;
+    case Opcode::kGetLocalI32:
+      (*visitor)(op::GetLocalI32(ReadImmediate(pc)));
+      return pc + kImm;
+    case Opcode::kSetLocalI32:
+      (*visitor)(op::SetLocalI32(ReadImmediate(pc)));
+      return pc + kImm;
+    case Opcode::kReturn:
+      (*visitor)(op::Return());
+      return pc;
+    case Opcode::kUnreachable:
+      (*visitor)(op::Unreachable());
+      return pc;
+    case Opcode::kBlock:
+      (*visitor)(op::Block{.result = ReadBlockType(pc)});
+      return pc + 1;
+    case Opcode::kLoop:
+      (*visitor)(op::Loop{.result = ReadBlockType(pc)});
+      return pc + 1;
+    case Opcode::kIf:
+      (*visitor)(op::If{.result = ReadBlockType(pc)});
+      return pc + 1;
+    case Opcode::kElse:
+      (*visitor)(op::Else());
+      return pc;
+    case Opcode::kEnd:
+      (*visitor)(op::End());
+      return pc;
+    case Opcode::kBr:
+      (*visitor)(op::Br{.depth = ReadImmediate(pc)});
+      return pc + kImm;
+    case Opcode::kBrIf:
+      (*visitor)(op::BrIf{.depth = ReadImmediate(pc)});
+      return pc + kImm;
+    case Opcode::kBrTable: {
+      // Encoded as the number of targets, the targets then the default.
+      uint32_t size = ReadImmediate(pc);
+      pc += kImm;
+      auto targets = std::span<const uint8_t>(pc, size * kImm);
+      pc += size * kImm;
+      (*visitor)(op::BrTable{
+          .packed_targets = targets,
+          .default_depth = ReadImmediate(pc),
+      });
+      return pc + kImm;
+    }
+  }
+  __builtin_unreachable();
+}
+
+/**
+ * Invoke `visitor` with every instruction in `buffer` in order.
+ */
+template <typename Visitor>
+void Dispatch(const InstructionBuffer& buffer, Visitor* visitor) {
+  for (const uint8_t* pc = buffer.begin(); pc != buffer.end();) {
+    pc = DispatchOne(pc, visitor);
+  }
+}
+
+/**
+ * Step through an `InstructionBuffer` one instruction at a time, for callers
+ * that need to do work in between instructions (such as yielding).
+ */
+class InstructionReader {
+ public:
+  explicit InstructionReader(const InstructionBuffer& buffer)
+      : _pc(buffer.begin()), _end(buffer.end()) {}
+
+  bool HasNext() const { return _pc != _end; }
+
+  template <typename Visitor>
+  void DispatchNext(Visitor* visitor) {
+    _pc = DispatchOne(_pc, visitor);
+  }
+
+ private:
+  const uint8_t* _pc;
+  const uint8_t* _end;
+};
 
 }  // namespace wasmcc
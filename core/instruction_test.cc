@@ -0,0 +1,189 @@
+#include "core/instruction.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+
+namespace wasmcc {
+namespace {
+
+std::string BlockType(std::optional<ValType> vt) {
+  if (!vt) {
+    return "";
+  }
+  std::stringstream ss;
+  ss << *vt;
+  return ss.str();
+}
+
+// Records every instruction it is dispatched as a string.
+class Recorder {
+ public:
+  void operator()(const op::ConstI32& op) {
+    _ops.push_back(absl::StrFormat("ConstI32(%d)", op.value.AsI32()));
+  }
+  void operator()(const op::AddI32&) { _ops.emplace_back("AddI32"); }
+  void operator()(const op::EqzI32&) { _ops.emplace_back("EqzI32"); }
+  void operator()(const op::CompareI32& op) {
+    _ops.push_back(absl::StrFormat("CompareI32(%d)", int(op.cond)));
+  }
+  void operator()(const op::GetLocalI32& op) {
+    _ops.push_back(absl::StrFormat("GetLocalI32(%d)", op.idx));
+  }
+  void operator()(const op::SetLocalI32& op) {
+    _ops.push_back(absl::StrFormat("SetLocalI32(%d)", op.idx));
+  }
+  void operator()(const op::Return&) { _ops.emplace_back("Return"); }
+  void operator()(const op::Unreachable&) { _ops.emplace_back("Unreachable"); }
+  void operator()(const op::Block& op) {
+    _ops.push_back(absl::StrFormat("Block(%s)", BlockType(op.result)));
+  }
+  void operator()(const op::Loop& op) {
+    _ops.push_back(absl::StrFormat("Loop(%s)", BlockType(op.result)));
+  }
+  void operator()(const op::If& op) {
+    _ops.push_back(absl::StrFormat("If(%s)", BlockType(op.result)));
+  }
+  void operator()(const op::Else&) { _ops.emplace_back("Else"); }
+  void operator()(const op::End&) { _ops.emplace_back("End"); }
+  void operator()(const op::Br& op) {
+    _ops.push_back(absl::StrFormat("Br(%d)", op.depth));
+  }
+  void operator()(const op::BrIf& op) {
+    _ops.push_back(absl::StrFormat("BrIf(%d)", op.depth));
+  }
+  void operator()(const op::BrTable& op) {
+    std::string targets;
+    for (size_t i = 0; i < op.size(); ++i) {
+      targets += absl::StrFormat("%d, ", op.target(i));
+    }
+    _ops.push_back(
+        absl::StrFormat("BrTable(%sdefault=%d)", targets, op.default_depth));
+  }
+
+  const std::vector<std::string>& ops() const { return _ops; }
+
+ private:
+  std::vector<std::string> _ops;
+};
+
+TEST(InstructionBuffer, Empty) {
+  InstructionBuffer buffer;
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(buffer.size(), 0);
+  EXPECT_EQ(buffer.size_bytes(), 0);
+  Recorder recorder;
+  Dispatch(buffer, &recorder);
+  EXPECT_TRUE(recorder.ops().empty());
+}
+
+TEST(InstructionBuffer, RoundTrip) {
+  InstructionBuffer buffer;
+  buffer.Append(op::Block{.result = ValType::kI32});
+  buffer.Append(op::Loop{});
+  buffer.Append(op::GetLocalI32(3));
+  buffer.Append(op::If{});
+  buffer.Append(op::ConstI32(-7));
+  buffer.Append(op::ConstI32(1));
+  buffer.Append(op::AddI32());
+  buffer.Append(op::EqzI32());
+  buffer.Append(op::CompareI32{.cond = Condition::kGeU});
+  buffer.Append(op::SetLocalI32(70000));
+  buffer.Append(op::Br{.depth = 1});
+  buffer.Append(op::Else());
+  buffer.Append(op::Unreachable());
+  buffer.Append(op::End());
+  buffer.Append(op::GetLocalI32(0));
+  buffer.Append(op::BrIf{.depth = 0});
+  buffer.Append(op::End());
+  buffer.Append(op::GetLocalI32(0));
+  std::vector<uint8_t> packed_targets(sizeof(uint32_t) * 2);
+  uint32_t targets[] = {0, 1};
+  std::memcpy(packed_targets.data(), targets, sizeof(targets));
+  buffer.Append(op::BrTable{.packed_targets = packed_targets,
+                            .default_depth = 2});
+  buffer.Append(op::End());
+  buffer.Append(op::Return());
+  EXPECT_EQ(buffer.size(), 21);
+  // 1 byte opcodes, 1 byte for each block type and condition and 4 bytes for
+  // each other immediate.
+  EXPECT_EQ(buffer.size_bytes(), 21 + 3 + 1 + (4 * 8) + (4 * 4));
+
+  std::vector<std::string> expected = {
+      "Block(i32)",
+      "Loop()",
+      "GetLocalI32(3)",
+      "If()",
+      "ConstI32(-7)",
+      "ConstI32(1)",
+      "AddI32",
+      "EqzI32",
+      "CompareI32(9)",
+      "SetLocalI32(70000)",
+      "Br(1)",
+      "Else",
+      "Unreachable",
+      "End",
+      "GetLocalI32(0)",
+      "BrIf(0)",
+      "End",
+      "GetLocalI32(0)",
+      "BrTable(0, 1, default=2)",
+      "End",
+      "Return",
+  };
+  Recorder recorder;
+  Dispatch(buffer, &recorder);
+  EXPECT_EQ(recorder.ops(), expected);
+
+  Recorder stepped;
+  InstructionReader reader(buffer);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_TRUE(reader.HasNext());
+    reader.DispatchNext(&stepped);
+    EXPECT_EQ(stepped.ops().back(), expected[i]);
+  }
+  EXPECT_FALSE(reader.HasNext());
+}
+
+TEST(Condition, Negate) {
+  for (int i = 0; i <= int(Condition::kGeU); ++i) {
+    auto cond = Condition(i);
+    EXPECT_NE(Negate(cond), cond);
+    EXPECT_EQ(Negate(Negate(cond)), cond);
+  }
+}
+
+TEST(Condition, Evaluate) {
+  EXPECT_TRUE(Evaluate(Condition::kLtS, -1, 1));
+  EXPECT_FALSE(Evaluate(Condition::kLtU, -1, 1));
+  EXPECT_TRUE(Evaluate(Condition::kGeU, -1, 1));
+  EXPECT_TRUE(Evaluate(Condition::kLeS, 1, 1));
+  EXPECT_FALSE(Evaluate(Condition::kNe, 1, 1));
+  const uint32_t values[] = {0, 1, 2, 0x7fffffff, 0x80000000, 0xffffffff};
+  for (int i = 0; i <= int(Condition::kGeU); ++i) {
+    auto cond = Condition(i);
+    for (uint32_t lhs : values) {
+      for (uint32_t rhs : values) {
+        EXPECT_NE(Evaluate(cond, lhs, rhs), Evaluate(Negate(cond), lhs, rhs));
+        EXPECT_EQ(Evaluate(cond, lhs, rhs), Evaluate(Commute(cond), rhs, lhs));
+      }
+    }
+  }
+}
+
+TEST(InstructionBuffer, Of) {
+  auto buffer = InstructionBuffer::Of(op::ConstI32(1), op::Return());
+  EXPECT_EQ(buffer.size(), 2);
+  Recorder recorder;
+  Dispatch(buffer, &recorder);
+  EXPECT_EQ(recorder.ops(), std::vector<std::string>({"ConstI32(1)", "Return"}));
+}
+
+}  // namespace
+}  // namespace wasmcc
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <bit>
 #include <climits>
 #include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
 
+#include "base/byte_cursor.h"
 #include "base/bytes.h"
 #include "base/stream.h"
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace wasmcc::leb128 {
 
 template <typename int_type>
@@ -48,13 +57,18 @@ bytes Encode(int_type value) {
 
 class DecodeException : std::exception {};
 
-template <typename int_type>
-int_type Decode(Stream* stream) {
+namespace internal {
+
+/**
+ * The reference decoder: one byte at a time through the source's `ReadByte`.
+ *
+ * This works with any source, including ones where the encoded value may not
+ * be contiguous in memory.
+ */
+template <typename int_type, ByteSource S>
+int_type DecodeByteAtATime(S* stream) {
   constexpr unsigned lower_seven_bits_mask = 0x7FU;
   constexpr unsigned continuation_bit_mask = 0x80U;
-  static_assert(sizeof(int_type) == sizeof(uint32_t) ||
-                    sizeof(int_type) == sizeof(uint64_t),
-                "Only 32bit and 64bit integers are supported");
   constexpr unsigned size = sizeof(int_type) * CHAR_BIT;
   int_type result = 0;
   unsigned shift = 0;
@@ -71,7 +85,6 @@ int_type Decode(Stream* stream) {
   }
 
   if constexpr (std::is_signed_v<int_type>) {
-    constexpr unsigned size = sizeof(int_type) * CHAR_BIT;
     constexpr unsigned sign_bit_mask = 0x40U;
     if ((shift < size) && (byte & sign_bit_mask)) {
       // sign extend
@@ -82,4 +95,145 @@ int_type Decode(Stream* stream) {
   return result;
 }
 
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+constexpr uint64_t kContinuationBits = 0x8080808080808080ULL;
+constexpr uint64_t kPayloadBits = 0x7F7F7F7F7F7F7F7FULL;
+
+inline uint64_t LoadWord(const uint8_t* data) {
+  uint64_t word = 0;
+  std::memcpy(&word, data, sizeof(word));
+  if constexpr (std::endian::native == std::endian::big) {
+    word = __builtin_bswap64(word);
+  }
+  return word;
+}
+
+/**
+ * Gather the low 7 bits of each byte in `word` into a contiguous 56 bit
+ * integer, with the first byte in the least significant bits.
+ */
+inline uint64_t GatherPayload(uint64_t word) {
+#if defined(__BMI2__)
+  return _pext_u64(word, kPayloadBits);
+#else
+  word &= kPayloadBits;
+  // Merge adjacent groups: 7 bits into 14, 14 bits into 28, 28 bits into 56.
+  word = ((word & 0x7F007F007F007F00ULL) >> 1) | (word & 0x007F007F007F007FULL);
+  word = ((word & 0x3FFF00003FFF0000ULL) >> 2) | (word & 0x00003FFF00003FFFULL);
+  word = ((word & 0x0FFFFFFF00000000ULL) >> 4) | (word & 0x000000000FFFFFFFULL);
+  return word;
+#endif
+}
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
+
+/**
+ * Decode from a contiguous buffer by loading 8 bytes at a time.
+ *
+ * The length of the encoding is found from the first byte without the
+ * continuation bit set, and the payload is gathered from the word without
+ * looping, so every encoding of up to 8 bytes (all 32 bit values, and the
+ * common 1-2 byte case) is decoded without any data dependent branches.
+ * Encodings longer than 8 bytes, and values too close to the end of the
+ * buffer to load a full word, fall back to the byte at a time decoder.
+ */
+template <typename int_type>
+int_type DecodeContiguous(ByteCursor* cursor) {
+  constexpr unsigned lower_seven_bits_mask = 0x7FU;
+  constexpr unsigned continuation_bit_mask = 0x80U;
+  constexpr unsigned size = sizeof(int_type) * CHAR_BIT;
+  constexpr unsigned max_length = (size + CHAR_BIT - 2) / (CHAR_BIT - 1);
+  bytes_view buffer = cursor->unread();
+  if (buffer.size() < sizeof(uint64_t)) [[unlikely]] {
+    return DecodeByteAtATime<int_type>(cursor);
+  }
+  uint64_t word = LoadWord(buffer.data());
+  if ((word & continuation_bit_mask) == 0) [[likely]] {
+    // Single byte values are by far the most common, and a predictable
+    // branch here keeps the next load off the length computation below.
+    cursor->Skip(1);
+    if constexpr (std::is_signed_v<int_type>) {
+      return static_cast<int8_t>(word << 1) >> 1;
+    } else {
+      return static_cast<int_type>(word & lower_seven_bits_mask);
+    }
+  }
+  uint64_t terminators = ~word & kContinuationBits;
+  if (terminators == 0) [[unlikely]] {
+    return DecodeByteAtATime<int_type>(cursor);
+  }
+  // The terminating byte's high bit is the last bit of the encoding.
+  unsigned encoded_bits = std::countr_zero(terminators) + 1;
+  unsigned length = encoded_bits / CHAR_BIT;
+  if (length > max_length) [[unlikely]] {
+    // Overflow!
+    throw DecodeException();
+  }
+  uint64_t result = GatherPayload(word & (~uint64_t(0) >> (64 - encoded_bits)));
+  if constexpr (std::is_signed_v<int_type>) {
+    // Sign extend from the top payload bit, a no-op if it's not set. Bits
+    // above `size` are truncated away below.
+    unsigned shift = length * (CHAR_BIT - 1);
+    uint64_t sign = (result >> (shift - 1)) & 1U;
+    result |= (uint64_t(0) - sign) << shift;
+  }
+  cursor->Skip(length);
+  return static_cast<int_type>(result);
+}
+
+}  // namespace internal
+
+/**
+ * Decode a LEB128 value from `stream`.
+ *
+ * This is a template over the source so that contiguous sources like
+ * `ByteCursor` can have their reads inlined, while `Stream*` still works.
+ * `ByteCursor` sources use a word at a time decoder.
+ */
+template <typename int_type, ByteSource S>
+int_type Decode(S* stream) {
+  static_assert(sizeof(int_type) == sizeof(uint32_t) ||
+                    sizeof(int_type) == sizeof(uint64_t),
+                "Only 32bit and 64bit integers are supported");
+  if constexpr (std::is_same_v<S, ByteCursor>) {
+    return internal::DecodeContiguous<int_type>(stream);
+  } else {
+    return internal::DecodeByteAtATime<int_type>(stream);
+  }
+}
+
+/**
+ * Decode `output.size()` consecutive LEB128 values from `stream`.
+ *
+ * This is meant for vectors of indices (such as the function section), where
+ * almost every value fits in a single byte. For unsigned values from a
+ * `ByteCursor`, runs of 8 single byte values are decoded with one load.
+ */
+template <typename int_type, ByteSource S>
+void DecodeN(S* stream, std::span<int_type> output) {
+  size_t i = 0;
+  if constexpr (std::is_same_v<S, ByteCursor> && std::is_unsigned_v<int_type>) {
+    constexpr size_t kWordSize = sizeof(uint64_t);
+    while (output.size() - i >= kWordSize &&
+           stream->remaining() >= kWordSize) {
+      uint64_t word = internal::LoadWord(stream->unread().data());
+      if ((word & internal::kContinuationBits) != 0) {
+        // Decode one at a time past this word before trying again.
+        size_t end = stream->BytesConsumed() + kWordSize;
+        while (i < output.size() && stream->BytesConsumed() < end) {
+          output[i++] = internal::DecodeContiguous<int_type>(stream);
+        }
+        continue;
+      }
+      for (size_t j = 0; j < kWordSize; ++j) {
+        output[i + j] = int_type((word >> (j * CHAR_BIT)) & 0xFFU);
+      }
+      i += kWordSize;
+      stream->Skip(kWordSize);
+    }
+  }
+  for (; i < output.size(); ++i) {
+    output[i] = Decode<int_type>(stream);
+  }
+}
+
 }  // namespace wasmcc::leb128
@@ -0,0 +1,101 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <vector>
+
+#include "base/byte_cursor.h"
+#include "base/bytes.h"
+#include "base/stream.h"
+#include "leb128/leb128.h"
+
+namespace wasmcc::leb128 {
+namespace {
+
+constexpr size_t kNumValues = 4096;
+
+// Encode `kNumValues` values, where each value has a uniformly random encoded
+// length between 1 and `max_length` bytes.
+template <typename T>
+bytes GenerateInput(int max_length) {
+  std::mt19937_64 rng(max_length);
+  bytes encoded;
+  for (size_t i = 0; i < kNumValues; ++i) {
+    auto length = 1 + (rng() % max_length);
+    auto bits = std::min<uint64_t>(length * (CHAR_BIT - 1),
+                                   sizeof(T) * CHAR_BIT - 1);
+    auto b = Encode<T>(T(rng() >> (64 - bits)));
+    encoded.insert(encoded.end(), b.begin(), b.end());
+  }
+  return encoded;
+}
+
+template <typename T>
+void BM_DecodeStream(benchmark::State& state) {
+  bytes input = GenerateInput<T>(int(state.range(0)));
+  for (auto _ : state) {
+    ByteStream stream(input);
+    Stream* s = &stream;
+    for (size_t i = 0; i < kNumValues; ++i) {
+      benchmark::DoNotOptimize(Decode<T>(s));
+    }
+  }
+  state.SetItemsProcessed(int64_t(state.iterations() * kNumValues));
+}
+
+template <typename T>
+void BM_DecodeCursorByteAtATime(benchmark::State& state) {
+  bytes input = GenerateInput<T>(int(state.range(0)));
+  for (auto _ : state) {
+    ByteCursor cursor(input);
+    for (size_t i = 0; i < kNumValues; ++i) {
+      benchmark::DoNotOptimize(internal::DecodeByteAtATime<T>(&cursor));
+    }
+  }
+  state.SetItemsProcessed(int64_t(state.iterations() * kNumValues));
+}
+
+template <typename T>
+void BM_DecodeCursor(benchmark::State& state) {
+  bytes input = GenerateInput<T>(int(state.range(0)));
+  for (auto _ : state) {
+    ByteCursor cursor(input);
+    for (size_t i = 0; i < kNumValues; ++i) {
+      benchmark::DoNotOptimize(Decode<T>(&cursor));
+    }
+  }
+  state.SetItemsProcessed(int64_t(state.iterations() * kNumValues));
+}
+
+template <typename T>
+void BM_DecodeN(benchmark::State& state) {
+  bytes input = GenerateInput<T>(int(state.range(0)));
+  std::vector<T> output(kNumValues);
+  for (auto _ : state) {
+    ByteCursor cursor(input);
+    DecodeN<T>(&cursor, output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(int64_t(state.iterations() * kNumValues));
+}
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+void Int32Lengths(benchmark::internal::Benchmark* b) {
+  b->ArgName("max_length")->Arg(1)->Arg(2)->Arg(5);
+}
+void Int64Lengths(benchmark::internal::Benchmark* b) {
+  b->ArgName("max_length")->Arg(2)->Arg(10);
+}
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
+
+BENCHMARK(BM_DecodeStream<uint32_t>)->Apply(Int32Lengths);
+BENCHMARK(BM_DecodeCursorByteAtATime<uint32_t>)->Apply(Int32Lengths);
+BENCHMARK(BM_DecodeCursor<uint32_t>)->Apply(Int32Lengths);
+BENCHMARK(BM_DecodeN<uint32_t>)->Apply(Int32Lengths);
+BENCHMARK(BM_DecodeStream<int64_t>)->Apply(Int64Lengths);
+BENCHMARK(BM_DecodeCursorByteAtATime<int64_t>)->Apply(Int64Lengths);
+BENCHMARK(BM_DecodeCursor<int64_t>)->Apply(Int64Lengths);
+
+}  // namespace
+}  // namespace wasmcc::leb128
@@ -3,9 +3,12 @@
 #include <gtest/gtest.h>
 
 #include <initializer_list>
+#include <algorithm>
 #include <limits>
+#include <random>
 #include <vector>
 
+#include "base/byte_cursor.h"
 #include "base/bytes.h"
 #include "base/stream.h"
 #include "gtest/gtest.h"
@@ -26,6 +29,19 @@ void RunTest(const TestData<T>& testcase) {
   auto s = ByteStream(testcase.encoded);
   EXPECT_EQ(Decode<T>(&s), testcase.decoded)
       << "decoding: " << testcase.decoded;
+
+  auto c = ByteCursor(testcase.encoded);
+  EXPECT_EQ(Decode<T>(&c), testcase.decoded)
+      << "decoding from cursor: " << testcase.decoded;
+  EXPECT_FALSE(c.HasRemaining());
+
+  // With trailing bytes the cursor can use the word at a time decoder.
+  bytes padded = testcase.encoded;
+  padded.resize(padded.size() + sizeof(uint64_t), 0xff);
+  c = ByteCursor(padded);
+  EXPECT_EQ(Decode<T>(&c), testcase.decoded)
+      << "decoding from padded cursor: " << testcase.decoded;
+  EXPECT_EQ(c.BytesConsumed(), testcase.encoded.size());
 }
 
 template <typename T>
@@ -116,6 +132,22 @@ TEST(Overflow, Long) {
   s = ByteStream(encoded);
   EXPECT_THROW(Decode<uint64_t>(&s), DecodeException);
 }
+TEST(Overflow, Cursor) {
+  bytes encoded(size_t(11), 0xff);
+  auto c = ByteCursor(encoded);
+  EXPECT_THROW(Decode<uint64_t>(&c), DecodeException);
+  c = ByteCursor(bytes_view(encoded).subspan(0, 3));
+  EXPECT_THROW(Decode<uint32_t>(&c), EndOfStreamException);
+}
+TEST(Overflow, PaddedCursor) {
+  bytes encoded = {0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x00, 0x00, 0x00};
+  auto c = ByteCursor(encoded);
+  EXPECT_THROW(Decode<uint32_t>(&c), DecodeException);
+  c = ByteCursor(encoded);
+  EXPECT_THROW(Decode<int32_t>(&c), DecodeException);
+  c = ByteCursor(encoded);
+  EXPECT_EQ(Decode<uint64_t>(&c), 0xfffffffffULL);
+}
 TEST(Overflow, Int) {
   bytes encoded = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
   auto s = ByteStream(encoded);
@@ -124,5 +156,70 @@ TEST(Overflow, Int) {
   EXPECT_THROW(Decode<uint32_t>(&s), DecodeException);
 }
 
+template <typename T>
+class MatchesByteAtATime : public testing::Test {};
+using IntegerTypes = testing::Types<int32_t, uint32_t, int64_t, uint64_t>;
+TYPED_TEST_SUITE(MatchesByteAtATime, IntegerTypes);
+
+TYPED_TEST(MatchesByteAtATime, RandomValues) {
+  std::mt19937_64 rng(GTEST_FLAG_GET(random_seed));
+  bytes encoded;
+  std::vector<TypeParam> expected;
+  for (int i = 0; i < 10000; ++i) {
+    // Pick a random bit width so that every encoded length shows up.
+    auto bits = rng() % (sizeof(TypeParam) * CHAR_BIT);
+    auto value = TypeParam(rng() >> (63 - bits));
+    if (std::is_signed_v<TypeParam> && (rng() & 1U)) {
+      value = ~value;
+    }
+    expected.push_back(value);
+    auto b = Encode<TypeParam>(value);
+    encoded.insert(encoded.end(), b.begin(), b.end());
+  }
+  auto c = ByteCursor(encoded);
+  auto s = ByteStream(encoded);
+  for (TypeParam value : expected) {
+    ASSERT_EQ(Decode<TypeParam>(&c), value);
+    ASSERT_EQ(internal::DecodeByteAtATime<TypeParam>(&s), value);
+  }
+  EXPECT_FALSE(c.HasRemaining());
+  EXPECT_FALSE(s.HasRemaining());
+
+  std::vector<TypeParam> decoded(expected.size());
+  c = ByteCursor(encoded);
+  DecodeN<TypeParam>(&c, decoded);
+  EXPECT_EQ(decoded, expected);
+  EXPECT_FALSE(c.HasRemaining());
+}
+
+TEST(DecodeN, SingleByteRuns) {
+  bytes encoded;
+  std::vector<uint32_t> expected;
+  for (uint32_t i = 0; i < 100; ++i) {
+    // A multi-byte value every so often to break up the runs.
+    uint32_t value = i % 13 == 0 ? i * 1000 : i;
+    expected.push_back(value);
+    auto b = Encode<uint32_t>(value);
+    encoded.insert(encoded.end(), b.begin(), b.end());
+  }
+  std::vector<uint32_t> decoded(expected.size());
+  auto c = ByteCursor(encoded);
+  DecodeN<uint32_t>(&c, decoded);
+  EXPECT_EQ(decoded, expected);
+  EXPECT_FALSE(c.HasRemaining());
+
+  auto s = ByteStream(encoded);
+  std::fill(decoded.begin(), decoded.end(), 0);
+  DecodeN<uint32_t>(&s, decoded);
+  EXPECT_EQ(decoded, expected);
+}
+
+TEST(DecodeN, Truncated) {
+  bytes encoded(size_t(16), 0x01);
+  std::vector<uint32_t> decoded(17);
+  auto c = ByteCursor(encoded);
+  EXPECT_THROW(DecodeN<uint32_t>(&c, decoded), EndOfStreamException);
+}
+
 // NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
 }  // namespace wasmcc::leb128
@@ -2,11 +2,15 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
+#include <array>
 #include <bit>
+#include <coroutine>
 #include <cstdint>
 #include <cstring>
 #include <iterator>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -14,9 +18,12 @@
 #include "absl/container/flat_hash_set.h"
 #include "absl/functional/any_invocable.h"
 #include "absl/strings/str_format.h"
+#include "base/byte_cursor.h"
 #include "base/bytes.h"
+#include "base/chunked_stream.h"
 #include "base/coro.h"
 #include "base/stream.h"
+#include "base/thread_pool.h"
 #include "core/ast.h"
 #include "core/instruction.h"
 #include "leb128/leb128.h"
@@ -28,6 +35,7 @@ namespace {
 
 constexpr size_t MAX_FUNCTIONS = 1U << 16U;
 constexpr size_t MAX_FUNCTION_LOCALS = 1U << 8U;
+constexpr size_t MAX_BR_TABLE_SIZE = 1U << 16U;
 // These are currently set so that we're always passing everything into
 // registers.
 constexpr size_t kMaxFunctionParameters = 6;
@@ -43,7 +51,39 @@ constexpr size_t kMaxGlobals = 1U << 10U;
 constexpr size_t kMaxExports = 1U << 8U;
 constexpr size_t kMaxNameLength = 1U << 8U;
 
-ValType ParseValType(Stream* parser) {
+// An awaitable for sources that have all their data available upfront.
+struct AlwaysReady {
+  constexpr bool await_ready() const noexcept { return true; }
+  constexpr void await_suspend(std::coroutine_handle<>) const noexcept {}
+  constexpr void await_resume() const noexcept {}
+};
+
+// Wait for `n` bytes to be available in the source.
+//
+// This is a noop for sources that are not asynchronous.
+template <ByteSource S>
+auto WaitFor(S* parser, size_t n) {
+  if constexpr (AsyncByteSource<S>) {
+    return parser->WaitFor(n);
+  } else {
+    return AlwaysReady{};
+  }
+}
+
+// Wait for a LEB128 encoded integer to be available in the source.
+//
+// This is a noop for sources that are not asynchronous.
+template <ByteSource S>
+auto WaitForLeb128(S* parser) {
+  if constexpr (AsyncByteSource<S>) {
+    return parser->WaitForLeb128();
+  } else {
+    return AlwaysReady{};
+  }
+}
+
+template <ByteSource S>
+ValType ParseValType(S* parser) {
   auto type_id = parser->ReadByte();
   switch (type_id) {
     case uint8_t(ValType::kI32):
@@ -66,7 +106,8 @@ void ValidateInRange(std::string_view msg, NamedInteger idx, const Vector& v) {
   }
 }
 
-Name ParseName(Stream* parser) {
+template <ByteSource S>
+Name ParseName(S* parser) {
   auto str_len = leb128::Decode<uint32_t>(parser);
   if (str_len > kMaxNameLength) {
     throw ParseException(absl::StrFormat("name too long: %d", str_len));
@@ -77,25 +118,30 @@ Name ParseName(Stream* parser) {
   return Name(std::move(s));
 }
 
-TypeIdx ParseTypeIdx(Stream* parser) {
+template <ByteSource S>
+TypeIdx ParseTypeIdx(S* parser) {
   return TypeIdx(leb128::Decode<uint32_t>(parser));
 }
 
-FuncIdx ParseFuncIdx(Stream* parser) {
+template <ByteSource S>
+FuncIdx ParseFuncIdx(S* parser) {
   return FuncIdx(leb128::Decode<uint32_t>(parser));
 }
-TableIdx ParseTableIdx(Stream* parser) {
+template <ByteSource S>
+TableIdx ParseTableIdx(S* parser) {
   return TableIdx(leb128::Decode<uint32_t>(parser));
 }
-MemIdx ParseMemIdx(Stream* parser) {
+template <ByteSource S>
+MemIdx ParseMemIdx(S* parser) {
   return MemIdx(leb128::Decode<uint32_t>(parser));
 }
-GlobalIdx ParseGlobalIdx(Stream* parser) {
+template <ByteSource S>
+GlobalIdx ParseGlobalIdx(S* parser) {
   return GlobalIdx(leb128::Decode<uint32_t>(parser));
 }
 
-template <size_t kMax>
-std::vector<ValType> ParseSignatureTypes(Stream* parser) {
+template <size_t kMax, ByteSource S>
+std::vector<ValType> ParseSignatureTypes(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMax) {
     throw ModuleTooLargeException(
@@ -109,7 +155,8 @@ std::vector<ValType> ParseSignatureTypes(Stream* parser) {
   return result_type;
 }
 
-BlockType ParseSignature(Stream* parser) {
+template <ByteSource S>
+BlockType ParseSignature(S* parser) {
   auto magic = parser->ReadByte();
   // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers)
   if (magic != 0x60) {
@@ -122,7 +169,8 @@ BlockType ParseSignature(Stream* parser) {
           .result_types = std::move(result_types)};
 }
 
-Limits ParseLimits(Stream* parser) {
+template <ByteSource S>
+Limits ParseLimits(S* parser) {
   if (parser->ReadByte()) {
     auto min = leb128::Decode<uint32_t>(parser);
     auto max = leb128::Decode<uint32_t>(parser);
@@ -133,7 +181,8 @@ Limits ParseLimits(Stream* parser) {
   }
 }
 
-TableType ParseTableType(Stream* parser) {
+template <ByteSource S>
+TableType ParseTableType(S* parser) {
   auto reftype = ParseValType(parser);
   if (reftype != ValType::kExternRef && reftype != ValType::kFuncRef) {
     throw ParseException(
@@ -143,19 +192,16 @@ TableType ParseTableType(Stream* parser) {
   return {.limits = limits, .reftype = reftype};
 }
 
-MemType ParseMemType(Stream* parser) { return {.limits = ParseLimits(parser)}; }
+template <ByteSource S>
+MemType ParseMemType(S* parser) { return {.limits = ParseLimits(parser)}; }
 
-GlobalType ParseGlobalType(Stream* parser) {
+template <ByteSource S>
+GlobalType ParseGlobalType(S* parser) {
   auto valtype = ParseValType(parser);
   auto mut = parser->ReadByte();
   return {.valtype = valtype, .mut = bool(mut)};
 }
 
-struct Code {
-  std::vector<ValType> locals;
-  std::vector<Instruction> body;
-};
-
 /**
  * module_builder is responible for parsing the binary representation of a WASM
  * module and also enforcing various limits we've enforced.
@@ -169,14 +215,15 @@ struct Code {
  */
 class ModuleBuilder {
  public:
-  ModuleBuilder() = default;
+  explicit ModuleBuilder(ParseOptions options) : _options(options) {}
   ModuleBuilder(const ModuleBuilder&) = delete;
   ModuleBuilder& operator=(const ModuleBuilder&) = delete;
   ModuleBuilder(ModuleBuilder&&) = delete;
   ModuleBuilder& operator=(ModuleBuilder&&) = delete;
   ~ModuleBuilder() = default;
 
-  co::Future<> Parse(Stream* parser);
+  template <ByteSource S>
+  co::Future<> Parse(S* parser);
 
   co::Future<ParsedModule> Build();
 
@@ -199,36 +246,53 @@ class ModuleBuilder {
   //
   // Around any of these sections can be a custom section, which we
   // currently ignore.
-  co::Future<> ParseOneSection(Stream* parser);
+  template <ByteSource S>
+  co::Future<> ParseOneSection(S* parser);
 
   // Parses the first section, which is made up of function signatures.
-  co::Future<> ParseSignatureSection(Stream*);
+  template <ByteSource S>
+  co::Future<> ParseSignatureSection(S*);
 
   // Parses the forward declarations of functions.
-  co::Future<> ParseFunctionDeclarationSection(Stream*);
+  template <ByteSource S>
+  co::Future<> ParseFunctionDeclarationSection(S*);
 
   // Parses the imports for this module.
   //
   // NOTE: this does not validate that the imports exist. That will need to be
   // done at a later phase (or maybe that should be inputs to this..?)
-  ModuleImport ParseOneImport(Stream*);
-  co::Future<> ParseImportSection(Stream*);
+  template <ByteSource S>
+  ModuleImport ParseOneImport(S*);
+  template <ByteSource S>
+  co::Future<> ParseImportSection(S*);
 
-  co::Future<> ParseTableSection(Stream*);
+  template <ByteSource S>
+  co::Future<> ParseTableSection(S*);
 
-  co::Future<> ParseMemoriesSection(Stream*);
+  template <ByteSource S>
+  co::Future<> ParseMemoriesSection(S*);
 
-  co::Future<> ParseGlobalsSection(Stream*);
+  template <ByteSource S>
+  co::Future<> ParseGlobalsSection(S*);
 
-  ModuleExport ParseOneExport(Stream*);
-  co::Future<> ParseExportsSection(Stream*);
+  template <ByteSource S>
+  ModuleExport ParseOneExport(S*);
+  template <ByteSource S>
+  co::Future<> ParseExportsSection(S*);
 
   // Parse a function body
-  std::vector<Instruction> ParseExpression(Stream* parser,
-                                           FunctionValidator* validator);
-  BlockType ParseBlockType(Stream*);
-  void ParseOneCode(Stream*, Function*);
-  co::Future<> ParseCodeSection(Stream*);
+  template <ByteSource S>
+  InstructionBuffer ParseExpression(S* parser, FunctionValidator* validator,
+                                    uint32_t expected_size);
+  template <ByteSource S>
+  BlockType ParseBlockType(S*);
+  template <ByteSource S>
+  void ParseOneCode(S*, Function*, uint32_t expected_size);
+  template <ByteSource S>
+  co::Future<> ParseCodeSection(S*);
+  // Parse the code section by first finding the boundaries of each function
+  // body, then decoding and validating the bodies in parallel.
+  void ParseCodeSectionInParallel(ByteCursor*, ThreadPool*);
 
   // In order to properly be able to stream parsing of modules, we need to
   // ensure everything is created in the correct order. The spec enforces that
@@ -246,9 +310,12 @@ class ModuleBuilder {
   std::vector<Global> _globals;
   std::vector<ModuleExport> _exports;
   std::optional<FuncIdx> _start;
+
+  ParseOptions _options;
 };
 
-BlockType ModuleBuilder::ParseBlockType(Stream* parser) {
+template <ByteSource S>
+BlockType ModuleBuilder::ParseBlockType(S* parser) {
   auto byte = parser->PeekByte();
   // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers)
   if (byte == 0x40) {
@@ -286,10 +353,12 @@ co::Future<ParsedModule> ModuleBuilder::Build() {
                                         std::get<FuncIdx>(exprt.description));
     }
   }
+  parsed.start_function = _start;
   co_return parsed;
 }
 
-co::Future<> ModuleBuilder::ParseSignatureSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseSignatureSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMaxFunctionSignatures) {
     throw ModuleTooLargeException(
@@ -302,14 +371,18 @@ co::Future<> ModuleBuilder::ParseSignatureSection(Stream* parser) {
   }
 }
 
-co::Future<> ModuleBuilder::ParseFunctionDeclarationSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseFunctionDeclarationSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > MAX_FUNCTIONS) {
     throw ModuleTooLargeException(absl::StrFormat(
         "too many functions: %d, max: %d", vector_size, MAX_FUNCTIONS));
   }
+  // These are almost always single byte indexes, so decode them in bulk.
+  std::vector<uint32_t> type_indexes(vector_size);
+  leb128::DecodeN<uint32_t>(parser, type_indexes);
   for (uint32_t i = 0; i < vector_size; ++i) {
-    auto funcidx = ParseFuncIdx(parser);
+    auto funcidx = TypeIdx(type_indexes[i]);
     ValidateInRange("unknown function signature", funcidx, _func_signatures);
     _functions.push_back({.meta = {
                               .signature = _func_signatures[funcidx.value()],
@@ -318,7 +391,8 @@ co::Future<> ModuleBuilder::ParseFunctionDeclarationSection(Stream* parser) {
   }
 }
 
-ModuleImport ModuleBuilder::ParseOneImport(Stream* parser) {
+template <ByteSource S>
+ModuleImport ModuleBuilder::ParseOneImport(S* parser) {
   auto module_name = ParseName(parser);
   auto name = ParseName(parser);
   auto type = parser->ReadByte();
@@ -349,7 +423,8 @@ ModuleImport ModuleBuilder::ParseOneImport(Stream* parser) {
           .description = desc.value()};
 }
 
-co::Future<> ModuleBuilder::ParseImportSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseImportSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMaxImports) {
     throw ModuleTooLargeException(absl::StrFormat(
@@ -362,9 +437,11 @@ co::Future<> ModuleBuilder::ParseImportSection(Stream* parser) {
   }
 }
 
-Table parse_table(Stream* parser) { return {.type = ParseTableType(parser)}; }
+template <ByteSource S>
+Table parse_table(S* parser) { return {.type = ParseTableType(parser)}; }
 
-co::Future<> ModuleBuilder::ParseTableSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseTableSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMaxTables) {
     throw ModuleTooLargeException(absl::StrFormat(
@@ -377,9 +454,11 @@ co::Future<> ModuleBuilder::ParseTableSection(Stream* parser) {
   }
 }
 
-Mem parse_memory(Stream* parser) { return {.type = ParseMemType(parser)}; }
+template <ByteSource S>
+Mem parse_memory(S* parser) { return {.type = ParseMemType(parser)}; }
 
-co::Future<> ModuleBuilder::ParseMemoriesSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseMemoriesSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMaxMemories) {
     throw ModuleTooLargeException(absl::StrFormat(
@@ -392,7 +471,8 @@ co::Future<> ModuleBuilder::ParseMemoriesSection(Stream* parser) {
   }
 }
 
-Value parse_const_expr(Stream* parser) {
+template <ByteSource S>
+Value parse_const_expr(S* parser) {
   auto opcode = parser->ReadByte();
   // NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
   switch (opcode) {
@@ -401,13 +481,13 @@ Value parse_const_expr(Stream* parser) {
     case 0x42:
       return Value::U64(leb128::Decode<uint64_t>(parser));
     case 0x43: {
-      bytes b = parser->ReadBytes(sizeof(float));
+      auto b = parser->ReadBytes(sizeof(float));
       float result = 0;
       std::memcpy(&result, b.data(), b.size());
       return Value::F32(result);
     }
     case 0x44: {
-      bytes b = parser->ReadBytes(sizeof(double));
+      auto b = parser->ReadBytes(sizeof(double));
       double result = 0;
       std::memcpy(&result, b.data(), b.size());
       return Value::F64(result);
@@ -420,13 +500,15 @@ Value parse_const_expr(Stream* parser) {
   // NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
 }
 
-Global parse_global(Stream* parser) {
+template <ByteSource S>
+Global parse_global(S* parser) {
   auto type = ParseGlobalType(parser);
   auto value = parse_const_expr(parser);
   return {.type = type, .value = value};
 }
 
-co::Future<> ModuleBuilder::ParseGlobalsSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseGlobalsSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMaxGlobals) {
     throw ModuleTooLargeException(absl::StrFormat(
@@ -439,7 +521,8 @@ co::Future<> ModuleBuilder::ParseGlobalsSection(Stream* parser) {
   }
 }
 
-ModuleExport ModuleBuilder::ParseOneExport(Stream* parser) {
+template <ByteSource S>
+ModuleExport ModuleBuilder::ParseOneExport(S* parser) {
   auto name = ParseName(parser);
   auto type = parser->ReadByte();
   std::optional<ModuleExport::Description> desc;
@@ -474,7 +557,8 @@ ModuleExport ModuleBuilder::ParseOneExport(Stream* parser) {
   return {.name = std::move(name), .description = desc.value()};
 }
 
-co::Future<> ModuleBuilder::ParseExportsSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseExportsSection(S* parser) {
   auto vector_size = leb128::Decode<uint32_t>(parser);
   if (vector_size > kMaxExports) {
     throw ModuleTooLargeException(absl::StrFormat(
@@ -495,39 +579,109 @@ class OpEmitter {
  public:
   explicit OpEmitter(FunctionValidator* v) : _validator(v) {}
 
-  void Emit(Instruction instruction) {
-    std::visit(*_validator, instruction);
-    _instructions.push_back(std::move(instruction));
+  template <typename Op>
+  void Emit(const Op& op) {
+    (*_validator)(op);
+    _instructions.Append(op);
   }
 
-  std::vector<Instruction> Finalize() && {
+  void Reserve(size_t n) { _instructions.Reserve(n); }
+
+  InstructionBuffer Finalize() && {
     _validator->Finalize();
     return std::move(_instructions);
   }
 
  private:
   FunctionValidator* _validator;
-  std::vector<Instruction> _instructions;
+  InstructionBuffer _instructions;
 };
 
-std::vector<Instruction> ModuleBuilder::ParseExpression(
-    Stream* parser, FunctionValidator* validator) {
+// Our IR only supports the MVP block types, with no parameters and at most one
+// result.
+std::optional<ValType> AsBlockResult(const BlockType& bt) {
+  if (!bt.parameter_types.empty() || bt.result_types.size() > 1) {
+    throw ParseException("unsupported multi-value block type");
+  }
+  if (bt.result_types.empty()) {
+    return std::nullopt;
+  }
+  return bt.result_types.front();
+}
+
+template <ByteSource S>
+InstructionBuffer ModuleBuilder::ParseExpression(S* parser,
+                                                 FunctionValidator* validator,
+                                                 uint32_t expected_size) {
   auto emitter = OpEmitter(validator);
+  // The encoded IR is usually 2-3x the size of the wasm bytecode, so this
+  // avoids most of the regrowth.
+  emitter.Reserve(size_t(expected_size) * 3);
+  // The number of open blocks, the `end` of the function body closes it when
+  // this is zero.
+  size_t depth = 0;
+  std::vector<uint8_t> packed_targets;
   // NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
-  for (auto opcode = parser->ReadByte(); opcode != 0x0B;
-       opcode = parser->ReadByte()) {
+  while (true) {
+    auto opcode = parser->ReadByte();
     switch (opcode) {
-      case 0x04:  // if
-        emitter.Emit(op::BrIf(MakeLabelId("then", 0), MakeLabelId("else", 0)));
-        emitter.Emit(op::Label(MakeLabelId("then", 0)));
+      case 0x00:  // unreachable
+        emitter.Emit(op::Unreachable());
+        break;
+      case 0x01:  // nop
+        break;
+      case 0x02: {  // block
+        auto result = AsBlockResult(ParseBlockType(parser));
+        emitter.Emit(op::Block{.result = result});
+        ++depth;
+        break;
+      }
+      case 0x03: {  // loop
+        auto result = AsBlockResult(ParseBlockType(parser));
+        emitter.Emit(op::Loop{.result = result});
+        ++depth;
+        break;
+      }
+      case 0x04: {  // if
+        auto result = AsBlockResult(ParseBlockType(parser));
+        emitter.Emit(op::If{.result = result});
+        ++depth;
         break;
+      }
       case 0x05:  // else
-        emitter.Emit(op::Br(MakeLabelId("end", 0)));
-        emitter.Emit(op::Label(MakeLabelId("else", 0)));
+        emitter.Emit(op::Else());
         break;
       case 0x0B:  // end
-        emitter.Emit(op::Label(MakeLabelId("end", 0)));
+        if (depth == 0) {
+          return std::move(emitter).Finalize();
+        }
+        emitter.Emit(op::End());
+        --depth;
+        break;
+      case 0x0C:  // br
+        emitter.Emit(op::Br{.depth = leb128::Decode<uint32_t>(parser)});
+        break;
+      case 0x0D:  // br_if
+        emitter.Emit(op::BrIf{.depth = leb128::Decode<uint32_t>(parser)});
+        break;
+      case 0x0E: {  // br_table
+        auto size = leb128::Decode<uint32_t>(parser);
+        if (size > MAX_BR_TABLE_SIZE) {
+          throw ModuleTooLargeException(
+              absl::StrFormat("too large of br_table: %d", size));
+        }
+        packed_targets.resize(size_t(size) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < size; ++i) {
+          auto target = leb128::Decode<uint32_t>(parser);
+          std::memcpy(&packed_targets[i * sizeof(target)], &target,
+                      sizeof(target));
+        }
+        emitter.Emit(op::BrTable{
+            .packed_targets = packed_targets,
+            .default_depth = leb128::Decode<uint32_t>(parser),
+        });
         break;
+      }
       case 0x0F:  // return
         emitter.Emit(op::Return());
         break;
@@ -542,10 +696,43 @@ std::vector<Instruction> ModuleBuilder::ParseExpression(
         break;
       }
       case 0x41: {  // const_i32
-        auto v = leb128::Decode<uint32_t>(parser);
-        emitter.Emit(op::ConstI32(Value::U32(v)));
+        auto v = leb128::Decode<int32_t>(parser);
+        emitter.Emit(op::ConstI32(Value::I32(v)));
         break;
       }
+      case 0x45:  // eqz_i32
+        emitter.Emit(op::EqzI32());
+        break;
+      case 0x46:  // eq_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kEq});
+        break;
+      case 0x47:  // ne_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kNe});
+        break;
+      case 0x48:  // lt_s_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kLtS});
+        break;
+      case 0x49:  // lt_u_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kLtU});
+        break;
+      case 0x4A:  // gt_s_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kGtS});
+        break;
+      case 0x4B:  // gt_u_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kGtU});
+        break;
+      case 0x4C:  // le_s_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kLeS});
+        break;
+      case 0x4D:  // le_u_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kLeU});
+        break;
+      case 0x4E:  // ge_s_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kGeS});
+        break;
+      case 0x4F:  // ge_u_i32
+        emitter.Emit(op::CompareI32{.cond = Condition::kGeU});
+        break;
       case 0x6A:  // add_i32
         emitter.Emit(op::AddI32());
         break;
@@ -554,11 +741,11 @@ std::vector<Instruction> ModuleBuilder::ParseExpression(
     }
   }
   // NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
-  return std::move(emitter).Finalize();
 }
 
-void ModuleBuilder::ParseOneCode(Stream* parser, Function* func) {
-  auto expected_size = leb128::Decode<uint32_t>(parser);
+template <ByteSource S>
+void ModuleBuilder::ParseOneCode(S* parser, Function* func,
+                                 uint32_t expected_size) {
   auto start_position = parser->BytesConsumed();
 
   auto vector_size = leb128::Decode<uint32_t>(parser);
@@ -572,11 +759,16 @@ void ModuleBuilder::ParseOneCode(Stream* parser, Function* func) {
     std::fill_n(std::back_inserter(func->meta.locals), num_locals, valtype);
   }
   FunctionValidator validator(func->meta.signature, func->meta.locals);
-  func->body = ParseExpression(parser, &validator);
+  func->body = ParseExpression(parser, &validator, expected_size);
   func->meta.max_stack_size_bytes = validator.maximum_stack_size_bytes();
   func->meta.max_stack_elements = validator.maximum_stack_elements();
+  func->meta.local_uses = validator.local_uses();
 
   auto actual = parser->BytesConsumed() - start_position;
+  if (actual > expected_size) {
+    throw ParseException(absl::StrFormat(
+        "function body overruns its declared size of %d bytes", expected_size));
+  }
   if (actual != expected_size) {
     throw ParseException(
         absl::StrFormat("unexpected size of function, actual: %d expected: %d",
@@ -584,7 +776,9 @@ void ModuleBuilder::ParseOneCode(Stream* parser, Function* func) {
   }
 }
 
-co::Future<> ModuleBuilder::ParseCodeSection(Stream* parser) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseCodeSection(S* parser) {
+  co_await WaitForLeb128(parser);
   auto vector_size = leb128::Decode<uint32_t>(parser);
   // We don't need to check the max size because we did that for _functions
   if (vector_size != _functions.size()) {
@@ -592,15 +786,50 @@ co::Future<> ModuleBuilder::ParseCodeSection(Stream* parser) {
         absl::StrFormat("unexpected number of code, actual: %d expected: %d",
                         vector_size, _functions.size()));
   }
-  // Check the number vs the function section
+  if constexpr (std::is_same_v<S, ByteCursor>) {
+    if (_options.code_section_pool != nullptr &&
+        _options.code_section_pool->size() > 1) {
+      ParseCodeSectionInParallel(parser, _options.code_section_pool);
+      co_return;
+    }
+  }
   for (uint32_t i = 0; i < vector_size; ++i) {
     auto& fn = _functions[i];
-    ParseOneCode(parser, &fn);
+    co_await WaitForLeb128(parser);
+    auto expected_size = leb128::Decode<uint32_t>(parser);
+    co_await WaitFor(parser, expected_size);
+    ParseOneCode(parser, &fn, expected_size);
     co_await co::MaybeYield();
   }
 }
 
-co::Future<> ModuleBuilder::ParseOneSection(Stream* parser) {
+void ModuleBuilder::ParseCodeSectionInParallel(ByteCursor* parser,
+                                               ThreadPool* pool) {
+  // Bodies are length prefixed, so we can find all the boundaries without
+  // decoding anything.
+  std::vector<bytes_view> bodies;
+  bodies.reserve(_functions.size());
+  for (size_t i = 0; i < _functions.size(); ++i) {
+    auto expected_size = leb128::Decode<uint32_t>(parser);
+    bodies.push_back(parser->ReadBytes(expected_size));
+  }
+  pool->ParallelFor(bodies.size(), [this, &bodies](size_t i) {
+    ByteCursor body(bodies[i]);
+    auto expected_size = uint32_t(bodies[i].size());
+    try {
+      ParseOneCode(&body, &_functions[i], expected_size);
+    } catch (const EndOfStreamException&) {
+      // Parsing serially reads on into the next body and then finds that it
+      // overran, so fail the same way.
+      throw ParseException(absl::StrFormat(
+          "function body overruns its declared size of %d bytes",
+          expected_size));
+    }
+  });
+}
+
+template <ByteSource S>
+co::Future<> ModuleBuilder::ParseOneSection(S* parser) {
   auto id = parser->ReadByte();
 
   if (id != 0 && id <= _latest_section_read) {
@@ -612,7 +841,14 @@ co::Future<> ModuleBuilder::ParseOneSection(Stream* parser) {
     // ensure are read in order.
     _latest_section_read = id;
   }
+  co_await WaitForLeb128(parser);
   auto size = leb128::Decode<uint32_t>(parser);
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers)
+  if (id != 0x0A) {
+    // Wait for the entire section to arrive, except for the code section where
+    // we're able to make progress on each function as it arrives.
+    co_await WaitFor(parser, size);
+  }
   // NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
   switch (id) {
     case 0x00:  // Custom section
@@ -663,20 +899,26 @@ co::Future<> ModuleBuilder::ParseOneSection(Stream* parser) {
   // NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
 }
 
-co::Future<> ModuleBuilder::Parse(Stream* parser) {
-  bytes magic = parser->ReadBytes(4);
-  static const bytes kMagicBytes = bytes({0x00, 0x61, 0x73, 0x6D});
-  if (magic != kMagicBytes) {
+template <ByteSource S>
+co::Future<> ModuleBuilder::Parse(S* parser) {
+  co_await WaitFor(parser, 8);
+  auto magic = parser->ReadBytes(4);
+  constexpr std::array<uint8_t, 4> kMagicBytes = {0x00, 0x61, 0x73, 0x6D};
+  if (!std::ranges::equal(magic, kMagicBytes)) {
     throw ParseException(absl::StrFormat("magic bytes mismatch: %x %x %x %x",
                                          magic[0], magic[1], magic[2],
                                          magic[3]));
   }
-  bytes version = parser->ReadBytes(4);
-  static const bytes kVersionOne = bytes({0x01, 0x00, 0x00, 0x00});
-  if (version != kVersionOne) {
+  auto version = parser->ReadBytes(4);
+  constexpr std::array<uint8_t, 4> kVersionOne = {0x01, 0x00, 0x00, 0x00};
+  if (!std::ranges::equal(version, kVersionOne)) {
     throw ParseException("unsupported wasm version");
   }
-  while (parser->HasRemaining()) {
+  while (true) {
+    co_await WaitFor(parser, 1);
+    if (!parser->HasRemaining()) {
+      break;
+    }
     co_await ParseOneSection(parser);
     co_await co::MaybeYield();
   }
@@ -684,10 +926,25 @@ co::Future<> ModuleBuilder::Parse(Stream* parser) {
 
 }  // namespace
 
-co::Future<ParsedModule> ParseModule(Stream* stream) {
-  ModuleBuilder builder;
+namespace {
+template <ByteSource S>
+co::Future<ParsedModule> ParseModuleImpl(S* stream, ParseOptions options) {
+  ModuleBuilder builder(options);
   co_await builder.Parse(stream);
   co_return co_await builder.Build();
 }
+}  // namespace
+
+co::Future<ParsedModule> ParseModule(Stream* stream) {
+  return ParseModuleImpl(stream, {});
+}
+
+co::Future<ParsedModule> ParseModule(ByteCursor* cursor, ParseOptions options) {
+  return ParseModuleImpl(cursor, options);
+}
+
+co::Future<ParsedModule> ParseModule(ChunkedStream* stream) {
+  return ParseModuleImpl(stream, {});
+}
 
 }  // namespace wasmcc
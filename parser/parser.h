@@ -1,7 +1,10 @@
 #pragma once
 
+#include "base/byte_cursor.h"
+#include "base/chunked_stream.h"
 #include "base/coro.h"
 #include "base/stream.h"
+#include "base/thread_pool.h"
 #include "core/ast.h"
 
 namespace wasmcc {
@@ -22,6 +25,37 @@ class ModuleTooLargeException : public ParseException {
       : ParseException(std::move(msg)) {}
 };
 
+struct ParseOptions {
+  /**
+   * If set, function bodies within the code section are decoded and validated
+   * in parallel on this pool. The resulting module is identical to parsing
+   * serially.
+   *
+   * This is only supported when parsing from a `ByteCursor`, as all the
+   * bodies must be available upfront.
+   */
+  ThreadPool* code_section_pool = nullptr;
+};
+
 co::Future<ParsedModule> ParseModule(Stream*);
 
+/**
+ * Parse a module from a contiguous buffer.
+ *
+ * This is the fastest way to parse a module, as every read is inlined and no
+ * bytes are copied out of the source. Combine with `MappedFile` to parse a
+ * module directly from disk.
+ */
+co::Future<ParsedModule> ParseModule(ByteCursor*, ParseOptions = {});
+
+/**
+ * Parse a module incrementally as it arrives.
+ *
+ * The returned future suspends whenever it needs data that has not been pushed
+ * into the stream yet, so the caller should `Start()` it and then push data
+ * into the stream as it arrives. Each push parses as much of the module as
+ * possible, so the module is parsed alongside being received.
+ */
+co::Future<ParsedModule> ParseModule(ChunkedStream*);
+
 }  // namespace wasmcc
@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "base/byte_cursor.h"
+#include "base/thread_pool.h"
+#include "parser/parser.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+constexpr int kNumFunctions = 10000;
+constexpr int kAddsPerFunction = 32;
+
+bytes GenerateModule() {
+  std::string wat = "(module\n";
+  for (int i = 0; i < kNumFunctions; ++i) {
+    absl::StrAppendFormat(
+        &wat, "(func $f%d (param i32 i32) (result i32) (local i32)\n", i);
+    for (int j = 0; j < kAddsPerFunction; ++j) {
+      wat += "local.get 0 local.get 1 i32.add local.set 2\n";
+    }
+    wat += "local.get 2)\n";
+  }
+  wat += "(export \"f0\" (func $f0)))";
+  return Wat2Wasm(wat);
+}
+
+void BM_ParseModule(benchmark::State& state) {
+  static const bytes kWasm = GenerateModule();
+  ThreadPool pool(state.range(0));
+  for (auto _ : state) {
+    ByteCursor cursor(kWasm);
+    auto parsed = ParseModule(&cursor, {.code_section_pool = &pool}).get();
+    benchmark::DoNotOptimize(parsed);
+  }
+  state.SetBytesProcessed(int64_t(state.iterations() * kWasm.size()));
+}
+BENCHMARK(BM_ParseModule)
+    ->ArgName("threads")
+    ->DenseRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace wasmcc
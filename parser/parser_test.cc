@@ -3,16 +3,25 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <fstream>
 #include <initializer_list>
+#include <random>
 
+#include "absl/strings/str_format.h"
+#include "base/byte_cursor.h"
+#include "base/chunked_stream.h"
+#include "base/mapped_file.h"
 #include "base/stream.h"
+#include "base/thread_pool.h"
 #include "gmock/gmock.h"
+#include "parser/validator.h"
 #include "testing/wat.h"
 
 namespace wasmcc {
 
-TEST(Parsing, AddFunc) {
-  std::string_view wat = R"WAT(
+namespace {
+constexpr std::string_view kAddModule = R"WAT(
     (module
       (func $add (param $lhs i32) (param $rhs i32) (result i32)
         local.get $lhs
@@ -21,13 +30,191 @@ TEST(Parsing, AddFunc) {
       (export "add" (func $add))
     )
   )WAT";
-  ByteStream s(Wat2Wasm(wat));
+}  // namespace
+
+TEST(Parsing, AddFunc) {
+  ByteStream s(Wat2Wasm(kAddModule));
   auto parsed = ParseModule(&s).get();
   EXPECT_FALSE(s.HasRemaining());
   EXPECT_EQ(parsed.functions.size(), 1);
+  EXPECT_EQ(parsed.start_function, std::nullopt);
+  using ::testing::Pair;
+  using ::testing::UnorderedElementsAre;
+  EXPECT_THAT(parsed.exported_functions,
+              UnorderedElementsAre(Pair(Name("add"), FuncIdx(0))));
+}
+
+TEST(Parsing, FromCursor) {
+  auto wasm = Wat2Wasm(kAddModule);
+  ByteCursor c(wasm);
+  auto parsed = ParseModule(&c).get();
+  EXPECT_FALSE(c.HasRemaining());
+  EXPECT_EQ(parsed.functions.size(), 1);
   using ::testing::Pair;
   using ::testing::UnorderedElementsAre;
   EXPECT_THAT(parsed.exported_functions,
               UnorderedElementsAre(Pair(Name("add"), FuncIdx(0))));
 }
+
+TEST(Parsing, FromMappedFile) {
+  auto wasm = Wat2Wasm(kAddModule);
+  auto path = std::filesystem::path(testing::TempDir()) / "add.wasm";
+  {
+    std::ofstream out(path, std::ios::binary);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    out.write(reinterpret_cast<const char*>(wasm.data()), int64_t(wasm.size()));
+  }
+  auto file = MappedFile::Open(path.string());
+  ByteCursor c(file.data());
+  auto parsed = ParseModule(&c).get();
+  EXPECT_FALSE(c.HasRemaining());
+  EXPECT_EQ(parsed.functions.size(), 1);
+}
+
+TEST(Parsing, StartFunction) {
+  ByteStream s(Wat2Wasm(R"WAT(
+    (module
+      (func $a)
+      (func $b)
+      (start $b))
+  )WAT"));
+  auto parsed = ParseModule(&s).get();
+  EXPECT_EQ(parsed.start_function, FuncIdx(1));
+}
+
+TEST(Parsing, TruncatedCursor) {
+  auto wasm = Wat2Wasm(kAddModule);
+  ByteCursor c(bytes_view(wasm).subspan(0, wasm.size() - 1));
+  EXPECT_THROW(ParseModule(&c).get(), EndOfStreamException);
+}
+
+TEST(Parsing, ParallelCodeSection) {
+  std::string wat = "(module\n";
+  for (int i = 0; i < 64; ++i) {
+    wat += absl::StrFormat(
+        "(func $f%d (param i32) (result i32) (local i32) local.get 0 ", i);
+    for (int j = 0; j < i; ++j) {
+      wat += "i32.const 1 i32.add ";
+    }
+    wat += absl::StrFormat(
+        "local.set 1 local.get 1)\n(export \"f%d\" (func $f%d))\n", i, i);
+  }
+  wat += ")";
+  auto wasm = Wat2Wasm(wat);
+  ByteCursor serial_cursor(wasm);
+  auto serial = ParseModule(&serial_cursor).get();
+  ThreadPool pool(4);
+  ByteCursor parallel_cursor(wasm);
+  auto parallel =
+      ParseModule(&parallel_cursor, {.code_section_pool = &pool}).get();
+  EXPECT_FALSE(parallel_cursor.HasRemaining());
+  EXPECT_EQ(parallel.exported_functions, serial.exported_functions);
+  ASSERT_EQ(parallel.functions.size(), serial.functions.size());
+  for (size_t i = 0; i < serial.functions.size(); ++i) {
+    const auto& expected = serial.functions[i];
+    const auto& actual = parallel.functions[i];
+    EXPECT_EQ(actual.meta.signature, expected.meta.signature);
+    EXPECT_EQ(actual.meta.locals, expected.meta.locals);
+    EXPECT_EQ(actual.meta.max_stack_size_bytes,
+              expected.meta.max_stack_size_bytes);
+    EXPECT_EQ(actual.meta.max_stack_elements, expected.meta.max_stack_elements);
+    EXPECT_EQ(actual.body.size(), expected.body.size());
+  }
+}
+
+TEST(Parsing, ParallelCodeSectionInvalidBody) {
+  // NOTE: Wat2Wasm does not validate the module.
+  std::string_view wat = R"WAT(
+    (module
+      (func $ok (result i32) i32.const 1)
+      (func $bad (result i32) i32.add)
+      (func $also_ok (result i32) i32.const 1)
+    )
+  )WAT";
+  auto wasm = Wat2Wasm(wat);
+  ThreadPool pool(2);
+  ByteCursor c(wasm);
+  EXPECT_THROW(ParseModule(&c, {.code_section_pool = &pool}).get(),
+               ValidationException);
+}
+
+TEST(Parsing, ParallelCodeSectionOverrunningBody) {
+  auto wasm = Wat2Wasm(R"WAT(
+    (module
+      (func $one (result i32) i32.const 1)
+    )
+  )WAT");
+  // The code section ends with the body: its size, no locals, `i32.const 1`
+  // and `end`. Claim it's a byte shorter, so the `end` is past its end.
+  ASSERT_EQ(wasm[wasm.size() - 5], 4);
+  wasm[wasm.size() - 5] = 3;
+  auto overruns = testing::ThrowsMessage<ParseException>(
+      testing::StrEq("function body overruns its declared size of 3 bytes"));
+  ByteCursor serial(wasm);
+  EXPECT_THAT([&] { ParseModule(&serial).get(); }, overruns);
+  ThreadPool pool(2);
+  ByteCursor parallel(wasm);
+  EXPECT_THAT(
+      [&] { ParseModule(&parallel, {.code_section_pool = &pool}).get(); },
+      overruns);
+}
+
+TEST(Parsing, Incremental) {
+  std::string_view wat = R"WAT(
+    (module
+      (func $add (param $lhs i32) (param $rhs i32) (result i32)
+        local.get $lhs
+        local.get $rhs
+        i32.add)
+      (func $seven (result i32)
+        i32.const 3
+        i32.const 4
+        i32.add)
+      (func $noop)
+      (export "add" (func $add))
+      (export "seven" (func $seven))
+      (export "a_rather_long_export_name_for_the_noop" (func $noop))
+    )
+  )WAT";
+  auto wasm = Wat2Wasm(wat);
+  std::mt19937 rng(testing::UnitTest::GetInstance()->random_seed());
+  for (int trial = 0; trial < 32; ++trial) {
+    ChunkedStream stream;
+    auto parsing = ParseModule(&stream);
+    parsing.Start();
+    std::uniform_int_distribution<size_t> slice_size(1, 8);
+    size_t offset = 0;
+    while (offset < wasm.size()) {
+      EXPECT_FALSE(parsing.IsDone());
+      size_t n = std::min(slice_size(rng), wasm.size() - offset);
+      stream.Push(bytes_view(wasm).subspan(offset, n));
+      offset += n;
+    }
+    EXPECT_FALSE(parsing.IsDone());
+    stream.Close();
+    ASSERT_TRUE(parsing.IsDone());
+    auto parsed = parsing.get();
+    EXPECT_EQ(parsed.functions.size(), 3);
+    using ::testing::Pair;
+    using ::testing::UnorderedElementsAre;
+    EXPECT_THAT(
+        parsed.exported_functions,
+        UnorderedElementsAre(
+            Pair(Name("add"), FuncIdx(0)), Pair(Name("seven"), FuncIdx(1)),
+            Pair(Name("a_rather_long_export_name_for_the_noop"), FuncIdx(2))));
+    EXPECT_EQ(stream.BytesConsumed(), wasm.size());
+  }
+}
+
+TEST(Parsing, IncrementalTruncated) {
+  auto wasm = Wat2Wasm(kAddModule);
+  ChunkedStream stream;
+  auto parsing = ParseModule(&stream);
+  parsing.Start();
+  stream.Push(bytes_view(wasm).subspan(0, wasm.size() - 2));
+  EXPECT_FALSE(parsing.IsDone());
+  stream.Close();
+  ASSERT_TRUE(parsing.IsDone());
+  EXPECT_THROW(parsing.get(), EndOfStreamException);
+}
 }  // namespace wasmcc
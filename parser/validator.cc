@@ -1,6 +1,7 @@
 #include "parser/validator.h"
 
 #include <algorithm>
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -66,6 +67,8 @@ FunctionValidator::FunctionValidator(BlockType ft,
     : _locals(std::move(ft.parameter_types)),
       _returns(std::move(ft.result_types)) {
   std::copy(locals.begin(), locals.end(), std::back_inserter(_locals));
+  _local_uses.resize(_locals.size());
+  PushControl(Opcode::kBlock, std::nullopt);
 }
 
 size_t FunctionValidator::maximum_stack_elements() const {
@@ -74,6 +77,9 @@ size_t FunctionValidator::maximum_stack_elements() const {
 size_t FunctionValidator::maximum_stack_size_bytes() const {
   return _max_memory_usage;
 }
+const std::vector<uint32_t>& FunctionValidator::local_uses() const {
+  return _local_uses;
+}
 
 void FunctionValidator::operator()(const op::ConstI32&) { Push(ValType::kI32); }
 void FunctionValidator::operator()(const op::AddI32&) {
@@ -81,62 +87,190 @@ void FunctionValidator::operator()(const op::AddI32&) {
   Pop(ValType::kI32);
   Push(ValType::kI32);
 }
+void FunctionValidator::operator()(const op::EqzI32&) {
+  Pop(ValType::kI32);
+  Push(ValType::kI32);
+}
+void FunctionValidator::operator()(const op::CompareI32&) {
+  Pop(ValType::kI32);
+  Pop(ValType::kI32);
+  Push(ValType::kI32);
+}
 void FunctionValidator::operator()(const op::GetLocalI32& op) {
   AssertLocal(op.idx, ValType::kI32);
+  UseLocal(op.idx);
   Push(ValType::kI32);
 }
 void FunctionValidator::operator()(const op::SetLocalI32& op) {
   Pop(ValType::kI32);
   AssertLocal(op.idx, ValType::kI32);
+  UseLocal(op.idx);
 }
 void FunctionValidator::operator()(const op::Return&) {
-  for (ValType vt : _returns) {
-    Pop(vt);
-  }
+  Pop(_returns);
   AssertEmpty();
-  // Mark the current block as unreachable.
-  _unreachable = true;
+  MarkUnreachable();
+}
+void FunctionValidator::operator()(const op::Unreachable&) {
+  MarkUnreachable();
+}
+void FunctionValidator::operator()(const op::Block& op) {
+  PushControl(Opcode::kBlock, op.result);
+}
+void FunctionValidator::operator()(const op::Loop& op) {
+  PushControl(Opcode::kLoop, op.result);
+}
+void FunctionValidator::operator()(const op::If& op) {
+  Pop(ValType::kI32);
+  PushControl(Opcode::kIf, op.result);
 }
-void FunctionValidator::operator()(const op::Label&) {
-  // TODO: Handle
+void FunctionValidator::operator()(const op::Else&) {
+  if (_control.back().opcode != Opcode::kIf) [[unlikely]] {
+    throw ValidationException();
+  }
+  auto frame = PopControl();
+  PushControl(Opcode::kElse, frame.result);
 }
-void FunctionValidator::operator()(const op::Br&) {
-  // TODO: Handle
+void FunctionValidator::operator()(const op::End&) {
+  // The function body's frame is closed by `Finalize`.
+  if (_control.size() == 1) [[unlikely]] {
+    throw ValidationException();
+  }
+  auto frame = PopControl();
+  // Without an else the (implicit) else branch produces nothing.
+  if (frame.opcode == Opcode::kIf && frame.result) [[unlikely]] {
+    throw ValidationException();
+  }
+  if (frame.result) {
+    Push(*frame.result);
+  }
+}
+void FunctionValidator::operator()(const op::Br& op) {
+  Pop(LabelTypes(ControlAt(op.depth)));
+  MarkUnreachable();
 }
-void FunctionValidator::operator()(const op::BrIf&) {
-  // TODO: Handle
+void FunctionValidator::operator()(const op::BrIf& op) {
+  Pop(ValType::kI32);
+  auto types = LabelTypes(ControlAt(op.depth));
+  Pop(types);
+  Push(types);
+}
+void FunctionValidator::operator()(const op::BrTable& op) {
+  Pop(ValType::kI32);
+  auto default_types = LabelTypes(ControlAt(op.default_depth));
+  for (size_t i = 0; i < op.size(); ++i) {
+    auto types = LabelTypes(ControlAt(op.target(i)));
+    if (!std::ranges::equal(types, default_types)) [[unlikely]] {
+      throw ValidationException();
+    }
+  }
+  Pop(default_types);
+  MarkUnreachable();
 }
 
 void FunctionValidator::Finalize() {
-  for (ValType vt : _returns) {
-    Pop(vt);
+  if (_control.size() != 1) [[unlikely]] {
+    throw ValidationException();
   }
+  Pop(_returns);
   AssertEmpty();
 }
-bool FunctionValidator::empty() const { return _underlying.empty(); }
+bool FunctionValidator::empty() const {
+  return _underlying.size() == _control.back().height;
+}
+
+void FunctionValidator::PushControl(Opcode opcode,
+                                    std::optional<ValType> result) {
+  if (opcode == Opcode::kLoop) {
+    ++_loop_depth;
+  }
+  _control.push_back({
+      .opcode = opcode,
+      .result = result,
+      .height = _underlying.size(),
+      .unreachable = false,
+  });
+}
+FunctionValidator::ControlFrame FunctionValidator::PopControl() {
+  auto frame = _control.back();
+  if (frame.result) {
+    Pop(*frame.result);
+  }
+  AssertEmpty();
+  _control.pop_back();
+  if (frame.opcode == Opcode::kLoop) {
+    --_loop_depth;
+  }
+  return frame;
+}
+const FunctionValidator::ControlFrame& FunctionValidator::ControlAt(
+    uint32_t depth) const {
+  if (depth >= _control.size()) [[unlikely]] {
+    throw ValidationException();
+  }
+  return _control[_control.size() - 1 - depth];
+}
+std::span<const ValType> FunctionValidator::LabelTypes(
+    const ControlFrame& frame) const {
+  if (&frame == &_control.front()) {
+    return _returns;
+  }
+  if (frame.opcode == Opcode::kLoop || !frame.result) {
+    return {};
+  }
+  return {&*frame.result, 1};
+}
+void FunctionValidator::MarkUnreachable() {
+  auto& frame = _control.back();
+  while (_underlying.size() > frame.height) {
+    _current_memory_usage -= _underlying.back().size_bytes();
+    _underlying.pop_back();
+  }
+  frame.unreachable = true;
+}
 
 void FunctionValidator::AssertLocal(size_t idx, ValType vt) const {
   if (idx >= _locals.size() || _locals[idx] != vt) [[unlikely]] {
     throw ValidationException();
   }
 }
+void FunctionValidator::UseLocal(size_t idx) {
+  // Assume each loop runs a handful of times, and saturate so deep nesting
+  // can't overflow.
+  constexpr size_t kLoopWeightShift = 3;
+  constexpr size_t kMaxWeightShift = 24;
+  size_t shift = std::min(_loop_depth * kLoopWeightShift, kMaxWeightShift);
+  uint64_t weight = uint64_t{1} << shift;
+  _local_uses[idx] = uint32_t(std::min<uint64_t>(
+      _local_uses[idx] + weight, std::numeric_limits<uint32_t>::max()));
+}
 void FunctionValidator::AssertEmpty() const {
-  if (!_underlying.empty()) [[unlikely]] {
+  if (!empty()) [[unlikely]] {
     throw ValidationException();
   }
 }
+void FunctionValidator::Pop(std::span<const ValType> types) {
+  for (auto it = types.rbegin(); it != types.rend(); ++it) {
+    Pop(*it);
+  }
+}
+void FunctionValidator::Push(std::span<const ValType> types) {
+  for (ValType vt : types) {
+    Push(vt);
+  }
+}
 void FunctionValidator::Pop(ValType vt) { Pop(ValidationType(vt)); }
 void FunctionValidator::Pop(ValidationType expected) {
   ValidationType actual = ValidationType::any();
-  if (_underlying.empty()) {
-    if (!_unreachable) {
+  if (empty()) {
+    if (!_control.back().unreachable) {
       throw ValidationException();
     }
   } else {
     actual = _underlying.back();
     _underlying.pop_back();
+    _current_memory_usage -= actual.size_bytes();
   }
-  _current_memory_usage -= actual.size_bytes();
   bool ok = actual == expected;
   if (actual.is_any() || expected.is_any()) {
     ok = true;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <exception>
+#include <optional>
+#include <span>
 
 #include "core/ast.h"
 #include "core/instruction.h"
@@ -65,19 +67,54 @@ class FunctionValidator {
   size_t maximum_stack_elements() const;
   // The maximum bytes that is used by the stack for this function at runtime.
   size_t maximum_stack_size_bytes() const;
+  // How often each local (including parameters) is accessed, weighted by the
+  // loop nesting depth of each access.
+  const std::vector<uint32_t>& local_uses() const;
 
   void operator()(const op::ConstI32&);
   void operator()(const op::AddI32&);
+  void operator()(const op::EqzI32&);
+  void operator()(const op::CompareI32&);
   void operator()(const op::GetLocalI32&);
   void operator()(const op::SetLocalI32&);
   void operator()(const op::Return&);
-  void operator()(const op::Label&);
+  void operator()(const op::Unreachable&);
+  void operator()(const op::Block&);
+  void operator()(const op::Loop&);
+  void operator()(const op::If&);
+  void operator()(const op::Else&);
+  void operator()(const op::End&);
   void operator()(const op::Br&);
   void operator()(const op::BrIf&);
+  void operator()(const op::BrTable&);
 
   void Finalize();
 
  private:
+  // A structured control instruction that is currently open.
+  //
+  // Spec ref:
+  // https://webassembly.github.io/spec/core/appendix/algorithm.html
+  struct ControlFrame {
+    Opcode opcode;
+    std::optional<ValType> result;
+    // The height of the operand stack when this frame was entered.
+    size_t height;
+    // If the rest of the instructions in this frame are unreachable
+    bool unreachable;
+  };
+
+  // Open a new control frame.
+  void PushControl(Opcode, std::optional<ValType> result);
+  // Close the current control frame, checking its results are on the stack.
+  ControlFrame PopControl();
+  // The frame that is `depth` levels out from the current frame.
+  const ControlFrame& ControlAt(uint32_t depth) const;
+  // The types carried by a branch to the label of `frame`.
+  std::span<const ValType> LabelTypes(const ControlFrame& frame) const;
+  // Mark the rest of the current frame as unreachable.
+  void MarkUnreachable();
+
   // Assert the correct type is popped
   void Pop(ValidationType);
   void Pop(ValType);
@@ -86,15 +123,23 @@ class FunctionValidator {
   void Push(ValType);
   // Assert a local is a specific valtype
   void AssertLocal(size_t, ValType) const;
-  // Assert the stack is empty
+  // Record an access of a (valid) local.
+  void UseLocal(size_t);
+  void Pop(std::span<const ValType>);
+  void Push(std::span<const ValType>);
+  // Assert the stack is empty for the current frame
   void AssertEmpty() const;
-  // Check if the stack is empty
+  // Check if the stack is empty for the current frame
   bool empty() const;
 
   std::vector<ValType> _locals;
   std::vector<ValType> _returns;
+  std::vector<uint32_t> _local_uses;
+  // The number of loops that are currently open.
+  size_t _loop_depth{0};
 
-  bool _unreachable = false;
+  // The outermost frame is the function body.
+  std::vector<ControlFrame> _control;
 
   std::vector<ValidationType> _underlying;
   size_t _current_memory_usage{0};
@@ -2,9 +2,10 @@
 
 #include <gtest/gtest.h>
 
-#include <initializer_list>
+#include <cstring>
 #include <optional>
 #include <type_traits>
+#include <vector>
 
 #include "base/type_traits.h"
 #include "core/ast.h"
@@ -46,108 +47,156 @@ std::vector<ValType> AsWasmTypes() {
 }
 
 template <typename R, typename... A>
-void check_instructions(const std::initializer_list<Instruction>& ops) {
+void check_instructions(const InstructionBuffer& ops) {
   BlockType ft{.parameter_types = AsWasmTypes<A...>()};
   if constexpr (!std::is_void_v<R>) {
     auto vt = AsWasmType<R>();
     ft.result_types.push_back(vt);
   }
   auto sv = FunctionValidator(ft, {});
-  for (const auto& op : ops) {
-    std::visit(sv, op);
-  }
+  Dispatch(ops, &sv);
   sv.Finalize();
 }
 }  // namespace
 
-template <typename R, typename... A>
-void AssertValid(const std::initializer_list<Instruction>& ops) {
-  auto fn = [ops] { check_instructions<R, A...>(ops); };
+template <typename R, typename... A, typename... Op>
+void AssertValid(const Op&... op) {
+  auto ops = InstructionBuffer::Of(op...);
+  auto fn = [&ops] { check_instructions<R, A...>(ops); };
   EXPECT_NO_THROW(fn());
 }
-template <typename R, typename... A>
-void AssertInvalid(const std::initializer_list<Instruction>& ops) {
-  auto fn = [ops] { check_instructions<R, A...>(ops); };
+template <typename R, typename... A, typename... Op>
+void AssertInvalid(const Op&... op) {
+  auto ops = InstructionBuffer::Of(op...);
+  auto fn = [&ops] { check_instructions<R, A...>(ops); };
   EXPECT_THROW(fn(), ValidationException);
 }
 
 using namespace wasmcc::op;
 
 TEST(Validation, NoopFunc) {
-  AssertValid<void>({
-      Return(),
-  });
+  AssertValid<void>(Return());
 }
 TEST(Validation, GoodReturnSequence) {
-  AssertValid<int>({
-      ConstI32(0),
-      Return(),
-  });
+  AssertValid<int>(ConstI32(0), Return());
 }
 TEST(Validation, ImplicitReturn) {
-  AssertValid<int>({
-      ConstI32(0),
-  });
+  AssertValid<int>(ConstI32(0));
 }
 TEST(Validation, AddFunc) {
-  AssertValid<int, int, int>({
-      GetLocalI32(0),
-      GetLocalI32(1),
-      AddI32(),
-      Return(),
-  });
+  AssertValid<int, int, int>(GetLocalI32(0), GetLocalI32(1), AddI32(),
+                             Return());
 }
 TEST(Validation, GoodSequence) {
-  AssertValid<int>({
-      ConstI32(0),
-      ConstI32(0),
-      AddI32(),
-      Return(),
-  });
+  AssertValid<int>(ConstI32(0), ConstI32(0), AddI32(), Return());
 }
 TEST(Validation, ExtraStackAtEnd) {
-  AssertInvalid<int>({
-      ConstI32(0),
-      ConstI32(0),
-  });
+  AssertInvalid<int>(ConstI32(0), ConstI32(0));
 }
 TEST(Validation, MissingIntAddSequence) {
-  AssertInvalid<int>({
-      ConstI32(0),
-      AddI32(),
-      Return(),
-  });
+  AssertInvalid<int>(ConstI32(0), AddI32(), Return());
 }
 TEST(Validation, ExtraIntAddSequence) {
-  AssertInvalid<int>({
-      ConstI32(0),
-      ConstI32(0),
-      ConstI32(0),
-      AddI32(),
-      Return(),
-  });
+  AssertInvalid<int>(ConstI32(0), ConstI32(0), ConstI32(0), AddI32(), Return());
 }
 TEST(Validation, GetInvalidLocal) {
-  AssertInvalid<int>({
-      GetLocalI32(0),
-      ConstI32(0),
-      AddI32(),
-      Return(),
-  });
+  AssertInvalid<int>(GetLocalI32(0), ConstI32(0), AddI32(), Return());
 }
 TEST(Validation, SetInvalidLocal) {
-  AssertInvalid<void, int>({
-      ConstI32(0),
-      ConstI32(0),
-      AddI32(),
-      SetLocalI32(1),
-      Return(),
-  });
+  AssertInvalid<void, int>(ConstI32(0), ConstI32(0), AddI32(), SetLocalI32(1),
+                           Return());
 }
 TEST(Validation, SetInvalidLocalType) {
-  AssertInvalid<void, long>({
-      ConstI32(0),
-      SetLocalI32(0),
-  });
+  AssertInvalid<void, long>(ConstI32(0), SetLocalI32(0));
+}
+TEST(Validation, Comparisons) {
+  AssertValid<int, int>(GetLocalI32(0), EqzI32());
+  AssertValid<int, int, int>(GetLocalI32(0), GetLocalI32(1),
+                             CompareI32{.cond = Condition::kLtS});
+  AssertValid<void, int>(Block{}, GetLocalI32(0), EqzI32(), BrIf{.depth = 0},
+                         End());
+  AssertInvalid<int>(EqzI32());
+  AssertInvalid<int, int>(GetLocalI32(0), CompareI32{.cond = Condition::kEq});
+}
+TEST(Validation, BlockResult) {
+  AssertValid<int>(Block{.result = ValType::kI32}, ConstI32(1), End());
+  AssertInvalid<int>(Block{.result = ValType::kI32}, End());
+  AssertInvalid<int>(Block{}, ConstI32(1), End());
+  AssertInvalid<void>(Block{.result = ValType::kI32}, ConstI32(1), End());
+}
+TEST(Validation, BlockCannotPopOuterValues) {
+  AssertInvalid<int>(ConstI32(1), Block{.result = ValType::kI32}, End());
+}
+TEST(Validation, UnbalancedBlocks) {
+  AssertInvalid<void>(Block{});
+  AssertInvalid<void>(End());
+  AssertInvalid<void>(Else());
+  AssertInvalid<void>(Block{}, Else(), End());
+}
+TEST(Validation, IfElse) {
+  AssertValid<int, int>(GetLocalI32(0), If{.result = ValType::kI32},
+                        ConstI32(1), Else(), ConstI32(2), End());
+  AssertValid<void, int>(GetLocalI32(0), If{}, Else(), End());
+  AssertValid<void, int>(GetLocalI32(0), If{}, End());
+  // Without an else, there is no way to produce the result.
+  AssertInvalid<int, int>(GetLocalI32(0), If{.result = ValType::kI32},
+                          ConstI32(1), End());
+  // The condition is required
+  AssertInvalid<void>(If{}, End());
+  AssertInvalid<int, int>(GetLocalI32(0), If{.result = ValType::kI32},
+                          ConstI32(1), Else(), End());
+}
+TEST(Validation, Br) {
+  AssertValid<int>(Block{.result = ValType::kI32}, ConstI32(1), Br{.depth = 0},
+                   End());
+  // Extra values are discarded by the branch.
+  AssertValid<int>(Block{.result = ValType::kI32}, ConstI32(1), ConstI32(2),
+                   Br{.depth = 0}, End());
+  // A branch to the function body is a return.
+  AssertValid<int>(Block{}, ConstI32(1), Br{.depth = 1}, End(), ConstI32(2));
+  AssertInvalid<int>(Block{.result = ValType::kI32}, Br{.depth = 0}, End());
+  AssertInvalid<void>(Block{}, Br{.depth = 2}, End());
+}
+TEST(Validation, BrIf) {
+  AssertValid<int, int>(Block{.result = ValType::kI32}, ConstI32(1),
+                        GetLocalI32(0), BrIf{.depth = 0}, End());
+  // The branch to a loop carries no values.
+  AssertValid<void, int>(Loop{}, GetLocalI32(0), BrIf{.depth = 0}, End());
+  AssertInvalid<void, int>(Loop{}, BrIf{.depth = 0}, End());
+  AssertInvalid<int, int>(Block{.result = ValType::kI32}, GetLocalI32(0),
+                          BrIf{.depth = 0}, End());
+}
+TEST(Validation, BrTable) {
+  std::vector<uint8_t> packed(sizeof(uint32_t) * 2);
+  uint32_t targets[] = {0, 1};
+  std::memcpy(packed.data(), targets, sizeof(targets));
+  AssertValid<void, int>(Block{}, Block{}, GetLocalI32(0),
+                         BrTable{.packed_targets = packed, .default_depth = 1},
+                         End(), End());
+  AssertInvalid<void, int>(Block{}, Block{}, GetLocalI32(0),
+                           BrTable{.packed_targets = packed, .default_depth = 3},
+                           End(), End());
+  // All the targets must carry the same types
+  AssertInvalid<void, int>(Block{.result = ValType::kI32}, Block{},
+                           ConstI32(1), GetLocalI32(0),
+                           BrTable{.packed_targets = packed, .default_depth = 1},
+                           End(), End());
+}
+TEST(Validation, UnreachableIsPolymorphic) {
+  AssertValid<int>(Unreachable(), AddI32());
+  AssertValid<int>(Block{.result = ValType::kI32}, Unreachable(), End());
+  AssertValid<int>(ConstI32(1), Return(), AddI32());
+  AssertInvalid<int>(Unreachable(), Block{.result = ValType::kI32}, End());
+}
+TEST(Validation, LocalUses) {
+  FunctionValidator validator({.parameter_types = {ValType::kI32}},
+                              {ValType::kI32, ValType::kI32});
+  auto ops = InstructionBuffer::Of(
+      GetLocalI32(0), SetLocalI32(1), Loop{}, GetLocalI32(2), SetLocalI32(2),
+      Loop{}, GetLocalI32(2), SetLocalI32(2), End(), End());
+  Dispatch(ops, &validator);
+  validator.Finalize();
+  EXPECT_EQ(validator.local_uses(),
+            (std::vector<uint32_t>{1, 1, (2 * 8) + (2 * 64)}));
 }
 }  // namespace wasmcc
@@ -1,11 +1,34 @@
 #include "runtime/function_handle.h"
 
+#include <utility>
+
 #include "base/assert.h"
 #include "runtime/thread/thread.h"
 
 namespace wasmcc::runtime {
 
-DynamicComputation::DynamicComputation(VMThread* t) : _thread(t) {}
+DynamicComputation::DynamicComputation(VMThread* t, ThreadOwner* owner)
+    : _thread(t), _owner(owner) {}
+DynamicComputation::DynamicComputation(DynamicComputation&& other) noexcept
+    : _thread(std::exchange(other._thread, nullptr)),
+      _owner(std::exchange(other._owner, nullptr)) {}
+DynamicComputation& DynamicComputation::operator=(
+    DynamicComputation&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    _thread = std::exchange(other._thread, nullptr);
+    _owner = std::exchange(other._owner, nullptr);
+  }
+  return *this;
+}
+DynamicComputation::~DynamicComputation() { Reset(); }
+void DynamicComputation::Reset() {
+  if (_thread == nullptr) {
+    return;
+  }
+  Cancel();
+  _owner->ReturnThread(std::exchange(_thread, nullptr));
+}
 void DynamicComputation::Execute() {
   if (_thread->state() == VMThread::State::kSuspended) {
     _thread->Resume();
@@ -1,11 +1,15 @@
 #pragma once
 #include <memory>
+#include <span>
+#include <stdexcept>
 #include <tuple>
 #include <utility>
 
 #include "absl/functional/any_invocable.h"
 #include "base/type_traits.h"
 #include "compiler/module.h"
+#include "core/ast.h"
+#include "core/value.h"
 
 namespace wasmcc {
 
@@ -19,47 +23,144 @@ class Computation;
  * small setup cost to actually creating a handle, but most work is deferred to
  * at that time.
  *
- * You may only invoke a single FunctionHandle at once, and must either call the
- * resulting `Computation's` `Execute` method until `IsDone()` is true or call
- * `Stop()`.
+ * Each invocation runs on its own stack, so many computations can be in flight
+ * at once (see `ExecutionOptions::max_computations`), and each one's
+ * `Computation` must either have its `Execute` method called until `IsDone()`
+ * is true or have `Cancel()` called.
+ *
+ * Functions that don't need to be suspended can instead be run to completion
+ * with `Call`, which is much cheaper for short functions, or with `CallBatch`
+ * over many inputs at once.
  */
 template <typename Signature>
 class FunctionHandle {
+ public:
   using ResultType = FunctionTraits<Signature>::result_type;
   using ArgTypes = FunctionTraits<Signature>::arg_types;
+
+ private:
   using UnderlyingType =
       absl::AnyInvocable<std::unique_ptr<Computation<ResultType>>(ArgTypes&&)>;
+  using CallType = absl::AnyInvocable<ResultType(ArgTypes&&)>;
+  using CallBatchType = absl::AnyInvocable<void(std::span<const ArgTypes>,
+                                                std::span<ResultType>)>;
 
  public:
-  explicit FunctionHandle(UnderlyingType u) : _underlying(std::move(u)) {}
+  FunctionHandle(UnderlyingType u, CallType call, CallBatchType call_batch)
+      : _underlying(std::move(u)),
+        _call(std::move(call)),
+        _call_batch(std::move(call_batch)) {}
 
   template <typename... Args>
   std::unique_ptr<Computation<ResultType>> Invoke(Args&&... args) {
     return _underlying(std::make_tuple(std::forward<Args>(args)...));
   }
 
+  /**
+   * Run the function to completion on the VM's stack and return its result.
+   *
+   * A stack is entered once and nothing is allocated, rather than creating a
+   * `Computation` that can be suspended.
+   */
+  template <typename... Args>
+  ResultType Call(Args&&... args) {
+    return _call(ArgTypes(std::forward<Args>(args)...));
+  }
+
+  /**
+   * Call the function once for each of `args`, writing each result into the
+   * same index of `results`, which must be the same size.
+   *
+   * This is like `Call`, but the VM's stack is only entered once for the whole
+   * batch, so it's amortized over many calls. A batch counts as a single call
+   * towards `ExecutionOptions::jit_threshold`.
+   */
+  void CallBatch(std::span<const ArgTypes> args,
+                 std::span<ResultType> results) {
+    if (args.size() != results.size()) {
+      throw std::runtime_error("a batch needs a result for every call.");
+    }
+    _call_batch(args, results);
+  }
+
  private:
   UnderlyingType _underlying;
+  CallType _call;
+  CallBatchType _call_batch;
 };
 
 namespace runtime {
 class VMThread;
-/** An untyped version of `Computation`. */
+
+/**
+ * A function within the VM, which is either run as compiled code, or by the
+ * interpreter until it has been compiled.
+ */
+class Callee {
+ public:
+  Callee() = default;
+  Callee(const Callee&) = delete;
+  Callee& operator=(const Callee&) = delete;
+  Callee(Callee&&) = delete;
+  Callee& operator=(Callee&&) = delete;
+  virtual ~Callee() = default;
+
+  virtual const BlockType& signature() const = 0;
+
+  /**
+   * Count a call to the function, returning the code to call, or null if the
+   * call is to be interpreted.
+   *
+   * This is where functions get compiled, so it's called on the invoking
+   * thread, before switching to the VM's thread.
+   */
+  virtual CompiledFunction* Enter() = 0;
+
+  /**
+   * Run the function with the interpreter, writing a value for each of its
+   * results. Only valid after `Enter` returned null.
+   */
+  virtual void Interpret(std::span<const Value> args,
+                         std::span<Value> results) = 0;
+};
+
+/** Lends out the threads that computations run on. */
+class ThreadOwner {
+ public:
+  ThreadOwner() = default;
+  ThreadOwner(const ThreadOwner&) = delete;
+  ThreadOwner& operator=(const ThreadOwner&) = delete;
+  ThreadOwner(ThreadOwner&&) = delete;
+  ThreadOwner& operator=(ThreadOwner&&) = delete;
+  virtual ~ThreadOwner() = default;
+
+  /** Take back a stopped thread that a computation is done with. */
+  virtual void ReturnThread(VMThread*) = 0;
+};
+
+/**
+ * An untyped version of `Computation`, which hands its thread back to its
+ * owner when it's destroyed.
+ */
 class DynamicComputation {
  public:
-  explicit DynamicComputation(VMThread*);
+  DynamicComputation() = default;
+  DynamicComputation(VMThread*, ThreadOwner*);
   DynamicComputation(const DynamicComputation&) = delete;
   DynamicComputation& operator=(const DynamicComputation&) = delete;
-  DynamicComputation(DynamicComputation&&) noexcept = default;
-  DynamicComputation& operator=(DynamicComputation&&) noexcept = default;
-  ~DynamicComputation() = default;
+  DynamicComputation(DynamicComputation&&) noexcept;
+  DynamicComputation& operator=(DynamicComputation&&) noexcept;
+  ~DynamicComputation();
 
   void Execute();
   void Cancel();
   bool IsDone() const noexcept;
 
  private:
-  VMThread* _thread;
+  void Reset();
+
+  VMThread* _thread = nullptr;
+  ThreadOwner* _owner = nullptr;
 };
 }  // namespace runtime
 
@@ -99,7 +200,7 @@ class Computation {
  private:
   friend class VM;
 
-  Computation() : _dyn(nullptr) {}
+  Computation() = default;
 
   runtime::DynamicComputation _dyn;
   // NOTE: This should be a variant when we have traps.
@@ -0,0 +1,314 @@
+#include "runtime/interpreter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "absl/container/fixed_array.h"
+#include "core/instruction.h"
+
+namespace wasmcc::runtime {
+
+/**
+ * Builds the side table by tracking the height of the operand stack and the
+ * enclosing control instructions, like a validator would.
+ *
+ * Forward branches can't be resolved until their target's `End` is reached,
+ * so each frame keeps the entries that are waiting for it. Branches inside
+ * unreachable code still get entries, so that the entries stay in the same
+ * order as the branches, but they are never used.
+ */
+class Interpreter::SideTableBuilder {
+ public:
+  SideTableBuilder(const Function& func, Interpreter* interpreter)
+      : _func(func), _interpreter(interpreter) {
+    auto arity = uint32_t(func.meta.signature.result_types.size());
+    _control.push_back({.kind = Kind::kFunction, .arity = arity});
+  }
+
+  void Build() {
+    const uint8_t* begin = _func.body.begin();
+    for (const uint8_t* pc = begin; pc != _func.body.end();) {
+      _pc = uint32_t(pc - begin);
+      pc = DispatchOne(pc, this);
+    }
+    // Branches to the function go to the end of the body, where the results
+    // are taken from the top of the stack.
+    _pc = uint32_t(_func.body.size_bytes());
+    Resolve(_control.back());
+  }
+
+  void operator()(const op::ConstI32&) { Push(); }
+  void operator()(const op::AddI32&) {
+    Pop(2);
+    Push();
+  }
+  void operator()(const op::EqzI32&) {
+    Pop(1);
+    Push();
+  }
+  void operator()(const op::CompareI32&) {
+    Pop(2);
+    Push();
+  }
+  void operator()(const op::GetLocalI32&) { Push(); }
+  void operator()(const op::SetLocalI32&) { Pop(1); }
+  void operator()(const op::Return&) { MarkUnreachable(); }
+  void operator()(const op::Unreachable&) { MarkUnreachable(); }
+  void operator()(const op::Block& op) {
+    _control.push_back({
+        .kind = Kind::kBlock,
+        .height = _height,
+        .arity = op.result ? 1U : 0U,
+    });
+  }
+  void operator()(const op::Loop& op) {
+    // Branches to a loop go back to the `Loop` instruction, which does
+    // nothing when it runs.
+    _control.push_back({
+        .kind = Kind::kLoop,
+        .height = _height,
+        .arity = op.result ? 1U : 0U,
+        .loop_pc = _pc,
+        .loop_stp = uint32_t(_interpreter->_branches.size()),
+    });
+  }
+  void operator()(const op::If& op) {
+    Pop(1);
+    _control.push_back({
+        .kind = Kind::kIf,
+        .height = _height,
+        .arity = op.result ? 1U : 0U,
+        .else_entry = Reserve(),
+    });
+  }
+  void operator()(const op::Else&) {
+    // The end of the then branch jumps over the else branch.
+    auto& frame = _control.back();
+    BranchTo(&frame, Reserve());
+    // The start of the else branch, just after this single byte instruction.
+    _interpreter->_branches[frame.else_entry] = {
+        .target_pc = _pc + 1,
+        .target_stp = uint32_t(_interpreter->_branches.size()),
+    };
+    frame.else_entry = kNoEntry;
+    _height = frame.height;
+    _unreachable = false;
+  }
+  void operator()(const op::End&) {
+    // Forward branches go to the `End`, which does nothing when it runs.
+    Frame frame = std::move(_control.back());
+    _control.pop_back();
+    Resolve(frame);
+    _height = frame.height + frame.arity;
+    _unreachable = false;
+  }
+  void operator()(const op::Br& op) {
+    BranchTo(op.depth, Reserve());
+    MarkUnreachable();
+  }
+  void operator()(const op::BrIf& op) {
+    Pop(1);
+    BranchTo(op.depth, Reserve());
+  }
+  void operator()(const op::BrTable& op) {
+    Pop(1);
+    for (size_t i = 0; i < op.size(); ++i) {
+      BranchTo(op.target(i), Reserve());
+    }
+    BranchTo(op.default_depth, Reserve());
+    MarkUnreachable();
+  }
+
+ private:
+  static constexpr uint32_t kNoEntry = std::numeric_limits<uint32_t>::max();
+
+  enum class Kind : uint8_t { kFunction, kBlock, kLoop, kIf };
+  struct Frame {
+    Kind kind;
+    // The height of the stack when the frame was entered.
+    uint32_t height = 0;
+    // The number of results at the end of the frame.
+    uint32_t arity = 0;
+    uint32_t loop_pc = 0;
+    uint32_t loop_stp = 0;
+    // The entry for the condition of an `If` being false, until its `Else` or
+    // `End` is reached.
+    uint32_t else_entry = kNoEntry;
+    // Entries for branches to the end of the frame.
+    std::vector<uint32_t> pending = {};
+  };
+
+  uint32_t Reserve() {
+    _interpreter->_branches.emplace_back();
+    return uint32_t(_interpreter->_branches.size() - 1);
+  }
+
+  void BranchTo(uint32_t depth, uint32_t entry) {
+    BranchTo(&_control[_control.size() - 1 - depth], entry);
+  }
+  void BranchTo(Frame* frame, uint32_t entry) {
+    // Branches to a loop start it over, so they carry no values.
+    uint32_t keep = frame->kind == Kind::kLoop ? 0 : frame->arity;
+    auto& branch = _interpreter->_branches[entry];
+    branch.keep = keep;
+    // In unreachable code the stack can be shallower than it looks, but the
+    // branch is never taken.
+    branch.drop = _height - std::min(_height, frame->height + keep);
+    if (frame->kind == Kind::kLoop) {
+      branch.target_pc = frame->loop_pc;
+      branch.target_stp = frame->loop_stp;
+    } else {
+      frame->pending.push_back(entry);
+    }
+  }
+
+  // Point the frame's forward branches at the current instruction.
+  void Resolve(const Frame& frame) {
+    auto stp = uint32_t(_interpreter->_branches.size());
+    for (uint32_t entry : frame.pending) {
+      _interpreter->_branches[entry].target_pc = _pc;
+      _interpreter->_branches[entry].target_stp = stp;
+    }
+    if (frame.else_entry != kNoEntry) {
+      _interpreter->_branches[frame.else_entry] = {
+          .target_pc = _pc,
+          .target_stp = stp,
+      };
+    }
+  }
+
+  void Push() {
+    ++_height;
+    _interpreter->_max_stack_height =
+        std::max(_interpreter->_max_stack_height, _height);
+  }
+  void Pop(uint32_t n) {
+    if (_unreachable) {
+      _height -= std::min(n, _height - _control.back().height);
+    } else {
+      _height -= n;
+    }
+  }
+  void MarkUnreachable() {
+    _height = _control.back().height;
+    _unreachable = true;
+  }
+
+  const Function& _func;
+  Interpreter* _interpreter;
+  std::vector<Frame> _control;
+  uint32_t _height = 0;
+  bool _unreachable = false;
+  // The offset of the instruction being visited.
+  uint32_t _pc = 0;
+};
+
+Interpreter::Interpreter(const Function& func) : _func(&func) {
+  SideTableBuilder(func, this).Build();
+}
+
+void Interpreter::Run(std::span<const Value> args,
+                      std::span<Value> results) const {
+  using internal::ReadImmediate;
+  constexpr size_t kImm = sizeof(uint32_t);
+  const auto& meta = _func->meta;
+  // Locals are 64 bits so parameters of any type are kept as they are, even
+  // though only 32 bit values can be operated on.
+  absl::FixedArray<uint64_t, 16> locals(args.size() + meta.locals.size(), 0);
+  for (size_t i = 0; i < args.size(); ++i) {
+    locals[i] = args[i].AsU64();
+  }
+  absl::FixedArray<uint32_t, 32> stack(_max_stack_height);
+  // One past the top of the stack.
+  uint32_t* sp = stack.data();
+  const uint8_t* const begin = _func->body.begin();
+  const uint8_t* const end = _func->body.end();
+  const uint8_t* pc = begin;
+  // The side table entry for the next branch.
+  size_t stp = 0;
+  auto take = [&](size_t entry) {
+    const Branch& branch = _branches[entry];
+    std::memmove(sp - branch.keep - branch.drop, sp - branch.keep,
+                 branch.keep * sizeof(uint32_t));
+    sp -= branch.drop;
+    pc = begin + branch.target_pc;
+    stp = branch.target_stp;
+  };
+  while (pc != end) {
+    switch (Opcode(*pc)) {
+      case Opcode::kConstI32:
+        *sp++ = ReadImmediate(pc + 1);
+        pc += 1 + kImm;
+        break;
+      case Opcode::kAddI32:
+        --sp;
+        sp[-1] += sp[0];
+        pc += 1;
+        break;
+      case Opcode::kEqzI32:
+        sp[-1] = sp[-1] == 0 ? 1 : 0;
+        pc += 1;
+        break;
+      case Opcode::kCompareI32:
+        --sp;
+        sp[-1] = Evaluate(Condition(pc[1]), sp[-1], sp[0]) ? 1 : 0;
+        pc += 2;
+        break;
+      case Opcode::kGetLocalI32:
+        *sp++ = uint32_t(locals[ReadImmediate(pc + 1)]);
+        pc += 1 + kImm;
+        break;
+      case Opcode::kSetLocalI32:
+        locals[ReadImmediate(pc + 1)] = *--sp;
+        pc += 1 + kImm;
+        break;
+      case Opcode::kReturn:
+        pc = end;
+        break;
+      case Opcode::kUnreachable:
+        __builtin_trap();
+      case Opcode::kBlock:
+      case Opcode::kLoop:
+        pc += 2;
+        break;
+      case Opcode::kIf:
+        if (*--sp != 0) {
+          pc += 2;
+          ++stp;
+        } else {
+          take(stp);
+        }
+        break;
+      case Opcode::kElse:
+        take(stp);
+        break;
+      case Opcode::kEnd:
+        pc += 1;
+        break;
+      case Opcode::kBr:
+        take(stp);
+        break;
+      case Opcode::kBrIf:
+        if (*--sp != 0) {
+          take(stp);
+        } else {
+          pc += 1 + kImm;
+          ++stp;
+        }
+        break;
+      case Opcode::kBrTable: {
+        uint32_t size = ReadImmediate(pc + 1);
+        uint32_t index = *--sp;
+        take(stp + std::min(index, size));
+        break;
+      }
+    }
+  }
+  // The results are on top of the stack.
+  for (size_t i = 0; i < results.size(); ++i) {
+    results[i] = Value::U32(*(sp - results.size() + i));
+  }
+}
+
+}  // namespace wasmcc::runtime
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "core/ast.h"
+#include "core/value.h"
+
+namespace wasmcc::runtime {
+
+/**
+ * Runs a function by interpreting its IR in place, for functions that are not
+ * called often enough to be worth compiling, such as start functions and
+ * initializers.
+ *
+ * The instruction buffer is executed as it is. The only preparation is a
+ * single pass over it that builds a side table, with an entry for each place
+ * a branch can go (like Titzer's in-place WebAssembly interpreter): where
+ * execution continues and how the operand stack changes on the way, so a
+ * branch never has to scan for its matching `End`. Entries are in the same
+ * order as the branches that use them, so the interpreter finds them by
+ * keeping an index into the side table alongside the program counter.
+ *
+ * An interpreter doesn't change once it's made, so it can run the function on
+ * any number of threads at once. The function must outlive it.
+ */
+class Interpreter {
+ public:
+  explicit Interpreter(const Function&);
+  Interpreter(const Interpreter&) = delete;
+  Interpreter& operator=(const Interpreter&) = delete;
+  Interpreter(Interpreter&&) noexcept = default;
+  Interpreter& operator=(Interpreter&&) noexcept = default;
+  ~Interpreter() = default;
+
+  /**
+   * Run the function with a value for each of its parameters, writing a value
+   * for each of its results.
+   *
+   * A trap aborts the process, just like it does in compiled code.
+   */
+  void Run(std::span<const Value> args, std::span<Value> results) const;
+
+  /** The memory used by the side table. */
+  size_t side_table_bytes() const {
+    return _branches.size() * sizeof(Branch);
+  }
+
+ private:
+  class SideTableBuilder;
+
+  // Where a branch goes when it's taken.
+  struct Branch {
+    // The offset into the instruction buffer to continue at.
+    uint32_t target_pc;
+    // The side table entry for the first branch after the target.
+    uint32_t target_stp;
+    // The number of values on top of the stack that are carried to the
+    // target, and how many values below them are dropped.
+    uint32_t keep;
+    uint32_t drop;
+  };
+
+  const Function* _func;
+  std::vector<Branch> _branches;
+  // The most values that are ever on the operand stack.
+  uint32_t _max_stack_height = 0;
+};
+
+}  // namespace wasmcc::runtime
@@ -0,0 +1,119 @@
+#include "runtime/interpreter.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "core/ast.h"
+#include "core/instruction.h"
+#include "core/value.h"
+#include "testing/functions.h"
+
+namespace wasmcc::runtime {
+namespace {
+
+using namespace wasmcc::op;
+
+int32_t Interpret(const Function& func, int32_t arg0, int32_t arg1) {
+  Interpreter interpreter(func);
+  std::vector<Value> args = {Value::I32(arg0), Value::I32(arg1)};
+  std::vector<Value> results(1);
+  interpreter.Run(args, results);
+  return results[0].AsI32();
+}
+
+}  // namespace
+
+TEST(Interpreter, StraightLine) {
+  auto func = Fn(InstructionBuffer::Of(
+      GetLocalI32(0), GetLocalI32(1), AddI32(), ConstI32(Value::I32(3)),
+      AddI32()));
+  EXPECT_EQ(Interpret(func, 1, 2), 6);
+  EXPECT_EQ(Interpret(func, -1, -2), 0);
+}
+
+TEST(Interpreter, Compares) {
+  auto func = Fn(InstructionBuffer::Of(
+      GetLocalI32(0), GetLocalI32(1), CompareI32{.cond = Condition::kLtU},
+      EqzI32()));
+  EXPECT_EQ(Interpret(func, 1, 2), 0);
+  EXPECT_EQ(Interpret(func, -1, 2), 1);
+}
+
+TEST(Interpreter, Loops) {
+  // Sums the numbers from the first parameter up to the second.
+  auto func = Fn(InstructionBuffer::Of(
+      Block{}, Loop{}, GetLocalI32(0), GetLocalI32(1),
+      CompareI32{.cond = Condition::kGeS}, BrIf{.depth = 1}, GetLocalI32(2),
+      GetLocalI32(0), AddI32(), SetLocalI32(2), GetLocalI32(0),
+      ConstI32(Value::I32(1)), AddI32(), SetLocalI32(0), Br{.depth = 0},
+      End(), End(), GetLocalI32(2)));
+  EXPECT_EQ(Interpret(func, 3, 7), 3 + 4 + 5 + 6);
+  EXPECT_EQ(Interpret(func, 7, 3), 0);
+}
+
+TEST(Interpreter, IfElse) {
+  auto func = Fn(InstructionBuffer::Of(
+      GetLocalI32(0), If{.result = ValType::kI32}, ConstI32(Value::I32(10)),
+      Else(), ConstI32(Value::I32(20)), End(), GetLocalI32(1), If{},
+      GetLocalI32(0), SetLocalI32(2), End(), GetLocalI32(2), AddI32()));
+  EXPECT_EQ(Interpret(func, 0, 0), 20);
+  EXPECT_EQ(Interpret(func, 1, 0), 10);
+  EXPECT_EQ(Interpret(func, 1, 1), 11);
+}
+
+TEST(Interpreter, BranchesCarryResultsAndDropTheRest) {
+  // Leaves an extra value on the stack under the block's result when it
+  // branches out.
+  auto func = Fn(InstructionBuffer::Of(
+      Block{.result = ValType::kI32}, GetLocalI32(1), GetLocalI32(1),
+      GetLocalI32(0), BrIf{.depth = 0}, AddI32(), End(),
+      ConstI32(Value::I32(100)), AddI32()));
+  EXPECT_EQ(Interpret(func, 1, 2), 102);
+  EXPECT_EQ(Interpret(func, 0, 2), 104);
+}
+
+TEST(Interpreter, BranchTables) {
+  // Classifies the first parameter, returning from inside the blocks.
+  static const auto kTargets = PackTargets({0, 1, 1});
+  auto func = Fn(InstructionBuffer::Of(
+      Block{}, Block{}, Block{}, GetLocalI32(0),
+      BrTable{.packed_targets = kTargets, .default_depth = 2}, End(),
+      ConstI32(Value::I32(10)), Return(), End(), ConstI32(Value::I32(20)),
+      Return(), End(), GetLocalI32(1)));
+  EXPECT_EQ(Interpret(func, 0, 9), 10);
+  EXPECT_EQ(Interpret(func, 1, 9), 20);
+  EXPECT_EQ(Interpret(func, 2, 9), 20);
+  EXPECT_EQ(Interpret(func, 3, 9), 9);
+  EXPECT_EQ(Interpret(func, -1, 9), 9);
+}
+
+TEST(Interpreter, ReturnsFromTheMiddleOfTheStack) {
+  auto func = Fn(InstructionBuffer::Of(
+      GetLocalI32(1), GetLocalI32(1), GetLocalI32(0), If{}, Return(), End(),
+      AddI32()));
+  EXPECT_EQ(Interpret(func, 1, 2), 2);
+  EXPECT_EQ(Interpret(func, 0, 2), 4);
+}
+
+TEST(Interpreter, BranchesToTheFunction) {
+  auto func = Fn(InstructionBuffer::Of(
+      GetLocalI32(1), Block{}, GetLocalI32(0), BrIf{.depth = 1}, End(),
+      ConstI32(Value::I32(1)), AddI32()));
+  EXPECT_EQ(Interpret(func, 1, 2), 2);
+  EXPECT_EQ(Interpret(func, 0, 2), 3);
+}
+
+TEST(Interpreter, SkipsUnreachableCode) {
+  // The branches after the `Br` still get side table entries, so the ones
+  // after the block are found.
+  auto func = Fn(InstructionBuffer::Of(
+      Block{}, Br{.depth = 0}, AddI32(), BrIf{.depth = 0}, Br{.depth = 1},
+      End(), Block{}, GetLocalI32(0), BrIf{.depth = 0},
+      ConstI32(Value::I32(5)), Return(), End(), GetLocalI32(1)));
+  EXPECT_EQ(Interpret(func, 1, 2), 2);
+  EXPECT_EQ(Interpret(func, 0, 2), 5);
+}
+
+}  // namespace wasmcc::runtime
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <tuple>
 #include <type_traits>
@@ -63,4 +64,55 @@ BlockType SignatureFromNative() {
   return sig;
 }
 
+/** Convert a native value to the wasm value it's passed as. */
+template <typename T>
+Value NativeToValue(T v) {
+  if constexpr (std::is_same_v<T, int32_t>) {
+    return Value::I32(v);
+  } else if constexpr (std::is_same_v<T, uint32_t>) {
+    return Value::U32(v);
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return Value::I64(v);
+  } else if constexpr (std::is_same_v<T, uint64_t>) {
+    return Value::U64(v);
+  } else if constexpr (std::is_same_v<T, float>) {
+    return Value::F32(v);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return Value::F64(v);
+  } else {
+    static_assert(DependantFalse<T>::value, "Unsupported wasm type");
+  }
+}
+
+/** Convert a wasm value to the native type it's returned as. */
+template <typename T>
+T ValueToNative(Value v) {
+  if constexpr (std::is_same_v<T, int32_t>) {
+    return v.AsI32();
+  } else if constexpr (std::is_same_v<T, uint32_t>) {
+    return v.AsU32();
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return v.AsI64();
+  } else if constexpr (std::is_same_v<T, uint64_t>) {
+    return v.AsU64();
+  } else if constexpr (std::is_same_v<T, float>) {
+    return v.AsF32();
+  } else if constexpr (std::is_same_v<T, double>) {
+    return v.AsF64();
+  } else {
+    static_assert(DependantFalse<T>::value, "Unsupported wasm type");
+  }
+}
+
+/** Convert a tuple of native arguments to wasm values. */
+template <typename Tuple>
+std::array<Value, std::tuple_size_v<Tuple>> NativeArgsToValues(
+    const Tuple& args) {
+  return std::apply(
+      [](const auto&... arg) {
+        return std::array<Value, sizeof...(arg)>{NativeToValue(arg)...};
+      },
+      args);
+}
+
 }  // namespace wasmcc::runtime::detail
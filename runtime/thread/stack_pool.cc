@@ -0,0 +1,200 @@
+#include "runtime/thread/stack_pool.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+#include "base/align.h"
+#include "base/assert.h"
+
+namespace wasmcc::runtime {
+namespace {
+
+size_t PageSize() {
+  static const size_t page_size = getpagesize();
+  return page_size;
+}
+
+// Map a stack of `size` bytes, which must be whole pages, returning its base.
+void* MapStack(size_t size, bool guard_pages) {
+  size_t guard_size = guard_pages ? PageSize() : 0;
+  // The kernel only commits pages as they're touched, so nothing is zeroed or
+  // faulted in here.
+  void* mapping = ::mmap(nullptr, size + (guard_size * 2),
+                         guard_pages ? PROT_NONE : PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED) [[unlikely]] {
+    throw std::runtime_error(absl::StrFormat("unable to map stack: %s",
+                                             std::strerror(errno)));
+  }
+  // NOLINTNEXTLINE(*-pointer-arithmetic)
+  void* base = static_cast<uint8_t*>(mapping) + guard_size;
+  if (guard_pages &&
+      ::mprotect(base, size, PROT_READ | PROT_WRITE) != 0) [[unlikely]] {
+    int err = errno;
+    ::munmap(mapping, size + (guard_size * 2));
+    throw std::runtime_error(
+        absl::StrFormat("unable to protect stack: %s", std::strerror(err)));
+  }
+  return base;
+}
+
+void UnmapStack(void* base, size_t size, bool guard_pages) {
+  size_t guard_size = guard_pages ? PageSize() : 0;
+  // NOLINTNEXTLINE(*-pointer-arithmetic)
+  void* mapping = static_cast<uint8_t*>(base) - guard_size;
+  bool err = ::munmap(mapping, size + (guard_size * 2));
+  Assert(!err, "unable to unmap stack: %s", std::strerror(errno));
+}
+
+// Give the stack's pages back to the kernel while keeping the mapping.
+void DecommitStack(void* base, size_t size) {
+#if defined(MADV_FREE)
+  // Cheaper, as the pages are only reclaimed under memory pressure, but it's
+  // not supported by older kernels.
+  if (::madvise(base, size, MADV_FREE) == 0) {
+    return;
+  }
+#endif
+  bool err = ::madvise(base, size, MADV_DONTNEED);
+  Assert(!err, "unable to release stack pages: %s", std::strerror(errno));
+}
+
+}  // namespace
+
+Stack::Stack(StackPool* pool, void* base, size_t size, bool guard_pages)
+    : _pool(pool), _base(base), _size(size), _guard_pages(guard_pages) {}
+
+Stack::Stack(Stack&& other) noexcept
+    : _pool(std::exchange(other._pool, nullptr)),
+      _base(std::exchange(other._base, nullptr)),
+      _size(std::exchange(other._size, 0)),
+      _guard_pages(other._guard_pages) {}
+
+Stack& Stack::operator=(Stack&& other) noexcept {
+  if (this != &other) {
+    if (_pool != nullptr) {
+      _pool->Release(_base, _size, _guard_pages);
+    }
+    _pool = std::exchange(other._pool, nullptr);
+    _base = std::exchange(other._base, nullptr);
+    _size = std::exchange(other._size, 0);
+    _guard_pages = other._guard_pages;
+  }
+  return *this;
+}
+
+Stack::~Stack() {
+  if (_pool != nullptr) {
+    _pool->Release(_base, _size, _guard_pages);
+  }
+}
+
+StackPool::StackPool(StackPoolOptions options)
+    : _max_pooled_stacks_per_core(options.max_pooled_stacks_per_core),
+      _num_shards(std::max(1U, std::thread::hardware_concurrency())) {
+  _shards = std::make_unique<Shard[]>(_num_shards);
+}
+
+StackPool::~StackPool() {
+  Assert(_resident_bytes.load() == 0,
+         "stack pool destroyed with stacks still in use");
+  for (size_t i = 0; i < _num_shards; ++i) {
+    for (const FreeStack& stack : _shards[i].stacks) {
+      UnmapStack(stack.base, stack.size, stack.guard_pages);
+    }
+  }
+}
+
+StackPool* StackPool::Default() {
+  // Never destroyed, as threads can outlive static destructors.
+  static auto* pool = new StackPool();
+  return pool;
+}
+
+Stack StackPool::Allocate(size_t size, bool guard_pages) {
+  size = AlignUp(std::max<size_t>(size, 1), PageSize());
+  // Prefer this core's stacks, but take another core's rather than map one.
+  size_t local = LocalShardIndex();
+  auto& pooled = PooledOfClass(size, guard_pages);
+  for (size_t i = 0; i < _num_shards; ++i) {
+    if (pooled.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    Shard& shard = _shards[(local + i) % _num_shards];
+    std::unique_lock lock(shard.mutex);
+    auto it = std::find_if(shard.stacks.rbegin(), shard.stacks.rend(),
+                           [size, guard_pages](const FreeStack& stack) {
+                             return stack.size == size &&
+                                    stack.guard_pages == guard_pages;
+                           });
+    if (it != shard.stacks.rend()) {
+      void* base = it->base;
+      shard.stacks.erase(std::next(it).base());
+      pooled.fetch_sub(1, std::memory_order_relaxed);
+      lock.unlock();
+      _pooled_stacks.fetch_sub(1, std::memory_order_relaxed);
+      _hits.fetch_add(1, std::memory_order_relaxed);
+      _resident_bytes.fetch_add(size, std::memory_order_relaxed);
+      return {this, base, size, guard_pages};
+    }
+  }
+  void* base = MapStack(size, guard_pages);
+  _misses.fetch_add(1, std::memory_order_relaxed);
+  _resident_bytes.fetch_add(size, std::memory_order_relaxed);
+  return {this, base, size, guard_pages};
+}
+
+void StackPool::Release(void* base, size_t size, bool guard_pages) {
+  _resident_bytes.fetch_sub(size, std::memory_order_relaxed);
+  Shard& shard = _shards[LocalShardIndex()];
+  {
+    std::unique_lock lock(shard.mutex);
+    if (shard.stacks.size() < _max_pooled_stacks_per_core) {
+      // Only pay for the syscall when the stack is kept.
+      lock.unlock();
+      DecommitStack(base, size);
+      lock.lock();
+      // Other stacks may have been released here in the meantime.
+      if (shard.stacks.size() < _max_pooled_stacks_per_core) {
+        shard.stacks.push_back({base, size, guard_pages});
+        PooledOfClass(size, guard_pages)
+            .fetch_add(1, std::memory_order_relaxed);
+        _pooled_stacks.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+  UnmapStack(base, size, guard_pages);
+}
+
+size_t StackPool::LocalShardIndex() const {
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : size_t(cpu) % _num_shards;
+}
+
+std::atomic<size_t>& StackPool::PooledOfClass(size_t size, bool guard_pages) {
+  size_t pages = size / PageSize();
+  return _pooled_by_class[((pages * 2) + size_t(guard_pages)) % kNumClasses];
+}
+
+StackPoolStats StackPool::stats() const {
+  return {
+      .hits = _hits.load(std::memory_order_relaxed),
+      .misses = _misses.load(std::memory_order_relaxed),
+      .resident_bytes = _resident_bytes.load(std::memory_order_relaxed),
+      .pooled_stacks = _pooled_stacks.load(std::memory_order_relaxed),
+  };
+}
+
+}  // namespace wasmcc::runtime
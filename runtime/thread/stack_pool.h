@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace wasmcc::runtime {
+
+struct StackPoolOptions {
+  /**
+   * The most released stacks to keep around per core, beyond which they're
+   * unmapped.
+   */
+  size_t max_pooled_stacks_per_core = 64;
+};
+
+/** Counters for how a `StackPool` is doing. */
+struct StackPoolStats {
+  /** The number of stacks that were reused from the pool. */
+  uint64_t hits = 0;
+  /** The number of stacks that had to be mapped. */
+  uint64_t misses = 0;
+  /**
+   * The bytes of stacks that are handed out. Pages are only committed once
+   * they're touched, so this is an upper bound on what is actually resident.
+   * Pooled stacks have their pages released and don't count.
+   */
+  size_t resident_bytes = 0;
+  /** The number of released stacks that are waiting to be reused. */
+  size_t pooled_stacks = 0;
+};
+
+class StackPool;
+
+/**
+ * Memory for a VMThread to run on, which goes back to the pool it came from
+ * when destroyed.
+ */
+class Stack {
+ public:
+  Stack() = default;
+  Stack(const Stack&) = delete;
+  Stack& operator=(const Stack&) = delete;
+  Stack(Stack&&) noexcept;
+  Stack& operator=(Stack&&) noexcept;
+  ~Stack();
+
+  /** The lowest usable address of the stack. */
+  void* base() const { return _base; }
+  /** The number of usable bytes, above `base`. */
+  size_t size() const { return _size; }
+
+ private:
+  friend class StackPool;
+
+  Stack(StackPool*, void* base, size_t size, bool guard_pages);
+
+  StackPool* _pool = nullptr;
+  void* _base = nullptr;
+  size_t _size = 0;
+  bool _guard_pages = false;
+};
+
+/**
+ * Hands out stacks for VMThreads.
+ *
+ * Each stack is its own mapping, with `PROT_NONE` pages on either side when
+ * guard pages are enabled, so overflowing it faults instead of running into
+ * other memory. Pages are only committed by the kernel once the stack grows
+ * into them, so a large stack costs address space rather than memory.
+ *
+ * Released stacks are kept on a free list for the core that released them
+ * and preferably handed out again to threads on that core, so creating a
+ * thread is usually an uncontended lock instead of several syscalls. Their
+ * pages are given back to the kernel with `madvise` while they wait.
+ *
+ * This class is thread safe.
+ */
+class StackPool {
+ public:
+  explicit StackPool(StackPoolOptions = {});
+  StackPool(const StackPool&) = delete;
+  StackPool& operator=(const StackPool&) = delete;
+  StackPool(StackPool&&) = delete;
+  StackPool& operator=(StackPool&&) = delete;
+  /** Every stack from the pool must have been released. */
+  ~StackPool();
+
+  /** The pool used by VMThreads unless configured otherwise. */
+  static StackPool* Default();
+
+  /**
+   * Get a stack of at least `size` bytes, rounded up to whole pages. Throws
+   * `std::runtime_error` if it can't be mapped.
+   */
+  Stack Allocate(size_t size, bool guard_pages);
+
+  StackPoolStats stats() const;
+
+ private:
+  friend class Stack;
+
+  struct FreeStack {
+    void* base;
+    size_t size;
+    bool guard_pages;
+  };
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::vector<FreeStack> stacks;
+  };
+
+  // Pooled stacks are counted by their size and guard pages, hashed into
+  // this many buckets.
+  static constexpr size_t kNumClasses = 64;
+
+  void Release(void* base, size_t size, bool guard_pages);
+  size_t LocalShardIndex() const;
+  std::atomic<size_t>& PooledOfClass(size_t size, bool guard_pages);
+
+  size_t _max_pooled_stacks_per_core;
+  std::unique_ptr<Shard[]> _shards;
+  size_t _num_shards;
+  std::atomic<uint64_t> _hits = 0;
+  std::atomic<uint64_t> _misses = 0;
+  std::atomic<size_t> _resident_bytes = 0;
+  std::atomic<size_t> _pooled_stacks = 0;
+  // So that a miss only locks other cores' shards when one of them might have
+  // a matching stack.
+  std::array<std::atomic<size_t>, kNumClasses> _pooled_by_class{};
+};
+
+}  // namespace wasmcc::runtime
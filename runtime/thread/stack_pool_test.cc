@@ -0,0 +1,133 @@
+#include "runtime/thread/stack_pool.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "runtime/thread/thread.h"
+
+namespace wasmcc::runtime {
+
+TEST(StackPool, ReusesReleasedStacks) {
+  StackPool pool;
+  size_t page_size = getpagesize();
+  void* base = nullptr;
+  {
+    Stack stack = pool.Allocate(page_size * 4, /*guard_pages=*/true);
+    base = stack.base();
+    EXPECT_EQ(stack.size(), page_size * 4);
+    // The whole stack is writable.
+    std::memset(stack.base(), 1, stack.size());
+    auto stats = pool.stats();
+    EXPECT_EQ(stats.hits, 0);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.resident_bytes, page_size * 4);
+    EXPECT_EQ(stats.pooled_stacks, 0);
+  }
+  auto stats = pool.stats();
+  EXPECT_EQ(stats.resident_bytes, 0);
+  EXPECT_EQ(stats.pooled_stacks, 1);
+
+  Stack stack = pool.Allocate(page_size * 4, /*guard_pages=*/true);
+  EXPECT_EQ(stack.base(), base);
+  std::memset(stack.base(), 1, stack.size());
+  stats = pool.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.resident_bytes, page_size * 4);
+  EXPECT_EQ(stats.pooled_stacks, 0);
+}
+
+TEST(StackPool, OnlyReusesMatchingStacks) {
+  StackPool pool;
+  size_t page_size = getpagesize();
+  pool.Allocate(page_size, /*guard_pages=*/true);
+  // Rounded up to whole pages.
+  Stack stack = pool.Allocate(page_size * 2 - 1, /*guard_pages=*/true);
+  EXPECT_EQ(stack.size(), page_size * 2);
+  Stack unguarded = pool.Allocate(page_size, /*guard_pages=*/false);
+  auto stats = pool.stats();
+  EXPECT_EQ(stats.hits, 0);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.pooled_stacks, 1);
+}
+
+TEST(StackPool, LimitsPooledStacks) {
+  StackPool pool({.max_pooled_stacks_per_core = 0});
+  size_t page_size = getpagesize();
+  pool.Allocate(page_size, /*guard_pages=*/false);
+  pool.Allocate(page_size, /*guard_pages=*/false);
+  auto stats = pool.stats();
+  EXPECT_EQ(stats.hits, 0);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.pooled_stacks, 0);
+}
+
+TEST(StackPool, LimitsStacksReleasedConcurrently) {
+  StackPool pool({.max_pooled_stacks_per_core = 1});
+  std::vector<Stack> stacks;
+  for (int i = 0; i < 64; ++i) {
+    stacks.push_back(pool.Allocate(getpagesize(), /*guard_pages=*/false));
+  }
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&stacks, i] {
+      for (size_t j = i; j < stacks.size(); j += 8) {
+        stacks[j] = Stack();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(pool.stats().pooled_stacks,
+            std::max(1U, std::thread::hardware_concurrency()));
+}
+
+TEST(StackPool, MovesStacks) {
+  StackPool pool;
+  Stack stack = pool.Allocate(getpagesize(), /*guard_pages=*/true);
+  void* base = stack.base();
+  Stack moved = std::move(stack);
+  EXPECT_EQ(moved.base(), base);
+  moved = Stack();
+  EXPECT_EQ(pool.stats().resident_bytes, 0);
+  EXPECT_EQ(pool.stats().pooled_stacks, 1);
+}
+
+TEST(StackPoolDeathTest, GuardPagesFault) {
+  StackPool pool;
+  Stack stack = pool.Allocate(getpagesize(), /*guard_pages=*/true);
+  EXPECT_DEATH(
+      {
+        // NOLINTNEXTLINE(*-pointer-arithmetic)
+        volatile auto* below = static_cast<uint8_t*>(stack.base()) - 1;
+        *below = 1;
+      },
+      "");
+}
+
+TEST(StackPool, RunsVMThreads) {
+  StackPool pool;
+  int invoke_count = 0;
+  for (int i = 0; i < 4; ++i) {
+    auto thread = VMThread::Create([&invoke_count] { ++invoke_count; },
+                                   {.stack_size = 8L * 1024,
+                                    .enable_guard_pages = true,
+                                    .stack_pool = &pool});
+    thread->Resume();
+  }
+  EXPECT_EQ(invoke_count, 4);
+  auto stats = pool.stats();
+  EXPECT_EQ(stats.hits, 3);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.resident_bytes, 0);
+}
+
+}  // namespace wasmcc::runtime
@@ -4,6 +4,7 @@
 #include <memory>
 
 #include "absl/functional/any_invocable.h"
+#include "runtime/thread/stack_pool.h"
 
 namespace wasmcc::runtime {
 struct ThreadStack;
@@ -21,6 +22,11 @@ struct VMThreadConfiguration {
    * {over,under}flow that the process is aborted.
    */
   bool enable_guard_pages = true;
+  /**
+   * Where to get the stack from, which must outlive the thread. Defaults to
+   * `StackPool::Default()`.
+   */
+  StackPool* stack_pool = nullptr;
 };
 
 /**
@@ -62,6 +68,15 @@ class VMThread {
    */
   void Resume();
 
+  /**
+   * Run `fn(arg)` on the thread's stack instead of the thread's function,
+   * returning once it has. This switches stacks only once in each direction
+   * and allocates nothing, for calls too short to be worth suspending.
+   *
+   * The thread must be stopped, and `fn` must not yield.
+   */
+  void Call(void (*fn)(void*), void* arg);
+
   /**
    * Move a thread in the suspended state into the stopped state.
    *
@@ -78,28 +93,28 @@ class VMThread {
 
   uintptr_t stack_bottom() const {
     // NOLINTNEXTLINE(*-reinterpret-cast)
-    return reinterpret_cast<uintptr_t>(_stack_memory.get());
+    return reinterpret_cast<uintptr_t>(_stack.base());
   }
   uintptr_t stack_top() const {
     // NOLINTNEXTLINE(*-reinterpret-cast)
-    return reinterpret_cast<uintptr_t>(_stack_memory.get()) + _stack_size;
+    return reinterpret_cast<uintptr_t>(_stack.base()) + _stack.size();
   }
 
  private:
   friend void VMThreadStart(VMThread*);
 
-  using StackMemory = std::unique_ptr<void, absl::AnyInvocable<void(void*)>>;
-
-  VMThread(absl::AnyInvocable<void()>, StackMemory, size_t);
+  VMThread(absl::AnyInvocable<void()>, Stack);
 
   void TrampolineInToVM();
   void TrampolineOutOfVM();
 
   State _state = State::kStopped;
   absl::AnyInvocable<void()> _func;
+  // Run instead of `_func` if set, for `Call`.
+  void (*_call_fn)(void*) = nullptr;
+  void* _call_arg = nullptr;
 
-  StackMemory _stack_memory;
-  size_t _stack_size;
+  Stack _stack;
 
   StackState _my_thread_state;
   StackState _main_thread_state;
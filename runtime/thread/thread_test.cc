@@ -4,8 +4,10 @@
 #include <gtest/gtest.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 
 #include "gtest/gtest.h"
 
@@ -78,4 +80,44 @@ TEST(VMThread, CanBeStoppedWhileSuspended) {
   EXPECT_EQ(thread->state(), VMThread::State::kSuspended);
 }
 
+TEST(VMThread, CallRunsOnTheThreadStack) {
+  int invoke_count = 0;
+  auto thread = VMThread::Create([&invoke_count] { ++invoke_count; }, kConfig);
+  struct Frame {
+    VMThread* thread;
+    int input;
+    int output;
+    bool on_stack;
+  } frame = {thread.get(), 20, 0, false};
+  for (int i = 0; i < 2; ++i) {
+    thread->Call(
+        [](void* arg) {
+          auto* frame = static_cast<Frame*>(arg);
+          int local = 0;
+          // NOLINTNEXTLINE(*-reinterpret-cast)
+          auto address = reinterpret_cast<uintptr_t>(&local);
+          frame->on_stack = address >= frame->thread->stack_bottom() &&
+                            address < frame->thread->stack_top();
+          frame->output = frame->input * 2 + 2;
+        },
+        &frame);
+    EXPECT_EQ(thread->state(), VMThread::State::kStopped);
+    EXPECT_EQ(frame.output, 42);
+    EXPECT_TRUE(frame.on_stack);
+  }
+  // The thread's own function still runs when it's resumed.
+  EXPECT_EQ(invoke_count, 0);
+  thread->Resume();
+  EXPECT_EQ(invoke_count, 1);
+}
+
+TEST(VMThread, CallRequiresAStoppedThread) {
+  auto thread = VMThread::Create([] { VMThread::Yield(); }, kConfig);
+  thread->Resume();
+  EXPECT_THROW(thread->Call([](void*) {}, nullptr), std::runtime_error);
+  thread->Stop();
+  thread->Call([](void*) {}, nullptr);
+  EXPECT_EQ(thread->state(), VMThread::State::kStopped);
+}
+
 }  // namespace wasmcc::runtime
@@ -1,55 +1,205 @@
 #include "runtime/vm.h"
 
+#include <algorithm>
+#include <atomic>
 #include <exception>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
+#include "absl/strings/str_format.h"
 #include "base/assert.h"
+#include "compiler/common/exception.h"
+#include "compiler/compiler.h"
+#include "compiler/single_function_compiler.h"
+#include "compiler/stack_usage.h"
 #include "runtime/function_handle.h"
+#include "runtime/interpreter.h"
 #include "runtime/thread/thread.h"
 
 namespace wasmcc {
 namespace runtime {
-class VMImpl final : public VM {
+namespace {
+
+// The stack the VM's own frames need around the function it runs: the thread
+// entry, the function handle's trampoline, and what `VMThread::Yield` saves.
+constexpr size_t kHostStackBytes = 1024L * 8;
+
+// A function that was compiled before the VM was created.
+class CompiledCallee final : public Callee {
  public:
-  explicit VMImpl(CompiledModule compiled)
-      : _compiled(std::move(compiled)),
-        _thread(runtime::VMThread::Create([this] { RunInternal(); }, {})) {}
-
-  std::optional<CompiledFunction> LookupFunctionHandleDynamic(
-      const Name& name, const BlockType& signature) final {
-    auto it = _compiled.exported_functions.find(name);
-    if (it == _compiled.exported_functions.end()) {
-      return std::nullopt;
+  explicit CompiledCallee(CompiledFunction* compiled) : _compiled(compiled) {}
+
+  const BlockType& signature() const final {
+    return _compiled->metadata().signature;
+  }
+  CompiledFunction* Enter() final {
+    // Functions of a `LazyModule` compile on their first call, which has to
+    // happen here rather than on the VM's thread, as compiling can throw.
+    _compiled->Resolve();
+    return _compiled;
+  }
+  void Interpret(std::span<const Value>, std::span<Value>) final {
+    Abort(std::source_location::current(),
+          "compiled functions are never interpreted");
+  }
+
+ private:
+  CompiledFunction* _compiled;
+};
+
+// A function that is interpreted for its first calls, and then compiled by
+// `compile`, which returns null if it can't be.
+class LazyCallee final : public Callee {
+ public:
+  LazyCallee(const Function* func, uint32_t jit_threshold,
+             absl::AnyInvocable<CompiledFunction*()> compile)
+      : _func(func),
+        _jit_threshold(jit_threshold),
+        _compile(std::move(compile)) {}
+
+  const BlockType& signature() const final { return _func->meta.signature; }
+
+  CompiledFunction* Enter() final {
+    if (auto* compiled = _compiled.load(std::memory_order_acquire)) {
+      return compiled;
     }
-    const auto& compiled = _compiled.functions[it->second.value()];
-    if (compiled.metadata().signature != signature) {
-      return std::nullopt;
+    if (_calls.fetch_add(1, std::memory_order_relaxed) >= _jit_threshold) {
+      std::call_once(_compile_once, [this] {
+        _compiled.store(_compile(), std::memory_order_release);
+      });
+      if (auto* compiled = _compiled.load(std::memory_order_acquire)) {
+        return compiled;
+      }
     }
-    return compiled;
+    // The side table is only built for functions that are actually run.
+    std::call_once(_interpreter_once,
+                   [this] { _interpreter.emplace(*_func); });
+    return nullptr;
   }
 
-  DynamicComputation InvokeDynamic(absl::AnyInvocable<void()> fn) final {
-    if (_current_fn || _thread->state() != runtime::VMThread::State::kStopped) {
-      throw std::runtime_error(
-          "cannot run a function when one is already executing.");
+  void Interpret(std::span<const Value> args,
+                 std::span<Value> results) final {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    _interpreter->Run(args, results);
+  }
+
+ private:
+  const Function* _func;
+  uint32_t _jit_threshold;
+  absl::AnyInvocable<CompiledFunction*()> _compile;
+  std::atomic<uint32_t> _calls = 0;
+  std::once_flag _compile_once;
+  std::atomic<CompiledFunction*> _compiled = nullptr;
+  std::once_flag _interpreter_once;
+  std::optional<Interpreter> _interpreter;
+};
+
+// Runs each function on a VMThread from a pool, so that many can be in
+// flight at once. Subclasses provide the functions.
+class VMImpl : public VM, public ThreadOwner {
+ public:
+  VMImpl(ExecutionOptions options, size_t stack_size)
+      : _max_computations(options.max_computations), _stack_size(stack_size) {}
+
+  Callee* LookupFunctionHandleDynamic(const Name& name,
+                                      const BlockType& signature) final {
+    auto it = _exports.find(name);
+    if (it == _exports.end()) {
+      return nullptr;
+    }
+    Callee* callee = _callees[it->second.value()].get();
+    if (callee->signature() != signature) {
+      return nullptr;
     }
-    _current_fn = std::move(fn);
-    auto comp = runtime::DynamicComputation(_thread.get());
-    // We immediately yield, but this ensures that _current_fn is exchanged, so
+    return callee;
+  }
+
+  DynamicComputation InvokeDynamic(absl::AnyInvocable<void()> fn) final {
+    Worker* worker = AcquireWorker();
+    worker->current_fn = std::move(fn);
+    auto comp = runtime::DynamicComputation(worker->thread.get(), this);
+    // We immediately yield, but this ensures that current_fn is exchanged, so
     // it's possible to immediately throw away the result of the computation.
-    _thread->Resume();
+    worker->thread->Resume();
     return comp;
   }
 
+  void CallDynamic(void (*fn)(void*), void* frame) final {
+    Worker* worker = AcquireWorker();
+    try {
+      worker->thread->Call(fn, frame);
+    } catch (...) {
+      ReturnWorker(worker);
+      throw;
+    }
+    ReturnWorker(worker);
+  }
+
+  size_t stack_size() const final { return _stack_size; }
+
+  void ReturnThread(VMThread* thread) final {
+    Worker* worker = nullptr;
+    {
+      std::unique_lock lock(_mutex);
+      worker = _workers.at(thread).get();
+    }
+    ReturnWorker(worker);
+  }
+
+ protected:
+  absl::flat_hash_map<Name, FuncIdx> _exports;
+  std::vector<std::unique_ptr<Callee>> _callees;
+
  private:
-  void RunInternal() {
-    // Clear _current function immediately so that there
-    // is no issue with _thread->Stop() being able to be reset.
-    auto fn = std::exchange(_current_fn, std::nullopt);
+  // A pooled thread, and the function it's about to start running.
+  struct Worker {
+    std::unique_ptr<VMThread> thread;
+    std::optional<absl::AnyInvocable<void()>> current_fn;
+  };
+
+  Worker* AcquireWorker() {
+    if (Worker* spare = _spare.exchange(nullptr, std::memory_order_acquire)) {
+      return spare;
+    }
+    std::unique_lock lock(_mutex);
+    if (!_idle.empty()) {
+      Worker* worker = _idle.back();
+      _idle.pop_back();
+      return worker;
+    }
+    if (_max_computations != 0 && _workers.size() >= _max_computations) {
+      throw std::runtime_error(
+          absl::StrFormat("cannot run more than %d functions at once.",
+                          _max_computations));
+    }
+    auto worker = std::make_unique<Worker>();
+    Worker* raw = worker.get();
+    worker->thread = VMThread::Create([raw] { RunInternal(raw); },
+                                      {.stack_size = _stack_size});
+    _workers.emplace(worker->thread.get(), std::move(worker));
+    return raw;
+  }
+
+  void ReturnWorker(Worker* worker) {
+    Worker* expected = nullptr;
+    if (_spare.compare_exchange_strong(expected, worker,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+      return;
+    }
+    std::unique_lock lock(_mutex);
+    _idle.push_back(worker);
+  }
+
+  static void RunInternal(Worker* worker) {
+    // Clear the current function immediately so that there
+    // is no issue with thread->Stop() being able to be reset.
+    auto fn = std::exchange(worker->current_fn, std::nullopt);
     Assert(fn.has_value(), "run_internal called without anything to run");
     // Pause so the computation is ready
     VMThread::Yield();
@@ -57,13 +207,92 @@ class VMImpl final : public VM {
     (*fn)();
   }
 
-  std::optional<absl::AnyInvocable<void()>> _current_fn;
+  uint32_t _max_computations;
+  size_t _stack_size;
+  // An idle worker that can be taken without locking, so back to back calls
+  // keep reusing the same stack.
+  std::atomic<Worker*> _spare = nullptr;
+  std::mutex _mutex;
+  absl::flat_hash_map<VMThread*, std::unique_ptr<Worker>> _workers;
+  std::vector<Worker*> _idle;
+};
+
+// A VM for a module that was compiled upfront.
+class CompiledVM final : public VMImpl {
+ public:
+  CompiledVM(CompiledModule compiled, ExecutionOptions options)
+      : VMImpl(options, StackSizeFor(compiled)),
+        _compiled(std::move(compiled)) {
+    _exports = _compiled.exported_functions;
+    for (auto& function : _compiled.functions) {
+      _callees.push_back(std::make_unique<CompiledCallee>(&function));
+    }
+  }
+
+ private:
+  // Big enough for any export, as nothing else can be called from outside.
+  static size_t StackSizeFor(const CompiledModule& compiled) {
+    size_t max_bytes = 0;
+    for (const auto& [_, idx] : compiled.exported_functions) {
+      auto bytes = MaxStackBytes(compiled, idx);
+      if (!bytes) {
+        return kDefaultStackSize;
+      }
+      max_bytes = std::max(max_bytes, *bytes);
+    }
+    return kHostStackBytes + max_bytes;
+  }
+
   CompiledModule _compiled;
-  std::unique_ptr<runtime::VMThread> _thread;
 };
+
+// A VM that interprets functions until they're called often enough to be
+// compiled.
+class InterpretedVM final : public VMImpl {
+ public:
+  InterpretedVM(ParsedModule parsed, Compiler* compiler,
+                ExecutionOptions options)
+      : VMImpl(options, kDefaultStackSize),
+        _parsed(std::move(parsed)),
+        _compiler(compiler) {
+    _exports = _parsed.exported_functions;
+    for (size_t i = 0; i < _parsed.functions.size(); ++i) {
+      _callees.push_back(std::make_unique<LazyCallee>(
+          &_parsed.functions[i], options.jit_threshold,
+          [this, i] { return Compile(i); }));
+    }
+  }
+  InterpretedVM(const InterpretedVM&) = delete;
+  InterpretedVM& operator=(const InterpretedVM&) = delete;
+  InterpretedVM(InterpretedVM&&) = delete;
+  InterpretedVM& operator=(InterpretedVM&&) = delete;
+  ~InterpretedVM() final = default;
+
+ private:
+  CompiledFunction* Compile(size_t idx) {
+    try {
+      return _compiler.Compile(_parsed.functions[idx]);
+    } catch (const CompilationException&) {
+      // Keep interpreting it.
+      return nullptr;
+    }
+  }
+
+  ParsedModule _parsed;
+  SingleFunctionCompiler _compiler;
+};
+
+}  // namespace
 }  // namespace runtime
 
-std::unique_ptr<VM> VM::Create(CompiledModule compiled) {
-  return std::make_unique<runtime::VMImpl>(std::move(compiled));
+std::unique_ptr<VM> VM::Create(CompiledModule compiled,
+                               ExecutionOptions options) {
+  return std::make_unique<runtime::CompiledVM>(std::move(compiled), options);
+}
+
+std::unique_ptr<VM> VM::Create(ParsedModule parsed, Compiler* compiler,
+                               ExecutionOptions options) {
+  return std::make_unique<runtime::InterpretedVM>(std::move(parsed), compiler,
+                                                  options);
 }
 }  // namespace wasmcc
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+
 #include "absl/functional/any_invocable.h"
 #include "base/type_traits.h"
 #include "compiler/module.h"
@@ -9,6 +16,24 @@
 
 namespace wasmcc {
 
+class Compiler;
+
+struct ExecutionOptions {
+  /**
+   * How many times each function is interpreted before it's compiled, just
+   * before its next call. Functions that only ever run a few times, such as
+   * start functions and initializers, are never compiled at all. Zero
+   * compiles each function before its first call.
+   */
+  uint32_t jit_threshold = 1;
+  /**
+   * How many computations can be in flight at once, each on its own stack,
+   * where zero is unlimited. Stacks are pooled, so are only allocated for the
+   * most computations that have been in flight at once.
+   */
+  uint32_t max_computations = 0;
+};
+
 /**
  * A VM is an instance of a compiled WASM module.
  *
@@ -29,7 +54,17 @@ class VM {
    *
    * TODO: Talk about lifetimes
    */
-  static std::unique_ptr<VM> Create(CompiledModule);
+  static std::unique_ptr<VM> Create(CompiledModule, ExecutionOptions = {});
+
+  /**
+   * Create a VM that runs the parsed module without compiling it upfront.
+   * Functions start out interpreted, and are compiled with `compiler` one at
+   * a time once they've been called often enough (see `ExecutionOptions`).
+   *
+   * LIFETIMES: The compiler must outlive the VM.
+   */
+  static std::unique_ptr<VM> Create(ParsedModule, Compiler*,
+                                    ExecutionOptions = {});
 
   /**
    * Lookup a function handle with the given signature and name.
@@ -45,47 +80,124 @@ class VM {
   template <typename Signature>
   std::optional<FunctionHandle<Signature>> LookupFunctionHandle(const Name&);
 
+  /**
+   * The size of the native stack each computation runs on.
+   *
+   * VMs for compiled modules size it from the deepest stack any export can
+   * need, so small modules take a few pages per computation. Otherwise, such
+   * as when functions are compiled while the VM runs, it's big enough for
+   * anything.
+   */
+  virtual size_t stack_size() const = 0;
+
  protected:
   /**
-   * Dynamically lookup a function with the given signature.
+   * Dynamically lookup a function with the given signature, returning null if
+   * there is none. The function lives as long as the VM.
    */
-  virtual std::optional<CompiledFunction> LookupFunctionHandleDynamic(
-      const Name&, const BlockType&) = 0;
+  virtual runtime::Callee* LookupFunctionHandleDynamic(const Name&,
+                                                       const BlockType&) = 0;
 
   /**
-   * Run the specified compiled function within the VM's thread and stack.
+   * Run the specified compiled function within a thread and stack of the VM's
+   * own, which is returned to the VM once the computation is destroyed.
    *
-   * Only one live DynamicComputation is allowed at once.
+   * Throws if there are already `ExecutionOptions::max_computations` live
+   * DynamicComputations.
    *
    * NOTE: The VM **must** outlive the resuling computation.
    */
   virtual runtime::DynamicComputation InvokeDynamic(
       absl::AnyInvocable<void()>) = 0;
+
+  /**
+   * Run `fn(frame)` to completion within a thread and stack of the VM's own,
+   * which counts towards `ExecutionOptions::max_computations` while it runs.
+   */
+  virtual void CallDynamic(void (*fn)(void*), void* frame) = 0;
 };
 
+namespace runtime::detail {
+/**
+ * Run a function that `Callee::Enter` returned `compiled` for, on the VM's
+ * stack.
+ */
+template <typename Signature, typename ArgTypes>
+FunctionTraits<Signature>::result_type RunCallee(CompiledFunction* compiled,
+                                                 Callee* callee,
+                                                 ArgTypes&& args) {
+  using ResultType = FunctionTraits<Signature>::result_type;
+  if (compiled != nullptr) {
+    return compiled->template apply<Signature, ArgTypes>(
+        std::forward<ArgTypes>(args));
+  }
+  auto values = NativeArgsToValues(args);
+  std::array<Value, 1> result{};
+  callee->Interpret(values, result);
+  return ValueToNative<ResultType>(result[0]);
+}
+}  // namespace runtime::detail
+
 template <typename Signature>
 std::optional<FunctionHandle<Signature>> VM::LookupFunctionHandle(
     const Name& name) {
   auto signature = runtime::detail::SignatureFromNative<Signature>();
-  auto compiled = LookupFunctionHandleDynamic(name, std::move(signature));
-  if (!compiled) {
+  runtime::Callee* callee = LookupFunctionHandleDynamic(name, signature);
+  if (callee == nullptr) {
     return std::nullopt;
   }
   using ArgTypes = FunctionTraits<Signature>::arg_types;
   using ResultType = FunctionTraits<Signature>::result_type;
-  return FunctionHandle<Signature>(
-      [this, compiled = std::move(compiled).value()](ArgTypes&& args) {
-        std::unique_ptr<Computation<ResultType>> typed_computation{
-            new Computation<ResultType>()};
-        typed_computation->_dyn = InvokeDynamic(
-            [compiled = compiled, args = std::forward<ArgTypes>(args),
-             comp = typed_computation.get()]() mutable {
-              comp->_result =
-                  compiled.template apply<Signature, ArgTypes>(std::move(args));
-            });
-
-        return std::move(typed_computation);
-      });
+  auto invoke = [this, callee](ArgTypes&& args) {
+    std::unique_ptr<Computation<ResultType>> typed_computation{
+        new Computation<ResultType>()};
+    auto* comp = typed_computation.get();
+    typed_computation->_dyn = InvokeDynamic(
+        [compiled = callee->Enter(), callee,
+         args = std::forward<ArgTypes>(args), comp]() mutable {
+          comp->_result = runtime::detail::RunCallee<Signature>(
+              compiled, callee, std::move(args));
+        });
+    return std::move(typed_computation);
+  };
+  auto call = [this, callee](ArgTypes&& args) {
+    // Everything the call needs lives on this stack, and the trampoline is a
+    // plain function specialized for the signature, so nothing is allocated.
+    struct Frame {
+      CompiledFunction* compiled;
+      runtime::Callee* callee;
+      ArgTypes* args;
+      ResultType result;
+    } frame = {callee->Enter(), callee, &args, {}};
+    CallDynamic(
+        [](void* opaque) {
+          auto* frame = static_cast<Frame*>(opaque);
+          frame->result = runtime::detail::RunCallee<Signature>(
+              frame->compiled, frame->callee, std::move(*frame->args));
+        },
+        &frame);
+    return frame.result;
+  };
+  auto call_batch = [this, callee](std::span<const ArgTypes> args,
+                                   std::span<ResultType> results) {
+    struct Frame {
+      CompiledFunction* compiled;
+      runtime::Callee* callee;
+      std::span<const ArgTypes> args;
+      std::span<ResultType> results;
+    } frame = {callee->Enter(), callee, args, results};
+    CallDynamic(
+        [](void* opaque) {
+          auto* frame = static_cast<Frame*>(opaque);
+          for (size_t i = 0; i < frame->args.size(); ++i) {
+            frame->results[i] = runtime::detail::RunCallee<Signature>(
+                frame->compiled, frame->callee, ArgTypes(frame->args[i]));
+          }
+        },
+        &frame);
+  };
+  return FunctionHandle<Signature>(std::move(invoke), std::move(call),
+                                   std::move(call_batch));
 }
 
 }  // namespace wasmcc
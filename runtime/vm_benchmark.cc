@@ -0,0 +1,181 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "base/byte_cursor.h"
+#include "compiler/compiler.h"
+#include "core/ast.h"
+#include "parser/parser.h"
+#include "runtime/vm.h"
+#include "testing/wat.h"
+
+namespace wasmcc {
+namespace {
+
+// A loop that keeps a counter and an accumulator in locals.
+constexpr std::string_view kKernel = R"WAT(
+  (func (param $n i32) (result i32) (local $i i32) (local $acc i32)
+    block
+      loop
+        local.get $i
+        local.get $n
+        i32.ge_s
+        br_if 1
+        local.get $acc
+        local.get $i
+        i32.add
+        local.set $acc
+        local.get $i
+        i32.const 1
+        i32.add
+        local.set $i
+        br 0
+      end
+    end
+    local.get $acc)
+)WAT";
+
+// A module of `n` copies of the kernel, where only the first is exported.
+ParsedModule ParseModuleOfSize(int n) {
+  std::string wat = "(module\n";
+  for (int i = 0; i < n; ++i) {
+    wat += kKernel;
+  }
+  wat += R"WAT((export "kernel" (func 0))))WAT";
+  bytes wasm = Wat2Wasm(wat);
+  ByteCursor cursor(wasm);
+  return ParseModule(&cursor).get();
+}
+
+int RunKernel(VM* vm) {
+  auto kernel = vm->LookupFunctionHandle<int (*)(int)>(Name("kernel"));
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  auto computation = kernel->Invoke(100);
+  while (!computation->IsDone()) {
+    computation->Execute();
+  }
+  return computation->GetResult();
+}
+
+// The time from having a parsed module of `functions` functions to the result
+// of calling one of them, when every function is compiled upfront.
+void BM_TimeToFirstResultCompiled(benchmark::State& state) {
+  ParsedModule parsed = ParseModuleOfSize(int(state.range(0)));
+  auto compiler = Compiler::CreateNative();
+  for (auto _ : state) {
+    auto compiled = compiler->Compile(parsed).get();
+    CodeRegion code = compiled.code;
+    auto vm = VM::Create(std::move(compiled));
+    benchmark::DoNotOptimize(RunKernel(vm.get()));
+    state.PauseTiming();
+    vm.reset();
+    compiler->Release({.code = code}).get();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_TimeToFirstResultCompiled)
+    ->ArgName("functions")
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
+
+// The same, but when functions are interpreted until they have been called
+// `jit_threshold` times.
+void BM_TimeToFirstResultInterpreted(benchmark::State& state) {
+  ParsedModule parsed = ParseModuleOfSize(int(state.range(0)));
+  auto compiler = Compiler::CreateNative();
+  for (auto _ : state) {
+    auto vm = VM::Create(parsed, compiler.get(),
+                         {.jit_threshold = uint32_t(state.range(1))});
+    benchmark::DoNotOptimize(RunKernel(vm.get()));
+    state.PauseTiming();
+    vm.reset();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_TimeToFirstResultInterpreted)
+    ->ArgNames({"functions", "jit_threshold"})
+    ->ArgsProduct({{100, 1000, 10000}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// The latency of calling a short function, either by running a computation
+// until it's done (`call` = 0), or with `FunctionHandle::Call`.
+void BM_CallLatency(benchmark::State& state) {
+  bytes wasm = Wat2Wasm(R"WAT(
+  (module
+    (func $add (param $lhs i32) (param $rhs i32) (result i32)
+      local.get $lhs
+      local.get $rhs
+      i32.add) (export "add" (func $add)))
+  )WAT");
+  ByteCursor cursor(wasm);
+  auto compiler = Compiler::CreateNative();
+  auto compiled = compiler->Compile(ParseModule(&cursor).get()).get();
+  CodeRegion code = compiled.code;
+  auto vm = VM::Create(std::move(compiled));
+  auto add = vm->LookupFunctionHandle<int (*)(int, int)>(Name("add"));
+  bool call = state.range(0) != 0;
+  int i = 0;
+  for (auto _ : state) {
+    if (call) {
+      // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+      benchmark::DoNotOptimize(add->Call(i, 1));
+    } else {
+      // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+      auto computation = add->Invoke(i, 1);
+      while (!computation->IsDone()) {
+        computation->Execute();
+      }
+      benchmark::DoNotOptimize(computation->GetResult());
+    }
+    ++i;
+  }
+  vm.reset();
+  compiler->Release({.code = code}).get();
+}
+BENCHMARK(BM_CallLatency)->ArgName("call")->Arg(0)->Arg(1);
+
+// The throughput of calling a short function for each record in a stream, in
+// batches of `batch` records.
+void BM_CallBatchThroughput(benchmark::State& state) {
+  bytes wasm = Wat2Wasm(R"WAT(
+  (module
+    (func $add (param $lhs i32) (param $rhs i32) (result i32)
+      local.get $lhs
+      local.get $rhs
+      i32.add) (export "add" (func $add)))
+  )WAT");
+  ByteCursor cursor(wasm);
+  auto compiler = Compiler::CreateNative();
+  auto compiled = compiler->Compile(ParseModule(&cursor).get()).get();
+  CodeRegion code = compiled.code;
+  auto vm = VM::Create(std::move(compiled));
+  auto add = vm->LookupFunctionHandle<int (*)(int, int)>(Name("add"));
+  auto batch = size_t(state.range(0));
+  std::vector<std::tuple<int, int>> args;
+  for (size_t i = 0; i < batch; ++i) {
+    args.emplace_back(int(i), 1);
+  }
+  std::vector<int> results(batch);
+  for (auto _ : state) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    add->CallBatch(args, results);
+    benchmark::DoNotOptimize(results.data());
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(batch));
+  vm.reset();
+  compiler->Release({.code = code}).get();
+}
+BENCHMARK(BM_CallBatchThroughput)
+    ->ArgName("batch")
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(1024)
+    ->Arg(16384);
+
+}  // namespace
+}  // namespace wasmcc
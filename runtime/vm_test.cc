@@ -3,27 +3,102 @@
 #include <gtest/gtest.h>
 
 #include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 #include "base/stream.h"
 #include "compiler/compiler.h"
 #include "parser/parser.h"
+#include "runtime/thread/thread.h"
 #include "testing/wat.h"
 
 namespace wasmcc {
 
 namespace {
+// Compiles natively, counting the functions it compiles.
+class CountingCompiler final : public Compiler {
+ public:
+  co::Future<CompiledModule> Compile(ParsedModule parsed) override {
+    num_compiled += parsed.functions.size();
+    return _native->Compile(std::move(parsed));
+  }
+  co::Future<CompiledArtifact> CompileArtifact(ParsedModule parsed) override {
+    return _native->CompileArtifact(std::move(parsed));
+  }
+  co::Future<> Release(CompiledModule compiled) override {
+    return _native->Release(std::move(compiled));
+  }
+  const CompilerOptions& options() const override {
+    return _native->options();
+  }
+
+  size_t num_compiled = 0;
+
+ private:
+  std::unique_ptr<Compiler> _native = Compiler::CreateNative();
+};
+
 class VMTest : public ::testing::Test {
  public:
-  std::unique_ptr<VM> CreateVM(std::string_view wat) {
-    auto source = ByteStream(Wat2Wasm(wat));
-    auto parsed = ParseModule(&source).get();
-    auto compiled = _compiler->Compile(parsed).get();
-    return VM::Create(std::move(compiled));
+  std::unique_ptr<VM> CreateVM(std::string_view wat,
+                               ExecutionOptions options = {}) {
+    auto compiled = _compiler.Compile(Parse(wat)).get();
+    return VM::Create(std::move(compiled), options);
+  }
+
+  std::unique_ptr<VM> CreateInterpretedVM(std::string_view wat,
+                                          ExecutionOptions options) {
+    return VM::Create(Parse(wat), &_compiler, options);
   }
 
+  size_t num_compiled() const { return _compiler.num_compiled; }
+
  private:
-  std::unique_ptr<Compiler> _compiler = Compiler::CreateNative();
+  static ParsedModule Parse(std::string_view wat) {
+    auto source = ByteStream(Wat2Wasm(wat));
+    return ParseModule(&source).get();
+  }
+
+  CountingCompiler _compiler;
 };
+
+constexpr std::string_view kSumModule = R"WAT(
+  (module
+    (func $sum (param $n i32) (result i32) (local $i i32) (local $acc i32)
+      block
+        loop
+          local.get $i
+          local.get $n
+          i32.ge_s
+          br_if 1
+          local.get $acc
+          local.get $i
+          i32.add
+          local.set $acc
+          local.get $i
+          i32.const 1
+          i32.add
+          local.set $i
+          br 0
+        end
+      end
+      local.get $acc)
+    (func $unused (result i32) i32.const 1)
+    (export "sum" (func $sum)))
+  )WAT";
+
+int RunToCompletion(FunctionHandle<int (*)(int)>* func, int arg) {
+  auto computation = func->Invoke(arg);
+  while (!computation->IsDone()) {
+    computation->Execute();
+  }
+  return computation->GetResult();
+}
+
 }  // namespace
 
 TEST_F(VMTest, Works) {
@@ -44,4 +119,156 @@ TEST_F(VMTest, Works) {
   EXPECT_EQ(computation->GetResult(), 2);
 }
 
+TEST_F(VMTest, CallsRunToCompletion) {
+  auto vm = CreateVM(kSumModule);
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  for (int i = 0; i < 3; ++i) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    EXPECT_EQ(func->Call(4), 0 + 1 + 2 + 3);
+  }
+  // Calls don't wait for computations that are in flight.
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  auto computation = func->Invoke(3);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_EQ(func->Call(5), 0 + 1 + 2 + 3 + 4);
+  while (!computation->IsDone()) {
+    computation->Execute();
+  }
+  EXPECT_EQ(computation->GetResult(), 0 + 1 + 2);
+}
+
+TEST_F(VMTest, RunsManyComputationsAtOnce) {
+  auto vm = CreateVM(kSumModule);
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  std::vector<std::unique_ptr<Computation<int>>> computations;
+  for (int i = 0; i < 3; ++i) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    computations.push_back(func->Invoke(i + 2));
+  }
+  // Finish them in the opposite order to starting them.
+  for (int i = 2; i >= 0; --i) {
+    auto& computation = computations[i];
+    while (!computation->IsDone()) {
+      computation->Execute();
+    }
+    EXPECT_EQ(computation->GetResult(), (i + 2) * (i + 1) / 2);
+  }
+}
+
+TEST_F(VMTest, LimitsComputationsInFlight) {
+  auto vm = CreateVM(kSumModule, {.max_computations = 2});
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  auto first = func->Invoke(3);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  auto second = func->Invoke(3);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_THROW(func->Invoke(3), std::runtime_error);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_THROW(func->Call(3), std::runtime_error);
+  // Abandoning a computation frees up its stack.
+  first.reset();
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_EQ(func->Call(3), 0 + 1 + 2);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_EQ(RunToCompletion(&*func, 4), 0 + 1 + 2 + 3);
+}
+
+TEST_F(VMTest, CallsInBatches) {
+  auto vm = CreateVM(kSumModule);
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  std::vector<std::tuple<int>> args;
+  for (int i = 0; i < 100; ++i) {
+    args.emplace_back(i);
+  }
+  std::vector<int> results(args.size());
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  func->CallBatch(args, results);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(results[i], i * (i - 1) / 2);
+  }
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_THROW(func->CallBatch(args, std::span(results).first(99)),
+               std::runtime_error);
+}
+
+TEST_F(VMTest, InterpretedBatchesCountAsOneCall) {
+  auto vm = CreateInterpretedVM(kSumModule, {.jit_threshold = 1});
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  std::vector<std::tuple<int>> args = {{3}, {4}, {5}};
+  std::vector<int> results(args.size());
+  for (int i = 0; i < 2; ++i) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    func->CallBatch(args, results);
+    EXPECT_EQ(results, (std::vector<int>{3, 6, 10}));
+    EXPECT_EQ(num_compiled(), i);
+  }
+}
+
+TEST_F(VMTest, CallsInterpretUntilTheThreshold) {
+  auto vm = CreateInterpretedVM(kSumModule, {.jit_threshold = 2});
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  for (int i = 0; i < 4; ++i) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    EXPECT_EQ(func->Call(5), 0 + 1 + 2 + 3 + 4);
+    EXPECT_EQ(num_compiled(), i < 2 ? 0 : 1);
+  }
+}
+
+TEST_F(VMTest, InterpretsUntilTheThreshold) {
+  auto vm = CreateInterpretedVM(kSumModule, {.jit_threshold = 3});
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  for (int i = 0; i < 3; ++i) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    EXPECT_EQ(RunToCompletion(&*func, 5), 0 + 1 + 2 + 3 + 4);
+  }
+  EXPECT_EQ(num_compiled(), 0);
+  // The next call compiles the function, but not the one that is never called.
+  for (int i = 0; i < 3; ++i) {
+    // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+    EXPECT_EQ(RunToCompletion(&*func, 5), 0 + 1 + 2 + 3 + 4);
+  }
+  EXPECT_EQ(num_compiled(), 1);
+}
+
+TEST_F(VMTest, CompilesBeforeTheFirstCallWithoutAThreshold) {
+  auto vm = CreateInterpretedVM(kSumModule, {.jit_threshold = 0});
+  EXPECT_EQ(num_compiled(), 0);
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_EQ(RunToCompletion(&*func, 3), 0 + 1 + 2);
+  EXPECT_EQ(num_compiled(), 1);
+}
+
+TEST_F(VMTest, SizesStacksFromTheModule) {
+  auto vm = CreateVM(kSumModule);
+  EXPECT_LT(vm->stack_size(), runtime::kDefaultStackSize);
+  auto func = vm->LookupFunctionHandle<int (*)(int)>(Name("sum"));
+  ASSERT_NE(func, std::nullopt);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_EQ(func->Call(5), 0 + 1 + 2 + 3 + 4);
+  // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
+  EXPECT_EQ(RunToCompletion(&*func, 5), 0 + 1 + 2 + 3 + 4);
+
+  // Functions that are compiled as the VM runs can't be bounded upfront.
+  auto interpreted = CreateInterpretedVM(kSumModule, {});
+  EXPECT_EQ(interpreted->stack_size(), runtime::kDefaultStackSize);
+}
+
+TEST_F(VMTest, InterpretedLookupChecksTheSignature) {
+  auto vm = CreateInterpretedVM(kSumModule, {});
+  EXPECT_EQ(vm->LookupFunctionHandle<int (*)(int, int)>(Name("sum")),
+            std::nullopt);
+  EXPECT_EQ(vm->LookupFunctionHandle<int (*)(int)>(Name("unused")),
+            std::nullopt);
+}
+
 }  // namespace wasmcc
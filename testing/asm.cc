@@ -0,0 +1,90 @@
+#include "testing/asm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+namespace wasmcc {
+namespace {
+
+// Call `fn` with each instruction in the log, without any comment.
+template <typename Fn>
+void ForEachInstruction(std::string_view log, Fn fn) {
+  while (!log.empty()) {
+    auto end = log.find('\n');
+    auto line = log.substr(0, end);
+    log.remove_prefix(end == std::string_view::npos ? log.size() : end + 1);
+    line = line.substr(0, line.find(';'));
+    auto start = line.find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+      continue;
+    }
+    line.remove_prefix(start);
+    line = line.substr(0, line.find_last_not_of(" \t\r") + 1);
+    if (line.ends_with(':') || line.starts_with('.')) {
+      continue;
+    }
+    fn(line);
+  }
+}
+
+}  // namespace
+
+std::vector<std::string> Mnemonics(std::string_view log) {
+  std::vector<std::string> mnemonics;
+  ForEachInstruction(log, [&mnemonics](std::string_view line) {
+    mnemonics.emplace_back(line.substr(0, line.find(' ')));
+  });
+  return mnemonics;
+}
+
+std::string After(const std::vector<std::string>& mnemonics,
+                  const std::string& mnemonic) {
+  auto it = std::ranges::find(mnemonics, mnemonic);
+  if (it == mnemonics.end() || std::next(it) == mnemonics.end()) {
+    return "";
+  }
+  return *std::next(it);
+}
+
+std::vector<std::string> Prefix(const std::vector<std::string>& mnemonics,
+                                size_t n) {
+  n = std::min(n, mnemonics.size());
+  return {mnemonics.begin(), mnemonics.begin() + int64_t(n)};
+}
+
+bool IsConditionalJump(const std::string& mnemonic) {
+  return mnemonic.starts_with('j') && mnemonic != "jmp";
+}
+
+bool IsSetcc(const std::string& mnemonic) {
+  return mnemonic.starts_with("set");
+}
+
+bool IsConditionalBranch(const std::string& mnemonic) {
+  return mnemonic.starts_with("b.");
+}
+
+MemoryAccesses CountMemoryAccesses(std::string_view log) {
+  MemoryAccesses accesses;
+  ForEachInstruction(log, [&accesses](std::string_view line) {
+    auto mnemonic = line.substr(0, line.find(' '));
+    auto operands = line.substr(mnemonic.size());
+    if (mnemonic.starts_with("ldr") || mnemonic.starts_with("ldp") ||
+        mnemonic.starts_with("ldur") || mnemonic == "pop") {
+      ++accesses.loads;
+    } else if (mnemonic.starts_with("str") || mnemonic.starts_with("stp") ||
+               mnemonic.starts_with("stur") || mnemonic == "push") {
+      ++accesses.stores;
+    } else if (mnemonic != "lea" && operands.find('[') != std::string::npos) {
+      if (operands.find('[') < operands.find(',')) {
+        ++accesses.stores;
+      } else {
+        ++accesses.loads;
+      }
+    }
+  });
+  return accesses;
+}
+
+}  // namespace wasmcc
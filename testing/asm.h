@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wasmcc {
+
+/**
+ * Extract the mnemonic of each instruction from the output of an asmjit
+ * logger, skipping labels, directives and comments.
+ *
+ * Useful for testing the instruction sequences that a compiler emits.
+ */
+std::vector<std::string> Mnemonics(std::string_view log);
+
+/**
+ * The mnemonic after the first `mnemonic`, or empty if there isn't one.
+ */
+std::string After(const std::vector<std::string>& mnemonics,
+                  const std::string& mnemonic);
+
+/**
+ * The first `n` mnemonics, or all of them if there are fewer.
+ */
+std::vector<std::string> Prefix(const std::vector<std::string>& mnemonics,
+                                size_t n);
+
+/** Whether `mnemonic` is an x86 conditional jump (`jcc`). */
+bool IsConditionalJump(const std::string& mnemonic);
+/** Whether `mnemonic` is an x86 `setcc`. */
+bool IsSetcc(const std::string& mnemonic);
+/** Whether `mnemonic` is an arm64 conditional branch (`b.cond`). */
+bool IsConditionalBranch(const std::string& mnemonic);
+
+struct MemoryAccesses {
+  int loads = 0;
+  int stores = 0;
+
+  bool operator==(const MemoryAccesses&) const = default;
+};
+
+/**
+ * Count the instructions in the output of an asmjit logger that load from or
+ * store to memory, for either x86 or arm64.
+ *
+ * On x86 an instruction with a memory destination operand counts as a store,
+ * and with a memory source operand as a load.
+ */
+MemoryAccesses CountMemoryAccesses(std::string_view log);
+
+}  // namespace wasmcc
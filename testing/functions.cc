@@ -0,0 +1,65 @@
+#include "testing/functions.h"
+
+#include <cstring>
+#include <utility>
+
+namespace wasmcc {
+
+using namespace wasmcc::op;
+
+Function Fn(InstructionBuffer body, size_t num_params, size_t num_locals) {
+  return {
+      .meta = {.signature = {.parameter_types = std::vector<ValType>(
+                                 num_params, ValType::kI32),
+                             .result_types = {ValType::kI32}},
+               .locals = std::vector<ValType>(num_locals, ValType::kI32),
+               .max_stack_size_bytes = 64,
+               .max_stack_elements = 16},
+      .body = std::move(body),
+  };
+}
+
+std::vector<uint8_t> PackTargets(const std::vector<uint32_t>& targets) {
+  std::vector<uint8_t> packed(targets.size() * sizeof(uint32_t));
+  std::memcpy(packed.data(), targets.data(), packed.size());
+  return packed;
+}
+
+InstructionBuffer SumKernel(SumLocals locals) {
+  return InstructionBuffer::Of(
+      Block{}, Loop{}, GetLocalI32(locals.counter), GetLocalI32(locals.limit),
+      CompareI32{.cond = Condition::kGeS}, BrIf{.depth = 1},
+      GetLocalI32(locals.sum), GetLocalI32(locals.counter), AddI32(),
+      SetLocalI32(locals.sum), GetLocalI32(locals.counter), ConstI32(1),
+      AddI32(), SetLocalI32(locals.counter), Br{.depth = 0}, End(), End(),
+      GetLocalI32(locals.sum));
+}
+
+InstructionBuffer ManyLiveValues(int n) {
+  InstructionBuffer body;
+  for (int i = 0; i < n; ++i) {
+    body.Append(GetLocalI32(0));
+    body.Append(ConstI32(i + 1));
+    body.Append(AddI32());
+    body.Append(SetLocalI32(2 + i));
+  }
+  body.Append(GetLocalI32(1));
+  for (int i = 0; i < n; ++i) {
+    body.Append(GetLocalI32(2 + i));
+    body.Append(AddI32());
+  }
+  return body;
+}
+
+InstructionBuffer DeepStack(int depth) {
+  InstructionBuffer body;
+  for (int i = 0; i < depth; ++i) {
+    body.Append(GetLocalI32(0));
+  }
+  for (int i = 1; i < depth; ++i) {
+    body.Append(AddI32());
+  }
+  return body;
+}
+
+}  // namespace wasmcc
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/ast.h"
+#include "core/instruction.h"
+
+namespace wasmcc {
+
+/**
+ * A function with `num_params` i32 parameters, `num_locals` i32 locals and an
+ * i32 result, with room for 16 values on its stack.
+ */
+Function Fn(InstructionBuffer body, size_t num_params = 2,
+            size_t num_locals = 2);
+
+/**
+ * Pack the targets of a `br_table` in the layout that `op::BrTable` expects.
+ */
+std::vector<uint8_t> PackTargets(const std::vector<uint32_t>& targets);
+
+/**
+ * The locals that `SumKernel` reads and writes.
+ */
+struct SumLocals {
+  uint32_t counter = 0;
+  uint32_t limit = 1;
+  uint32_t sum = 2;
+};
+
+/**
+ * Adds up the numbers from `counter` to `limit` into `sum` in a loop.
+ *
+ * By default this sums the numbers from the first parameter up to the second
+ * into the first local of `Fn`.
+ */
+InstructionBuffer SumKernel(SumLocals locals = {});
+
+/**
+ * Computes `n` different values from the first parameter, which are all live
+ * at once, then adds them to the second parameter.
+ *
+ * The values are stored in the locals after the two parameters, so the
+ * function needs at least `n` locals.
+ */
+InstructionBuffer ManyLiveValues(int n);
+
+/**
+ * Pushes `depth` copies of the first parameter, then adds them all together.
+ */
+InstructionBuffer DeepStack(int depth);
+
+}  // namespace wasmcc